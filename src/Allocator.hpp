@@ -3,6 +3,7 @@
 #include "Common.hpp"
 #include "Debug.hpp"
 
+#include <atomic>
 #include <new>
 
 namespace shit {
@@ -100,19 +101,25 @@ inline fn bump_free(opaque *context, opaque *pointer, usize length,
 inline constexpr Allocator::VTable BUMP_VTABLE{bump_alloc, bump_resize,
                                                bump_free};
 
+/* The takes of every pool released so far, so the --show-stats count keeps
+   what pipeline stage and shitbox worker threads allocated after they exit. */
+inline std::atomic<u64> RELEASED_HEAP_ALLOCATIONS{0};
+
 /* A size-classed cache over the C allocator. musl returns a freed page group to
    the kernel at once, so a tight allocate then free of the same size churns
    mmap and munmap once per turn, which dominates the bench on Alpine where
    glibc would have cached the page. A freed block parks on a per-class free
    list and is handed back on the next request of that class, so the kernel sees
    a steady working set. The cache is bounded per class so a burst does not pin
-   memory. The pool is single threaded, since the evaluator never shares an
-   allocator across threads. */
+   memory. Each thread owns its pool, so the free lists take no lock. A block
+   freed on another thread than the one that took it parks on the freeing
+   thread's list, which is harmless since every block came from malloc. */
 class HeapPool
 {
 public:
   hot fn take(usize length) wontthrow -> opaque *
   {
+    m_allocations++;
     let const shift = class_shift_for(length);
     if (shift > MAX_CLASS_SHIFT) return std::malloc(length);
 
@@ -149,6 +156,32 @@ public:
     m_counts[class_index]++;
   }
 
+  /* Hand every parked block back to the C allocator, what a pipeline stage
+     thread does before it exits so its lists do not leak. Its take count moves
+     to the process total. */
+  cold fn release() wontthrow -> void
+  {
+    RELEASED_HEAP_ALLOCATIONS.fetch_add(m_allocations,
+                                        std::memory_order_relaxed);
+    m_allocations = 0;
+    for (usize i = 0; i < CLASS_COUNT; i++) {
+      while (m_bins[i] != nullptr) {
+        let const parked = m_bins[i];
+        m_bins[i] = parked->next;
+        std::free(parked);
+      }
+      m_counts[i] = 0;
+    }
+  }
+
+  /* Every take since startup, pooled or not, for the --show-stats report. A
+     thread still running its own pool is not counted until it releases it. */
+  fn allocation_count() const wontthrow -> u64
+  {
+    return m_allocations +
+           RELEASED_HEAP_ALLOCATIONS.load(std::memory_order_relaxed);
+  }
+
 private:
   static constexpr usize MIN_CLASS_SHIFT =
       4; /* the smallest class is 16 bytes */
@@ -164,6 +197,7 @@ private:
 
   node *m_bins[CLASS_COUNT] = {};
   u32 m_counts[CLASS_COUNT] = {};
+  u64 m_allocations{0};
 
   hot static fn class_shift_for(usize length) wontthrow -> usize
   {
@@ -176,15 +210,15 @@ private:
   }
 };
 
-/* The single process-wide cache, one instance across every translation unit
-   through the inline function local static. The pool is trivially destructible,
-   so it registers no exit destructor and its storage stays valid through
-   process teardown. A heap free from a file-scope cache destructor at process
-   exit then reaches live storage whatever the static destruction order names.
- */
+/* The calling thread's cache, one instance per thread across every translation
+   unit through the inline function local static. The pool is trivially
+   destructible, so it registers no exit destructor and its storage stays valid
+   through process teardown. A heap free from a file-scope cache destructor at
+   process exit then reaches live storage whatever the static destruction order
+   names. */
 hot inline fn heap_pool_instance() wontthrow -> HeapPool &
 {
-  static HeapPool pool;
+  static thread_local HeapPool pool;
   return pool;
 }
 
@@ -123,8 +123,11 @@ fn execute_builtin(ExecContext &&ec, EvalContext &cxt) throws -> i32
      the terminal instead of following the standard output. */
   const bool has_dup_routing = ec.dup_err_to_out || ec.dup_out_to_err;
 
+  /* A stage that runs beside pipeline stage threads reads and writes through
+     its context alone, since fd 0, 1, and 2 belong to every thread at once. */
   let saved_descriptors = ArrayList<os::saved_descriptor>{heap_allocator()};
-  if (has_pipe_descriptors || has_dup_routing) {
+  if ((has_pipe_descriptors || has_dup_routing) && !ec.should_leave_shell_fds)
+  {
     if (ec.in_fd)
       saved_descriptors.push(os::save_and_replace_descriptor(0, *ec.in_fd));
     if (ec.out_fd)
@@ -792,6 +792,7 @@ cold fn make_flag_help(const ArrayList<Flag *> &flags) throws -> String
 
 fn print(StringView text) throws -> void
 {
+  if (STDOUT_CAPTURE != nullptr) return STDOUT_CAPTURE->append(text);
   /* Flushed at once so it interleaves with the unbuffered write_fd path the
      builtins use. */
   std::fwrite(text.data, 1, text.count(), stdout);
@@ -202,6 +202,11 @@ fn show_message(StringView err) throws -> void;
    joining the prompt. The first message consumes the arming. */
 fn arm_message_leading_newline(bool armed) wontthrow -> void;
 
+/* The result of the command substitution that is running, when its body runs
+   only builtins. print and ExecContext::print_to_stdout append to it instead of
+   writing fd 1, and each substitution puts back the one around it. */
+inline constinit thread_local String *STDOUT_CAPTURE = nullptr;
+
 fn print(StringView text) throws -> void;
 fn print_error(StringView text) throws -> void;
 fn flush() throws -> void;
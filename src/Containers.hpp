@@ -3,6 +3,7 @@
 #include "ArrayList.hpp"
 #include "HashSet.hpp"
 #include "PackedStringKey.hpp"
+#include "PersistentStringMap.hpp"
 #include "StaticStringMap.hpp"
 #include "String.hpp"
 #include "StringMap.hpp"
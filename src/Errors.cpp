@@ -5,6 +5,7 @@
 #include "Debug.hpp"
 #include "ErrorOr.hpp"
 #include "Eval.hpp"
+#include "PipelineStages.hpp"
 #include "Platform.hpp"
 #include "Toiletline.hpp"
 #include "Trace.hpp"
@@ -142,7 +143,11 @@ cold static fn get_context_pointing_to(
 
   let generated_highlights = ArrayList<highlight_span>{heap_allocator()};
   const ArrayList<highlight_span> *source_highlights = &generated_highlights;
-  if (eval_context != nullptr && !color.reset.is_empty()) {
+  /* The highlight cache belongs to the main thread, so a pipeline stage thread
+     prints its caret line plain. */
+  if (eval_context != nullptr && !color.reset.is_empty() &&
+      !stages::is_stage_thread())
+  {
     let *cache = eval_context->get_or_create_diagnostic_highlight_cache();
     source_highlights = cache->spans_for(source, line_position.line_start,
                                          line_position.line_end, *eval_context);
@@ -11,6 +11,7 @@
 #include "Lexer.hpp"
 #include "Parser.hpp"
 #include "Path.hpp"
+#include "PipelineStages.hpp"
 #include "Platform.hpp"
 #include "ResolvedCommand.hpp"
 #include "Shitbox.hpp"
@@ -38,7 +39,7 @@ EvalContext::EvalContext(bool should_disable_path_expansion, bool should_echo,
   m_shell_start_time = static_cast<i64>(std::time(nullptr));
 
   for (let const &name : os::environment_names())
-    m_exported_names.add(name.view());
+    mark_exported(name.view());
 }
 
 EvalContext::~EvalContext() { reset_runtime_diagnostic_highlight_cache(); }
@@ -101,13 +102,19 @@ fn EvalContext::end_command() wontthrow -> void
 
 hot fn EvalContext::assign_variable(StringView name, StringView value) throws
     -> void
+{
+  assign_variable(name, value, variable_attributes(name));
+}
+
+hot fn EvalContext::assign_variable(StringView name, StringView value,
+                                    u8 attributes) throws -> void
 {
   LOG(All, "assigning variable '%.*s' to a value of %zu bytes",
       static_cast<int>(name.length), name.data, value.length);
   if (name == "IFS") set_field_separators(value);
   if (name == "PATH") m_program_resolver.assign_path(String{value});
   m_shell_variables.set(name, value);
-  if (m_exported_names.contains(name)) {
+  if ((attributes & static_cast<u8>(variable_attribute::Exported)) != 0) {
     if (m_subshell_depth > 0)
       m_environment_undo_log.push(environment_undo_entry{
           String{name}, os::get_environment_variable(name)});
@@ -170,18 +177,64 @@ fn EvalContext::guard_restricted_path(StringView path, SourceLocation location,
 hot fn EvalContext::set_shell_variable(StringView name, StringView value) throws
     -> void
 {
-  if (is_readonly(name))
+  /* One probe reads every mark, the restricted names aside. */
+  let const attributes = variable_attributes(name);
+  if ((attributes & static_cast<u8>(variable_attribute::Readonly)) != 0 ||
+      (restricted_enforcement_active() && is_readonly(name)))
     throw Error{"Unable to assign '" + name + "' because it is read only"};
 
-  if (is_integer_variable(name)) [[unlikely]] {
+  if ((attributes & static_cast<u8>(variable_attribute::Integer)) != 0)
+      [[unlikely]] {
     let const result = value.length == 0 ? 0 : evaluate_arithmetic(value);
     char result_text[24];
-    assign_variable(name, utils::int_to_text_into(result, result_text,
-                                                  sizeof(result_text)));
+    assign_variable(name,
+                    utils::int_to_text_into(result, result_text,
+                                            sizeof(result_text)),
+                    attributes);
     return;
   }
 
-  assign_variable(name, value);
+  assign_variable(name, value, attributes);
+}
+
+hot fn EvalContext::append_shell_variable(StringView name,
+                                          StringView value) throws -> void
+{
+  let const attributes = variable_attributes(name);
+  if ((attributes & static_cast<u8>(variable_attribute::Readonly)) != 0 ||
+      (restricted_enforcement_active() && is_readonly(name)))
+    throw Error{"Unable to assign '" + name + "' because it is read only"};
+
+  /* An integer name adds rather than concatenates, IFS and PATH keep side
+     tables, and a name with no stored string reads an array element or a
+     dynamic value, so those join a copy and assign it whole. */
+  String *stored = nullptr;
+  if ((attributes & static_cast<u8>(variable_attribute::Integer)) == 0 &&
+      name != "IFS" && name != "PATH")
+    stored = m_shell_variables.find_mutable(name);
+
+  if (stored == nullptr) {
+    let joined = String{scratch_allocator()};
+    let storage = borrowed_value_storage{};
+    if (let const current = borrow_variable_value(name, storage))
+      joined.append(*current);
+    if ((attributes & static_cast<u8>(variable_attribute::Integer)) != 0)
+      append_integer_expression(joined, value);
+    else
+      joined.append(value);
+    set_shell_variable(name, joined.view());
+    return;
+  }
+
+  LOG(All, "appending %zu bytes to the variable '%.*s'", value.length,
+      static_cast<int>(name.length), name.data);
+  stored->append(value);
+  if ((attributes & static_cast<u8>(variable_attribute::Exported)) != 0) {
+    if (m_subshell_depth > 0)
+      m_environment_undo_log.push(environment_undo_entry{
+          String{name}, os::get_environment_variable(name)});
+    os::set_environment_variable(name, stored->view());
+  }
 }
 
 fn EvalContext::seed_shell_identity_variables(bool is_bash_identity) throws
@@ -241,7 +294,7 @@ fn EvalContext::unset_shell_variable(StringView name) throws -> void
   force_unset_shell_variable(name);
   m_indexed_arrays.erase(name);
   clear_sparse_array(name);
-  m_integer_names.remove(name);
+  unmark_integer(name);
 }
 
 fn EvalContext::peel_caller_local_binding(StringView name) throws -> bool
@@ -282,14 +335,12 @@ fn EvalContext::restore_local_binding(local_binding &binding) throws -> void
     m_indexed_arrays.erase(binding.name.view());
   let const was_restricted = restricted_enforcement_active();
   m_runtime.set_option(shell_option_id::Restricted, false);
-  m_readonly_names.remove(binding.name.view());
+  unmark_readonly(binding.name.view());
   defer
   {
     m_runtime.set_option(shell_option_id::Restricted, was_restricted);
-    if (binding.previous_was_readonly)
-      m_readonly_names.add(binding.name.view());
-    else
-      m_readonly_names.remove(binding.name.view());
+    set_variable_attribute(binding.name.view(), variable_attribute::Readonly,
+                           binding.previous_was_readonly);
   };
   clear_sparse_array(binding.name.view());
   for (usize i = 0; i < binding.previous_sparse_indices.count(); i++)
@@ -301,17 +352,15 @@ fn EvalContext::restore_local_binding(local_binding &binding) throws -> void
       set_associative_element(binding.name.view(),
                               binding.previous_associative_keys[k].view(),
                               binding.previous_associative_values[k].view());
-  if (binding.previous_was_integer)
-    m_integer_names.add(binding.name.view());
-  else
-    m_integer_names.remove(binding.name.view());
+  set_variable_attribute(binding.name.view(), variable_attribute::Integer,
+                         binding.previous_was_integer);
 
   if (binding.previous_was_exported) {
-    m_exported_names.add(binding.name.view());
+    mark_exported(binding.name.view());
     if (binding.previous_value.has_value())
       os::set_environment_variable(binding.name, *binding.previous_value);
   } else if (is_exported(binding.name)) {
-    m_exported_names.remove(binding.name.view());
+    unmark_exported(binding.name.view());
     os::unset_environment_variable(binding.name);
   }
 }
@@ -333,7 +382,7 @@ fn EvalContext::publish_single_pipe_status(i32 status) throws -> void
   if (is_readonly("PIPESTATUS"))
     throw Error{"Unable to assign 'PIPESTATUS' because it is read only"};
 
-  if (let *values = m_indexed_arrays.find("PIPESTATUS");
+  if (let *values = m_indexed_arrays.find_mutable("PIPESTATUS");
       values != nullptr && values->count() == 1 &&
       !m_sparse_array_names.contains("PIPESTATUS"))
   {
@@ -353,7 +402,9 @@ fn EvalContext::publish_single_pipe_status(i32 status) throws -> void
 fn EvalContext::append_indexed_array(StringView name,
                                      ArrayList<String> values) throws -> void
 {
-  if (let *existing = m_indexed_arrays.find(name); existing != nullptr) {
+  if (let *existing = m_indexed_arrays.find_mutable(name);
+      existing != nullptr)
+  {
     LOG(All, "appending %zu elements to the existing array '%.*s'",
         values.count(), static_cast<int>(name.length), name.data);
     if (is_readonly(name))
@@ -572,12 +623,12 @@ fn EvalContext::mark_exported(StringView name) throws -> void
 {
   LOG(All, "marking '%.*s' as exported", static_cast<int>(name.length),
       name.data);
-  m_exported_names.add(name);
+  set_variable_attribute(name, variable_attribute::Exported, true);
 }
 
 fn EvalContext::unmark_exported(StringView name) throws -> void
 {
-  m_exported_names.remove(name);
+  set_variable_attribute(name, variable_attribute::Exported, false);
 }
 
 fn EvalContext::unexport_shell_variable(StringView name) throws -> void
@@ -598,16 +649,14 @@ fn EvalContext::unexport_shell_variable(StringView name) throws -> void
 
 pure fn EvalContext::is_exported(StringView name) const wontthrow -> bool
 {
-  return m_exported_names.contains(name);
+  return (variable_attributes(name) &
+          static_cast<u8>(variable_attribute::Exported)) != 0;
 }
 
 fn EvalContext::sync_exported_after_restore(StringView name,
                                             bool has_value) throws -> void
 {
-  if (has_value)
-    m_exported_names.add(name);
-  else
-    m_exported_names.remove(name);
+  set_variable_attribute(name, variable_attribute::Exported, has_value);
 }
 
 struct ansi_color_variable
@@ -743,6 +792,67 @@ pure fn EvalContext::variable_requires_dynamic_lookup(
          BASH_DYNAMIC.find(name).has_value();
 }
 
+hot fn EvalContext::borrow_variable_value(
+    StringView name, borrowed_value_storage &storage) const throws
+    -> Maybe<StringView>
+{
+  const char first_byte = name.is_empty() ? '\0' : name[0];
+
+  if (name.count() == 1) {
+    switch (first_byte) {
+    case '?':
+      return utils::int_to_text_into(m_last_exit_status, storage.digits,
+                                     sizeof(storage.digits));
+    case '$':
+      return utils::int_to_text_into(os::get_shell_process_id(),
+                                     storage.digits, sizeof(storage.digits));
+    case '!':
+      if (!m_last_background_pid) return StringView{};
+      return utils::int_to_text_into(*m_last_background_pid, storage.digits,
+                                     sizeof(storage.digits));
+    case '#':
+      return utils::int_to_text_into(
+          static_cast<i64>(m_positional_params.count()), storage.digits,
+          sizeof(storage.digits));
+    case '0': return m_shell_name.view();
+    case '_': return m_last_argument.view();
+    /* $- and the joined forms are built, so they take the spill. */
+    case '-':
+    case '*':
+    case '@': {
+      storage.spill = get_variable_value(name);
+      return storage.spill->view();
+    }
+    default: break;
+    }
+  }
+
+  if (first_byte >= '0' && first_byte <= '9') {
+    if (name.is_all_decimal_digits()) {
+      if (name.count() > 9) return None;
+      let const parsed_index = name.to<i64>();
+      if (parsed_index.is_error()) return None;
+      let const index = static_cast<usize>(parsed_index.value());
+      if (index >= 1 && index <= m_positional_params.count())
+        return m_positional_params[index - 1].view();
+      return None;
+    }
+  }
+
+  if (let const *stored = m_shell_variables.find(name); stored != nullptr)
+    return stored->view();
+
+  if (m_indexed_arrays.count() != 0)
+    if (let const *array = m_indexed_arrays.find(name); array != nullptr) {
+      if (array->is_empty()) return shit::None;
+      return array->front().view();
+    }
+
+  storage.spill = computed_variable_value(name);
+  if (!storage.spill.has_value()) return None;
+  return storage.spill->view();
+}
+
 hot fn EvalContext::get_variable_value(StringView name) const throws
     -> Maybe<String>
 {
@@ -819,6 +929,16 @@ hot fn EvalContext::get_variable_value(StringView name) const throws
       return array->front();
     }
 
+  return computed_variable_value(name);
+}
+
+/* The tail of a variable read once the store and the arrays miss, the dynamic
+   variables and then the process environment. */
+fn EvalContext::computed_variable_value(StringView name) const throws
+    -> Maybe<String>
+{
+  const char first_byte = name.is_empty() ? '\0' : name[0];
+
   if (is_local_in_current_scope(name)) return shit::None;
 
   /* The store lookup above wins, so IFS= reads back empty while the unset
@@ -1739,6 +1859,8 @@ fn EvalContext::snapshot_state() const throws -> eval_state_snapshot
   if (!working_directory.is_valid())
     throw Error{"Could not preserve the current working directory"};
 
+  /* The tables copy by sharing, so this costs a reference count per table. */
+  persistent_map_stats().snapshots_taken++;
   return eval_state_snapshot{m_shell_variables,
                              m_indexed_arrays,
                              m_associative_names,
@@ -1755,9 +1877,7 @@ fn EvalContext::snapshot_state() const throws -> eval_state_snapshot
                              steal(working_directory),
                              os::get_file_creation_mask(),
                              m_traps,
-                             m_readonly_names,
-                             m_integer_names,
-                             m_exported_names,
+                             m_variable_attributes,
                              m_environment_undo_log.count(),
                              RuntimeState::capture(*this),
                              m_program_resolver,
@@ -1797,9 +1917,7 @@ fn EvalContext::restore_state(eval_state_snapshot snapshot) throws -> void
   m_diagnostics_mutation_revision = snapshot.diagnostics_mutation_revision;
   m_shell_option_mutations = snapshot.option_mutations;
 
-  m_readonly_names = steal(snapshot.readonly_names);
-  m_integer_names = steal(snapshot.integer_names);
-  m_exported_names = steal(snapshot.exported_names);
+  m_variable_attributes = steal(snapshot.variable_attributes);
 
   /* A signal the subshell trapped that the parent does not is returned to
      default before the parent's dispositions are reinstalled. */
@@ -1922,13 +2040,17 @@ fn EvalContext::apply_indirect_or_name_listing(StringView body) throws -> String
         target_view.substring_of_length(*bracket + 1,
                                         target_view.length - *bracket - 2));
   }
-  if (!get_variable_value(target_view).has_value())
-    report_unset_reference(*target);
-  return expand_variable(target_view);
+  let storage = borrowed_value_storage{};
+  let const value = borrow_variable_value(target_view, storage);
+  if (!value.has_value()) report_unset_reference(*target);
+  return String{scratch_allocator(), value.value_or(StringView{})};
 }
 
 cold fn EvalContext::make_stats_string() const throws -> String
 {
+  /* Sampled before the report allocates anything of its own. */
+  const u64 heap_allocations =
+      allocators::heap_pool_instance().allocation_count();
   let stats_text = String{heap_allocator()};
 
   /* Stats print before end_command runs the rollup, so the live arena is
@@ -1969,6 +2091,10 @@ cold fn EvalContext::make_stats_string() const throws -> String
   stats_text += "Peak AST arena bytes: " +
                 String::from(peak_ast_arena_bytes, heap_allocator());
   stats_text += '\n';
+  stats_text += EXPRESSION_DOUBLE_AST_INDENT;
+  stats_text += "Heap allocations: " +
+                String::from(heap_allocations, heap_allocator());
+  stats_text += '\n';
 
   stats_text += "]";
 
@@ -2101,6 +2227,14 @@ fn ExecContext::close_fds() throws -> void
     os::close_fd(*err_fd);
     err_fd.reset();
   }
+  if (in_ring != nullptr) {
+    stages::close_ring_reader(in_ring);
+    in_ring = nullptr;
+  }
+  if (out_ring != nullptr) {
+    stages::close_ring_writer(out_ring);
+    out_ring = nullptr;
+  }
 }
 
 pure fn ExecContext::builtin_kind() const wontthrow -> const Builtin::Kind &
@@ -2111,15 +2245,39 @@ pure fn ExecContext::builtin_kind() const wontthrow -> const Builtin::Kind &
 
 fn ExecContext::print_to_stdout(StringView s) const throws -> void
 {
-  if (!os::write_fd(out_fd.value_or(SHIT_STDOUT), s.data, s.length).has_value())
-  {
-    const i32 saved_errno = errno;
-    if (saved_errno == EPIPE) throw BrokenPipeExit{};
-    throw Error{"Unable to write to stdout: " +
-                os::last_system_error_message()};
+  if (out_ring != nullptr) return stages::write_ring(out_ring, s);
+  if (STDOUT_CAPTURE != nullptr && !out_fd.has_value())
+    return STDOUT_CAPTURE->append(s);
+  /* A pipe whose reader leaves mid-write takes a short count first, and only
+     the next write sees EPIPE, so the rest is written until one fails. */
+  usize written_count = 0;
+  while (written_count < s.length) {
+    let const written = os::write_fd(out_fd.value_or(SHIT_STDOUT),
+                                     s.data + written_count,
+                                     s.length - written_count);
+    if (!written.has_value() || *written == 0) {
+      const i32 saved_errno = errno;
+      if (saved_errno == EPIPE) throw BrokenPipeExit{};
+      throw Error{"Unable to write to stdout: " +
+                  os::last_system_error_message()};
+    }
+    written_count += *written;
   }
 }
 
+fn ExecContext::stdout_is_a_tty() const wontthrow -> bool
+{
+  let const fd = stdout_descriptor();
+  return fd.has_value() && os::is_fd_a_tty(*fd);
+}
+
+fn ExecContext::stdout_descriptor() const wontthrow -> Maybe<os::descriptor>
+{
+  if (out_ring != nullptr) return None;
+  if (STDOUT_CAPTURE != nullptr && !out_fd.has_value()) return None;
+  return out_fd.value_or(SHIT_STDOUT);
+}
+
 fn ExecContext::print_to_stderr(StringView s) const throws -> void
 {
   if (!os::write_fd(err_fd.value_or(SHIT_STDERR), s.data, s.length).has_value())
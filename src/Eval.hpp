@@ -6,6 +6,7 @@
 #include "Common.hpp"
 #include "Containers.hpp"
 #include "Errors.hpp"
+#include "Glob.hpp"
 #include "Maybe.hpp"
 #include "MimicMood.hpp"
 #include "Path.hpp"
@@ -19,6 +20,15 @@ namespace completion {
 class shell_highlight_cache;
 } /* namespace completion */
 
+namespace stages {
+struct ring;
+} /* namespace stages */
+
+/* The arena a pipeline stage thread allocates its scratch from. The evaluator's
+   own arena belongs to the main thread, so a stage thread that reached it
+   through the shared context would race the main thread's bumps. */
+inline constinit thread_local BumpArena *THREAD_SCRATCH_ARENA = nullptr;
+
 enum class argument_lifetime : u8
 {
   Persistent,
@@ -81,11 +91,263 @@ inline pure fn is_colon_modifier_operator(char c) wontthrow -> bool
   return c == '-' || c == '+' || c == '=' || c == '?';
 }
 
+/* A ${...} body taken apart once. A word segment keeps it the way it keeps its
+   arithmetic program, so a body that runs in a loop is scanned on its first run
+   only. The name is the leading name_length bytes of the body and the operand
+   starts at operand_offset. */
+struct parameter_expansion_plan
+{
+  enum class form : u8
+  {
+    Unplanned,
+    /* Indirection, the length forms and subscripts, scanned on every run. */
+    General,
+    /* ${name}, reported under set -u. */
+    Plain,
+    /* ${name:} and an unknown operator, read without the set -u report. */
+    Unchecked,
+    /* ${name-word} ${name:=word} and the rest of the test operators. */
+    Test,
+    /* ${name#word} ${name%%word} and the other trims. */
+    Trim,
+    /* ${name:offset:length}, separator at the length colon in the operand. */
+    Substring,
+    /* ${name/pattern/replacement}, separator at the replacement slash past the
+       anchor. */
+    Replacement,
+    CaseModification,
+    Transform,
+  };
+
+  form kind{form::Unplanned};
+  char op{'\0'};
+  bool is_colon_form{false};
+  bool is_doubled{false};
+  u32 name_length{0};
+  u32 operand_offset{0};
+  u32 separator{0};
+};
+
+/* One step of a compiled arithmetic expression. The registers are i64 slots
+   local to one run, the operand indexes the program's constants, names, or
+   jump targets depending on the op. */
+struct arith_instruction
+{
+  enum class Op : u8
+  {
+    /* r[dst] = constants[operand] */
+    Constant,
+    /* r[dst] = the value of names[operand] */
+    Load,
+    /* r[dst] = names[operand][names[b]] */
+    LoadElement,
+    /* names[operand] = r[a] */
+    Store,
+    /* names[operand][names[b]] = r[a] */
+    StoreElement,
+    /* r[dst] = r[a] kind r[b], with kind the arith_apply_binop letter. A
+       division or power keeps its source span in spans[operand]. */
+    Binary,
+    Negate,
+    Not,
+    Complement,
+    /* r[dst] = r[a] != 0 */
+    Truth,
+    Jump,
+    JumpIfZero,
+    JumpIfNonZero,
+  };
+
+  Op op;
+  char kind{'\0'};
+  u16 dst{0};
+  u16 a{0};
+  u16 b{0};
+  u32 operand{0};
+};
+
+/* The tables one compiled arithmetic expression runs from. The names, the
+   subscripts among them, view the clause text, which the owner keeps alive. */
+struct arith_program_body
+{
+  struct span
+  {
+    u32 start;
+    u32 end;
+  };
+
+  u16 register_count{0};
+  ArrayList<arith_instruction> code{heap_allocator()};
+  ArrayList<i64> constants{heap_allocator()};
+  ArrayList<StringView> names{heap_allocator()};
+  /* One per name, so a Load of a plain variable skips the hash once bound. */
+  ArrayList<persistent_map_slot<String>> bound_names{heap_allocator()};
+  ArrayList<span> spans{heap_allocator()};
+};
+
+/* An arithmetic expression compiled once into register code, kept by a word
+   segment and by the (( )) and for (( )) clauses the way a ${...} body keeps
+   its plan. A clause holding a substitution is Interpreted, expanded and
+   parsed on every run. One the compiler declines, a syntax error among them,
+   runs the char parser every time too. The body
+   lives behind a pointer so a segment that never holds arithmetic stays
+   small, and a copy starts over uncompiled since its names would view the
+   original's text. */
+struct arith_program
+{
+  enum class state : u8
+  {
+    Uncompiled,
+    Compiled,
+    Interpreted,
+    Declined,
+  };
+
+  arith_program() = default;
+  arith_program(const arith_program &) {}
+  arith_program(arith_program &&other) noexcept
+      : status(other.status), body(other.body)
+  {
+    other.status = state::Uncompiled;
+    other.body = nullptr;
+  }
+
+  fn operator=(const arith_program &other) wontthrow -> arith_program &
+  {
+    if (this != &other) reset();
+    return *this;
+  }
+
+  fn operator=(arith_program &&other) wontthrow -> arith_program &
+  {
+    if (this != &other) {
+      reset();
+      status = other.status;
+      body = other.body;
+      other.status = state::Uncompiled;
+      other.body = nullptr;
+    }
+    return *this;
+  }
+
+  ~arith_program() { reset(); }
+
+  fn reset() wontthrow -> void
+  {
+    if (body != nullptr) {
+      body->~arith_program_body();
+      heap_allocator().free_array(body, 1);
+      body = nullptr;
+    }
+    status = state::Uncompiled;
+  }
+
+  state status{state::Uncompiled};
+  arith_program_body *body{nullptr};
+};
+
+/* One piece of a modifier word taken apart once. A Literal holds bytes that
+   read the same on every run, all of them glob-active or none. The other kinds
+   hold the inner text of an expansion, run again on every evaluation, with
+   offset and length placing it in the word for its source location. */
+struct modifier_word_piece
+{
+  enum class piece_kind : u8
+  {
+    Literal,
+    /* $name and the special parameters. */
+    Variable,
+    Braced,
+    Arithmetic,
+    /* $(...) and a backquote run, the text already unescaped. */
+    Command,
+  };
+
+  piece_kind kind;
+  bool is_active;
+  u32 offset;
+  u32 length;
+  String text;
+};
+
+struct modifier_word_program
+{
+  explicit modifier_word_program(Allocator allocator) : pieces(allocator) {}
+
+  ArrayList<modifier_word_piece> pieces;
+};
+
+/* The operand subwords of a planned ${...} body, taken apart on its first run.
+   first is the word of a test form, the pattern of a trim, or the pattern of
+   a replacement, and second is the replacement. A substring keeps its offset
+   and its length compiled. A word holding $'...' reads differently in the
+   POSIX mood, so a body with one is Unparseable and expands from its text on
+   every run. */
+struct parameter_operand_words
+{
+  enum class state : u8
+  {
+    Parsed,
+    Unparseable,
+  };
+
+  state status{state::Parsed};
+  bool has_second{false};
+  modifier_word_program first{heap_allocator()};
+  modifier_word_program second{heap_allocator()};
+  arith_program offset{};
+  arith_program length{};
+};
+
+/* The owner of a segment's parameter_operand_words, behind a pointer the way
+   arith_program keeps its body, and a copy starts over unparsed since the
+   compiled offset views the original's text. */
+struct parameter_operand_cache
+{
+  parameter_operand_cache() = default;
+  parameter_operand_cache(const parameter_operand_cache &) {}
+  parameter_operand_cache(parameter_operand_cache &&other) noexcept
+      : words(other.words)
+  {
+    other.words = nullptr;
+  }
+
+  fn operator=(const parameter_operand_cache &other) wontthrow
+      -> parameter_operand_cache &
+  {
+    if (this != &other) reset();
+    return *this;
+  }
+
+  fn operator=(parameter_operand_cache &&other) wontthrow
+      -> parameter_operand_cache &
+  {
+    if (this != &other) {
+      reset();
+      words = other.words;
+      other.words = nullptr;
+    }
+    return *this;
+  }
+
+  ~parameter_operand_cache() { reset(); }
+
+  fn reset() wontthrow -> void
+  {
+    if (words != nullptr) {
+      words->~parameter_operand_words();
+      heap_allocator().free_array(words, 1);
+      words = nullptr;
+    }
+  }
+
+  parameter_operand_words *words{nullptr};
+};
+
 class Token;
 class Word;
 class WordSegment;
 class Expression;
-struct arith_token;
 
 struct conditional_element
 {
@@ -166,6 +428,23 @@ struct local_binding
   bool previous_was_exported{false};
 };
 
+/* The storage a borrowed variable read formats into when the value does not
+   live in the store. A numeric special renders into the digits, a joined $* or
+   a computed dynamic value lands in the spill. */
+struct borrowed_value_storage
+{
+  char digits[24];
+  Maybe<String> spill{};
+};
+
+/* The per-name marks kept in EvalContext::m_variable_attributes. */
+enum class variable_attribute : u8
+{
+  Readonly = 1 << 0,
+  Integer = 1 << 1,
+  Exported = 1 << 2,
+};
+
 struct job
 {
   enum class State : u8
@@ -436,28 +715,26 @@ using ProgramResolver = utils::ProgramResolver;
 
 struct eval_state_snapshot
 {
-  StringMap<String> shell_variables;
-  StringMap<ArrayList<String>> indexed_arrays;
-  HashSet associative_names;
-  StringMap<String> associative_values;
-  StringMap<String> sparse_array_values;
-  HashSet sparse_array_names;
-  StringMap<bool> shopt_options;
-  StringMap<const Expression *> functions;
-  StringMap<String> function_sources;
-  StringMap<function_definition_info> function_definition_infos;
-  StringMap<String> aliases;
+  PersistentStringMap<String> shell_variables;
+  PersistentStringMap<ArrayList<String>> indexed_arrays;
+  PersistentHashSet associative_names;
+  PersistentStringMap<String> associative_values;
+  PersistentStringMap<String> sparse_array_values;
+  PersistentHashSet sparse_array_names;
+  PersistentStringMap<bool> shopt_options;
+  PersistentStringMap<const Expression *> functions;
+  PersistentStringMap<String> function_sources;
+  PersistentStringMap<function_definition_info> function_definition_infos;
+  PersistentStringMap<String> aliases;
   ArrayList<String> positional_params;
   ArrayList<String> directory_stack;
   os::DirectoryReference working_directory;
   u32 file_creation_mask;
-  StringMap<String> traps;
-  /* The read-only and integer name sets ride the snapshot too, so a readonly or
-     a declare -i inside a subshell dies with the child rather than leaking its
-     mark to the parent. */
-  HashSet readonly_names;
-  HashSet integer_names;
-  HashSet exported_names;
+  PersistentStringMap<String> traps;
+  /* The read-only, integer and export marks ride the snapshot too, so a
+     readonly or a declare -i inside a subshell dies with the child rather than
+     leaking its mark to the parent. */
+  PersistentStringMap<u8> variable_attributes;
   /* The length of the environment undo log when the snapshot was taken, the
      point restore_state rewinds the process environment back to. */
   usize environment_undo_mark;
@@ -558,6 +835,8 @@ public:
 
   fn scratch_allocator() const wontthrow -> Allocator
   {
+    if (THREAD_SCRATCH_ARENA != nullptr) [[unlikely]]
+      return bump_allocator(*THREAD_SCRATCH_ARENA);
     return bump_allocator(m_scratch_arena);
   }
   mustuse fn scratch_mark() const wontthrow -> BumpArena::Mark
@@ -571,6 +850,9 @@ public:
   fn reset_scratch_arena() wontthrow -> void { m_scratch_arena.reset(); }
 
   fn set_shell_variable(StringView name, StringView value) throws -> void;
+  /* NAME+=VALUE. A stored string grows in place, so a loop of appends stays
+     linear in the final length. */
+  fn append_shell_variable(StringView name, StringView value) throws -> void;
   fn get_program_resolver() wontthrow -> ProgramResolver &
   {
     return m_program_resolver;
@@ -640,6 +922,18 @@ public:
      loop compiles each distinct pattern once. */
   fn cached_compiled_regex(StringView pattern) throws -> os::compiled_regex *;
 
+  /* The compiled program of a glob, keyed by its bytes, its active mask, and
+     the flags, so a case arm or a ${x//pat/rep} in a loop compiles each
+     distinct pattern once. The reference stays valid until the next call. */
+  fn cached_glob_program(StringView glob, const Bitset &glob_active,
+                         usize mask_offset, bool fold_case) throws
+      -> const GlobProgram &;
+
+  /* A matcher for a glob whose mask starts at the glob's first byte, backed by
+     the cached program. */
+  fn glob_matcher(StringView glob, const Bitset &glob_active) throws
+      -> GlobMatcher;
+
   fn collect_array_subscripts(StringView name) const throws
       -> ArrayList<String>;
 
@@ -671,6 +965,17 @@ public:
   }
   fn get_variable_value(StringView name) const throws -> Maybe<String>;
   fn get_variable_value_checked(StringView name) const throws -> Maybe<String>;
+  /* get_variable_value without the copy. The view points into the store, or
+     into storage for a value the shell computes, and is valid until the next
+     write to the shell state. */
+  hot fn borrow_variable_value(StringView name,
+                               borrowed_value_storage &storage) const throws
+      -> Maybe<StringView>;
+  hot fn is_variable_set(StringView name) const throws -> bool
+  {
+    let storage = borrowed_value_storage{};
+    return borrow_variable_value(name, storage).has_value();
+  }
   pure fn variable_requires_dynamic_lookup(StringView name) const wontthrow
       -> bool;
 
@@ -683,12 +988,20 @@ public:
     return m_shell_variables.find(name);
   }
 
+  /* lookup_shell_variable for a name the caller reads over and over, answered
+     from the slot it remembers while the table layout holds. */
+  hot fn lookup_bound_shell_variable(StringView name,
+                                     persistent_map_slot<String> &slot) const
+      wontthrow -> const String *
+  {
+    return m_shell_variables.find_cached(name, slot);
+  }
+
   hot pure fn has_variable_name(StringView name) const wontthrow -> bool
   {
     return m_shell_variables.find(name) != nullptr ||
            m_indexed_arrays.find(name) != nullptr ||
-           m_associative_names.contains(name) ||
-           m_exported_names.contains(name) ||
+           m_associative_names.contains(name) || is_exported(name) ||
            variable_requires_dynamic_lookup(name);
   }
 
@@ -715,8 +1028,11 @@ public:
   fn set_last_background_pid(i64 pid) wontthrow -> void;
 
   /* The job table tracks the background commands started with the & operator.
-     register_job adds a running job and returns its id. update_jobs polls every
-     job without blocking and marks the ones that finished or stopped. */
+     register_job adds a running job and returns its id. update_jobs marks the
+     jobs that finished or stopped without blocking. It returns at once when no
+     SIGCHLD arrived since its last run, and otherwise reaps only the children
+     that have a report waiting, so its cost follows the events rather than the
+     job count. */
   fn register_job(os::process pid, StringView command,
                   i64 process_group_id = 0) throws -> i32;
   fn register_pipeline_job(const ArrayList<os::process> &processes,
@@ -735,6 +1051,10 @@ public:
   fn most_recent_job() wontthrow -> job *;
   fn forget_done_jobs() throws -> void;
   fn remove_job(i32 id) throws -> bool;
+  /* The id of the oldest finished job among the candidates, or any job when
+     there are none, which leaves the finished queue. It is what wait -n
+     reports. */
+  fn take_finished_job(const ArrayList<i32> &candidates) throws -> Maybe<i32>;
 
   fn notify_done_jobs() throws -> void;
   fn format_done_job_notifications(StringView line_ending) throws -> String;
@@ -849,7 +1169,7 @@ public:
   /* A signal condition installs the shell's handler. */
   fn set_trap(StringView condition, StringView action) throws -> void;
   fn remove_trap(StringView condition) throws -> void;
-  pure fn traps() const wontthrow -> const StringMap<String> &;
+  pure fn traps() const wontthrow -> const PersistentStringMap<String> &;
   fn run_exit_trap() throws -> void;
 
   fn run_named_trap(StringView condition) throws -> void;
@@ -865,6 +1185,10 @@ public:
   fn clear_inherited_exit_trap() throws -> void;
   fn run_subshell_exit_trap() throws -> void;
 
+  pure fn variable_attributes(StringView name) const wontthrow -> u8;
+  fn set_variable_attribute(StringView name, variable_attribute attribute,
+                            bool is_set) throws -> void;
+
   fn mark_readonly(StringView name) throws -> void;
   fn unmark_readonly(StringView name) throws -> void;
   fn is_readonly(StringView name) const wontthrow -> bool;
@@ -1191,6 +1515,21 @@ public:
     return m_make_shell_suppressed;
   }
 
+  /* The bundled make asks for the subshell around a recipe line to run by
+     snapshot instead of a fork, so a line of builtins starts no process. The
+     request covers only the next subshell, the line's own, and one nested in
+     the line forks as usual. */
+  fn request_in_process_subshell() wontthrow -> void
+  {
+    m_is_in_process_subshell_requested = true;
+  }
+  fn take_in_process_subshell_request() wontthrow -> bool
+  {
+    let const was_requested = m_is_in_process_subshell_requested;
+    m_is_in_process_subshell_requested = false;
+    return was_requested;
+  }
+
   /* Seed the nounset, pipefail, and failglob strictness from the active mood.
      An explicit set -u, set -o pipefail, or set -o failglob is the script's own
      ask, so it survives the mood switch untouched. */
@@ -1435,17 +1774,19 @@ public:
       -> String;
 
   /* The same value as evaluate_arithmetic, but a substitution-free expression
-     lexes its tokens once onto the segment and re-evaluates from them. */
+     compiles once onto the segment and re-runs from the program. */
   fn evaluate_arithmetic_cached(const WordSegment &segment) throws -> i64;
 
-  /* The same value as evaluate_arithmetic, but it lexes the clause once into
-     the caller-owned token store and re-evaluates from it. A complex clause or
-     a lexing failure falls back to the char parser, and a clause holding a
-     substitution skips the cache. */
+  /* The same value as evaluate_arithmetic, but it compiles the clause once
+     into the caller-owned program and re-runs it. A division by zero or a
+     negative exponent points at its operands under precise_base, and is left
+     for the caller to place otherwise. A declined clause of plain operators
+     reports the same way, while one that assigns, steps, or branches, like a
+     clause holding a substitution, reports under source_location. */
   fn evaluate_arithmetic_cached_clause(
-      StringView expression, ArrayList<arith_token> &tokens, bool &is_tokenized,
-      bool &is_simple, const SourceLocation *source_location = nullptr) throws
-      -> i64;
+      StringView expression, arith_program &program,
+      const SourceLocation *source_location = nullptr,
+      const SourceLocation *precise_base = nullptr) throws -> i64;
 
   /* Evaluate a [[ ]] conditional element list and report whether it is true.
      The operands expand without field splitting, == and != glob match their
@@ -1565,6 +1906,12 @@ public:
                                  const SourceLocation *source_location) throws
       -> String;
 
+  /* Run a modifier word taken apart by parse_modifier_word, the expansions in
+     it evaluated in order. source_location covers the word. */
+  fn run_modifier_word(const modifier_word_program &program,
+                       Bitset *active_out,
+                       const SourceLocation *source_location) throws -> String;
+
   pure fn should_echo() const wontthrow -> bool;
   fn set_echo(bool enabled) wontthrow -> void
   {
@@ -1692,21 +2039,24 @@ protected:
   usize m_peak_ast_arena_bytes{0};
 
   mutable BumpArena m_scratch_arena{};
-  StringMap<String> m_shell_variables{heap_allocator()};
-  StringMap<ArrayList<String>> m_indexed_arrays{heap_allocator()};
+  PersistentStringMap<String> m_shell_variables{heap_allocator()};
+  PersistentStringMap<ArrayList<String>> m_indexed_arrays{heap_allocator()};
   StringMap<completion_spec> m_completion_specs{heap_allocator()};
   Maybe<completion_spec> m_default_completion_spec{};
-  HashSet m_associative_names{heap_allocator()};
-  StringMap<String> m_associative_values{heap_allocator()};
+  PersistentHashSet m_associative_names{heap_allocator()};
+  PersistentStringMap<String> m_associative_values{heap_allocator()};
   /* An indexed array element whose subscript is past the dense limit, held by
      its name and decimal index so a sparse far subscript does not pad a huge
      dense gap. The name still reads as indexed. */
-  StringMap<String> m_sparse_array_values{heap_allocator()};
-  HashSet m_sparse_array_names{heap_allocator()};
-  StringMap<bool> m_shopt_options{heap_allocator()};
+  PersistentStringMap<String> m_sparse_array_values{heap_allocator()};
+  PersistentHashSet m_sparse_array_names{heap_allocator()};
+  PersistentStringMap<bool> m_shopt_options{heap_allocator()};
   /* The compiled form of each [[ =~ ]] pattern, keyed by the pattern text, so a
      hot loop with a constant regex compiles it once and reuses it. */
   StringMap<CompiledRegex> m_regex_cache{heap_allocator()};
+  /* The compiled form of each glob the matchers ran, keyed the way
+     cached_glob_program builds it. */
+  StringMap<GlobProgram> m_glob_cache{heap_allocator()};
   /* The cached value of IFS, kept current by set_shell_variable, so word
      splitting does not look it up per word. */
   String m_field_separators{" \t\n"};
@@ -1730,19 +2080,20 @@ protected:
   String m_cli_invocation{heap_allocator()};
   String m_current_command{heap_allocator()};
   bool m_make_shell_suppressed{false};
+  bool m_is_in_process_subshell_requested{false};
   ArrayList<String> m_positional_params{heap_allocator()};
   /* The saved directories below the current one, back is the top of the stack.
      pushd appends the current directory, popd drops the back and moves to it.
    */
   ArrayList<String> m_directory_stack{heap_allocator()};
   Maybe<i64> m_last_background_pid{};
-  StringMap<const Expression *> m_functions{heap_allocator()};
+  PersistentStringMap<const Expression *> m_functions{heap_allocator()};
   /* The definition text of each function, kept on the heap since a function
      outlives the command it was parsed from. */
-  StringMap<String> m_function_sources{heap_allocator()};
+  PersistentStringMap<String> m_function_sources{heap_allocator()};
   /* The position mapping for each stored definition, read by
      resolve_render_source when a diagnostic fires inside a call. */
-  StringMap<function_definition_info> m_function_definition_infos{
+  PersistentStringMap<function_definition_info> m_function_definition_infos{
       heap_allocator()};
   usize m_subshell_depth{0};
   /* The descriptors bare execs moved inside live in-process subshells, kept
@@ -1757,9 +2108,6 @@ protected:
      only while m_subshell_depth is above zero, so a top-level export pays
      nothing. */
   ArrayList<environment_undo_entry> m_environment_undo_log{heap_allocator()};
-  /* The names currently in the process environment, kept in step with every
-     environment write so an assignment tests membership in O(1). */
-  HashSet m_exported_names{heap_allocator()};
 #if !defined NDEBUG
   mutable usize m_debug_variable_name_enumeration_count{0};
 #endif
@@ -1835,7 +2183,7 @@ protected:
   bool m_glob_exempt_for_test{false};
   usize m_getopts_char_index{1};
   i64 m_getopts_last_optind{0};
-  StringMap<String> m_traps{heap_allocator()};
+  PersistentStringMap<String> m_traps{heap_allocator()};
   bool m_has_debug_trap{false};
   bool m_exit_trap_ran{false};
   /* True while run_pending_traps is draining, so a signal delivered during a
@@ -1847,9 +2195,12 @@ protected:
 
   fn install_trap_dispositions() throws -> void;
 
-  HashSet m_readonly_names{heap_allocator()};
-  HashSet m_integer_names{heap_allocator()};
-  StringMap<String> m_aliases{heap_allocator()};
+  /* The variable_attribute bits of every marked name, one record per name so
+     an assignment reads the read-only, integer and export marks in one probe.
+     The export bit covers every name in the process environment, kept in step
+     with every environment write. A name with no mark has no entry. */
+  PersistentStringMap<u8> m_variable_attributes{heap_allocator()};
+  PersistentStringMap<String> m_aliases{heap_allocator()};
   /* One entry per active function call, holding the bindings a local shadowed.
    */
   ArrayList<ArrayList<local_binding>> m_local_scopes{heap_allocator()};
@@ -1863,19 +2214,38 @@ protected:
      classification. */
   usize m_sourced_file_frames{0};
 
+  /* Ordered by id, so a job is found by a binary search. */
   ArrayList<job> m_jobs{heap_allocator()};
   ArrayList<os::process> m_detached_job_processes{heap_allocator()};
+  /* The job id of every process the table still has to reap, keyed by the raw
+     bytes of its process id. A disowned process maps to zero, no job's id. */
+  StringMap<i32> m_job_process_index{heap_allocator()};
+  /* The ids of the jobs in the order they finished, for wait -n. */
+  ArrayList<i32> m_finished_job_ids{heap_allocator()};
+  sig_atomic_t m_updated_child_generation{0};
+  bool m_has_updated_jobs{false};
   i32 m_next_job_id{1};
   bool m_shell_is_interactive;
 
+  fn index_job_process(os::process p, i32 id) throws -> void;
+  fn unindex_job_process(os::process p) throws -> void;
+  fn poll_job_processes(ArrayList<os::process> &processes) throws
+      -> Maybe<i32>;
+  fn update_job(job &job) throws -> void;
+  fn update_reported_jobs() throws -> bool;
+
   fn option_flags_string() const throws -> String;
 
   fn expand_variable(StringView name) const throws -> String;
+  fn computed_variable_value(StringView name) const throws -> Maybe<String>;
 
   /* Write a variable without the read-only check, for restoring a shadowed
      local on function return where a throw from a noexcept defer would
      terminate the shell. */
   fn assign_variable(StringView name, StringView value) throws -> void;
+  /* assign_variable with the name's variable_attribute bits already read. */
+  fn assign_variable(StringView name, StringView value, u8 attributes) throws
+      -> void;
 
   /* Remove a variable without the read-only check, the same local restore path
      as assign_variable. */
@@ -1889,20 +2259,30 @@ protected:
      the integer mark, shared by the scope pop and the unset peel. */
   fn restore_local_binding(local_binding &binding) throws -> void;
 
-  fn apply_parameter_expansion(StringView spec,
-                               const SourceLocation *source_location = nullptr,
-                               usize source_location_offset = 0) throws
-      -> String;
+  /* operand_cache keeps the operand subwords of the plan's body, and is read
+     only with a plan that is not General. */
+  fn apply_parameter_expansion(
+      StringView spec, const SourceLocation *source_location = nullptr,
+      usize source_location_offset = 0,
+      const parameter_expansion_plan *plan = nullptr,
+      parameter_operand_cache *operand_cache = nullptr) throws -> String;
+  /* apply_parameter_expansion for a ${...} segment, planned on its first run.
+   */
+  fn expand_parameter_segment(const WordSegment &segment) throws -> String;
 
   /* Expand the bash substring form ${name:offset:length}, an arithmetic offset
      and an optional arithmetic length, each counting from the end when
      negative. */
   fn apply_substring_expansion(
       StringView name, StringView body,
-      const SourceLocation *source_location = nullptr) throws -> String;
+      const SourceLocation *source_location = nullptr,
+      Maybe<usize> planned_separator = None,
+      parameter_operand_words *operand_words = nullptr) throws -> String;
   fn apply_substring_to_value(
       StringView value, StringView body,
-      const SourceLocation *source_location = nullptr) throws -> String;
+      const SourceLocation *source_location = nullptr,
+      Maybe<usize> planned_separator = None,
+      parameter_operand_words *operand_words = nullptr) throws -> String;
 
   /* Expand the bash pattern-replacement forms ${name/pat/rep},
      ${name//pat/rep}, ${name/#pat/rep}, and ${name/%pat/rep}. A leading second
@@ -1910,13 +2290,17 @@ protected:
      the end. */
   fn apply_pattern_replacement(
       StringView name, StringView spec,
-      const SourceLocation *source_location = nullptr) throws -> String;
+      const SourceLocation *source_location = nullptr,
+      Maybe<usize> planned_separator = None,
+      const parameter_operand_words *operand_words = nullptr) throws -> String;
 
   /* The pattern-replacement core that works on an already-resolved value, so an
      array element ${a[i]/pat/rep} and ${a[@]/pat/rep} reuse it. */
   fn pattern_replace_value(
       const String &value, StringView spec,
-      const SourceLocation *source_location = nullptr) throws -> String;
+      const SourceLocation *source_location = nullptr,
+      Maybe<usize> planned_separator = None,
+      const parameter_operand_words *operand_words = nullptr) throws -> String;
 
   /* Expand the bash case-modification forms ${name^}, ${name^^}, ${name,}, and
      ${name,,}. A single operator touches the first character, a doubled one
@@ -2015,6 +2399,17 @@ public:
      binary behind it. */
   bool is_multicall{false};
 
+  /* In-memory ends a pipeline stage reads and writes in place of the pipe when
+     its neighbour runs on a thread of this process. close_fds closes them with
+     the descriptors. */
+  stages::ring *in_ring{nullptr};
+  stages::ring *out_ring{nullptr};
+
+  /* A builtin that runs beside pipeline stage threads keeps its descriptors to
+     itself rather than placing them on fd 0, 1, and 2, which the threads share.
+   */
+  bool should_leave_shell_fds{false};
+
   pure fn is_builtin() const wontthrow -> bool;
   pure fn is_unresolved() const wontthrow -> bool;
   pure fn get_unresolved_status() const wontthrow -> i32;
@@ -2031,6 +2426,11 @@ public:
   fn close_fds() throws -> void;
   fn print_to_stdout(StringView s) const throws -> void;
   fn print_to_stderr(StringView s) const throws -> void;
+  /* Whether print_to_stdout reaches a terminal. */
+  fn stdout_is_a_tty() const wontthrow -> bool;
+  /* The descriptor print_to_stdout writes to, none when the output goes to a
+     stage ring or a capture instead. */
+  fn stdout_descriptor() const wontthrow -> Maybe<os::descriptor>;
 
   fn execute(execution_mode mode) throws -> i32;
 
@@ -2083,6 +2483,12 @@ private:
 fn evaluate_constant_arithmetic(StringView expression) throws -> i64;
 
 fn find_substring_length_separator(StringView body) wontthrow -> usize;
+fn find_replacement_separator(StringView body) wontthrow -> usize;
+
+/* Split a ${...} body into its plan, General for the forms the expander scans
+   on every run. */
+fn plan_parameter_expansion(StringView spec) wontthrow
+    -> parameter_expansion_plan;
 
 /* The abort the set -u read and the ${name:?} report perform even in the bash
    mood. */
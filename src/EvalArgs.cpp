@@ -363,6 +363,10 @@ fn expand_braces(const Word &word, Allocator alloc) throws -> ArrayList<Word>
 
       reference.text.append(
           following.text.view().substring_of_length(0, taken));
+      /* The copy carries what the shorter name cached. */
+      reference.expansion_plan = parameter_expansion_plan{};
+      reference.operand_cache.reset();
+      reference.bound_variable = persistent_map_slot<String>{};
       if (taken == following.text.count())
         out.segments.remove(s + 1);
       else
@@ -698,11 +702,7 @@ hot flatten fn EvalContext::process_args(
                     value += stored->view();
                     break;
                   }
-                let const source_location =
-                    segment.get_source_location(m_current_location.filename);
-                value += apply_parameter_expansion(
-                    spec,
-                    source_location.has_value() ? &*source_location : nullptr);
+                value += expand_parameter_segment(segment);
               } break;
               case WordSegment::Kind::ArithmeticExpansion: {
                 let const number = segment.has_folded_arithmetic_result
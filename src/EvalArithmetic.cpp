@@ -788,6 +788,20 @@ static const StringView ARITH_OPERATORS[] = {
     "%",   "<",   ">",  "=",  "&",  "|",  "^",  "!",  "~",
 };
 
+struct arith_token
+{
+  enum class kind : u8
+  {
+    number,
+    name,
+    op,
+    subscript,
+  };
+  kind k;
+  i64 value{0};
+  StringView text{};
+};
+
 static fn tokenize_arithmetic(StringView src,
                               ArrayList<arith_token> &out) throws -> void
 {
@@ -858,39 +872,14 @@ static fn tokenize_arithmetic(StringView src,
   }
 }
 
-/* An operator that assigns, steps, short-circuits, or branches forces the full
-   char parser, the token fast path keeps no side-effect ordering. */
-static pure fn arith_op_is_complex(StringView t) wontthrow -> bool
-{
-  static constexpr PackedStringKey KEYS[] = {
-      SSK("="),  SSK("+="), SSK("-="), SSK("*="),  SSK("/="),  SSK("%="),
-      SSK("&="), SSK("|="), SSK("^="), SSK("<<="), SSK(">>="), SSK("?"),
-      SSK(":"),  SSK(","),  SSK("++"), SSK("--"),  SSK("&&"),  SSK("||"),
-  };
-  static constexpr StaticStringSet COMPLEX_OPS{KEYS};
-  return COMPLEX_OPS.contains(t);
-}
-
-static pure fn
-arith_tokens_are_simple(const ArrayList<arith_token> &toks) wontthrow -> bool
-{
-  for (let const &t : toks) {
-    if (t.k == arith_token::kind::subscript) return false;
-    if (t.k == arith_token::kind::op && arith_op_is_complex(t.text)) {
-      return false;
-    }
-  }
-  return true;
-}
-
 struct arith_binop
 {
   char kind;
   u8 precedence;
 };
 
-/* Mirrors peek_binary_operator. The short-circuit pair is excluded, a simple
-   expression never holds it. */
+/* Mirrors peek_binary_operator, the compound assignments answering no
+   operator. */
 static pure fn arith_classify_binop(StringView t) wontthrow -> arith_binop
 {
   static constexpr static_string_entry<arith_binop> ENTRIES[] = {
@@ -911,13 +900,37 @@ static pure fn arith_classify_binop(StringView t) wontthrow -> arith_binop
       {SSK("&"),  {'&', 5} },
       {SSK("^"),  {'^', 4} },
       {SSK("|"),  {'|', 3} },
+      {SSK("&&"), {'A', 2} },
+      {SSK("||"), {'O', 1} },
   };
   static constexpr StaticStringMap BINOPS{ENTRIES};
   if (let const found = BINOPS.find(t); found.has_value()) return *found;
   return {0, 0};
 }
 
-/* Uses the same helpers as the char parser's ladder so the fast path and the
+/* The letter arith_apply_binop takes for a compound assignment token, or 0
+   when the token is not one. */
+static pure fn arith_classify_compound_assignment(StringView t) wontthrow
+    -> char
+{
+  static constexpr static_string_entry<char> ENTRIES[] = {
+      {SSK("<<="), 'L'},
+      {SSK(">>="), 'R'},
+      {SSK("+="),  '+'},
+      {SSK("-="),  '-'},
+      {SSK("*="),  '*'},
+      {SSK("/="),  '/'},
+      {SSK("%="),  '%'},
+      {SSK("&="),  '&'},
+      {SSK("|="),  '|'},
+      {SSK("^="),  '^'},
+  };
+  static constexpr StaticStringMap COMPOUNDS{ENTRIES};
+  if (let const found = COMPOUNDS.find(t); found.has_value()) return *found;
+  return '\0';
+}
+
+/* Uses the same helpers as the char parser's ladder so the program and the
    full parser agree. */
 static fn arith_apply_binop(char kind, i64 lhs, i64 rhs) throws -> i64
 {
@@ -970,11 +983,12 @@ static fn evaluate_named_value_operand(EvalContext *context,
   return nested.parse();
 }
 
-static fn arith_read_variable(EvalContext *context, StringView name) throws
+static fn arith_read_bound_variable(EvalContext *context, StringView name,
+                                    persistent_map_slot<String> &slot) throws
     -> i64
 {
   ASSERT(context != nullptr);
-  if (let const *stored = context->lookup_shell_variable(name);
+  if (let const *stored = context->lookup_bound_shell_variable(name, slot);
       stored != nullptr)
   {
     return evaluate_named_value_operand(context, stored->view());
@@ -987,102 +1001,545 @@ static fn arith_read_variable(EvalContext *context, StringView name) throws
   return evaluate_named_value_operand(context, value->view());
 }
 
-/* A precedence-climbing evaluator over the cached token stream for a simple
-   expression with no assignment, ternary, comma, or short-circuit. */
-class ArithmeticTokenEvaluator
+/* Thrown by the compiler for a clause it does not take. */
+struct arith_compile_declined
+{};
+
+/* Compiles the token stream of a substitution-free expression into register
+   code, following ArithmeticParser rule for rule. Each rule leaves its value
+   in the register it is given and uses the ones above it for operands. A
+   subtree of constants folds to one Constant, and a constant condition keeps
+   only the branch it takes. Anything the rules do not take is declined, so the
+   char parser reports it where the source has it. */
+class ArithmeticCompiler
 {
 public:
-  EvalContext *context;
+  StringView source;
   const ArrayList<arith_token> &toks;
+  arith_program_body &program;
   usize ti{0};
   usize depth{0};
   static constexpr usize MAX_DEPTH = 512;
+  static constexpr u16 MAX_REGISTERS = 64;
+  static constexpr u32 NO_SPAN = static_cast<u32>(-1);
+
+  struct lvalue
+  {
+    u32 name;
+    Maybe<u16> subscript;
+  };
 
-  pure fn at_op(StringView s) wontthrow -> bool
+  [[noreturn]] cold fn decline() throws -> void
+  {
+    throw arith_compile_declined{};
+  }
+
+  pure fn at_op(StringView s) const wontthrow -> bool
   {
     return ti < toks.count() && toks[ti].k == arith_token::kind::op &&
            toks[ti].text == s;
   }
 
-  fn parse_operand() throws -> i64
+  pure fn at_kind(arith_token::kind k) const wontthrow -> bool
   {
-    depth++;
-    defer { depth--; };
-    if (depth > MAX_DEPTH) {
-      throw ErrorWithDetails{"Expression nested too deeply",
-                             "A variable may reference itself, like `x=x`"};
+    return ti < toks.count() && toks[ti].k == k;
+  }
+
+  fn expect_op(StringView s) throws -> void
+  {
+    if (!at_op(s)) decline();
+    ti++;
+  }
+
+  pure fn offset_of(const arith_token &t) const wontthrow -> u32
+  {
+    return static_cast<u32>(t.text.data - source.data);
+  }
+
+  fn use_register(u16 r) throws -> u16
+  {
+    if (r >= MAX_REGISTERS) decline();
+    if (r >= program.register_count) program.register_count = r + 1;
+    return r;
+  }
+
+  fn emit(arith_instruction instruction) throws -> usize
+  {
+    program.code.push(instruction);
+    return program.code.count() - 1;
+  }
+
+  fn patch_to_here(usize jump) wontthrow -> void
+  {
+    program.code[jump].operand = static_cast<u32>(program.code.count());
+  }
+
+  fn emit_constant(u16 dst, i64 value) throws -> void
+  {
+    program.constants.push(value);
+    emit({arith_instruction::Op::Constant, '\0', use_register(dst), 0, 0,
+          static_cast<u32>(program.constants.count() - 1)});
+  }
+
+  /* The value of the code emitted since mark, when that code is one Constant.
+   */
+  pure fn constant_since(usize mark) const wontthrow -> Maybe<i64>
+  {
+    if (program.code.count() != mark + 1) return None;
+    let const &only = program.code[mark];
+    if (only.op != arith_instruction::Op::Constant) return None;
+    return program.constants[only.operand];
+  }
+
+  fn discard_since(usize mark) wontthrow -> void
+  {
+    while (program.code.count() > mark)
+      program.code.pop_back();
+  }
+
+  /* A repeated name shares one entry, so its bound slot serves every use. */
+  fn intern_name(StringView name) throws -> u32
+  {
+    for (usize i = 0; i < program.names.count(); i++)
+      if (program.names[i] == name) return static_cast<u32>(i);
+    program.names.push(name);
+    program.bound_names.push(persistent_map_slot<String>{});
+    return static_cast<u32>(program.names.count() - 1);
+  }
+
+  fn read_lvalue() throws -> lvalue
+  {
+    if (!at_kind(arith_token::kind::name)) decline();
+    let target = lvalue{intern_name(toks[ti].text), None};
+    ti++;
+    if (at_kind(arith_token::kind::subscript)) {
+      let const subscript = intern_name(toks[ti].text);
+      if (subscript > 0xFFFF) decline();
+      target.subscript = static_cast<u16>(subscript);
+      ti++;
     }
+    return target;
+  }
 
-    if (at_op("+")) {
+  pure fn is_at_lvalue_start() const wontthrow -> bool
+  {
+    return at_kind(arith_token::kind::name);
+  }
+
+  fn emit_load(const lvalue &target, u16 dst) throws -> void
+  {
+    if (target.subscript.has_value())
+      emit({arith_instruction::Op::LoadElement, '\0', use_register(dst), 0,
+            *target.subscript, target.name});
+    else
+      emit({arith_instruction::Op::Load, '\0', use_register(dst), 0, 0,
+            target.name});
+  }
+
+  fn emit_store(const lvalue &target, u16 source_register) throws -> void
+  {
+    if (target.subscript.has_value())
+      emit({arith_instruction::Op::StoreElement, '\0', 0, source_register,
+            *target.subscript, target.name});
+    else
+      emit({arith_instruction::Op::Store, '\0', 0, source_register, 0,
+            target.name});
+  }
+
+  fn emit_binary(char kind, u16 dst, u16 lhs, u16 rhs, u32 span) throws
+      -> void
+  {
+    emit({arith_instruction::Op::Binary, kind, use_register(dst), lhs, rhs,
+          span});
+  }
+
+  /* target += delta, leaving the stepped value in dst. */
+  fn emit_step(const lvalue &target, u16 from, u16 dst, i64 delta) throws
+      -> void
+  {
+    emit_constant(dst + 1, delta);
+    emit_binary('+', dst, from, dst + 1, NO_SPAN);
+    emit_store(target, dst);
+  }
+
+  fn compile() throws -> void
+  {
+    if (toks.is_empty()) {
+      emit_constant(0, 0);
+      return;
+    }
+    compile_comma(0);
+    if (ti != toks.count()) decline();
+  }
+
+  fn compile_comma(u16 dst) throws -> void
+  {
+    compile_assignment(dst);
+    while (at_op(",")) {
       ti++;
-      return parse_operand();
+      compile_assignment(dst);
+    }
+  }
+
+  fn compile_assignment(u16 dst) throws -> void
+  {
+    if (is_at_lvalue_start()) {
+      let const save = ti;
+      let const target = read_lvalue();
+      if (at_op("=")) {
+        ti++;
+        compile_assignment(dst);
+        emit_store(target, dst);
+        return;
+      }
+      if (at_kind(arith_token::kind::op))
+        if (let const kind = arith_classify_compound_assignment(toks[ti].text);
+            kind != '\0')
+        {
+          ti++;
+          compile_assignment(dst);
+          emit_load(target, dst + 1);
+          emit_binary(kind, dst, dst + 1, dst, NO_SPAN);
+          emit_store(target, dst);
+          return;
+        }
+      ti = save;
     }
-    if (at_op("-")) {
+    compile_ternary(dst);
+  }
+
+  fn compile_ternary(u16 dst) throws -> void
+  {
+    let const mark = program.code.count();
+    compile_binary(dst, 1);
+    if (!at_op("?")) return;
+    ti++;
+
+    if (let const condition = constant_since(mark); condition.has_value()) {
+      discard_since(mark);
+      compile_assignment(dst);
+      if (*condition == 0) discard_since(mark);
+      expect_op(":");
+      let const false_mark = program.code.count();
+      compile_ternary(dst);
+      if (*condition != 0) discard_since(false_mark);
+      return;
+    }
+
+    let const to_false = emit({arith_instruction::Op::JumpIfZero, '\0', 0,
+                               dst, 0, 0});
+    compile_assignment(dst);
+    expect_op(":");
+    let const to_end = emit({arith_instruction::Op::Jump, '\0', 0, 0, 0, 0});
+    patch_to_here(to_false);
+    compile_ternary(dst);
+    patch_to_here(to_end);
+  }
+
+  fn compile_binary(u16 dst, u8 min_precedence) throws -> void
+  {
+    if (ti >= toks.count()) decline();
+    let const lhs_start = offset_of(toks[ti]);
+    let const mark = program.code.count();
+    compile_unary(dst);
+    loop
+    {
+      if (!at_kind(arith_token::kind::op)) return;
+      let const op = arith_classify_binop(toks[ti].text);
+      if (op.precedence == 0 || op.precedence < min_precedence) return;
       ti++;
-      return arithmetic_subtract(0, parse_operand());
+
+      if (op.kind == 'A' || op.kind == 'O') {
+        compile_short_circuit(op, dst, mark);
+        continue;
+      }
+
+      let const rhs = use_register(dst + 1);
+      let const rhs_mark = program.code.count();
+      /* ** is right-associative so it re-enters at its own precedence. */
+      compile_binary(rhs,
+                     op.kind == 'P' ? op.precedence : op.precedence + 1);
+      let const lhs_value = rhs_mark == mark + 1 ? constant_since(mark) : None;
+      let const rhs_value = constant_since(rhs_mark);
+      if (lhs_value.has_value() && rhs_value.has_value()) {
+        /* A constant division by zero stays for the run to report. */
+        try {
+          let const folded = arith_apply_binop(op.kind, *lhs_value, *rhs_value);
+          discard_since(mark);
+          emit_constant(dst, folded);
+          continue;
+        } catch (const ErrorBase &) {
+        }
+      }
+
+      u32 span = NO_SPAN;
+      if (op.kind == 'P' || op.kind == '/' || op.kind == '%') {
+        let const &last = toks[ti - 1];
+        program.spans.push(arith_program_body::span{
+            lhs_start, offset_of(last) + static_cast<u32>(last.text.length)});
+        span = static_cast<u32>(program.spans.count() - 1);
+      }
+      emit_binary(op.kind, dst, dst, rhs, span);
+    }
+  }
+
+  /* The right operand runs only when the left one does not decide. A constant
+     left operand decides now, keeping the right operand's code or none. */
+  fn compile_short_circuit(arith_binop op, u16 dst, usize mark) throws -> void
+  {
+    let const is_and = op.kind == 'A';
+    if (let const lhs = constant_since(mark); lhs.has_value()) {
+      discard_since(mark);
+      compile_binary(dst, op.precedence + 1);
+      if (is_and == (*lhs == 0)) {
+        discard_since(mark);
+        emit_constant(dst, is_and ? 0 : 1);
+      } else if (let const rhs = constant_since(mark); rhs.has_value()) {
+        discard_since(mark);
+        emit_constant(dst, *rhs != 0 ? 1 : 0);
+      } else {
+        emit({arith_instruction::Op::Truth, '\0', dst, dst, 0, 0});
+      }
+      return;
     }
-    if (at_op("!")) {
+
+    /* && leaves a zero left operand as its 0, || turns the left operand into
+       its truth first so a taken jump leaves 1. */
+    if (!is_and) emit({arith_instruction::Op::Truth, '\0', dst, dst, 0, 0});
+    let const to_end =
+        emit({is_and ? arith_instruction::Op::JumpIfZero
+                     : arith_instruction::Op::JumpIfNonZero,
+              '\0', 0, dst, 0, 0});
+    compile_binary(dst, op.precedence + 1);
+    emit({arith_instruction::Op::Truth, '\0', dst, dst, 0, 0});
+    patch_to_here(to_end);
+  }
+
+  fn compile_unary(u16 dst) throws -> void
+  {
+    depth++;
+    defer { depth--; };
+    if (depth > MAX_DEPTH) decline();
+
+    if (at_op("++") || at_op("--")) {
+      let const delta = toks[ti].text[0] == '+' ? 1 : -1;
       ti++;
-      return parse_operand() == 0 ? 1 : 0;
+      let const target = read_lvalue();
+      emit_load(target, dst);
+      emit_step(target, dst, dst, delta);
+      return;
     }
-    if (at_op("~")) {
+    if (at_op("+")) {
       ti++;
-      return ~parse_operand();
+      compile_unary(dst);
+      return;
+    }
+
+    arith_instruction::Op op;
+    if (at_op("-"))
+      op = arith_instruction::Op::Negate;
+    else if (at_op("!"))
+      op = arith_instruction::Op::Not;
+    else if (at_op("~"))
+      op = arith_instruction::Op::Complement;
+    else {
+      compile_primary(dst);
+      return;
     }
+    ti++;
+
+    let const mark = program.code.count();
+    compile_unary(dst);
+    if (let const value = constant_since(mark); value.has_value()) {
+      discard_since(mark);
+      emit_constant(dst, op == arith_instruction::Op::Negate
+                             ? arithmetic_subtract(0, *value)
+                         : op == arith_instruction::Op::Not ? (*value == 0 ? 1
+                                                                           : 0)
+                                                            : ~*value);
+      return;
+    }
+    emit({op, '\0', dst, dst, 0, 0});
+  }
+
+  fn compile_primary(u16 dst) throws -> void
+  {
+    depth++;
+    defer { depth--; };
+    if (depth > MAX_DEPTH) decline();
+
     if (at_op("(")) {
       ti++;
-      let const value = parse_binary(1);
-      if (!at_op(")")) {
-        throw ErrorWithDetails{"Expected ')'", "An opening '(' is unmatched"};
-      }
-      ti++;
-      return value;
+      compile_comma(dst);
+      expect_op(")");
+      return;
     }
-    if (ti < toks.count() && toks[ti].k == arith_token::kind::number) {
-      let const value = toks[ti].value;
+    if (at_kind(arith_token::kind::number)) {
+      emit_constant(dst, toks[ti].value);
       ti++;
-      return value;
+      return;
     }
-    if (ti < toks.count() && toks[ti].k == arith_token::kind::name) {
-      let const name = toks[ti].text;
-      ti++;
-      return arith_read_variable(context, name);
+    if (is_at_lvalue_start()) {
+      let const target = read_lvalue();
+      emit_load(target, dst);
+      if (at_op("++") || at_op("--")) {
+        let const delta = toks[ti].text[0] == '+' ? 1 : -1;
+        ti++;
+        emit_step(target, dst, use_register(dst + 1), delta);
+      }
+      return;
     }
-    if (ti >= toks.count())
-      throw ErrorWithDetails{"Unfinished expression", "An operand is missing"};
-    throw ErrorWithDetails{"Unexpected character in the arithmetic expression",
-                           "This is not a valid operator or operand"};
+    decline();
   }
+};
 
-  fn parse_binary(u8 min_precedence) throws -> i64
-  {
-    let lhs = parse_operand();
-    loop
-    {
-      if (ti >= toks.count() || toks[ti].k != arith_token::kind::op) {
-        return lhs;
+/* Runs a compiled program. A Load reads the way ArithmeticParser does, through
+   the name's bound slot first. */
+static fn run_arithmetic_program(EvalContext *context,
+                                 arith_program_body &program,
+                                 const SourceLocation *precise_base) throws
+    -> i64
+{
+  ASSERT(context != nullptr);
+  ASSERT(program.register_count <= ArithmeticCompiler::MAX_REGISTERS);
+  i64 registers[ArithmeticCompiler::MAX_REGISTERS];
+
+  let const *code = program.code.begin();
+  let const code_length = program.code.count();
+  usize pc = 0;
+  while (pc < code_length) {
+    let const &step = code[pc++];
+    switch (step.op) {
+    case arith_instruction::Op::Constant:
+      registers[step.dst] = program.constants[step.operand];
+      break;
+    case arith_instruction::Op::Load:
+      registers[step.dst] =
+          arith_read_bound_variable(context, program.names[step.operand],
+                                    program.bound_names[step.operand]);
+      break;
+    case arith_instruction::Op::LoadElement:
+      registers[step.dst] = context->read_array_element_integer(
+          program.names[step.operand], program.names[step.b]);
+      break;
+    case arith_instruction::Op::Store: {
+      char buffer[24];
+      context->set_shell_variable(
+          program.names[step.operand],
+          utils::int_to_text_into(registers[step.a], buffer, sizeof(buffer)));
+      break;
+    }
+    case arith_instruction::Op::StoreElement: {
+      char buffer[24];
+      context->assign_array_element(
+          program.names[step.operand], program.names[step.b],
+          utils::int_to_text_into(registers[step.a], buffer, sizeof(buffer)),
+          false);
+      break;
+    }
+    case arith_instruction::Op::Binary: {
+      let const lhs = registers[step.a];
+      let const rhs = registers[step.b];
+      if (precise_base != nullptr &&
+          step.operand != ArithmeticCompiler::NO_SPAN &&
+          ((step.kind == 'P' && rhs < 0) || (step.kind != 'P' && rhs == 0)))
+      {
+        let const &span = program.spans[step.operand];
+        const SourceLocation location{precise_base->position + span.start,
+                                      span.end - span.start,
+                                      precise_base->filename};
+        if (step.kind == 'P')
+          throw ErrorWithLocationAndDetails{
+              location, "Exponent less than 0",
+              "'**' requires a non-negative exponent"};
+        throw ErrorWithLocationAndDetails{location, "Division by zero",
+                                          "The right operand evaluated to 0"};
       }
-      let const op = arith_classify_binop(toks[ti].text);
-      if (op.precedence < min_precedence) return lhs;
-      ti++;
-      let const rhs =
-          parse_binary(op.kind == 'P' ? op.precedence : op.precedence + 1);
-      lhs = arith_apply_binop(op.kind, lhs, rhs);
+      registers[step.dst] = arith_apply_binop(step.kind, lhs, rhs);
+      break;
+    }
+    case arith_instruction::Op::Negate:
+      registers[step.dst] = arithmetic_subtract(0, registers[step.a]);
+      break;
+    case arith_instruction::Op::Not:
+      registers[step.dst] = registers[step.a] == 0 ? 1 : 0;
+      break;
+    case arith_instruction::Op::Complement:
+      registers[step.dst] = ~registers[step.a];
+      break;
+    case arith_instruction::Op::Truth:
+      registers[step.dst] = registers[step.a] != 0 ? 1 : 0;
+      break;
+    case arith_instruction::Op::Jump: pc = step.operand; break;
+    case arith_instruction::Op::JumpIfZero:
+      if (registers[step.a] == 0) pc = step.operand;
+      break;
+    case arith_instruction::Op::JumpIfNonZero:
+      if (registers[step.a] != 0) pc = step.operand;
+      break;
     }
   }
+  return registers[0];
+}
 
-  fn run() throws -> i64
-  {
-    if (toks.is_empty()) return 0;
-    let const result = parse_binary(1);
-    if (ti != toks.count()) {
-      throw ErrorWithDetails{"Unexpected '" + String{toks[ti].text} +
-                                 "' after the expression",
-                             "An operator is missing between two values"};
+/* An operator that assigns, steps, short-circuits, or branches. A declined
+   clause holding one reports its error at the span the char parser finds. */
+static pure fn arith_op_is_complex(StringView t) wontthrow -> bool
+{
+  static constexpr PackedStringKey KEYS[] = {
+      SSK("="),  SSK("+="), SSK("-="), SSK("*="),  SSK("/="),  SSK("%="),
+      SSK("&="), SSK("|="), SSK("^="), SSK("<<="), SSK(">>="), SSK("?"),
+      SSK(":"),  SSK(","),  SSK("++"), SSK("--"),  SSK("&&"),  SSK("||"),
+  };
+  static constexpr StaticStringSet COMPLEX_OPS{KEYS};
+  return COMPLEX_OPS.contains(t);
+}
+
+static pure fn
+arith_tokens_are_simple(const ArrayList<arith_token> &toks) wontthrow -> bool
+{
+  for (let const &t : toks) {
+    if (t.k == arith_token::kind::subscript) return false;
+    if (t.k == arith_token::kind::op && arith_op_is_complex(t.text)) {
+      return false;
     }
-    return result;
   }
-};
+  return true;
+}
+
+/* A clause holding a substitution expands on every run, so it is never
+   compiled. */
+static fn compile_arithmetic_program(StringView expression,
+                                     arith_program &program) throws -> void
+{
+  if (expression.find_character('$').has_value() ||
+      expression.find_character('`').has_value())
+  {
+    program.status = arith_program::state::Interpreted;
+    return;
+  }
+
+  let const allocator = heap_allocator();
+  program.body = allocator.alloc_array<arith_program_body>(1);
+  new (program.body) arith_program_body{};
+  let tokens = ArrayList<arith_token>{allocator};
+  bool is_tokenized = false;
+  try {
+    tokenize_arithmetic(expression, tokens);
+    is_tokenized = true;
+    ArithmeticCompiler compiler{expression, tokens, *program.body};
+    compiler.compile();
+    program.status = arith_program::state::Compiled;
+    LOG(All, "compiled the arithmetic '%.*s' to %zu instructions",
+        static_cast<int>(expression.length), expression.data,
+        program.body->code.count());
+  } catch (...) {
+    program.reset();
+    program.status = is_tokenized && arith_tokens_are_simple(tokens)
+                         ? arith_program::state::Declined
+                         : arith_program::state::Interpreted;
+  }
+}
 
 } /* namespace */
 
@@ -1124,39 +1581,25 @@ fn EvalContext::evaluate_arithmetic_cached(const WordSegment &segment) throws
   let const source_location =
       segment.get_source_location(m_current_location.filename);
   return evaluate_arithmetic_cached_clause(
-      segment.text.view(), segment.cached_arith_tokens, segment.arith_tokenized,
-      segment.arith_simple,
+      segment.text.view(), segment.compiled_arithmetic,
       source_location.has_value() ? &*source_location : nullptr);
 }
 
 fn EvalContext::evaluate_arithmetic_cached_clause(
-    StringView expression, ArrayList<arith_token> &tokens, bool &is_tokenized,
-    bool &is_simple, const SourceLocation *source_location) throws -> i64
+    StringView expression, arith_program &program,
+    const SourceLocation *source_location,
+    const SourceLocation *precise_base) throws -> i64
 {
-  if (!is_tokenized) {
-    if (expression.find_character('$').has_value() ||
-        expression.find_character('`').has_value())
-    {
-      return evaluate_arithmetic(expression, source_location);
-    }
+  if (program.status == arith_program::state::Uncompiled)
+    compile_arithmetic_program(expression, program);
 
-    tokens.clear();
-    try {
-      tokenize_arithmetic(expression, tokens);
-    } catch (...) {
-      tokens.clear();
-      is_tokenized = true;
-      is_simple = false;
-      return evaluate_arithmetic(expression, source_location);
-    }
-    is_tokenized = true;
-    is_simple = arith_tokens_are_simple(tokens);
+  switch (program.status) {
+  case arith_program::state::Compiled:
+    return run_arithmetic_program(this, *program.body, precise_base);
+  case arith_program::state::Declined:
+    return evaluate_arithmetic(expression, precise_base);
+  default: return evaluate_arithmetic(expression, source_location);
   }
-
-  if (!is_simple) return evaluate_arithmetic(expression, source_location);
-
-  ArithmeticTokenEvaluator evaluator{this, tokens};
-  return evaluator.run();
 }
 
 fn evaluate_constant_arithmetic(StringView expression) throws -> i64
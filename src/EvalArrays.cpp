@@ -21,7 +21,7 @@ static fn sparse_array_key(StringView name, usize index,
 }
 
 template <class Visit>
-static fn for_each_sparse_index(const StringMap<String> &sparse,
+static fn for_each_sparse_index(const PersistentStringMap<String> &sparse,
                                 StringView name, Allocator allocator,
                                 Visit do_visit) throws -> void
 {
@@ -41,7 +41,7 @@ static fn for_each_sparse_index(const StringMap<String> &sparse,
   });
 }
 
-static fn sparse_array_has_entries(const StringMap<String> &sparse,
+static fn sparse_array_has_entries(const PersistentStringMap<String> &sparse,
                                    StringView name, Allocator allocator) throws
     -> bool
 {
@@ -63,7 +63,7 @@ struct sparse_array_entry
 
 /* The entries come back sorted by ascending index, always beyond the dense
    run. */
-static fn collect_sparse_array_entries(const StringMap<String> &sparse,
+static fn collect_sparse_array_entries(const PersistentStringMap<String> &sparse,
                                        StringView name,
                                        Allocator allocator) throws
     -> ArrayList<sparse_array_entry>
@@ -154,11 +154,16 @@ fn EvalContext::assign_indexed_array_elements(StringView name,
   if (is_append) {
     if (let const *array = lookup_indexed_array(name))
       running_index = array->count();
-    let const sparse = collect_sparse_array_entries(m_sparse_array_values, name,
-                                                    scratch_allocator());
-    if (!sparse.is_empty()) {
-      let const next_after_sparse = sparse[sparse.count() - 1].index + 1;
-      if (next_after_sparse > running_index) running_index = next_after_sparse;
+    /* The sparse scan walks every held element of every array, so a dense
+       array appended to in a loop skips it. */
+    if (m_sparse_array_names.contains(name)) {
+      let const sparse = collect_sparse_array_entries(
+          m_sparse_array_values, name, scratch_allocator());
+      if (!sparse.is_empty()) {
+        let const next_after_sparse = sparse[sparse.count() - 1].index + 1;
+        if (next_after_sparse > running_index)
+          running_index = next_after_sparse;
+      }
     }
   } else {
     set_indexed_array(name, ArrayList<String>{heap_allocator()});
@@ -195,13 +200,13 @@ fn EvalContext::set_array_element(StringView name, usize index,
   /* The dense run holds the contiguous prefix from index zero, and any element
      past its end lives in the sparse map keyed by index, so a gap is not
      padded. A first write promotes an existing scalar to element zero. */
-  ArrayList<String> *dense = m_indexed_arrays.find(name);
+  ArrayList<String> *dense = m_indexed_arrays.find_mutable(name);
   if (dense == nullptr) {
     let elements = ArrayList<String>{heap_allocator()};
     if (let const *scalar = m_shell_variables.find(name))
       elements.push(String{heap_allocator(), scalar->view()});
     set_indexed_array(name, steal(elements));
-    dense = m_indexed_arrays.find(name);
+    dense = m_indexed_arrays.find_mutable(name);
   }
   m_shell_variables.erase(name);
   ASSERT(dense != nullptr);
@@ -215,6 +220,7 @@ fn EvalContext::set_array_element(StringView name, usize index,
     /* The write extends the run, so any element now at its end migrates from
        the sparse map into the dense run. */
     dense->push(String{heap_allocator(), value});
+    if (!m_sparse_array_names.contains(name)) return;
     loop
     {
       let const key =
@@ -281,14 +287,18 @@ fn EvalContext::assign_array_element(StringView name, StringView subscript,
               lookup_associative_element(name, key.view())));
       return;
     }
-    if (is_append) {
-      let combined = String{lookup_associative_element(name, key.view())
-                                .value_or(String{scratch_allocator()})};
-      combined += value;
-      set_associative_element(name, key.view(), combined.view());
-    } else {
-      set_associative_element(name, key.view(), value);
-    }
+    /* An existing element grows in place, a missing one starts out as the
+       appended value. */
+    if (is_append)
+      if (let *existing = m_associative_values.find_mutable(
+              associative_composite_key(name, key.view(), scratch_allocator())
+                  .view());
+          existing != nullptr)
+      {
+        existing->append(value);
+        return;
+      }
+    set_associative_element(name, key.view(), value);
     return;
   }
 
@@ -312,16 +322,26 @@ fn EvalContext::assign_array_element(StringView name, StringView subscript,
     return;
   }
 
-  let element = String{scratch_allocator(), value};
   if (is_append) {
+    /* An element of the dense run grows in place. A sparse one or one past
+       the end joins a copy. */
+    if (let *dense = m_indexed_arrays.find_mutable(name);
+        dense != nullptr && static_cast<usize>(index) < dense->count())
+    {
+      (*dense)[static_cast<usize>(index)].append(value);
+      return;
+    }
     let combined = String{scratch_allocator()};
-    if (let const *array = lookup_indexed_array(name))
-      if (static_cast<usize>(index) < array->count())
-        combined = String{(*array)[static_cast<usize>(index)].view()};
+    if (let const *sparse = m_sparse_array_values.find(
+            sparse_array_key(name, static_cast<usize>(index),
+                             scratch_allocator())
+                .view()))
+      combined.append(sparse->view());
     combined += value;
-    element = steal(combined);
+    set_array_element(name, static_cast<usize>(index), combined.view());
+    return;
   }
-  set_array_element(name, static_cast<usize>(index), element.view());
+  set_array_element(name, static_cast<usize>(index), value);
 }
 
 fn EvalContext::declare_associative_array(StringView name) throws -> void
@@ -416,7 +436,7 @@ fn EvalContext::unset_array_element(StringView name,
     return;
   }
 
-  if (ArrayList<String> *array = m_indexed_arrays.find(name)) {
+  if (ArrayList<String> *array = m_indexed_arrays.find_mutable(name)) {
     const i64 index = evaluate_arithmetic(subscript);
     const i64 array_count = static_cast<i64>(array->count());
     const i64 resolved =
@@ -751,7 +771,7 @@ fn EvalContext::array_element_is_set(StringView name,
                                 scratch_allocator())
                    .view()) != nullptr;
   }
-  return index == 0 && get_variable_value(name).has_value();
+  return index == 0 && is_variable_set(name);
 }
 
 fn EvalContext::matching_prefix_names(StringView prefix) const throws
@@ -797,7 +817,7 @@ fn EvalContext::collect_array_subscripts(StringView name) const throws
       out.push(String::from(entry.index, heap_allocator()));
     return out;
   }
-  if (get_variable_value(name).has_value())
+  if (is_variable_set(name))
     out.push(String{heap_allocator(), "0"});
   return out;
 }
@@ -135,11 +135,6 @@ struct conditional_evaluator
   fn regex_match(StringView value, StringView pattern,
                  const Bitset &active) throws -> bool
   {
-    if (!os::HAS_REGEX_ENGINE) {
-      fail_conditional("Unable to use =~ in the [[ ]]",
-                       "It is not supported on this platform");
-    }
-
     /* An inactive mask byte came from a quoted part of the operand, so a regex
        metacharacter there is backslash-escaped to match itself. */
     let escaped_pattern = String{cxt.scratch_allocator()};
@@ -201,7 +196,7 @@ struct conditional_evaluator
             *bracket + 1, operand.length - *bracket - 2);
         return cxt.array_element_is_set(name, subscript);
       }
-      return cxt.get_variable_value(operand).has_value();
+      return cxt.is_variable_set(operand);
     }
     let const path = Path{operand};
     if (op == "-a" || op == "-e") {
@@ -350,8 +345,8 @@ struct conditional_evaluator
                     ? ascii_lower_copy(cxt.scratch_allocator(), left.view())
                     : left;
             const bool is_matched =
-                utils::glob_matches(match_pattern.view(), match_value.view(),
-                                    active, 0, cxt.extglob_enabled());
+                cxt.glob_matcher(match_pattern.view(), active)
+                    .matches(match_value.view());
             return op == "!=" ? !is_matched : is_matched;
           }
           if (op == "=~") {
@@ -235,7 +235,8 @@ fn EvalContext::run_pending_traps() throws -> void
   m_last_exit_status = saved_exit_status;
 }
 
-pure fn EvalContext::traps() const wontthrow -> const StringMap<String> &
+pure fn EvalContext::traps() const wontthrow
+    -> const PersistentStringMap<String> &
 {
   return m_traps;
 }
@@ -280,14 +281,37 @@ cold fn EvalContext::run_subshell_exit_trap() throws -> void
     }
 }
 
+pure fn EvalContext::variable_attributes(StringView name) const wontthrow
+    -> u8
+{
+  let const *attributes = m_variable_attributes.find(name);
+  return attributes == nullptr ? 0 : *attributes;
+}
+
+fn EvalContext::set_variable_attribute(StringView name,
+                                       variable_attribute attribute,
+                                       bool is_set) throws -> void
+{
+  let const previous = variable_attributes(name);
+  let const bit = static_cast<u8>(attribute);
+  let const updated = static_cast<u8>(is_set ? previous | bit : previous & ~bit);
+  if (updated == previous) return;
+  /* A name with no mark left gives its record back, so the table holds only
+     the marked names. */
+  if (updated == 0)
+    m_variable_attributes.erase(name);
+  else
+    m_variable_attributes.set(name, updated);
+}
+
 fn EvalContext::mark_readonly(StringView name) throws -> void
 {
-  m_readonly_names.add(name);
+  set_variable_attribute(name, variable_attribute::Readonly, true);
 }
 
 fn EvalContext::unmark_readonly(StringView name) throws -> void
 {
-  m_readonly_names.remove(name);
+  set_variable_attribute(name, variable_attribute::Readonly, false);
 }
 
 fn EvalContext::is_readonly(StringView name) const wontthrow -> bool
@@ -295,17 +319,21 @@ fn EvalContext::is_readonly(StringView name) const wontthrow -> bool
   if (restricted_enforcement_active())
     for (let const restricted_name : RESTRICTED_READONLY_NAMES)
       if (name == restricted_name) return true;
-  return m_readonly_names.contains(name);
+  return (variable_attributes(name) &
+          static_cast<u8>(variable_attribute::Readonly)) != 0;
 }
 
 fn EvalContext::readonly_names() const throws -> ArrayList<String>
 {
   let out = ArrayList<String>{heap_allocator()};
-  out.reserve(m_readonly_names.count() + countof(RESTRICTED_READONLY_NAMES));
-  m_readonly_names.for_each([&](StringView name) { out.push_managed(name); });
+  m_variable_attributes.for_each([&](StringView name, const u8 &attributes) {
+    if ((attributes & static_cast<u8>(variable_attribute::Readonly)) != 0)
+      out.push_managed(name);
+  });
   if (restricted_enforcement_active())
     for (let const restricted_name : RESTRICTED_READONLY_NAMES)
-      if (!m_readonly_names.contains(restricted_name))
+      if ((variable_attributes(restricted_name) &
+           static_cast<u8>(variable_attribute::Readonly)) == 0)
         out.push_managed(restricted_name);
   out.sort();
   return out;
@@ -313,17 +341,18 @@ fn EvalContext::readonly_names() const throws -> ArrayList<String>
 
 fn EvalContext::mark_integer(StringView name) throws -> void
 {
-  m_integer_names.add(name);
+  set_variable_attribute(name, variable_attribute::Integer, true);
 }
 
 fn EvalContext::unmark_integer(StringView name) throws -> void
 {
-  m_integer_names.remove(name);
+  set_variable_attribute(name, variable_attribute::Integer, false);
 }
 
 fn EvalContext::is_integer_variable(StringView name) const wontthrow -> bool
 {
-  return m_integer_names.contains(name);
+  return (variable_attributes(name) &
+          static_cast<u8>(variable_attribute::Integer)) != 0;
 }
 
 fn EvalContext::append_integer_expression(String &joined,
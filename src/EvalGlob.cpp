@@ -36,6 +36,46 @@ fn name_matches_glob(StringView glob, StringView filename,
 
 } // namespace
 
+static constexpr usize GLOB_CACHE_CAP = 128;
+
+fn EvalContext::cached_glob_program(StringView glob, const Bitset &glob_active,
+                                    usize mask_offset, bool fold_case) throws
+    -> const GlobProgram &
+{
+  let const extglob = extglob_enabled();
+  let key = String{scratch_allocator()};
+  key.reserve(2 * glob.length + 2);
+  key += extglob ? 'x' : '-';
+  key += fold_case ? 'i' : 's';
+  key += glob;
+  for (usize i = 0; i < glob.length; i++)
+    key += glob_active[mask_offset + i] ? '1' : '0';
+
+  if (const GlobProgram *cached = m_glob_cache.find(key.view());
+      cached != nullptr)
+    return *cached;
+
+  if (m_glob_cache.count() >= GLOB_CACHE_CAP) {
+    LOG(Debug, "glob cache full, dropping %zu compiled patterns",
+        m_glob_cache.count());
+    m_glob_cache.clear();
+  }
+
+  LOG(All, "glob cache miss, compiling the pattern '%.*s'",
+      static_cast<int>(glob.length), glob.data);
+  m_glob_cache.set(key.view(),
+                   GlobProgram::compile(glob, glob_active, mask_offset, extglob,
+                                        fold_case, heap_allocator()));
+  return *m_glob_cache.find(key.view());
+}
+
+fn EvalContext::glob_matcher(StringView glob, const Bitset &glob_active) throws
+    -> GlobMatcher
+{
+  return GlobMatcher{cached_glob_program(glob, glob_active, 0, false), glob,
+                     glob_active, extglob_enabled()};
+}
+
 fn EvalContext::expand_path_once(const glob_field &field,
                                  bool should_expand_files) throws
     -> ArrayList<glob_field>
@@ -107,6 +147,10 @@ fn EvalContext::expand_path_once(const glob_field &field,
       lowered_glob += utils::ascii_to_lower(glob[i]);
   }
   let const match_glob = nocaseglob_is_on ? lowered_glob.view() : glob;
+  /* One program serves every entry, folding case itself, so only a pattern
+     left to the interpreter lowers the names one by one. */
+  let const &program = cached_glob_program(match_glob, field.glob_active,
+                                           stem_start, nocaseglob_is_on);
 
   for (let const &entry_name : *entries) {
     let const filename = entry_name.view();
@@ -126,8 +170,11 @@ fn EvalContext::expand_path_once(const glob_field &field,
       continue;
     }
 
-    if (name_matches_glob(match_glob, filename, field.glob_active, stem_start,
-                          extglob_enabled(), nocaseglob_is_on, scratch))
+    if (program.is_compiled()
+            ? program.matches(filename)
+            : name_matches_glob(match_glob, filename, field.glob_active,
+                                stem_start, extglob_enabled(), nocaseglob_is_on,
+                                scratch))
     {
       add_expansion();
 
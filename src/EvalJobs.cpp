@@ -22,6 +22,7 @@ fn EvalContext::register_job(os::process pid, StringView command,
   new_job.process_group_id = process_group_id;
   new_job.command = command;
   new_job.state = job::State::Running;
+  index_job_process(pid, new_job.id);
   m_jobs.push(steal(new_job));
   ASSERT(!m_jobs.is_empty());
   LOG(Info, "registered job %d", m_jobs.back().id);
@@ -42,12 +43,14 @@ fn EvalContext::register_pipeline_job(const ArrayList<os::process> &processes,
   bool did_skip_primary = false;
 
   for (let const process : processes) {
+    index_job_process(process, new_job.id);
     if (!did_skip_primary && process == primary_process) {
       did_skip_primary = true;
       continue;
     }
     new_job.earlier_pipeline_processes.push(process);
   }
+  if (!did_skip_primary) index_job_process(primary_process, new_job.id);
 
   m_jobs.push(steal(new_job));
   ASSERT(!m_jobs.is_empty());
@@ -72,7 +75,26 @@ fn EvalContext::notify_stopped_job(i32 id, StringView command) throws -> void
               String{command} + "\n");
 }
 
-static fn poll_owned_processes(ArrayList<os::process> &processes) wontthrow
+static constexpr i32 DETACHED_JOB_ID = 0;
+
+static fn process_index_key(const i64 &id) wontthrow -> StringView
+{
+  return StringView{reinterpret_cast<const char *>(&id), sizeof id};
+}
+
+fn EvalContext::index_job_process(os::process p, i32 id) throws -> void
+{
+  let const process_id = os::process_id_of(p);
+  m_job_process_index.set(process_index_key(process_id), id);
+}
+
+fn EvalContext::unindex_job_process(os::process p) throws -> void
+{
+  let const process_id = os::process_id_of(p);
+  m_job_process_index.erase(process_index_key(process_id));
+}
+
+fn EvalContext::poll_job_processes(ArrayList<os::process> &processes) throws
     -> Maybe<i32>
 {
   let stopped_status = Maybe<i32>{None};
@@ -80,67 +102,118 @@ static fn poll_owned_processes(ArrayList<os::process> &processes) wontthrow
        process_position--)
   {
     i32 status = 0;
-    let const state = os::poll_process(processes[process_position - 1], status);
-    if (state == os::process_state::Exited)
+    let const process = processes[process_position - 1];
+    let const state = os::poll_process(process, status);
+    if (state == os::process_state::Exited) {
+      unindex_job_process(process);
       processes.remove(process_position - 1);
-    else if (state == os::process_state::Stopped)
+    } else if (state == os::process_state::Stopped) {
       stopped_status = status;
+    }
   }
 
   return stopped_status;
 }
 
-fn EvalContext::update_jobs() throws -> void
+fn EvalContext::update_job(job &job) throws -> void
 {
-  unused(poll_owned_processes(m_detached_job_processes));
+  if (job.state == job::State::Done) return;
 
-  for (job &job : m_jobs) {
-    if (job.state == job::State::Done) continue;
+  let const earlier_stopped_status =
+      poll_job_processes(job.earlier_pipeline_processes);
+  if (earlier_stopped_status.has_value()) {
+    if (job.state != job::State::Stopped)
+      job.has_unreported_state_change = true;
+    job.state = job::State::Stopped;
+    job.stopped_status = *earlier_stopped_status;
+  }
 
-    let const earlier_stopped_status =
-        poll_owned_processes(job.earlier_pipeline_processes);
-    if (earlier_stopped_status.has_value()) {
+  if (job.is_primary_process_active) {
+    i32 status = 0;
+    let const state = os::poll_process(job.pid, status);
+    switch (state) {
+    case os::process_state::Exited:
+      unindex_job_process(job.pid);
+      job.is_primary_process_active = false;
+      job.last_status = status;
+      break;
+    case os::process_state::Stopped:
       if (job.state != job::State::Stopped)
         job.has_unreported_state_change = true;
       job.state = job::State::Stopped;
-      job.stopped_status = *earlier_stopped_status;
-    }
-
-    if (job.is_primary_process_active) {
-      i32 status = 0;
-      let const state = os::poll_process(job.pid, status);
-      switch (state) {
-      case os::process_state::Exited:
-        job.is_primary_process_active = false;
-        job.last_status = status;
-        break;
-      case os::process_state::Stopped:
-        if (job.state != job::State::Stopped)
+      job.stopped_status = status;
+      break;
+    case os::process_state::Running:
+      if (!earlier_stopped_status.has_value()) {
+        if (job.state != job::State::Running)
           job.has_unreported_state_change = true;
-        job.state = job::State::Stopped;
-        job.stopped_status = status;
-        break;
-      case os::process_state::Running:
-        if (!earlier_stopped_status.has_value()) {
-          if (job.state != job::State::Running)
-            job.has_unreported_state_change = true;
-          job.state = job::State::Running;
-        }
-        break;
-      case os::process_state::Unchanged: break;
+        job.state = job::State::Running;
       }
+      break;
+    case os::process_state::Unchanged: break;
     }
+  }
 
-    if (!job.is_primary_process_active &&
-        job.earlier_pipeline_processes.is_empty())
-    {
-      LOG(Info, "job %d finished with status %d", job.id, job.last_status);
-      job.state = job::State::Done;
-      job.has_unreported_state_change = true;
+  if (!job.is_primary_process_active &&
+      job.earlier_pipeline_processes.is_empty())
+  {
+    LOG(Info, "job %d finished with status %d", job.id, job.last_status);
+    job.state = job::State::Done;
+    job.has_unreported_state_change = true;
+    m_finished_job_ids.push(job.id);
+  }
+}
+
+/* Reap the children the kernel holds a report for, one at a time, through the
+   index. False when a report belongs to a child the table does not own, say a
+   foreground process not yet waited for, which the peek cannot step past, so
+   the caller has to poll every job instead. */
+fn EvalContext::update_reported_jobs() throws -> bool
+{
+  let previous_process_id = Maybe<i64>{None};
+  loop
+  {
+    let const process_id = os::peek_child_report();
+    if (!process_id.has_value()) return true;
+    /* A report that survived its own poll was not ours to consume. */
+    if (previous_process_id.has_value() && *previous_process_id == *process_id)
+      return false;
+    previous_process_id = *process_id;
+
+    let const *id = m_job_process_index.find(process_index_key(*process_id));
+    if (id == nullptr) return false;
+
+    if (*id == DETACHED_JOB_ID) {
+      unused(poll_job_processes(m_detached_job_processes));
+      continue;
     }
+    job *const owner = find_job(*id);
+    if (owner == nullptr || owner->state == job::State::Done) return false;
+    update_job(*owner);
   }
 }
 
+fn EvalContext::update_jobs() throws -> void
+{
+  if constexpr (os::HAS_CHILD_STATE_CHANGE_WAIT) {
+    /* Read before any reaping, so a SIGCHLD that lands during this update
+       still makes the next one look. */
+    let const generation = os::CHILD_STATE_GENERATION;
+    if (m_has_updated_jobs && generation == m_updated_child_generation) return;
+    m_updated_child_generation = generation;
+    m_has_updated_jobs = true;
+
+    /* A forked subshell inherits jobs that are not its children, which only a
+       poll of each one marks done. */
+    if (!os::is_child_process() && update_reported_jobs()) return;
+  }
+
+  LOG(Debug, "polling every job of %zu", m_jobs.count());
+  unused(poll_job_processes(m_detached_job_processes));
+  for (job &job : m_jobs)
+    update_job(job);
+}
+
 fn EvalContext::wait_for_job_processes(job &job, bool *was_stopped) throws
     -> i32
 {
@@ -186,6 +259,7 @@ fn EvalContext::wait_for_job_processes(job &job, bool *was_stopped) throws
     }
 
     if (fallback_process == job.pid) {
+      unindex_job_process(fallback_process);
       job.last_status = process_status;
       job.is_primary_process_active = false;
     } else {
@@ -195,6 +269,7 @@ fn EvalContext::wait_for_job_processes(job &job, bool *was_stopped) throws
         if (job.earlier_pipeline_processes[process_position - 1] !=
             fallback_process)
           continue;
+        unindex_job_process(fallback_process);
         job.earlier_pipeline_processes.remove(process_position - 1);
         break;
       }
@@ -204,6 +279,7 @@ fn EvalContext::wait_for_job_processes(job &job, bool *was_stopped) throws
         job.earlier_pipeline_processes.is_empty())
     {
       job.state = job::State::Done;
+      m_finished_job_ids.push(job.id);
       if (was_stopped != nullptr) *was_stopped = false;
       return job.last_status;
     }
@@ -214,8 +290,17 @@ fn EvalContext::jobs() wontthrow -> ArrayList<job> & { return m_jobs; }
 
 fn EvalContext::find_job(i32 id) wontthrow -> job *
 {
-  for (job &job : m_jobs)
-    if (job.id == id) return &job;
+  usize low = 0;
+  usize high = m_jobs.count();
+  while (low < high) {
+    let const middle = low + (high - low) / 2;
+    if (m_jobs[middle].id < id) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low < m_jobs.count() && m_jobs[low].id == id) return &m_jobs[low];
   return nullptr;
 }
 
@@ -283,6 +368,28 @@ fn EvalContext::forget_done_jobs() throws -> void
   LOG(Debug, "dropping finished jobs, keeping %zu of %zu", kept.count(),
       m_jobs.count());
   m_jobs = steal(kept);
+  m_finished_job_ids.clear();
+}
+
+fn EvalContext::take_finished_job(const ArrayList<i32> &candidates) throws
+    -> Maybe<i32>
+{
+  usize position = 0;
+  while (position < m_finished_job_ids.count()) {
+    let const id = m_finished_job_ids[position];
+    let is_candidate = candidates.is_empty();
+    for (let const candidate : candidates)
+      if (candidate == id) is_candidate = true;
+    if (!is_candidate) {
+      position++;
+      continue;
+    }
+
+    m_finished_job_ids.remove(position);
+    /* A job forgotten since it finished leaves a stale id behind. */
+    if (find_job(id) != nullptr) return id;
+  }
+  return None;
 }
 
 fn EvalContext::remove_job(i32 id) throws -> bool
@@ -303,10 +410,14 @@ fn EvalContext::remove_job(i32 id) throws -> bool
   m_detached_job_processes.reserve(m_detached_job_processes.count() +
                                    detached_count);
 
-  if (removed.is_primary_process_active)
+  if (removed.is_primary_process_active) {
     m_detached_job_processes.push(removed.pid);
-  for (let const process : removed.earlier_pipeline_processes)
+    index_job_process(removed.pid, DETACHED_JOB_ID);
+  }
+  for (let const process : removed.earlier_pipeline_processes) {
     m_detached_job_processes.push(process);
+    index_job_process(process, DETACHED_JOB_ID);
+  }
   for (usize position = 0; position < m_jobs.count(); position++)
     if (position != *removed_index) kept.push(steal(m_jobs[position]));
 
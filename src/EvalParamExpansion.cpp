@@ -31,45 +31,18 @@ enum class trim_end
   Suffix,
 };
 
-/* The active mask marks which pattern bytes may act as glob metacharacters, so
-   a quoted or escaped * or ? matches itself. */
+/* The matcher reads the prefix or suffix lengths in one pass over the value
+   when its pattern compiled, rather than a glob match per candidate length. */
 fn trim_matching(Allocator result_allocator, StringView value,
-                 StringView pattern, const Bitset &active, trim_end end,
-                 bool longest, bool extglob_enabled) throws -> String
+                 const GlobMatcher &matcher, trim_end end, bool longest) throws
+    -> String
 {
-  ASSERT(active.count() == pattern.length);
-
   if (end == trim_end::Prefix) {
-    if (longest) {
-      for (usize length = value.length;; length--) {
-        if (utils::glob_matches(pattern, value.substring_of_length(0, length),
-                                active, 0, extglob_enabled))
-          return String{result_allocator, value.substring(length)};
-        if (length == 0) break;
-      }
-    } else {
-      for (usize length = 0; length <= value.length; length++) {
-        if (utils::glob_matches(pattern, value.substring_of_length(0, length),
-                                active, 0, extglob_enabled))
-          return String{result_allocator, value.substring(length)};
-      }
-    }
-
+    if (let const length = matcher.match_prefix(value, longest))
+      return String{result_allocator, value.substring(*length)};
   } else {
-    if (longest) {
-      for (usize start = 0; start <= value.length; start++) {
-        if (utils::glob_matches(pattern, value.substring(start), active, 0,
-                                extglob_enabled))
-          return String{result_allocator, value.substring_of_length(0, start)};
-      }
-    } else {
-      for (usize start = value.length;; start--) {
-        if (utils::glob_matches(pattern, value.substring(start), active, 0,
-                                extglob_enabled))
-          return String{result_allocator, value.substring_of_length(0, start)};
-        if (start == 0) break;
-      }
-    }
+    if (let const start = matcher.match_suffix(value, longest))
+      return String{result_allocator, value.substring_of_length(0, *start)};
   }
   return String{result_allocator, value};
 }
@@ -77,16 +50,21 @@ fn trim_matching(Allocator result_allocator, StringView value,
 static fn
 trim_value_with_modifier(EvalContext &cxt, StringView value, StringView word,
                          trim_end end, bool longest,
-                         const SourceLocation *source_location = nullptr) throws
+                         const SourceLocation *source_location = nullptr,
+                         const modifier_word_program *program = nullptr) throws
     -> String
 {
   LOG(All, "trimming a value of %zu bytes with the pattern word '%.*s'",
       value.length, static_cast<int>(word.length), word.data);
   let active = Bitset{cxt.scratch_allocator()};
   let const pattern =
-      cxt.expand_modifier_word_masked(word, active, true, source_location);
-  return trim_matching(cxt.scratch_allocator(), value, pattern.view(), active,
-                       end, longest, cxt.extglob_enabled());
+      program != nullptr
+          ? cxt.run_modifier_word(*program, &active, source_location)
+          : cxt.expand_modifier_word_masked(word, active, true,
+                                            source_location);
+  ASSERT(active.count() == pattern.length());
+  return trim_matching(cxt.scratch_allocator(), value,
+                       cxt.glob_matcher(pattern.view(), active), end, longest);
 }
 
 } // namespace
@@ -107,25 +85,36 @@ fn EvalContext::expand_modifier_word_masked(
                                      false, source_location);
 }
 
-fn EvalContext::expand_modifier_word_worker(
-    StringView word, Bitset *active_out, bool remove_quotes,
-    bool is_pattern_word, bool strip_escaped_literals,
-    const SourceLocation *source_location) throws -> String
+/* Take a modifier word apart into literal runs and the expansions inside it,
+   so running it later reads no quote or backslash again. Returns whether the
+   pieces depend on is_posix, which only a $'...' does. */
+static fn parse_modifier_word(StringView word, bool remove_quotes,
+                              bool is_pattern_word, bool strip_escaped_literals,
+                              bool is_posix, modifier_word_program &program,
+                              Allocator allocator) throws -> bool
 {
-  LOG(All, "expanding a modifier word of %zu bytes", word.length);
-  let out = String{scratch_allocator()};
-
-  let const do_emit_byte = [&](char byte, bool is_active) {
-    out += byte;
-    if (active_out != nullptr) active_out->push(is_active);
-  };
-
-  let do_emit_run = [&](StringView bytes, bool is_active) {
-    out.append(bytes);
-    if (active_out != nullptr) {
-      for (usize k = 0; k < bytes.length; k++)
-        active_out->push(is_active);
+  using piece_kind = modifier_word_piece::piece_kind;
+
+  let depends_on_mood = false;
+  let const do_emit_byte = [&](char byte, bool is_active) throws {
+    if (!program.pieces.is_empty()) {
+      let &last = program.pieces.back();
+      if (last.kind == piece_kind::Literal && last.is_active == is_active) {
+        last.text += byte;
+        return;
+      }
     }
+    let text = String{allocator};
+    text += byte;
+    program.pieces.push(
+        modifier_word_piece{piece_kind::Literal, is_active, 0, 0, steal(text)});
+  };
+  let const do_emit_piece = [&](piece_kind kind, usize offset, usize length,
+                                String text, bool is_active) throws {
+    program.pieces.push(modifier_word_piece{kind, is_active,
+                                            static_cast<u32>(offset),
+                                            static_cast<u32>(length),
+                                            steal(text)});
   };
 
   let is_in_single_quote = false;
@@ -179,7 +168,7 @@ fn EvalContext::expand_modifier_word_worker(
     if (word[i] == '`') {
       /* The POSIX backquote unescaping strips a backslash before a backtick, a
          dollar sign, or another backslash. */
-      let inner = String{scratch_allocator()};
+      let inner = String{allocator};
       usize j = i + 1;
       for (; j < word.length; j++) {
         if (word[j] == '\\' && j + 1 < word.length &&
@@ -192,14 +181,8 @@ fn EvalContext::expand_modifier_word_worker(
         if (word[j] == '`') break;
         inner += word[j];
       }
-      let call_site = SourceLocation{};
-      const SourceLocation *call_site_pointer = nullptr;
-      if (source_location != nullptr) {
-        call_site = source_location->subspan(i, j - i + (j < word.length));
-        call_site_pointer = &call_site;
-      }
-      do_emit_run(capture_command_substitution(inner, None, call_site_pointer),
-                  !is_in_double_quote);
+      do_emit_piece(piece_kind::Command, i, j - i + (j < word.length),
+                    steal(inner), !is_in_double_quote);
       i = j;
       continue;
     }
@@ -214,10 +197,10 @@ fn EvalContext::expand_modifier_word_worker(
     }
 
     let const next = word[i + 1];
-    if (next == '\'' && remove_quotes && !is_in_double_quote &&
-        !is_posix_mode())
-    {
-      let body = String{scratch_allocator()};
+    if (next == '\'' && remove_quotes && !is_in_double_quote)
+      depends_on_mood = true;
+    if (next == '\'' && remove_quotes && !is_in_double_quote && !is_posix) {
+      let body = String{allocator};
       usize j = i + 2;
       while (j < word.length && word[j] != '\'') {
         body.push(word[j]);
@@ -227,9 +210,10 @@ fn EvalContext::expand_modifier_word_worker(
         }
         j++;
       }
-      let decoded = String{scratch_allocator()};
+      let decoded = String{allocator};
       utils::decode_ansi_c_escapes(decoded, body.view());
-      do_emit_run(decoded.view(), false);
+      for (usize k = 0; k < decoded.length(); k++)
+        do_emit_byte(decoded.view()[k], false);
       i = j;
       continue;
     }
@@ -237,7 +221,7 @@ fn EvalContext::expand_modifier_word_worker(
       /* Scan the ${...} body to the matching } at brace depth one. A quote run
          or a backslash escape keeps its bytes literal so a } inside is never
          counted. */
-      let inner = String{scratch_allocator()};
+      let inner = String{allocator};
       usize j = i + 2;
       i32 depth = 1;
       char quote = 0;
@@ -331,35 +315,22 @@ fn EvalContext::expand_modifier_word_worker(
         inner += ch;
         j++;
       }
-      let inner_location = SourceLocation{};
-      const SourceLocation *inner_location_pointer = nullptr;
-      if (source_location != nullptr) {
-        inner_location = source_location->subspan(i + 2, inner.count());
-        inner_location_pointer = &inner_location;
-      }
-      do_emit_run(apply_parameter_expansion(inner, inner_location_pointer),
-                  !is_in_double_quote);
+      let const inner_length = inner.count();
+      do_emit_piece(piece_kind::Braced, i + 2, inner_length, steal(inner),
+                    !is_in_double_quote);
       i = j;
     } else if (lexer::is_variable_name_start(next)) {
-      let name = String{scratch_allocator()};
+      let name = String{allocator};
       usize j = i + 1;
       while (j < word.length && lexer::is_variable_name(word[j]))
         name += word[j++];
-      /* A nested reference obeys set -u the way a top level reference does. A
-         stored name resolves without the extra dynamic-value lookup and copy.
-       */
-      const String *stored = lookup_shell_variable(name);
-      if (stored == nullptr && !get_variable_value(name).has_value())
-        report_unset_reference(name);
-      if (stored != nullptr)
-        do_emit_run(stored->view(), !is_in_double_quote);
-      else
-        do_emit_run(expand_variable(name), !is_in_double_quote);
+      do_emit_piece(piece_kind::Variable, i, j - i, steal(name),
+                    !is_in_double_quote);
       i = j - 1;
     } else if (next == '(' && i + 2 < word.length && word[i + 2] == '(') {
       /* Arithmetic $((...)), scanned to the matching )). A quote run keeps its
          bytes literal so a ) inside a string does not count. */
-      let inner = String{scratch_allocator()};
+      let inner = String{allocator};
       usize j = i + 3;
       usize depth = 0;
       char quote = 0;
@@ -391,19 +362,14 @@ fn EvalContext::expand_modifier_word_worker(
         }
         inner += ch;
       }
-      let inner_location = SourceLocation{};
-      let const inner_source = word.substring_of_length(i + 3, inner.count());
-      do_emit_run(String::from(evaluate_arithmetic(
-                                   inner, source_location_for_subview(
-                                              source_location, word,
-                                              inner_source, inner_location)),
-                               scratch_allocator()),
-                  false);
+      let const inner_length = inner.count();
+      do_emit_piece(piece_kind::Arithmetic, i + 3, inner_length, steal(inner),
+                    false);
       i = j - 1;
     } else if (next == '(') {
       /* Command substitution $(...), scanned to the matching ). A quote run
          keeps its bytes literal so a ) inside a string does not close early. */
-      let inner = String{scratch_allocator()};
+      let inner = String{allocator};
       usize j = i + 2;
       usize depth = 1;
       char quote = 0;
@@ -433,35 +399,262 @@ fn EvalContext::expand_modifier_word_worker(
         }
         inner += ch;
       }
-      let call_site = SourceLocation{};
-      const SourceLocation *call_site_pointer = nullptr;
-      if (source_location != nullptr) {
-        call_site = source_location->subspan(i, j - i + (j < word.length));
-        call_site_pointer = &call_site;
-      }
-      do_emit_run(capture_command_substitution(inner, None, call_site_pointer),
-                  !is_in_double_quote);
+      do_emit_piece(piece_kind::Command, i, j - i + (j < word.length),
+                    steal(inner), !is_in_double_quote);
       i = j;
     } else if (next == '?' || next == '@' || next == '*' || next == '#' ||
                next == '$' || next == '!' || next == '-' ||
                lexer::is_number(next))
     {
-      let const special_name = StringView{&next, 1};
-      if (!get_variable_value(special_name).has_value())
-        report_unset_reference(special_name);
-      do_emit_run(expand_variable(special_name), !is_in_double_quote);
+      do_emit_piece(piece_kind::Variable, i, 2,
+                    String{allocator, StringView{&next, 1}},
+                    !is_in_double_quote);
       i++;
     } else {
       do_emit_byte('$', !is_in_double_quote);
     }
   }
+  return depends_on_mood;
+}
+
+/* Take apart the operand subwords of a planned body the way its form expands
+   them, the replacement operand starting at its leading slash. */
+static fn parse_operand_words(const parameter_expansion_plan &plan,
+                              StringView operand, bool is_posix,
+                              parameter_operand_words &words) throws -> void
+{
+  using form = parameter_expansion_plan::form;
+
+  let const allocator = heap_allocator();
+  let depends_on_mood = false;
+  switch (plan.kind) {
+  case form::Test:
+    depends_on_mood = parse_modifier_word(operand, true, false, true, is_posix,
+                                          words.first, allocator);
+    break;
+  case form::Trim:
+    depends_on_mood = parse_modifier_word(operand, true, true, false, is_posix,
+                                          words.first, allocator);
+    break;
+  case form::Replacement: {
+    let remainder = operand.substring(1);
+    if (!remainder.is_empty() &&
+        (remainder[0] == '/' || remainder[0] == '#' || remainder[0] == '%'))
+      remainder = remainder.substring(1);
+    let const separator = usize{plan.separator};
+    depends_on_mood = parse_modifier_word(
+        remainder.substring_of_length(0, separator), true, true, false,
+        is_posix, words.first, allocator);
+    if (separator < remainder.length) {
+      words.has_second = true;
+      depends_on_mood |= parse_modifier_word(remainder.substring(separator + 1),
+                                             true, false, false, is_posix,
+                                             words.second, allocator);
+    }
+    break;
+  }
+  default: break;
+  }
+  if (depends_on_mood)
+    words.status = parameter_operand_words::state::Unparseable;
+}
+
+fn EvalContext::expand_modifier_word_worker(
+    StringView word, Bitset *active_out, bool remove_quotes,
+    bool is_pattern_word, bool strip_escaped_literals,
+    const SourceLocation *source_location) throws -> String
+{
+  LOG(All, "expanding a modifier word of %zu bytes", word.length);
+  let program = modifier_word_program{scratch_allocator()};
+  parse_modifier_word(word, remove_quotes, is_pattern_word,
+                      strip_escaped_literals, is_posix_mode(), program,
+                      scratch_allocator());
+  return run_modifier_word(program, active_out, source_location);
+}
+
+fn EvalContext::run_modifier_word(const modifier_word_program &program,
+                                  Bitset *active_out,
+                                  const SourceLocation *source_location) throws
+    -> String
+{
+  using piece_kind = modifier_word_piece::piece_kind;
+
+  let out = String{scratch_allocator()};
+  let const do_emit_run = [&](StringView bytes, bool is_active) {
+    out.append(bytes);
+    if (active_out != nullptr) {
+      for (usize k = 0; k < bytes.length; k++)
+        active_out->push(is_active);
+    }
+  };
+
+  for (let const &piece : program.pieces) {
+    let piece_location = SourceLocation{};
+    const SourceLocation *piece_location_pointer = nullptr;
+    if (source_location != nullptr && piece.kind != piece_kind::Literal) {
+      piece_location = source_location->subspan(piece.offset, piece.length);
+      piece_location_pointer = &piece_location;
+    }
+
+    switch (piece.kind) {
+    case piece_kind::Literal:
+      do_emit_run(piece.text.view(), piece.is_active);
+      break;
+    case piece_kind::Variable: {
+      /* A nested reference obeys set -u the way a top level reference does.
+         The value is emitted straight from where it lives, in one lookup. */
+      let storage = borrowed_value_storage{};
+      let const value = borrow_variable_value(piece.text.view(), storage);
+      if (!value.has_value()) report_unset_reference(piece.text.view());
+      do_emit_run(value.value_or(StringView{}), piece.is_active);
+      break;
+    }
+    case piece_kind::Braced:
+      do_emit_run(apply_parameter_expansion(piece.text.view(),
+                                            piece_location_pointer),
+                  piece.is_active);
+      break;
+    case piece_kind::Arithmetic:
+      do_emit_run(
+          String::from(evaluate_arithmetic(piece.text.view(),
+                                           piece_location_pointer),
+                       scratch_allocator()),
+          piece.is_active);
+      break;
+    case piece_kind::Command:
+      do_emit_run(capture_command_substitution(piece.text.view(), None,
+                                               piece_location_pointer),
+                  piece.is_active);
+      break;
+    }
+  }
   return out;
 }
 
+/* The operator half of a plan, shared by the planner and by a subscripted form
+   that falls through to a plain operator on its name. */
+static fn plan_parameter_operator(StringView name, StringView rest) wontthrow
+    -> parameter_expansion_plan
+{
+  using form = parameter_expansion_plan::form;
+
+  let plan = parameter_expansion_plan{};
+  plan.name_length = static_cast<u32>(name.length);
+  plan.operand_offset = static_cast<u32>(name.length);
+  if (rest.is_empty()) {
+    plan.kind = form::Plain;
+    return plan;
+  }
+
+  /* A leading colon makes the test forms treat an empty value as unset. */
+  plan.is_colon_form = rest[0] == ':';
+  const usize op_index = plan.is_colon_form ? 1 : 0;
+  if (op_index >= rest.length) {
+    plan.kind = form::Unchecked;
+    return plan;
+  }
+  plan.op = rest[op_index];
+
+  let const is_positional_list = name == "@" || name == "*";
+  if (!is_positional_list) {
+    if (plan.is_colon_form && !is_colon_modifier_operator(plan.op)) {
+      plan.kind = form::Substring;
+      plan.operand_offset++;
+      plan.separator = static_cast<u32>(
+          find_substring_length_separator(rest.substring(1)));
+      return plan;
+    }
+    if (!plan.is_colon_form && plan.op == '/') {
+      /* The slash is found past the anchor, the way pattern_replace_value
+         reads the operand. */
+      StringView remainder = rest.substring(1);
+      if (!remainder.is_empty() &&
+          (remainder[0] == '/' || remainder[0] == '#' || remainder[0] == '%'))
+        remainder = remainder.substring(1);
+      plan.kind = form::Replacement;
+      plan.separator =
+          static_cast<u32>(find_replacement_separator(remainder));
+      return plan;
+    }
+    if (!plan.is_colon_form &&
+        (plan.op == '^' || plan.op == ',' || plan.op == '~'))
+    {
+      plan.kind = form::CaseModification;
+      return plan;
+    }
+    if (!plan.is_colon_form && plan.op == '@' && rest.length >= 2) {
+      plan.kind = form::Transform;
+      plan.operand_offset++;
+      return plan;
+    }
+  }
+
+  plan.is_doubled = op_index + 1 < rest.length &&
+                    rest[op_index + 1] == plan.op &&
+                    (plan.op == '#' || plan.op == '%');
+  plan.operand_offset += static_cast<u32>(op_index + (plan.is_doubled ? 2 : 1));
+  switch (plan.op) {
+  case '-':
+  case '=':
+  case '+':
+  case '?': plan.kind = form::Test; break;
+  case '#':
+  case '%': plan.kind = form::Trim; break;
+  default: plan.kind = form::Unchecked; break;
+  }
+  return plan;
+}
+
+fn plan_parameter_expansion(StringView spec) wontthrow
+    -> parameter_expansion_plan
+{
+  using form = parameter_expansion_plan::form;
+
+  let general = parameter_expansion_plan{};
+  general.kind = form::General;
+  if (spec.is_empty()) return general;
+  if (spec.length > 1 && (spec[0] == '!' || spec[0] == '#')) return general;
+
+  usize name_end = 0;
+  if (lexer::is_variable_name_start(spec[0])) {
+    while (name_end < spec.length && lexer::is_variable_name(spec[name_end]))
+      name_end++;
+  } else if (lexer::is_number(spec[0])) {
+    while (name_end < spec.length && lexer::is_number(spec[name_end]))
+      name_end++;
+  } else {
+    name_end = 1;
+  }
+
+  let const name = spec.substring_of_length(0, name_end);
+  let const rest = spec.substring(name_end);
+  if (!rest.is_empty() && rest[0] == '[' &&
+      lexer::is_variable_name_start(name[0]))
+    return general;
+
+  return plan_parameter_operator(name, rest);
+}
+
+fn EvalContext::expand_parameter_segment(const WordSegment &segment) throws
+    -> String
+{
+  if (segment.expansion_plan.kind == parameter_expansion_plan::form::Unplanned)
+    segment.expansion_plan = plan_parameter_expansion(segment.text.view());
+  let const source_location =
+      segment.get_source_location(m_current_location.filename);
+  return apply_parameter_expansion(
+      segment.text.view(),
+      source_location.has_value() ? &*source_location : nullptr, 0,
+      &segment.expansion_plan, &segment.operand_cache);
+}
+
 hot fn EvalContext::apply_parameter_expansion(
     StringView spec, const SourceLocation *source_location,
-    usize source_location_offset) throws -> String
+    usize source_location_offset, const parameter_expansion_plan *cached_plan,
+    parameter_operand_cache *operand_cache) throws -> String
 {
+  using form = parameter_expansion_plan::form;
+
   LOG(All, "applying the parameter expansion '${%.*s}'",
       static_cast<int>(spec.length), spec.data);
 
@@ -483,277 +676,318 @@ hot fn EvalContext::apply_parameter_expansion(
 
   if (spec.is_empty()) return String{scratch_allocator()};
 
-  /* ${!name} indirection, or a prefix listing when it ends with * or @. */
-  if (spec.length > 1 && spec[0] == '!') {
-    let const body = spec.substring(1);
-    /* A modifier after the name applies to the indirected value, the bare
-       trailing * and @ stay with the body as the prefix-listing forms. */
-    usize name_end = 0;
-    while (name_end < body.length && lexer::is_variable_name(body[name_end]))
-      name_end++;
-    if (name_end > 0 && name_end < body.length && body[name_end] == '[') {
-      if (let const close = body.substring(name_end).find_character(']'))
-        name_end += *close + 1;
-    }
-    if (name_end > 0 && name_end < body.length &&
-        !(name_end == body.length - 1 &&
-          (body[name_end] == '*' || body[name_end] == '@')))
-    {
-      let const name = body.substring_of_length(0, name_end);
-      let const target = get_variable_value(name);
-      let const target_name = target.has_value() ? target->view() : name;
-      let const suffix = body.substring(name_end);
-      let rewritten = String{scratch_allocator()};
-      rewritten.reserve(target_name.length + suffix.length);
-      /* An unset indirection name stands in for the target so the modifier sees
-         the unset state, a fatal error would be harsher than bash. */
-      rewritten.append(target_name);
-      rewritten.append(suffix);
-      let suffix_location = SourceLocation{};
-      let const *suffix_location_pointer =
-          do_source_location_for(suffix, suffix_location);
-      return apply_parameter_expansion(
-          rewritten.view(), suffix_location_pointer, target_name.length);
+  let plan =
+      cached_plan != nullptr ? *cached_plan : plan_parameter_expansion(spec);
+  ASSERT(plan.kind != form::Unplanned);
+
+  if (plan.kind == form::General) {
+    /* ${!name} indirection, or a prefix listing when it ends with * or @. */
+    if (spec.length > 1 && spec[0] == '!') {
+      let const body = spec.substring(1);
+      /* A modifier after the name applies to the indirected value, the bare
+         trailing * and @ stay with the body as the prefix-listing forms. */
+      usize name_end = 0;
+      while (name_end < body.length && lexer::is_variable_name(body[name_end]))
+        name_end++;
+      if (name_end > 0 && name_end < body.length && body[name_end] == '[') {
+        if (let const close = body.substring(name_end).find_character(']'))
+          name_end += *close + 1;
+      }
+      if (name_end > 0 && name_end < body.length &&
+          !(name_end == body.length - 1 &&
+            (body[name_end] == '*' || body[name_end] == '@')))
+      {
+        let const name = body.substring_of_length(0, name_end);
+        let const target = get_variable_value(name);
+        let const target_name = target.has_value() ? target->view() : name;
+        let const suffix = body.substring(name_end);
+        let rewritten = String{scratch_allocator()};
+        rewritten.reserve(target_name.length + suffix.length);
+        /* An unset indirection name stands in for the target so the modifier
+           sees the unset state, a fatal error would be harsher than bash. */
+        rewritten.append(target_name);
+        rewritten.append(suffix);
+        let suffix_location = SourceLocation{};
+        let const *suffix_location_pointer =
+            do_source_location_for(suffix, suffix_location);
+        return apply_parameter_expansion(
+            rewritten.view(), suffix_location_pointer, target_name.length);
+      }
+      return apply_indirect_or_name_listing(body);
     }
-    return apply_indirect_or_name_listing(body);
-  }
 
-  if (spec.length > 1 && spec[0] == '#') {
-    let const name = spec.substring(1);
-    if (name == "@" || name == "*") {
-      return String::from(m_positional_params.count(), scratch_allocator());
-    }
+    if (spec.length > 1 && spec[0] == '#') {
+      let const name = spec.substring(1);
+      if (name == "@" || name == "*") {
+        return String::from(m_positional_params.count(), scratch_allocator());
+      }
 
-    /* ${#a[@]} is the element count, ${#a[i]} the length of one element. */
-    if (let const bracket = name.find_character('[');
-        bracket.has_value() && *bracket > 0 && name[name.length - 1] == ']' &&
-        lexer::is_variable_name_start(name[0]))
-    {
-      const StringView array_name = name.substring_of_length(0, *bracket);
-      const StringView subscript =
-          name.substring_of_length(*bracket + 1, name.length - *bracket - 2);
-      if (subscript == "@" || subscript == "*") {
-        if ((array_name == "FUNCNAME" || array_name == "BASH_LINENO") &&
-            bash_dynamic_variables_enabled()) [[unlikely]]
-        {
-          return String::from(funcname_frame_count(), scratch_allocator());
-        }
-        if (is_associative_array(array_name))
-          return String::from(associative_keys(array_name).count(),
-                              scratch_allocator());
-        if (lookup_indexed_array(array_name) != nullptr)
-          return String::from(collect_array_elements(array_name).count(),
+      /* ${#a[@]} is the element count, ${#a[i]} the length of one element. */
+      if (let const bracket = name.find_character('[');
+          bracket.has_value() && *bracket > 0 && name[name.length - 1] == ']' &&
+          lexer::is_variable_name_start(name[0]))
+      {
+        const StringView array_name = name.substring_of_length(0, *bracket);
+        const StringView subscript =
+            name.substring_of_length(*bracket + 1, name.length - *bracket - 2);
+        if (subscript == "@" || subscript == "*") {
+          if ((array_name == "FUNCNAME" || array_name == "BASH_LINENO") &&
+              bash_dynamic_variables_enabled()) [[unlikely]]
+          {
+            return String::from(funcname_frame_count(), scratch_allocator());
+          }
+          if (is_associative_array(array_name))
+            return String::from(associative_keys(array_name).count(),
+                                scratch_allocator());
+          if (lookup_indexed_array(array_name) != nullptr)
+            return String::from(collect_array_elements(array_name).count(),
+                                scratch_allocator());
+          return String::from(is_variable_set(array_name) ? 1 : 0,
                               scratch_allocator());
-        return String::from(get_variable_value(array_name).has_value() ? 1 : 0,
-                            scratch_allocator());
+        }
+        let subscript_location = SourceLocation{};
+        return String::from(
+            apply_array_subscript(
+                array_name, subscript,
+                do_source_location_for(subscript, subscript_location))
+                .length(),
+            scratch_allocator());
       }
-      let subscript_location = SourceLocation{};
-      return String::from(
-          apply_array_subscript(
-              array_name, subscript,
-              do_source_location_for(subscript, subscript_location))
-              .length(),
-          scratch_allocator());
-    }
 
-    if (let const *stored = lookup_shell_variable(name); stored != nullptr)
-      return String::from(stored->count(), scratch_allocator());
-    let const value = get_variable_value(name);
-    if (!value.has_value()) report_unset_reference(name);
-    return String::from(value.value_or(String{scratch_allocator()}).length(),
-                        scratch_allocator());
-  }
+      let storage = borrowed_value_storage{};
+      let const value = borrow_variable_value(name, storage);
+      if (!value.has_value()) report_unset_reference(name);
+      return String::from(value.value_or(StringView{}).length,
+                          scratch_allocator());
+    }
 
-  ASSERT(!spec.is_empty());
-  usize name_end = 0;
-  if (lexer::is_variable_name_start(spec[0])) {
+    ASSERT(!spec.is_empty());
+    usize name_end = 0;
+    if (lexer::is_variable_name_start(spec[0])) {
 #pragma clang loop unroll_count(4)
-    while (name_end < spec.length && lexer::is_variable_name(spec[name_end]))
-      name_end++;
-  } else if (lexer::is_number(spec[0])) {
+      while (name_end < spec.length && lexer::is_variable_name(spec[name_end]))
+        name_end++;
+    } else if (lexer::is_number(spec[0])) {
 #pragma clang loop unroll_count(4)
-    while (name_end < spec.length && lexer::is_number(spec[name_end]))
-      name_end++;
-  } else {
-    name_end = 1;
-  }
+      while (name_end < spec.length && lexer::is_number(spec[name_end]))
+        name_end++;
+    } else {
+      name_end = 1;
+    }
 
-  let const name = spec.substring_of_length(0, name_end);
-  let const rest = spec.substring(name_end);
+    let const name = spec.substring_of_length(0, name_end);
+    let const rest = spec.substring(name_end);
 
-  if (!rest.is_empty() && rest[0] == '[' && !name.is_empty() &&
-      lexer::is_variable_name_start(name[0]))
-  {
-    if (let const close = rest.find_character(']'); close.has_value()) {
-      const StringView subscript = rest.substring_of_length(1, *close - 1);
-      let subscript_location = SourceLocation{};
-      let const *subscript_location_pointer =
-          do_source_location_for(subscript, subscript_location);
-      if (*close + 1 == rest.length)
-        return apply_array_subscript(name, subscript,
-                                     subscript_location_pointer);
-      /* The / # % ^ , modifiers after the ] modify the one element, a different
-         modifier such as :- falls through to the general path. */
-      const StringView modifier = rest.substring(*close + 1);
-      let modifier_location = SourceLocation{};
-      let const *modifier_location_pointer =
-          do_source_location_for(modifier, modifier_location);
-      const char modifier_op = modifier.is_empty() ? '\0' : modifier[0];
-      if (subscript != "@" && subscript != "*" &&
-          (modifier_op == '/' || modifier_op == '#' || modifier_op == '%' ||
-           modifier_op == '^' || modifier_op == ','))
-      {
-        return apply_value_modifier(
-            apply_array_subscript(name, subscript, subscript_location_pointer)
-                .view(),
-            modifier, modifier_location_pointer);
-      }
-      if (subscript != "@" && subscript != "*" && !modifier.is_empty()) {
-        let const is_colon = modifier_op == ':';
-        let const after =
-            is_colon && modifier.length > 1 ? modifier[1] : modifier_op;
-        let const is_test_form = is_colon_modifier_operator(after);
-        if (is_colon && !is_test_form) {
-          let const substring_body = modifier.substring(1);
-          let substring_location = SourceLocation{};
-          return apply_substring_to_value(
+    if (!rest.is_empty() && rest[0] == '[' && !name.is_empty() &&
+        lexer::is_variable_name_start(name[0]))
+    {
+      if (let const close = rest.find_character(']'); close.has_value()) {
+        const StringView subscript = rest.substring_of_length(1, *close - 1);
+        let subscript_location = SourceLocation{};
+        let const *subscript_location_pointer =
+            do_source_location_for(subscript, subscript_location);
+        if (*close + 1 == rest.length)
+          return apply_array_subscript(name, subscript,
+                                       subscript_location_pointer);
+        /* The / # % ^ , modifiers after the ] modify the one element, a
+           different modifier such as :- falls through to the general path. */
+        const StringView modifier = rest.substring(*close + 1);
+        let modifier_location = SourceLocation{};
+        let const *modifier_location_pointer =
+            do_source_location_for(modifier, modifier_location);
+        const char modifier_op = modifier.is_empty() ? '\0' : modifier[0];
+        if (subscript != "@" && subscript != "*" &&
+            (modifier_op == '/' || modifier_op == '#' || modifier_op == '%' ||
+             modifier_op == '^' || modifier_op == ','))
+        {
+          return apply_value_modifier(
               apply_array_subscript(name, subscript, subscript_location_pointer)
                   .view(),
-              substring_body,
-              do_source_location_for(substring_body, substring_location));
+              modifier, modifier_location_pointer);
         }
-        if (is_test_form) {
-          let const element_is_set = array_element_is_set(name, subscript);
-          let const value =
-              element_is_set ? apply_array_subscript(name, subscript,
-                                                     subscript_location_pointer)
-                             : String{scratch_allocator()};
-          let const treat_as_unset =
-              is_colon ? value.is_empty() : !element_is_set;
-          let const word = modifier.substring(is_colon ? 2 : 1);
-          switch (after) {
-          case '-':
-            if (treat_as_unset) return do_expand_modifier_word(word);
-            return value;
-          case '+':
-            if (treat_as_unset) return String{scratch_allocator()};
-            return do_expand_modifier_word(word);
-          case '=': {
-            if (!treat_as_unset) return value;
-            let const assigned = do_expand_modifier_word(word);
-            assign_array_element(name, subscript, assigned.view(), false);
-            return assigned;
+        if (subscript != "@" && subscript != "*" && !modifier.is_empty()) {
+          let const is_colon = modifier_op == ':';
+          let const after =
+              is_colon && modifier.length > 1 ? modifier[1] : modifier_op;
+          let const is_test_form = is_colon_modifier_operator(after);
+          if (is_colon && !is_test_form) {
+            let const substring_body = modifier.substring(1);
+            let substring_location = SourceLocation{};
+            return apply_substring_to_value(
+                apply_array_subscript(name, subscript,
+                                      subscript_location_pointer)
+                    .view(),
+                substring_body,
+                do_source_location_for(substring_body, substring_location));
           }
-          case '?':
-            if (treat_as_unset) {
-              if (word.is_empty())
-                throw_script_fatal(
-                    "Unable to expand '" + name + "[" + subscript +
-                    "]' because the element is not set or is empty");
-              throw_script_fatal(do_expand_modifier_word(word));
+          if (is_test_form) {
+            let const element_is_set = array_element_is_set(name, subscript);
+            let const value =
+                element_is_set
+                    ? apply_array_subscript(name, subscript,
+                                            subscript_location_pointer)
+                    : String{scratch_allocator()};
+            let const treat_as_unset =
+                is_colon ? value.is_empty() : !element_is_set;
+            let const word = modifier.substring(is_colon ? 2 : 1);
+            switch (after) {
+            case '-':
+              if (treat_as_unset) return do_expand_modifier_word(word);
+              return value;
+            case '+':
+              if (treat_as_unset) return String{scratch_allocator()};
+              return do_expand_modifier_word(word);
+            case '=': {
+              if (!treat_as_unset) return value;
+              let const assigned = do_expand_modifier_word(word);
+              assign_array_element(name, subscript, assigned.view(), false);
+              return assigned;
+            }
+            case '?':
+              if (treat_as_unset) {
+                if (word.is_empty())
+                  throw_script_fatal(
+                      "Unable to expand '" + name + "[" + subscript +
+                      "]' because the element is not set or is empty");
+                throw_script_fatal(do_expand_modifier_word(word));
+              }
+              return value;
+            default: break;
             }
-            return value;
-          default: break;
           }
         }
       }
     }
+
+    /* A subscript with an operator this block does not take reads as a plain
+       operator on the name. */
+    plan = plan_parameter_operator(name, rest);
   }
 
-  if (rest.is_empty()) {
+  let const name = spec.substring_of_length(0, plan.name_length);
+  let const operand = spec.substring(plan.operand_offset);
+
+  /* The operand subwords of a segment's own plan are taken apart on its first
+     run and kept, a plan made here from General is not the segment's. */
+  parameter_operand_words *words = nullptr;
+  if (operand_cache != nullptr && cached_plan != nullptr &&
+      cached_plan->kind != form::General)
+  {
+    if (operand_cache->words == nullptr) {
+      let const allocator = heap_allocator();
+      let *fresh = allocator.alloc_array<parameter_operand_words>(1);
+      new (fresh) parameter_operand_words{};
+      operand_cache->words = fresh;
+      parse_operand_words(plan, operand, is_posix_mode(), *fresh);
+    }
+    if (operand_cache->words->status == parameter_operand_words::state::Parsed)
+      words = operand_cache->words;
+  }
+  let const do_expand_operand = [&](StringView word) throws -> String {
+    if (words == nullptr) return do_expand_modifier_word(word);
+    let word_location = SourceLocation{};
+    return run_modifier_word(words->first, nullptr,
+                             do_source_location_for(word, word_location));
+  };
+
+  switch (plan.kind) {
+  case form::Plain: {
     /* A plain reference reports under set -u, a modifier form such as ${x:-w}
-       handles the unset case itself. */
-    if (!get_variable_value(name).has_value()) report_unset_reference(name);
-    return expand_variable(name);
+       handles the unset case itself. The lookup borrows, but the segment's
+       result is an owned String, so the value is still copied once. */
+    let storage = borrowed_value_storage{};
+    let const value = borrow_variable_value(name, storage);
+    if (!value.has_value()) report_unset_reference(name);
+    return String{heap_allocator(), value.value_or(StringView{})};
   }
 
-  /* A leading colon makes the test forms treat an empty value as unset. */
-  let const is_colon_form = rest[0] == ':';
-  const usize op_index = is_colon_form ? 1 : 0;
-  if (op_index >= rest.length) return expand_variable(name);
+  case form::Unchecked: return expand_variable(name);
 
-  if (is_colon_form) {
-    const char after_colon = rest[op_index];
-    if (!is_colon_modifier_operator(after_colon) && name != "@" && name != "*")
-    {
-      let const substring_body = rest.substring(1);
-      let substring_location = SourceLocation{};
-      return apply_substring_expansion(
-          name, substring_body,
-          do_source_location_for(substring_body, substring_location));
-    }
+  case form::Substring: {
+    let operand_location = SourceLocation{};
+    return apply_substring_expansion(
+        name, operand, do_source_location_for(operand, operand_location),
+        usize{plan.separator}, words);
   }
 
-  if (!is_colon_form && rest[0] == '/' && name != "@" && name != "*") {
-    let rest_location = SourceLocation{};
+  case form::Replacement: {
+    let operand_location = SourceLocation{};
     return apply_pattern_replacement(
-        name, rest, do_source_location_for(rest, rest_location));
+        name, operand, do_source_location_for(operand, operand_location),
+        usize{plan.separator}, words);
   }
 
-  if (!is_colon_form && (rest[0] == '^' || rest[0] == ',' || rest[0] == '~') &&
-      name != "@" && name != "*")
-  {
-    let rest_location = SourceLocation{};
-    return apply_case_modification(name, rest,
-                                   do_source_location_for(rest, rest_location));
+  case form::CaseModification: {
+    let operand_location = SourceLocation{};
+    return apply_case_modification(
+        name, operand, do_source_location_for(operand, operand_location));
   }
 
-  if (!is_colon_form && rest[0] == '@' && rest.length >= 2 &&
-      mood() != mimic_mood::Posix && name != "@" && name != "*")
-  {
-    return apply_parameter_transform(name, rest[1]);
-  }
+  /* The POSIX mood has no transforms, so ${x@Q} reads as x. */
+  case form::Transform:
+    if (mood() == mimic_mood::Posix) return expand_variable(name);
+    return apply_parameter_transform(name, operand[0]);
 
-  let const op = rest[op_index];
-  let const is_doubled = (op_index + 1 < rest.length &&
-                          rest[op_index + 1] == op && (op == '#' || op == '%'));
-  let const word = rest.substring(op_index + (is_doubled ? 2 : 1));
+  case form::Test:
+  case form::Trim: break;
 
-  let current = get_variable_value(name);
+  case form::Unplanned:
+  case form::General: unreachable("The plan was not resolved");
+  }
+
+  /* The value is only borrowed, since the operators that do not return it,
+     ${x:+word} most of all, have no use for a copy. Expanding a word may write
+     the shell state, so a view is never kept across one. */
+  let storage = borrowed_value_storage{};
+  let const current = borrow_variable_value(name, storage);
   let const is_set = current.has_value();
   let const is_empty = !is_set || current->is_empty();
-  let const treat_as_unset = is_colon_form ? is_empty : !is_set;
+  let const treat_as_unset = plan.is_colon_form ? is_empty : !is_set;
 
-  switch (op) {
+  switch (plan.op) {
   case '-':
-    if (treat_as_unset) return do_expand_modifier_word(word);
+    if (treat_as_unset) return do_expand_operand(operand);
     ASSERT(current.has_value());
-    return steal(*current);
+    return String{heap_allocator(), *current};
   case '=':
     if (treat_as_unset) {
-      let const assigned = do_expand_modifier_word(word);
+      let const assigned = do_expand_operand(operand);
       set_shell_variable(name, assigned);
       return assigned;
     }
     ASSERT(current.has_value());
-    return steal(*current);
+    return String{heap_allocator(), *current};
   case '+':
     if (treat_as_unset) return String{scratch_allocator()};
-    return do_expand_modifier_word(word);
+    return do_expand_operand(operand);
   case '?':
     if (treat_as_unset) {
-      if (word.is_empty())
+      if (operand.is_empty())
         throw_script_fatal("Unable to expand '" + name +
                            "' because the parameter is not set or is empty");
-      throw_script_fatal(do_expand_modifier_word(word));
+      throw_script_fatal(do_expand_operand(operand));
     }
     ASSERT(current.has_value());
-    return steal(*current);
+    return String{heap_allocator(), *current};
 
   case '#': {
-    let word_location = SourceLocation{};
+    let operand_location = SourceLocation{};
+    let const value =
+        String{scratch_allocator(), current.value_or(StringView{})};
     return trim_value_with_modifier(
-        *this, current.value_or(String{scratch_allocator()}).view(), word,
-        trim_end::Prefix, is_doubled,
-        do_source_location_for(word, word_location));
+        *this, value.view(), operand, trim_end::Prefix, plan.is_doubled,
+        do_source_location_for(operand, operand_location),
+        words != nullptr ? &words->first : nullptr);
   }
 
   case '%': {
-    let word_location = SourceLocation{};
+    let operand_location = SourceLocation{};
+    let const value =
+        String{scratch_allocator(), current.value_or(StringView{})};
     return trim_value_with_modifier(
-        *this, current.value_or(String{scratch_allocator()}).view(), word,
-        trim_end::Suffix, is_doubled,
-        do_source_location_for(word, word_location));
+        *this, value.view(), operand, trim_end::Suffix, plan.is_doubled,
+        do_source_location_for(operand, operand_location),
+        words != nullptr ? &words->first : nullptr);
   }
 
   default: return expand_variable(name);
@@ -796,32 +1030,44 @@ fn EvalContext::get_variable_value_checked(StringView name) const throws
 }
 
 fn EvalContext::apply_substring_expansion(
-    StringView name, StringView body,
-    const SourceLocation *source_location) throws -> String
+    StringView name, StringView body, const SourceLocation *source_location,
+    Maybe<usize> planned_separator, parameter_operand_words *operand_words)
+    throws -> String
 {
   let const current = get_variable_value_checked(name);
   return apply_substring_to_value(
       current.value_or(String{scratch_allocator()}).view(), body,
-      source_location);
+      source_location, planned_separator, operand_words);
 }
 
 fn EvalContext::apply_substring_to_value(
-    StringView value, StringView body,
-    const SourceLocation *source_location) throws -> String
+    StringView value, StringView body, const SourceLocation *source_location,
+    Maybe<usize> planned_separator, parameter_operand_words *operand_words)
+    throws -> String
 {
   LOG(All, "taking the substring '%.*s' of a value of %zu bytes",
       static_cast<int>(body.length), body.data, value.length);
   const i64 value_length = static_cast<i64>(value.length);
 
-  let const separator = find_substring_length_separator(body);
+  let const separator = planned_separator.has_value()
+                             ? *planned_separator
+                             : find_substring_length_separator(body);
   let const offset_text = body.substring_of_length(0, separator);
-  let offset_location = SourceLocation{};
-  const i64 offset =
-      offset_text.is_empty()
-          ? 0
-          : evaluate_arithmetic(offset_text, source_location_for_subview(
-                                                 source_location, body,
-                                                 offset_text, offset_location));
+  /* With the operand words kept, the offset and the length compile once and
+     re-run. */
+  let const do_evaluate = [&](StringView text,
+                              arith_program *program) throws -> i64 {
+    if (text.is_empty()) return 0;
+    let text_location = SourceLocation{};
+    let const *text_location_pointer = source_location_for_subview(
+        source_location, body, text, text_location);
+    if (program == nullptr)
+      return evaluate_arithmetic(text, text_location_pointer);
+    return evaluate_arithmetic_cached_clause(
+        text, *program, text_location_pointer, text_location_pointer);
+  };
+  const i64 offset = do_evaluate(
+      offset_text, operand_words != nullptr ? &operand_words->offset : nullptr);
 
   i64 start = offset < 0 ? value_length + offset : offset;
   if (start < 0) return String{scratch_allocator()};
@@ -830,13 +1076,9 @@ fn EvalContext::apply_substring_to_value(
   i64 end = value_length;
   if (separator < body.length) {
     let const length_text = body.substring(separator + 1);
-    let length_location = SourceLocation{};
-    i64 length = length_text.is_empty()
-                     ? 0
-                     : evaluate_arithmetic(length_text,
-                                           source_location_for_subview(
-                                               source_location, body,
-                                               length_text, length_location));
+    i64 length = do_evaluate(length_text, operand_words != nullptr
+                                              ? &operand_words->length
+                                              : nullptr);
     if (length < 0) {
       end = value_length + length;
     } else {
@@ -858,7 +1100,7 @@ fn EvalContext::apply_substring_to_value(
 
 /* A slash inside a quote run or behind a backslash belongs to the pattern, the
    way bash reads ${var/#"a/b"/c}, so the scan tracks the quote state. */
-static fn find_replacement_separator(StringView body) wontthrow -> usize
+fn find_replacement_separator(StringView body) wontthrow -> usize
 {
   char quote = 0;
   for (usize i = 0; i < body.length; i++) {
@@ -884,28 +1126,15 @@ static fn find_replacement_separator(StringView body) wontthrow -> usize
   return body.length;
 }
 
-static fn longest_pattern_match_at(StringView pattern,
-                                   const Bitset &pattern_active,
-                                   StringView value, usize start,
-                                   bool extglob) throws -> Maybe<usize>
-{
-  for (usize end = value.length; end >= start; end--) {
-    if (utils::glob_matches(pattern,
-                            value.substring_of_length(start, end - start),
-                            pattern_active, 0, extglob))
-      return end - start;
-    if (end == start) break;
-  }
-  return None;
-}
-
 fn EvalContext::apply_pattern_replacement(
-    StringView name, StringView spec,
-    const SourceLocation *source_location) throws -> String
+    StringView name, StringView spec, const SourceLocation *source_location,
+    Maybe<usize> planned_separator,
+    const parameter_operand_words *operand_words) throws -> String
 {
   let const current = get_variable_value_checked(name);
   return pattern_replace_value(current.value_or(String{scratch_allocator()}),
-                               spec, source_location);
+                               spec, source_location, planned_separator,
+                               operand_words);
 }
 
 /* & reads as the matched span, \& is a literal &, and a backslash before any
@@ -927,7 +1156,8 @@ static fn append_pattern_replacement(String &out, StringView replacement,
 
 fn EvalContext::pattern_replace_value(
     const String &value, StringView spec,
-    const SourceLocation *source_location) throws -> String
+    const SourceLocation *source_location, Maybe<usize> planned_separator,
+    const parameter_operand_words *operand_words) throws -> String
 {
   LOG(All, "applying the pattern replacement '%.*s' to a value of %zu bytes",
       static_cast<int>(spec.length), spec.data, value.count());
@@ -946,23 +1176,32 @@ fn EvalContext::pattern_replace_value(
     remainder = remainder.substring(1);
   }
 
-  const usize separator = find_replacement_separator(remainder);
+  const usize separator = planned_separator.has_value()
+                              ? *planned_separator
+                              : find_replacement_separator(remainder);
   let const pattern_word = remainder.substring_of_length(0, separator);
   let pattern_location = SourceLocation{};
   let pattern_active = Bitset{scratch_allocator()};
-  let const pattern = expand_modifier_word_masked(
-      pattern_word, pattern_active, true,
-      source_location_for_subview(source_location, spec, pattern_word,
-                                  pattern_location));
+  let const *pattern_location_pointer = source_location_for_subview(
+      source_location, spec, pattern_word, pattern_location);
+  let const pattern =
+      operand_words != nullptr
+          ? run_modifier_word(operand_words->first, &pattern_active,
+                              pattern_location_pointer)
+          : expand_modifier_word_masked(pattern_word, pattern_active, true,
+                                        pattern_location_pointer);
+  let const replacement_word = remainder.substring(
+      separator < remainder.length ? separator + 1 : remainder.length);
   let replacement_location = SourceLocation{};
+  let const *replacement_location_pointer = source_location_for_subview(
+      source_location, spec, replacement_word, replacement_location);
   let const replacement =
-      separator < remainder.length
-          ? expand_modifier_word(
-                remainder.substring(separator + 1), true, false,
-                source_location_for_subview(source_location, spec,
-                                            remainder.substring(separator + 1),
-                                            replacement_location))
-          : String{heap_allocator()};
+      separator >= remainder.length ? String{heap_allocator()}
+      : operand_words != nullptr
+          ? run_modifier_word(operand_words->second, nullptr,
+                              replacement_location_pointer)
+          : expand_modifier_word(replacement_word, true, false,
+                                 replacement_location_pointer);
 
   /* An empty unanchored pattern matches nothing in bash, so the value is
      returned unchanged. The anchored forms still splice at the start or the
@@ -971,11 +1210,10 @@ fn EvalContext::pattern_replace_value(
     return value;
 
   let out = String{scratch_allocator()};
+  let const matcher = glob_matcher(pattern.view(), pattern_active);
 
   if (is_anchored_at_start) {
-    if (let const matched = longest_pattern_match_at(
-            pattern.view(), pattern_active, value.view(), 0, extglob_enabled()))
-    {
+    if (let const matched = matcher.match_prefix(value.view(), true)) {
       append_pattern_replacement(out, replacement.view(),
                                  value.view().substring_of_length(0, *matched));
       out.append(value.view().substring(*matched));
@@ -986,28 +1224,28 @@ fn EvalContext::pattern_replace_value(
   }
 
   if (is_anchored_at_end) {
-    for (usize start = 0; start <= value.length(); start++) {
-      if (utils::glob_matches(pattern.view(), value.view().substring(start),
-                              pattern_active, 0, extglob_enabled()))
-      {
-        out.append(value.view().substring_of_length(0, start));
-        append_pattern_replacement(out, replacement.view(),
-                                   value.view().substring(start));
-        return out;
-      }
+    if (let const start = matcher.match_suffix(value.view(), true)) {
+      out.append(value.view().substring_of_length(0, *start));
+      append_pattern_replacement(out, replacement.view(),
+                                 value.view().substring(*start));
+    } else {
+      out.append(value.view());
     }
-    out.append(value.view());
     return out;
   }
 
-  /* A zero-length match advances one byte so the scan cannot loop. */
+  /* A zero-length match advances one byte so the scan cannot loop. A start
+     that does not hold the byte every match begins with is copied through
+     without running the matcher. */
+  let const first_byte = matcher.first_byte();
   bool has_replaced = false;
   usize i = 0;
   while (i < value.length()) {
     Maybe<usize> matched;
-    if (!has_replaced || should_replace_all) {
-      matched = longest_pattern_match_at(pattern.view(), pattern_active,
-                                         value.view(), i, extglob_enabled());
+    if ((!has_replaced || should_replace_all) &&
+        (!first_byte.has_value() || value.view()[i] == *first_byte))
+    {
+      matched = matcher.match_prefix(value.view().substring(i), true);
     }
     if (matched.has_value()) {
       append_pattern_replacement(out, replacement.view(),
@@ -1167,6 +1405,7 @@ fn EvalContext::apply_case_modification_to_value(
   }
 
   let const pattern_matches_any = pattern_word.is_empty();
+  let const matcher = glob_matcher(pattern.view(), pattern_active);
   let out = String{scratch_allocator()};
   out.reserve(value.length);
   for (usize i = 0; i < value.length; i++) {
@@ -1174,8 +1413,7 @@ fn EvalContext::apply_case_modification_to_value(
     const bool is_affected = should_modify_all || i == 0;
     if (is_affected &&
         (pattern_matches_any ||
-         utils::glob_matches(pattern.view(), value.substring_of_length(i, 1),
-                             pattern_active, 0, extglob_enabled())))
+         matcher.matches(value.substring_of_length(i, 1))))
     {
       const unsigned char byte = static_cast<unsigned char>(character);
       if (op == '^') {
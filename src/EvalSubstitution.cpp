@@ -245,6 +245,7 @@ fn EvalContext::setup_process_substitution(const WordSegment &segment) throws
 
   if (launch.should_evaluate_child) {
     if (launch.child_close_fd.has_value()) os::close_fd(*launch.child_close_fd);
+    STDOUT_CAPTURE = nullptr;
     i32 status = 0;
     let const previous_source = m_current_source;
     let const previous_origin = m_current_origin;
@@ -353,9 +354,6 @@ fn EvalContext::capture_command_substitution(const WordSegment &segment) throws
   if (AST_ARENA == nullptr)
     throw Error{"Command substitution outside of a parse"};
 
-  enter_substitution();
-  defer { leave_substitution(); };
-
   /* A cached tree from an earlier arena generation points into reclaimed
      storage, so it is reparsed when the generation no longer matches. */
   let cache_arena = segment.is_substitution_cache_in_function_arena
@@ -363,6 +361,22 @@ fn EvalContext::capture_command_substitution(const WordSegment &segment) throws
                         : AST_ARENA;
   ASSERT(cache_arena != nullptr);
   const usize generation = cache_arena->reset_generation();
+
+  /* The optimizer already ran a pure shitbox call with constant operands. A
+     function or alias that took the name since, a trap, or -x, which traces
+     the inner command, sends it down the ordinary path. */
+  if (segment.folded_substitution_output != nullptr &&
+      segment.cached_substitution_generation == generation &&
+      find_function("shitbox") == nullptr && !has_aliases() &&
+      traps().count() == 0 && !should_echo_expanded())
+  {
+    LOG(Debug, "reading the folded output of a pure substitution");
+    set_last_exit_status(0);
+    return segment.folded_substitution_output->clone();
+  }
+
+  enter_substitution();
+  defer { leave_substitution(); };
   let const did_push_source_frame = push_substitution_source_frame(
       segment, StringView{"command substitution"});
   defer
@@ -391,6 +405,7 @@ fn EvalContext::capture_command_substitution(const WordSegment &segment) throws
       throw;
     }
     segment.cached_substitution_generation = generation;
+    segment.folded_substitution_output = nullptr;
   }
   ASSERT(segment.cached_substitution_ast != nullptr);
 
@@ -460,6 +475,10 @@ fn EvalContext::run_captured_substitution(const Expression *ast,
       can_evaluate_in_process = false;
     }
   }
+  /* A body proven to run only builtins starts no process that would need fd 1,
+     so its output is appended straight to the result with no pipe and no drain
+     thread. The fallback below for a shell that cannot fork runs anything. */
+  let const is_output_in_memory = can_evaluate_in_process;
   if (!can_evaluate_in_process && !os::can_fork_evaluator()) {
     in_process_snapshot = snapshot_state();
     can_evaluate_in_process = true;
@@ -494,6 +513,7 @@ fn EvalContext::run_captured_substitution(const Expression *ast,
       was_pipe_handed_off = true;
       if (child == 0) {
         os::close_fd(pipe->in);
+        STDOUT_CAPTURE = nullptr;
         m_shell_is_interactive = false;
         enter_subshell();
         clear_inherited_exit_trap();
@@ -567,26 +587,34 @@ fn EvalContext::run_captured_substitution(const Expression *ast,
     }
   }
 
-  LOG(Debug, "running the captured substitution in process");
+  LOG(Debug, "running the captured substitution in process%s",
+      is_output_in_memory ? " into memory" : "");
   ASSERT(in_process_snapshot.has_value());
   let snapshot = steal(*in_process_snapshot);
 
-  let const pipe = os::make_pipe();
-  if (!pipe) throw Error{"Could not open a pipe for command substitution"};
-
   let captured = String{heap_allocator()};
+  Maybe<os::Pipe> pipe;
+  Maybe<os::thread> reader;
   let drain_context =
-      command_substitution_drain_context{nullptr, 0, 0, pipe->in};
-  let const reader =
-      os::start_thread(drain_command_substitution_pipe, &drain_context);
-  if (!reader) {
-    os::close_fd(pipe->in);
-    os::close_fd(pipe->out);
-    throw Error{"Could not start a thread for command substitution"};
-  }
+      command_substitution_drain_context{nullptr, 0, 0, SHIT_INVALID_FD};
+  os::descriptor saved = SHIT_INVALID_FD;
+  if (!is_output_in_memory) {
+    pipe = os::make_pipe();
+    if (!pipe) throw Error{"Could not open a pipe for command substitution"};
+
+    drain_context.read_fd = pipe->in;
+    reader = os::start_thread(drain_command_substitution_pipe, &drain_context);
+    if (!reader) {
+      os::close_fd(pipe->in);
+      os::close_fd(pipe->out);
+      throw Error{"Could not start a thread for command substitution"};
+    }
 
-  shit::flush();
-  let const saved = os::redirect_stdout(pipe->out);
+    shit::flush();
+    saved = os::redirect_stdout(pipe->out);
+  }
+  let *const outer_capture = STDOUT_CAPTURE;
+  STDOUT_CAPTURE = is_output_in_memory ? &captured : nullptr;
 
   let const was_interactive = m_shell_is_interactive;
   m_shell_is_interactive = false;
@@ -618,16 +646,19 @@ fn EvalContext::run_captured_substitution(const Expression *ast,
   leave_subshell();
 
   m_shell_is_interactive = was_interactive;
+  STDOUT_CAPTURE = outer_capture;
 
-  shit::flush();
-  os::restore_stdout(saved);
-  os::close_fd(pipe->out);
-  os::join_thread(*reader);
-  os::close_fd(pipe->in);
+  if (!is_output_in_memory) {
+    shit::flush();
+    os::restore_stdout(saved);
+    os::close_fd(pipe->out);
+    os::join_thread(*reader);
+    os::close_fd(pipe->in);
 
-  if (drain_context.data != nullptr) {
-    captured.append(StringView{drain_context.data, drain_context.length});
-    std::free(drain_context.data);
+    if (drain_context.data != nullptr) {
+      captured.append(StringView{drain_context.data, drain_context.length});
+      std::free(drain_context.data);
+    }
   }
 
   restore_state(steal(snapshot));
@@ -637,7 +668,15 @@ fn EvalContext::run_captured_substitution(const Expression *ast,
        holds a fatal expansion error to the command substitution. */
     LOG(Debug,
         "the command substitution failed, containing the error with status 1");
+    /* A forked body marks the outer frames printed in its own copy of them, so
+       the next failing substitution traces them again. The marks made here are
+       undone to match. */
+    let was_printed = Bitset{scratch_allocator()};
+    for (let const &frame : m_source_frames)
+      was_printed.push(frame.was_printed);
     render_contained_substitution_error(error, source.view());
+    for (usize i = 0; i < was_printed.count(); i++)
+      m_source_frames[i].was_printed = was_printed[i];
     set_last_exit_status(1);
   }
 
@@ -717,6 +756,8 @@ fn EvalContext::capture_function_substitution(const WordSegment &segment) throws
 
   shit::flush();
   let const saved = os::redirect_stdout(pipe->out);
+  let *const outer_capture = STDOUT_CAPTURE;
+  STDOUT_CAPTURE = nullptr;
 
   let const was_interactive = m_shell_is_interactive;
   m_shell_is_interactive = false;
@@ -727,6 +768,7 @@ fn EvalContext::capture_function_substitution(const WordSegment &segment) throws
   } catch (...) {
     error = std::current_exception();
   }
+  STDOUT_CAPTURE = outer_capture;
   /* A break, continue, or return acts only within the body and is consumed
      here. An exit stays pending, so the shell ends after the surrounding
      command finishes, the way bash exits from a funsub. */
@@ -670,7 +670,8 @@ hot fn EvalContext::expand_word(const Word &word) throws
             break;
           }
         if (is_plain_name)
-          if (let const *stored = lookup_shell_variable(segment_text);
+          if (let const *stored = lookup_bound_shell_variable(
+                  segment_text, segment.bound_variable);
               stored != nullptr)
           {
             if (segment.is_in_double_quotes)
@@ -680,11 +681,26 @@ hot fn EvalContext::expand_word(const Word &word) throws
             break;
           }
       }
-      let const source_location =
-          segment.get_source_location(m_current_location.filename);
-      let const value = apply_parameter_expansion(
-          segment.text.view(),
-          source_location.has_value() ? &*source_location : nullptr);
+      /* $?, $#, $$, $! and a single digit positional render into a stack
+         buffer or borrow the parameter, no String on the way. An unset one
+         goes the long way, which reports it under set -u. */
+      if (segment_text.length == 1 &&
+          (segment_text[0] == '?' || segment_text[0] == '#' ||
+           segment_text[0] == '$' || segment_text[0] == '!' ||
+           lexer::is_number(segment_text[0])))
+      {
+        let storage = borrowed_value_storage{};
+        if (let const borrowed = borrow_variable_value(segment_text, storage);
+            borrowed.has_value())
+        {
+          if (segment.is_in_double_quotes)
+            do_append_run(*borrowed, false);
+          else
+            do_append_split_run(*borrowed, true);
+          break;
+        }
+      }
+      let const value = expand_parameter_segment(segment);
       if (segment.is_in_double_quotes)
         do_append_run(value, false);
       else
@@ -769,11 +785,7 @@ hot fn EvalContext::expand_word_for_assignment(const Word &word) throws
     let const segment_text = segment.text.view();
     switch (segment.kind) {
     case WordSegment::Kind::VariableReference: {
-      let const source_location =
-          segment.get_source_location(m_current_location.filename);
-      result += apply_parameter_expansion(
-          segment_text,
-          source_location.has_value() ? &*source_location : nullptr);
+      result += expand_parameter_segment(segment);
     } break;
     case WordSegment::Kind::CommandSubstitution:
       result += capture_command_substitution(segment);
@@ -828,11 +840,7 @@ fn EvalContext::expand_case_pattern_masked(const Word &word,
       do_emit_run(segment_text, true);
       break;
     case WordSegment::Kind::VariableReference: {
-      let const source_location =
-          segment.get_source_location(m_current_location.filename);
-      let const value = apply_parameter_expansion(
-          segment_text,
-          source_location.has_value() ? &*source_location : nullptr);
+      let const value = expand_parameter_segment(segment);
       do_emit_run(value.view(), !segment.is_in_double_quotes);
     } break;
     case WordSegment::Kind::CommandSubstitution: {
@@ -243,6 +243,12 @@ fn Expression::as_cstyle_for_loop() const wontthrow
   return nullptr;
 }
 
+fn Expression::as_compound_list() const wontthrow
+    -> const expressions::CompoundList *
+{
+  return nullptr;
+}
+
 fn Expression::try_static_condition_verdict(
     const AnalysisContext &actx) const wontthrow -> Maybe<bool>
 {
@@ -474,7 +480,10 @@ fn analyze_ast(const Expression *root, StringView source,
     summary.append(" loops folded, ");
     summary.append(
         String::from(actx.optimizer_eliminated_compounds, heap_allocator()));
-    summary.append(" compounds eliminated");
+    summary.append(" compounds eliminated, ");
+    summary.append(
+        String::from(actx.optimizer_folded_substitutions, heap_allocator()));
+    summary.append(" substitutions folded");
     actx.trace_optimizer_line(summary.view());
   }
 
@@ -18,6 +18,8 @@ class AssignCommand;
 class SimpleCommand;
 class ForLoop;
 class CStyleForLoop;
+class CompoundList;
+class CompoundListCondition;
 } /* namespace expressions */
 
 enum class analyze_severity : u8
@@ -71,6 +73,7 @@ public:
   usize optimizer_folded_branches{0};
   usize optimizer_folded_loops{0};
   usize optimizer_eliminated_compounds{0};
+  usize optimizer_folded_substitutions{0};
 
   bool should_print_optimizer_state{false};
 
@@ -137,6 +140,8 @@ public:
   virtual fn as_for_loop() const wontthrow -> const expressions::ForLoop *;
   virtual fn as_cstyle_for_loop() const wontthrow
       -> const expressions::CStyleForLoop *;
+  virtual fn as_compound_list() const wontthrow
+      -> const expressions::CompoundList *;
 
   /* This no-ops for arena storage and frees an ordinary heap node otherwise. */
   static fn operator delete(opaque *pointer) wontthrow->void;
@@ -335,6 +340,10 @@ public:
 
   pure fn args() const wontthrow -> const ArrayList<const Token *> &;
 
+  /* Whether the command carries a redirection or an array assignment, anything
+     beyond its words. */
+  pure fn has_redirections() const wontthrow -> bool;
+
   fn to_string() const throws -> String override;
 
   fn analyze(AnalysisContext &actx, bool is_unconditional) const throws
@@ -383,6 +392,8 @@ public:
      exempts from its exit. */
   pure fn is_negated() const wontthrow -> bool;
 
+  pure fn command() const wontthrow -> const Command *;
+
   fn to_string() const throws -> String override;
   fn to_ast_string(usize layer = 0) const throws -> String override;
 
@@ -414,6 +425,11 @@ public:
   pure fn is_empty() const wontthrow -> bool;
   fn append_node(const CompoundListCondition *node) throws -> void;
 
+  pure fn nodes() const wontthrow
+      -> const ArrayList<const CompoundListCondition *> &;
+
+  fn as_compound_list() const wontthrow -> const CompoundList * override;
+
   fn to_string() const throws -> String override;
   fn to_ast_string(usize layer = 0) const throws -> String override;
 
@@ -701,6 +717,7 @@ protected:
   fn evaluate_impl(EvalContext &cxt) const throws -> i64 override;
 
   String m_expression;
+  mutable arith_program m_program{};
 };
 
 class CStyleForLoop : public CompoundCommand
@@ -739,14 +756,10 @@ protected:
 
   mutable Maybe<i64> m_folded_condition{};
 
-  /* A simple clause runs the token fast path, a complex clause falls back to
-     the char parser, decided once when the tokens are filled. */
-  mutable ArrayList<arith_token> m_condition_tokens{heap_allocator()};
-  mutable ArrayList<arith_token> m_step_tokens{heap_allocator()};
-  mutable bool m_condition_tokenized{false};
-  mutable bool m_step_tokenized{false};
-  mutable bool m_condition_simple{false};
-  mutable bool m_step_simple{false};
+  /* Each clause compiles on the loop's first run. */
+  mutable arith_program m_init_program{};
+  mutable arith_program m_condition_program{};
+  mutable arith_program m_step_program{};
 };
 
 class SelectLoop : public CompoundCommand
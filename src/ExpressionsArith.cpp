@@ -104,7 +104,8 @@ fn ArithmeticCommand::evaluate_impl(EvalContext &cxt) const throws -> i64
   try {
     const SourceLocation body_base{source_location().position + 2, 0,
                                    source_location().filename};
-    value = cxt.evaluate_arithmetic(m_expression.view(), &body_base);
+    value = cxt.evaluate_arithmetic_cached_clause(m_expression.view(), m_program,
+                                                  &body_base, &body_base);
   } catch (const ErrorWithLocation &) {
     throw;
   } catch (const Error &e) {
@@ -222,7 +223,8 @@ fn CStyleForLoop::evaluate_impl(EvalContext &cxt) const throws -> i64
       "'%s'",
       m_init.c_str(), m_condition.c_str(), m_step.c_str());
 
-  if (!is_blank_clause(m_init.view())) cxt.evaluate_arithmetic(m_init.view());
+  if (!is_blank_clause(m_init.view()))
+    cxt.evaluate_arithmetic_cached_clause(m_init.view(), m_init_program);
 
   cxt.enter_loop();
   defer { cxt.leave_loop(); };
@@ -236,8 +238,7 @@ fn CStyleForLoop::evaluate_impl(EvalContext &cxt) const throws -> i64
          (m_folded_condition.has_value()
               ? (*m_folded_condition != 0)
               : cxt.evaluate_arithmetic_cached_clause(
-                    m_condition.view(), m_condition_tokens,
-                    m_condition_tokenized, m_condition_simple) != 0))
+                    m_condition.view(), m_condition_program) != 0))
   {
     ret = m_body->evaluate(cxt);
     if (cxt.no_exec()) break;
@@ -245,8 +246,7 @@ fn CStyleForLoop::evaluate_impl(EvalContext &cxt) const throws -> i64
     /* The step runs after the body on every iteration, including one ended by a
        continue. */
     if (!step_is_blank) {
-      cxt.evaluate_arithmetic_cached_clause(m_step.view(), m_step_tokens,
-                                            m_step_tokenized, m_step_simple);
+      cxt.evaluate_arithmetic_cached_clause(m_step.view(), m_step_program);
     }
   }
   SET_AND_RETURN_EXIT_STATUS(cxt, ret);
@@ -394,6 +394,9 @@ fn Subshell::evaluate_impl(EvalContext &cxt) const throws -> i64
 {
   ASSERT(m_body != nullptr);
 
+  if (cxt.take_in_process_subshell_request())
+    return evaluate_subshell_in_process(m_body, cxt);
+
   shit::flush();
   let const forked_child = os::try_fork_compound_stage(None, None, None);
   if (!forked_child.has_value())
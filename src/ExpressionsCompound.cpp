@@ -39,6 +39,17 @@ pure fn CompoundList::is_empty() const wontthrow -> bool
   return m_nodes.is_empty();
 }
 
+pure fn CompoundList::nodes() const wontthrow
+    -> const ArrayList<const CompoundListCondition *> &
+{
+  return m_nodes;
+}
+
+fn CompoundList::as_compound_list() const wontthrow -> const CompoundList *
+{
+  return this;
+}
+
 fn CompoundList::append_node(const CompoundListCondition *node) throws -> void
 {
   ASSERT(node != nullptr);
@@ -219,6 +230,11 @@ pure fn CompoundListCondition::is_negated() const wontthrow -> bool
   return m_cmd->is_negated();
 }
 
+pure fn CompoundListCondition::command() const wontthrow -> const Command *
+{
+  return m_cmd;
+}
+
 cold fn CompoundListCondition::to_string() const throws -> String
 {
   String k{heap_allocator()};
@@ -1316,8 +1332,7 @@ fn CaseClause::evaluate_impl(EvalContext &cxt) const throws -> i64
         for (usize k = 0; k < pattern.count(); k++)
           pattern_active.push(true);
       }
-      if (utils::glob_matches(pattern, subject, pattern_active, 0,
-                              cxt.extglob_enabled()))
+      if (cxt.glob_matcher(pattern.view(), pattern_active).matches(subject))
         return true;
     }
     return false;
@@ -236,23 +236,18 @@ hot fn AssignCommand::evaluate_impl(EvalContext &cxt) const throws -> i64
       return cxt.last_exit_status();
     }
 
-    /* NAME+=VALUE prepends the current value of NAME, empty when unset. An
+    /* NAME+=VALUE appends to the current value of NAME, empty when unset. An
        integer name adds rather than concatenates. */
-    if (m_assignment->is_append()) {
-      let appended =
-          String{cxt.get_variable_value(m_assignment->key()).value_or("")};
-      if (cxt.is_integer_variable(m_assignment->key()))
-        cxt.append_integer_expression(appended, value.view());
-      else
-        appended += value;
-      value = steal(appended);
-    }
-
-    cxt.set_shell_variable(m_assignment->key(), value);
+    if (m_assignment->is_append())
+      cxt.append_shell_variable(m_assignment->key(), value);
+    else
+      cxt.set_shell_variable(m_assignment->key(), value);
     if (cxt.export_all()) {
       let const &key = m_assignment->key();
       cxt.record_environment_change(key);
-      os::set_environment_variable(key, value);
+      let const *stored = cxt.lookup_shell_variable(key);
+      os::set_environment_variable(key, stored != nullptr ? stored->view()
+                                                          : value.view());
       cxt.mark_exported(key);
     }
     if (!value_ran_substitution) cxt.set_last_exit_status(0);
@@ -327,7 +322,15 @@ fn SimpleCommand::can_evaluate_in_process_substitution(
       SSK("local"), SSK("printf"), SSK("return"), SSK("true"),
   };
   constexpr StaticStringSet SAFE_BUILTINS{SAFE_BUILTIN_KEYS};
-  return SAFE_BUILTINS.contains(command_name->view());
+  if (SAFE_BUILTINS.contains(command_name->view())) return true;
+
+  /* Only the explicit shitbox form is certain to reach the utility, a bare
+     name runs a program of that name when PATH has one. */
+  if (*command_name != "shitbox" || m_args.count() < 2) return false;
+  let const util_name = static_command_name(m_args[1]);
+  if (!util_name.has_value()) return false;
+  let const chosen = shitbox::find_util(util_name->view());
+  return chosen.has_value() && shitbox::util_is_pure(*chosen);
 }
 
 fn SimpleCommand::set_redirections(ArrayList<Redirection> &&redirections) throws
@@ -483,7 +486,7 @@ fn resolve_redirection(const Redirection &redir, EvalContext &cxt,
       body = expanded_body.view();
     }
 
-    let opened = os::write_to_temp_file(body);
+    let opened = os::stage_heredoc_body(body);
     if (!opened) {
       if (open_or_stage_failed != nullptr) *open_or_stage_failed = true;
       throw ErrorWithLocation{redir.target != nullptr
@@ -653,6 +656,11 @@ pure fn SimpleCommand::args() const wontthrow
   return m_args;
 }
 
+pure fn SimpleCommand::has_redirections() const wontthrow -> bool
+{
+  return !m_redirections.is_empty() || !m_array_args.is_empty();
+}
+
 fn SimpleCommand::as_simple_command() const wontthrow -> const SimpleCommand *
 {
   return this;
@@ -0,0 +1,282 @@
+#include "Glob.hpp"
+
+#include "Debug.hpp"
+#include "Utils.hpp"
+
+namespace shit {
+
+namespace {
+
+/* The set of bytes one step accepts. */
+struct glob_step
+{
+  u64 bytes[4]{};
+
+  fn add(u8 byte) wontthrow -> void
+  {
+    bytes[byte / 64] |= u64{1} << (byte % 64);
+  }
+
+  fn remove(u8 byte) wontthrow -> void
+  {
+    bytes[byte / 64] &= ~(u64{1} << (byte % 64));
+  }
+
+  mustuse pure fn has(u8 byte) const wontthrow -> bool
+  {
+    return ((bytes[byte / 64] >> (byte % 64)) & 1u) != 0;
+  }
+
+  /* The only byte of a single-byte step, None for a wider set. */
+  mustuse pure fn single_byte() const wontthrow -> Maybe<char>
+  {
+    usize members = 0;
+    for (usize w = 0; w < 4; w++)
+      members += static_cast<usize>(__builtin_popcountll(bytes[w]));
+    if (members != 1) return None;
+    for (usize c = 0; c < 256; c++) {
+      if (has(static_cast<u8>(c))) return static_cast<char>(c);
+    }
+    return None;
+  }
+};
+
+} // namespace
+
+fn GlobProgram::compile(StringView glob, const Bitset &glob_active,
+                        usize mask_offset, bool extglob, bool fold_case,
+                        Allocator allocator) throws -> GlobProgram
+{
+  GlobProgram program{allocator};
+  if (extglob && utils::glob_has_extglob_group(glob)) return program;
+
+  let const is_active = [&](usize index) wontthrow -> bool {
+    return glob_active[mask_offset + index];
+  };
+
+  /* Position p sits before step p, so loops holds one more entry than steps,
+     and a star marks the position it sits at. Consecutive stars land on the
+     same position and collapse the way the interpreter skips them. */
+  let steps = ArrayList<glob_step>{allocator};
+  let loops = ArrayList<bool>{allocator};
+  loops.push(false);
+
+  usize g = 0;
+  while (g < glob.count()) {
+    glob_step step{};
+    if (is_active(g) && glob[g] == '*') {
+      loops.back() = true;
+      g++;
+      continue;
+    }
+
+    Maybe<usize> close{};
+    if (is_active(g) && glob[g] == '[')
+      close = utils::glob_bracket_close(glob, glob_active, mask_offset, g);
+
+    if (is_active(g) && glob[g] == '?') {
+      for (usize w = 0; w < 4; w++)
+        step.bytes[w] = ~u64{0};
+      g++;
+    } else if (close.has_value()) {
+      /* A bracket is asked once per byte, so the class grammar, ranges and
+         [:name:] units included, stays in the one place that reads it. */
+      let const bracket = glob.substring_of_length(g, *close + 1 - g);
+      for (usize c = 0; c < 256; c++) {
+        let const byte = static_cast<char>(c);
+        if (utils::glob_matches(bracket, StringView{&byte, 1}, glob_active,
+                                mask_offset + g))
+          step.add(static_cast<u8>(c));
+      }
+      g = *close + 1;
+    } else {
+      /* An inactive byte, a plain active one, and a [ without a close all
+         match only themselves. */
+      step.add(static_cast<u8>(glob[g]));
+      g++;
+    }
+
+    steps.push(step);
+    loops.push(false);
+  }
+
+  let const step_count = steps.count();
+  let const word_count = (step_count + 1 + BITS_PER_WORD - 1) / BITS_PER_WORD;
+  if (word_count > MAX_WORDS) return program;
+
+  if (fold_case) {
+    for (let &step : steps) {
+      for (u8 c = 'A'; c <= 'Z'; c++) {
+        if (step.has(static_cast<u8>(c + ('a' - 'A'))))
+          step.add(c);
+        else
+          step.remove(c);
+      }
+    }
+  }
+
+  let const build = [&](ArrayList<u64> &masks, ArrayList<u64> &loop_words,
+                        bool is_reversed) throws -> void {
+    masks.reserve(256 * word_count);
+    for (usize i = 0; i < 256 * word_count; i++)
+      masks.push(0);
+    loop_words.reserve(word_count);
+    for (usize i = 0; i < word_count; i++)
+      loop_words.push(0);
+
+    for (usize p = 0; p <= step_count; p++) {
+      let const bit = u64{1} << (p % BITS_PER_WORD);
+      let const word = p / BITS_PER_WORD;
+      if (loops[is_reversed ? step_count - p : p]) loop_words[word] |= bit;
+      if (p == 0) continue;
+
+      /* Reversed, position p is reached by the step that ends the original
+         p steps from its end. */
+      let const &step = steps[is_reversed ? step_count - p : p - 1];
+      for (usize c = 0; c < 256; c++) {
+        if (step.has(static_cast<u8>(c))) masks[c * word_count + word] |= bit;
+      }
+    }
+  };
+  build(program.m_masks, program.m_loops, false);
+  build(program.m_reverse_masks, program.m_reverse_loops, true);
+
+  usize prefix_end = 0;
+  while (prefix_end < step_count && !loops[prefix_end]) {
+    Maybe<char> byte = steps[prefix_end].single_byte();
+    if (!byte.has_value()) break;
+    program.m_literal_prefix.push(*byte);
+    prefix_end++;
+  }
+
+  usize suffix_start = step_count;
+  while (suffix_start > 0 && !loops[suffix_start] &&
+         steps[suffix_start - 1].single_byte().has_value())
+  {
+    suffix_start--;
+  }
+  for (usize p = suffix_start; p < step_count; p++)
+    program.m_literal_suffix.push(*steps[p].single_byte());
+
+  program.m_step_count = step_count;
+  program.m_word_count = word_count;
+  program.m_is_compiled = true;
+  return program;
+}
+
+template <class Accept>
+fn GlobProgram::run(StringView text, bool is_reversed, Accept do_accept) const
+    wontthrow -> void
+{
+  ASSERT(m_is_compiled);
+
+  let const *masks = is_reversed ? m_reverse_masks.begin() : m_masks.begin();
+  let const *loops = is_reversed ? m_reverse_loops.begin() : m_loops.begin();
+  let const accept_word = m_step_count / BITS_PER_WORD;
+  let const accept_bit = u64{1} << (m_step_count % BITS_PER_WORD);
+
+  u64 live[MAX_WORDS]{};
+  live[0] = 1;
+  if ((live[accept_word] & accept_bit) != 0 && !do_accept(usize{0})) return;
+
+  for (usize i = 0; i < text.length; i++) {
+    let const c = static_cast<u8>(
+        is_reversed ? text[text.length - 1 - i] : text[i]);
+    let const *row = masks + c * m_word_count;
+
+    /* S' = (S & loops) | ((S << 1) & row), the shift carrying across words. */
+    u64 carry = 0;
+    u64 any = 0;
+    for (usize w = 0; w < m_word_count; w++) {
+      let const word = live[w];
+      let const shifted = (word << 1) | carry;
+      carry = word >> (BITS_PER_WORD - 1);
+      live[w] = (word & loops[w]) | (shifted & row[w]);
+      any |= live[w];
+    }
+
+    if (any == 0) return;
+    if ((live[accept_word] & accept_bit) != 0 && !do_accept(i + 1)) return;
+  }
+}
+
+fn GlobProgram::matches(StringView text) const wontthrow -> bool
+{
+  if (text.length < m_literal_suffix.length() ||
+      !text.starts_with(m_literal_prefix) ||
+      !text.substring(text.length - m_literal_suffix.length())
+           .starts_with(m_literal_suffix))
+    return false;
+
+  bool is_matched = false;
+  run(text, false, [&](usize consumed) wontthrow -> bool {
+    is_matched = consumed == text.length;
+    return !is_matched;
+  });
+  return is_matched;
+}
+
+fn GlobProgram::match_prefix(StringView text, bool longest) const wontthrow
+    -> Maybe<usize>
+{
+  if (!text.starts_with(m_literal_prefix)) return None;
+
+  Maybe<usize> length{};
+  run(text, false, [&](usize consumed) wontthrow -> bool {
+    length = consumed;
+    return longest;
+  });
+  return length;
+}
+
+fn GlobProgram::match_suffix(StringView text, bool longest) const wontthrow
+    -> Maybe<usize>
+{
+  if (text.length < m_literal_suffix.length() ||
+      !text.substring(text.length - m_literal_suffix.length())
+           .starts_with(m_literal_suffix))
+    return None;
+
+  Maybe<usize> start{};
+  run(text, true, [&](usize consumed) wontthrow -> bool {
+    start = text.length - consumed;
+    return longest;
+  });
+  return start;
+}
+
+fn GlobMatcher::matches(StringView text) const throws -> bool
+{
+  if (m_program->is_compiled()) return m_program->matches(text);
+  return utils::glob_matches(m_glob, text, *m_glob_active, 0, m_extglob);
+}
+
+fn GlobMatcher::match_prefix(StringView text, bool longest) const throws
+    -> Maybe<usize>
+{
+  if (m_program->is_compiled()) return m_program->match_prefix(text, longest);
+
+  for (usize i = 0; i <= text.length; i++) {
+    let const length = longest ? text.length - i : i;
+    if (utils::glob_matches(m_glob, text.substring_of_length(0, length),
+                            *m_glob_active, 0, m_extglob))
+      return length;
+  }
+  return None;
+}
+
+fn GlobMatcher::match_suffix(StringView text, bool longest) const throws
+    -> Maybe<usize>
+{
+  if (m_program->is_compiled()) return m_program->match_suffix(text, longest);
+
+  for (usize i = 0; i <= text.length; i++) {
+    let const start = longest ? i : text.length - i;
+    if (utils::glob_matches(m_glob, text.substring(start), *m_glob_active, 0,
+                            m_extglob))
+      return start;
+  }
+  return None;
+}
+
+} // namespace shit
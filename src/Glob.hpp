@@ -0,0 +1,129 @@
+#pragma once
+
+#include "Allocator.hpp"
+#include "ArrayList.hpp"
+#include "Bitset.hpp"
+#include "Common.hpp"
+#include "Maybe.hpp"
+#include "String.hpp"
+#include "StringView.hpp"
+
+namespace shit {
+
+/* A glob compiled once into a program the matchers run without reading the
+   pattern text again. Every step consumes one byte out of a set of 256, and a
+   star is a loop on the position it sits at. The program runs as a bit set of
+   live positions, shift and mask per byte, so a match over n bytes costs n
+   word operations per 64 steps where the interpreter in utils::glob_matches
+   backtracks. The prefix and suffix scans read every match length in that one
+   pass, which is what turns a ${x%%pat} or a ${x//pat/rep} from a match per
+   candidate span into a match per start.
+
+   An extended-glob group has no step form, so a pattern holding one compiles
+   to an empty program, is_compiled reads false, and the caller keeps the
+   interpreter for it. So does a pattern past MAX_WORDS words of steps, which
+   keeps the live set on the stack. */
+class GlobProgram
+{
+public:
+  explicit GlobProgram(Allocator allocator)
+      : m_masks(allocator), m_loops(allocator), m_reverse_masks(allocator),
+        m_reverse_loops(allocator), m_literal_prefix(allocator),
+        m_literal_suffix(allocator)
+  {}
+
+  GlobProgram() : GlobProgram(heap_allocator()) {}
+
+  /* The bytes of glob whose mask bit, read at mask_offset onward, is set act
+     as metacharacters. With fold_case a byte matches the way its lowercase
+     form does, so the caller passes a lowered glob, the way nocaseglob lowers
+     both sides for the interpreter. */
+  static fn compile(StringView glob, const Bitset &glob_active,
+                    usize mask_offset, bool extglob, bool fold_case,
+                    Allocator allocator) throws -> GlobProgram;
+
+  mustuse pure fn is_compiled() const wontthrow -> bool
+  {
+    return m_is_compiled;
+  }
+
+  /* Whether the whole of text matches. */
+  hot fn matches(StringView text) const wontthrow -> bool;
+
+  /* The length of the shortest or the longest prefix of text that matches. */
+  hot fn match_prefix(StringView text, bool longest) const wontthrow
+      -> Maybe<usize>;
+
+  /* The start of the shortest or the longest suffix of text that matches,
+     found in one pass from the end through the reversed program. */
+  hot fn match_suffix(StringView text, bool longest) const wontthrow
+      -> Maybe<usize>;
+
+  /* The first byte every match starts with, for a scan that skips ahead to
+     the next candidate start rather than trying each. */
+  mustuse pure fn first_byte() const wontthrow -> Maybe<char>
+  {
+    if (m_literal_prefix.is_empty()) return None;
+    return m_literal_prefix.first_character();
+  }
+
+private:
+  static constexpr usize BITS_PER_WORD = 64;
+  static constexpr usize MAX_WORDS = 8;
+
+  /* One pass of the simulation over text, forward or from the end, calling
+     do_accept with the count of bytes consumed whenever the accepting
+     position is live. Returns early once do_accept returns false or no
+     position is live. */
+  template <class Accept>
+  fn run(StringView text, bool is_reversed, Accept do_accept) const wontthrow
+      -> void;
+
+  bool m_is_compiled{false};
+  usize m_step_count{0};
+  usize m_word_count{0};
+  /* 256 rows of m_word_count words, row c holding the positions a byte c
+     reaches from the position before. */
+  ArrayList<u64> m_masks;
+  ArrayList<u64> m_loops;
+  ArrayList<u64> m_reverse_masks;
+  ArrayList<u64> m_reverse_loops;
+  /* The single-byte steps every match begins and ends with, so a candidate
+     without them is turned away before the simulation runs. */
+  String m_literal_prefix;
+  String m_literal_suffix;
+};
+
+/* A glob matched through its compiled program, or through utils::glob_matches
+   when the program could not be built. The fallback keeps the scans the
+   matchers ran before, an interpreter call per candidate span. The glob, the
+   mask, and the program are borrowed and must outlive the matcher. */
+class GlobMatcher
+{
+public:
+  GlobMatcher(const GlobProgram &program, StringView glob,
+              const Bitset &glob_active, bool extglob)
+      : m_program(&program), m_glob(glob), m_glob_active(&glob_active),
+        m_extglob(extglob)
+  {}
+
+  hot fn matches(StringView text) const throws -> bool;
+  hot fn match_prefix(StringView text, bool longest) const throws
+      -> Maybe<usize>;
+  hot fn match_suffix(StringView text, bool longest) const throws
+      -> Maybe<usize>;
+
+  mustuse pure fn first_byte() const wontthrow -> Maybe<char>
+  {
+    if (!m_program->is_compiled()) return None;
+    return m_program->first_byte();
+  }
+
+private:
+  const GlobProgram *m_program;
+  StringView m_glob;
+  const Bitset *m_glob_active;
+  bool m_extglob;
+};
+
+} // namespace shit
@@ -1,10 +1,15 @@
 #include "Optimizer.hpp"
 
+#include "Arena.hpp"
 #include "Builtin.hpp"
+#include "Cli.hpp"
 #include "Common.hpp"
 #include "Eval.hpp"
 #include "Expressions.hpp"
 #include "Lexer.hpp"
+#include "Parser.hpp"
+#include "ResolvedCommand.hpp"
+#include "Shitbox.hpp"
 #include "Tokens.hpp"
 #include "Trace.hpp"
 
@@ -615,6 +620,247 @@ fn rule_fold_constant_arithmetic(const Expression *node,
   return false;
 }
 
+/* The longest sequence a constant seq call folds for, so the analyze pass never
+   holds a large output the run may not read. */
+constexpr i64 MAX_FOLDED_SEQ_COUNT = 1024;
+
+/* A recorded constant read through an unquoted reference is split and globbed
+   at run time, so it stands for one operand only when it holds no blank and no
+   glob byte. */
+fn pure_call_operand_value(const Token *token,
+                           const AnalysisContext &actx) throws -> Maybe<String>
+{
+  let value = propagated_literal_word_value(token, actx);
+  if (!value.has_value() || !is_split_eligible_variable_operand(token))
+    return value;
+  if (value->is_empty()) return None;
+  for (usize i = 0; i < value->count(); i++) {
+    let const byte = (*value)[i];
+    if (byte == ' ' || byte == '\t' || byte == '\n' ||
+        lexer::is_expandable_char(byte))
+      return None;
+  }
+  return value;
+}
+
+/* Whether a call with these operands is certain to succeed, so running it at
+   analyze time prints what the run would and nothing on stderr. An operand
+   with a leading dash may read as a flag, so only a negative seq bound has
+   one. */
+fn pure_call_always_succeeds(shitbox::Utility::Kind chosen,
+                             const ArrayList<String> &args) throws -> bool
+{
+  /* The call is `shitbox name operand...`. */
+  let const operand_count = args.count() - 2;
+  switch (chosen) {
+  case shitbox::Utility::Kind::Basename:
+  case shitbox::Utility::Kind::Dirname: {
+    let const max_count =
+        chosen == shitbox::Utility::Kind::Basename ? usize{2} : usize{1};
+    if (operand_count == 0 || operand_count > max_count) return false;
+    for (usize i = 2; i < args.count(); i++)
+      if (!args[i].is_empty() && args[i][0] == '-') return false;
+    return true;
+  }
+  case shitbox::Utility::Kind::Seq: {
+    if (operand_count == 0 || operand_count > 3) return false;
+    /* Twelve bytes keep every bound under 10^12, so the span below cannot
+       overflow. */
+    i64 bounds[3] = {};
+    for (usize i = 0; i < operand_count; i++) {
+      let const operand = args[i + 2].view();
+      if (!is_plain_integer_literal(operand) || operand.length > 12)
+        return false;
+      bounds[i] = operand.to<i64>().value();
+    }
+    let const first = operand_count == 1 ? i64{1} : bounds[0];
+    let const increment = operand_count == 3 ? bounds[1] : i64{1};
+    let const last = bounds[operand_count - 1];
+    if (increment == 0) return false;
+    let const span = increment > 0 ? last - first : first - last;
+    if (span < 0) return true;
+    let const step = increment > 0 ? increment : -increment;
+    return span / step < MAX_FOLDED_SEQ_COUNT;
+  }
+  default: return false;
+  }
+}
+
+/* The single command a substitution body runs when it is a bare
+   `shitbox name operand...` with nothing around it. */
+fn lone_shitbox_call(const Expression *ast) wontthrow
+    -> const expressions::SimpleCommand *
+{
+  const expressions::CompoundList *list = ast->as_compound_list();
+  if (list == nullptr || list->nodes().count() != 1) return nullptr;
+
+  const expressions::CompoundListCondition *condition = list->nodes()[0];
+  if (condition->kind() != expressions::CompoundListCondition::Kind::None ||
+      condition->is_negated())
+    return nullptr;
+
+  const expressions::SimpleCommand *cmd =
+      condition->command()->as_simple_command();
+  if (cmd == nullptr || cmd->is_async() || cmd->is_timed() ||
+      cmd->is_negated() || cmd->has_redirections() ||
+      !cmd->local_vars().is_empty() || cmd->args().count() < 3)
+    return nullptr;
+  return cmd;
+}
+
+/* Run the call the way the shitbox builtin would, with its output appended to
+   a string. The trailing newlines go, as they do from any substitution. */
+fn run_pure_call(const expressions::SimpleCommand *cmd, ArrayList<String> &&args,
+                 EvalContext &cxt) throws -> Maybe<String>
+{
+  let arg_locations = ArrayList<SourceLocation>{heap_allocator()};
+  for (usize i = 0; i < args.count(); i++)
+    arg_locations.push(cmd->source_location());
+  let const ec = ExecContext::from_resolved(
+      cmd->source_location(),
+      ResolvedCommand::from_builtin(Builtin::Kind::Shitbox), steal(args),
+      steal(arg_locations));
+
+  let output = String{heap_allocator()};
+  let *const outer_capture = STDOUT_CAPTURE;
+  STDOUT_CAPTURE = &output;
+  defer { STDOUT_CAPTURE = outer_capture; };
+  try {
+    if (shitbox::dispatch(ec, cxt, 1) != 0) return None;
+  } catch (...) {
+    return None;
+  }
+
+  while (!output.is_empty() && output.back() == '\n')
+    output.pop_back();
+  return output;
+}
+
+fn fold_pure_substitution(const WordSegment &segment,
+                          AnalysisContext &actx) throws -> bool
+{
+  if (actx.eval_context == nullptr) return false;
+
+  /* Only a body that opens with the shitbox builtin is parsed here, any other
+     is left for its first run to parse. */
+  let const body = segment.text.view().trim_blanks();
+  if (!body.starts_with("shitbox ") && !body.starts_with("shitbox\t"))
+    return false;
+
+  /* A function or alias named shitbox would take the call. The run checks the
+     same again before it reads the folded output. */
+  if (actx.defined_functions.contains("shitbox") ||
+      actx.known_aliases.count() > 0)
+    return false;
+
+  /* The tree and the output share the arena the run reads the cache from. */
+  let cache_arena = segment.is_substitution_cache_in_function_arena
+                        ? FUNCTION_ARENA
+                        : AST_ARENA;
+  if (cache_arena == nullptr) return false;
+  let const generation = cache_arena->reset_generation();
+  let const is_cache_current =
+      segment.cached_substitution_ast != nullptr &&
+      segment.cached_substitution_generation == generation;
+  if (is_cache_current && segment.folded_substitution_output != nullptr)
+    return false;
+
+  EvalContext &cxt = *actx.eval_context;
+  if (!is_cache_current) {
+    /* A body that does not parse is left for the run to report. */
+    try {
+      let parser = Parser{
+          Lexer{String{segment.text.view()}, *cache_arena, false, None,
+                cxt.mood()}
+      };
+      segment.cached_substitution_ast = parser.construct_ast();
+    } catch (const Error &) {
+      segment.cached_substitution_ast = nullptr;
+      return false;
+    }
+    segment.cached_substitution_generation = generation;
+    segment.folded_substitution_output = nullptr;
+  }
+
+  const expressions::SimpleCommand *cmd =
+      lone_shitbox_call(segment.cached_substitution_ast);
+  if (cmd == nullptr) return false;
+
+  let args = ArrayList<String>{heap_allocator()};
+  args.reserve(cmd->args().count());
+  for (let const token : cmd->args()) {
+    let value = pure_call_operand_value(token, actx);
+    if (!value.has_value()) return false;
+    args.push(steal(*value));
+  }
+  if (args[0] != "shitbox") return false;
+
+  let const chosen = shitbox::find_util(args[1].view());
+  if (!chosen.has_value() || !shitbox::util_is_pure(*chosen)) return false;
+  if (!pure_call_always_succeeds(*chosen, args)) return false;
+
+  let output = run_pure_call(cmd, steal(args), cxt);
+  if (!output.has_value()) return false;
+
+  LOG(All, "folded the pure substitution '%s' to %zu bytes",
+      segment.text.c_str(), output->count());
+  if (actx.should_trace_optimizer) {
+    /* A multi-line output prints its newlines escaped, so the trace keeps one
+       line per fold. */
+    let line = String{"folded pure substitution: "} + String{body} + " = ";
+    for (usize i = 0; i < output->count(); i++) {
+      if ((*output)[i] == '\n')
+        line.append("\\n");
+      else
+        line += (*output)[i];
+    }
+    actx.trace_optimizer_line(line.view());
+  }
+  segment.folded_substitution_output =
+      cache_arena->create<String>(steal(*output));
+  actx.optimizer_folded_substitutions++;
+  return true;
+}
+
+fn fold_pure_substitutions_in_word(const Word &word,
+                                   AnalysisContext &actx) throws -> bool
+{
+  bool did_fold = false;
+  for (let const &segment : word.segments) {
+    if (segment.kind != WordSegment::Kind::CommandSubstitution) continue;
+    if (fold_pure_substitution(segment, actx)) did_fold = true;
+  }
+  return did_fold;
+}
+
+/* RULE pure substitution folding. A $(shitbox name ...) whose utility prints a
+   function of its operands alone, with every operand a literal or a recorded
+   constant, is run once here and the run reads its output back. */
+fn rule_fold_pure_substitution(const Expression *node,
+                               AnalysisContext &actx) throws -> bool
+{
+  if (const expressions::AssignCommand *assign = node->as_assign_command()) {
+    return fold_pure_substitutions_in_word(assign->assignment()->value_word(),
+                                           actx);
+  }
+
+  if (const expressions::SimpleCommand *cmd = node->as_simple_command()) {
+    bool did_fold = false;
+    for (let const t : cmd->args()) {
+      if (t == nullptr || t->kind() != Token::Kind::Word) continue;
+      if (fold_pure_substitutions_in_word(
+              static_cast<const tokens::WordToken *>(t)->word(), actx))
+        did_fold = true;
+    }
+    for (let const &var : cmd->local_vars()) {
+      if (fold_pure_substitutions_in_word(var.value, actx)) did_fold = true;
+    }
+    return did_fold;
+  }
+
+  return false;
+}
+
 /* RULE dead-branch elimination. The branch an if takes is recorded when every
    condition up to it is statically decidable, and the first undecidable
    condition stops the fold. */
@@ -800,6 +1046,7 @@ OptimizationRule *const OPTIMIZATION_RULES[] = {
     rule_fold_constant_arithmetic, rule_dead_branch_elimination,
     rule_loop_elimination,         rule_eliminate_compound_body,
     rule_eliminate_empty_for,      rule_fold_cstyle_for,
+    rule_fold_pure_substitution,
 };
 
 /* The pass cap bounds the fixpoint loop, so a rule that reports a change
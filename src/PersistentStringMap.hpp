@@ -0,0 +1,340 @@
+#pragma once
+
+#include "Allocator.hpp"
+#include "Common.hpp"
+#include "Debug.hpp"
+#include "Maybe.hpp"
+#include "StringMap.hpp"
+#include "StringView.hpp"
+
+namespace shit {
+
+/* Counters for the copy-on-write tables, printed by --show-memory. Subshells
+   and substitutions copy the evaluator tables by sharing them, so the work a
+   snapshot really costs shows up here as shards cloned on first write rather
+   than as a flat copy of every entry. */
+struct persistent_map_statistics
+{
+  usize snapshots_taken{0};
+  usize entries_shared{0};
+  usize shards_cloned{0};
+  usize entries_cloned{0};
+};
+
+inline fn persistent_map_stats() wontthrow -> persistent_map_statistics &
+{
+  static persistent_map_statistics statistics{};
+  return statistics;
+}
+
+/* Hands out the layout epochs, one counter for every table so two tables never
+   share an epoch and a remembered lookup can not validate against the wrong one.
+ */
+inline fn next_persistent_map_epoch() wontthrow -> u64
+{
+  static u64 epoch{0};
+  return ++epoch;
+}
+
+/* A lookup remembered by its caller, typically a syntax tree node that names the
+   same variable every time it runs. It stays valid while the table keeps the
+   layout it was taken under. A hit keeps pointing at the live value, since an
+   overwrite of an existing key writes into the same slot. */
+template <class Value>
+struct persistent_map_slot
+{
+  u64 epoch{0};
+  const Value *value{nullptr};
+};
+
+/* A StringMap split into shards by the top bits of the key hash, each shard
+   and the shard directory reference counted. A copy shares the directory and
+   costs one increment. The first write after a copy clones the directory, then
+   the one shard the key lands in, so a subshell that touches two variables pays
+   for two shards rather than the whole table. The counts are not atomic, since
+   the evaluator tables belong to one thread.
+
+   The API follows StringMap, except that find is read only. A caller that
+   writes through the found value asks for it with find_mutable, which unshares
+   the shard first. A pointer into the table is invalidated by any copy.
+
+   Every change to the layout, an insertion, an erase, or an unshared shard,
+   moves the directory to a fresh epoch. An overwrite of an existing key does
+   not, which is what lets find_cached answer a hot loop from a remembered
+   slot. */
+template <class Value = String>
+class PersistentStringMap
+{
+public:
+  explicit PersistentStringMap(Allocator allocator) : m_allocator(allocator) {}
+
+  PersistentStringMap(const PersistentStringMap &other)
+      : m_allocator(other.m_allocator), m_root(other.m_root)
+  {
+    if (m_root == nullptr) return;
+    m_root->references++;
+    let &statistics = persistent_map_stats();
+    statistics.entries_shared += m_root->count;
+  }
+
+  PersistentStringMap(PersistentStringMap &&other) noexcept
+      : m_allocator(other.m_allocator), m_root(other.m_root)
+  {
+    other.m_root = nullptr;
+  }
+
+  fn operator=(const PersistentStringMap &other) wontthrow
+      -> PersistentStringMap &
+  {
+    if (this != &other) {
+      PersistentStringMap copy{other};
+      *this = steal(copy);
+    }
+    return *this;
+  }
+
+  fn operator=(PersistentStringMap &&other) wontthrow->PersistentStringMap &
+  {
+    if (this != &other) {
+      release_root();
+      m_allocator = other.m_allocator;
+      m_root = other.m_root;
+      other.m_root = nullptr;
+    }
+    return *this;
+  }
+
+  ~PersistentStringMap() { release_root(); }
+
+  /* A copy already shares every entry, so clone is the same O(1) copy. */
+  mustuse fn clone() const wontthrow -> PersistentStringMap
+  {
+    return PersistentStringMap{*this};
+  }
+
+  pure fn allocator() const wontthrow -> Allocator { return m_allocator; }
+
+  mustuse pure fn count() const wontthrow -> usize
+  {
+    return m_root == nullptr ? 0 : m_root->count;
+  }
+
+  hot mustuse pure fn find(StringView key) const wontthrow -> const Value *
+  {
+    if (m_root == nullptr) return nullptr;
+    let const hash = hash_bytes(key);
+    let const *owner = m_root->shards[shard_index(hash)];
+    return owner == nullptr ? nullptr : owner->map.find_hashed(key, hash);
+  }
+
+  /* Answer from the remembered slot while the layout it was taken under still
+     stands, a miss included, and refill it otherwise. */
+  hot mustuse fn find_cached(StringView key,
+                             persistent_map_slot<Value> &slot) const wontthrow
+      -> const Value *
+  {
+    if (m_root == nullptr) return nullptr;
+    if (slot.epoch == m_root->epoch) [[likely]]
+      return slot.value;
+    slot.value = find(key);
+    slot.epoch = m_root->epoch;
+    return slot.value;
+  }
+
+  /* Find a value to write through. A missing key leaves the table shared. */
+  hot mustuse fn find_mutable(StringView key) throws -> Value *
+  {
+    if (find(key) == nullptr) return nullptr;
+    let const hash = hash_bytes(key);
+    return writable_shard(hash).find_hashed(key, hash);
+  }
+
+  hot fn set(StringView key, Value value) throws -> void
+  {
+    let const hash = hash_bytes(key);
+    let &map = writable_shard(hash);
+    let const before = map.count();
+    map.set_hashed(key, hash, steal(value));
+    note_count_change(map.count(), before);
+  }
+
+  /* Store a String value built from a view, reusing the buffer of an existing
+     slot the way StringMap::set does. */
+  hot fn set(StringView key, StringView value) throws -> void
+  {
+    let const hash = hash_bytes(key);
+    let &map = writable_shard(hash);
+    let const before = map.count();
+    map.set_hashed(key, hash, value);
+    note_count_change(map.count(), before);
+  }
+
+  hot fn get_or_create(StringView key, Value default_value) throws -> Value &
+  {
+    let const hash = hash_bytes(key);
+    let &map = writable_shard(hash);
+    let const before = map.count();
+    let &value = map.get_or_create_hashed(key, hash, steal(default_value));
+    note_count_change(map.count(), before);
+    return value;
+  }
+
+  hot fn erase(StringView key) throws -> void
+  {
+    if (find(key) == nullptr) return;
+    let const hash = hash_bytes(key);
+    writable_shard(hash).erase_hashed(key, hash);
+    m_root->count--;
+    m_root->epoch = next_persistent_map_epoch();
+  }
+
+  template <class Fn>
+  fn for_each(Fn callback) const throws -> void
+  {
+    if (m_root == nullptr) return;
+    for (usize i = 0; i < SHARD_COUNT; i++) {
+      if (m_root->shards[i] != nullptr) m_root->shards[i]->map.for_each(callback);
+    }
+  }
+
+  fn clear() wontthrow -> void { release_root(); }
+
+private:
+  static constexpr usize SHARD_BITS = 4;
+  static constexpr usize SHARD_COUNT = usize{1} << SHARD_BITS;
+
+  struct shard
+  {
+    usize references;
+    StringMap<Value> map;
+  };
+
+  struct root
+  {
+    usize references;
+    usize count;
+    u64 epoch;
+    shard *shards[SHARD_COUNT];
+  };
+
+  /* The low bits pick the slot inside a shard, so the shard comes from the top
+     bits and the two choices stay independent. */
+  hot static fn shard_index(u64 hash) wontthrow -> usize
+  {
+    return static_cast<usize>(hash >> (64 - SHARD_BITS));
+  }
+
+  fn make_shard(StringMap<Value> map) throws -> shard *
+  {
+    shard *created = m_allocator.alloc_array<shard>(1);
+    new (created) shard{1, steal(map)};
+    return created;
+  }
+
+  fn release_shard(shard *released) wontthrow -> void
+  {
+    if (released == nullptr || --released->references != 0) return;
+    released->~shard();
+    m_allocator.free_array(released, 1);
+  }
+
+  fn writable_root() throws -> root &
+  {
+    if (m_root != nullptr && m_root->references == 1) return *m_root;
+
+    root *created = m_allocator.alloc_array<root>(1);
+    new (created) root{1, 0, next_persistent_map_epoch(), {}};
+    if (m_root != nullptr) {
+      created->count = m_root->count;
+      for (usize i = 0; i < SHARD_COUNT; i++) {
+        created->shards[i] = m_root->shards[i];
+        if (created->shards[i] != nullptr) created->shards[i]->references++;
+      }
+      m_root->references--;
+    }
+    m_root = created;
+    return *m_root;
+  }
+
+  hot fn writable_shard(u64 hash) throws -> StringMap<Value> &
+  {
+    let &directory = writable_root();
+    let &slot = directory.shards[shard_index(hash)];
+    if (slot == nullptr) {
+      slot = make_shard(StringMap<Value>{m_allocator});
+    } else if (slot->references != 1) [[unlikely]] {
+      let &statistics = persistent_map_stats();
+      statistics.shards_cloned++;
+      statistics.entries_cloned += slot->map.count();
+      shard *shared = slot;
+      slot = make_shard(shared->map.clone());
+      release_shard(shared);
+      directory.epoch = next_persistent_map_epoch();
+    }
+    return slot->map;
+  }
+
+  /* An insertion may have rehashed the shard, so a new key moves the epoch. */
+  hot fn note_count_change(usize after, usize before) wontthrow -> void
+  {
+    if (after == before) return;
+    m_root->count += after - before;
+    m_root->epoch = next_persistent_map_epoch();
+  }
+
+  fn release_root() wontthrow -> void
+  {
+    if (m_root == nullptr) return;
+    if (--m_root->references == 0) {
+      for (usize i = 0; i < SHARD_COUNT; i++)
+        release_shard(m_root->shards[i]);
+      m_root->~root();
+      m_allocator.free_array(m_root, 1);
+    }
+    m_root = nullptr;
+  }
+
+  Allocator m_allocator;
+  root *m_root{nullptr};
+};
+
+/* The HashSet counterpart of PersistentStringMap, for the name sets that ride a
+   subshell snapshot alongside the tables. */
+class PersistentHashSet
+{
+public:
+  explicit PersistentHashSet(Allocator allocator) : m_map(allocator) {}
+
+  pure fn allocator() const wontthrow -> Allocator { return m_map.allocator(); }
+
+  hot fn add(StringView key) throws -> void
+  {
+    if (!contains(key)) m_map.set(key, Nothing{});
+  }
+
+  cold fn remove(StringView key) throws -> void { m_map.erase(key); }
+
+  hot mustuse pure fn contains(StringView key) const wontthrow -> bool
+  {
+    return m_map.find(key) != nullptr;
+  }
+
+  mustuse pure fn count() const wontthrow -> usize { return m_map.count(); }
+
+  mustuse fn clone() const wontthrow -> PersistentHashSet
+  {
+    return PersistentHashSet{*this};
+  }
+
+  template <class Fn>
+  fn for_each(Fn callback) const throws -> void
+  {
+    m_map.for_each(
+        [&callback](StringView key, const Nothing &) { callback(key); });
+  }
+
+private:
+  PersistentStringMap<Nothing> m_map;
+};
+
+} // namespace shit
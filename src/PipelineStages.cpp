@@ -0,0 +1,291 @@
+#include "PipelineStages.hpp"
+#include "Arena.hpp"
+#include "Builtin.hpp"
+#include "Cli.hpp"
+#include "Errors.hpp"
+#include "Eval.hpp"
+#include "Platform.hpp"
+#include "Trace.hpp"
+#include "Utils.hpp"
+
+#include <atomic>
+
+namespace shit {
+
+namespace stages {
+
+/* The writer only advances written and the reader only advances consumed, so
+   each counter has one owner, and the two sit on their own cache lines to keep
+   the ends from bouncing one line between cores. A side that finds the ring
+   full or empty sleeps on the monitor. The other side wakes it only when the
+   sleeper count says someone is there, so a ring that never blocks never
+   takes the lock. */
+struct ring
+{
+  static constexpr usize CAPACITY = 64 * 1024;
+
+  alignas(64) std::atomic<usize> written{0};
+  alignas(64) std::atomic<usize> consumed{0};
+  alignas(64) std::atomic<u32> sleepers{0};
+  std::atomic<bool> is_writer_closed{false};
+  std::atomic<bool> is_reader_closed{false};
+  char *buffer{nullptr};
+  os::monitor monitor{};
+};
+
+/* A sleeper rechecks on this period, so an interrupt that lands while both
+   ends are asleep still ends the stage. */
+static constexpr i64 WAIT_SLICE_NANOS = 50'000'000;
+
+template <class Fn>
+static fn wait_until(ring &r, Fn is_ready) wontthrow -> bool
+{
+  os::lock_monitor(r.monitor);
+  r.sleepers.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  let ready = is_ready();
+  while (!ready && !os::INTERRUPT_REQUESTED) {
+    os::wait_monitor(r.monitor, WAIT_SLICE_NANOS);
+    ready = is_ready();
+  }
+  r.sleepers.fetch_sub(1);
+  os::unlock_monitor(r.monitor);
+  return ready;
+}
+
+static fn wake(ring &r) wontthrow -> void
+{
+  os::lock_monitor(r.monitor);
+  os::wake_monitor(r.monitor);
+  os::unlock_monitor(r.monitor);
+}
+
+hot static fn wake_if_sleeping(ring &r) wontthrow -> void
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (r.sleepers.load(std::memory_order_relaxed) != 0) [[unlikely]]
+    wake(r);
+}
+
+fn make_ring() throws -> ring *
+{
+  let *r = heap_allocator().alloc_array<ring>(1);
+  new (r) ring{};
+  r->buffer = heap_allocator().alloc_array<char>(ring::CAPACITY);
+  return r;
+}
+
+fn free_ring(ring *r) wontthrow -> void
+{
+  if (r == nullptr) return;
+  heap_allocator().free_array(r->buffer, ring::CAPACITY);
+  r->~ring();
+  heap_allocator().free_array(r, 1);
+}
+
+hot fn write_ring(ring *r, StringView bytes) throws -> void
+{
+  usize position = 0;
+  while (position < bytes.length) {
+    if (r->is_reader_closed.load(std::memory_order_acquire))
+      throw BrokenPipeExit{};
+
+    let const written = r->written.load(std::memory_order_relaxed);
+    let const room = ring::CAPACITY -
+                     (written - r->consumed.load(std::memory_order_acquire));
+    if (room == 0) {
+      let const has_room = wait_until(*r, [&] {
+        return r->is_reader_closed.load(std::memory_order_acquire) ||
+               written - r->consumed.load(std::memory_order_acquire) <
+                   ring::CAPACITY;
+      });
+      if (!has_room) throw BrokenPipeExit{};
+      continue;
+    }
+
+    let const left = bytes.length - position;
+    let const count = room < left ? room : left;
+    let const offset = written & (ring::CAPACITY - 1);
+    let const head_count =
+        count < ring::CAPACITY - offset ? count : ring::CAPACITY - offset;
+    __builtin_memcpy(r->buffer + offset, bytes.data + position, head_count);
+    __builtin_memcpy(r->buffer, bytes.data + position + head_count,
+                     count - head_count);
+    r->written.store(written + count, std::memory_order_release);
+    position += count;
+    wake_if_sleeping(*r);
+  }
+}
+
+hot fn read_ring(ring *r, char *buffer, usize capacity) throws -> usize
+{
+  loop
+  {
+    let const consumed = r->consumed.load(std::memory_order_relaxed);
+    let const available =
+        r->written.load(std::memory_order_acquire) - consumed;
+    if (available == 0) {
+      /* The writer stores its last bytes before it closes, so a closed end
+         seen here leaves nothing more to read once the count is rechecked. */
+      if (r->is_writer_closed.load(std::memory_order_acquire)) {
+        if (r->written.load(std::memory_order_acquire) == consumed) return 0;
+        continue;
+      }
+      let const has_bytes = wait_until(*r, [&] {
+        return r->is_writer_closed.load(std::memory_order_acquire) ||
+               r->written.load(std::memory_order_acquire) != consumed;
+      });
+      if (!has_bytes) return 0;
+      continue;
+    }
+
+    let const count = available < capacity ? available : capacity;
+    let const offset = consumed & (ring::CAPACITY - 1);
+    let const head_count =
+        count < ring::CAPACITY - offset ? count : ring::CAPACITY - offset;
+    __builtin_memcpy(buffer, r->buffer + offset, head_count);
+    __builtin_memcpy(buffer + head_count, r->buffer, count - head_count);
+    r->consumed.store(consumed + count, std::memory_order_release);
+    wake_if_sleeping(*r);
+    return count;
+  }
+}
+
+fn read_ring_to_string(ring *r, Allocator allocator) throws -> String
+{
+  let text = String{allocator};
+  char buffer[16384];
+  loop
+  {
+    let const read_count = read_ring(r, buffer, sizeof(buffer));
+    if (read_count == 0) break;
+    text.append(StringView{buffer, read_count});
+  }
+  return text;
+}
+
+fn close_ring_reader(ring *r) wontthrow -> void
+{
+  r->is_reader_closed.store(true, std::memory_order_release);
+  wake(*r);
+}
+
+fn close_ring_writer(ring *r) wontthrow -> void
+{
+  r->is_writer_closed.store(true, std::memory_order_release);
+  wake(*r);
+}
+
+struct stage_thread
+{
+  ExecContext ec;
+  EvalContext *cxt;
+  i32 status{0};
+  os::thread handle{};
+};
+
+static constinit thread_local bool IS_STAGE_THREAD = false;
+
+fn is_stage_thread() wontthrow -> bool { return IS_STAGE_THREAD; }
+
+/* The same fallbacks the forked stage child applies, so an error reads and
+   exits the same whichever way the stage ran. */
+static fn run_stage(stage_thread &stage) wontthrow -> i32
+{
+  try {
+    return execute_builtin(steal(stage.ec), *stage.cxt);
+  } catch (const BrokenPipeExit &) {
+    return SHIT_BROKEN_PIPE_EXIT_STATUS;
+  } catch (const ErrorWithLocation &e) {
+    try {
+      const String *source = stage.cxt->current_source();
+      show_message(e.to_string(
+          source != nullptr ? source->view() : StringView{}, stage.cxt));
+    } catch (...) {}
+    return static_cast<i32>(e.command_status());
+  } catch (const Error &e) {
+    try {
+      show_message(e.to_string());
+    } catch (...) {}
+    return static_cast<i32>(e.command_status());
+  } catch (...) {
+    return 1;
+  }
+}
+
+/* The thread allocates its scratch from an arena of its own and hands its heap
+   cache back before it exits. */
+static fn run_stage_thread(opaque *raw_stage) wontthrow -> void
+{
+  let *stage = static_cast<stage_thread *>(raw_stage);
+  IS_STAGE_THREAD = true;
+  {
+    BumpArena arena{};
+    THREAD_SCRATCH_ARENA = &arena;
+    stage->status = run_stage(*stage);
+    /* A builtin that threw before its own cleanup ran still owns its ends. */
+    try {
+      stage->ec.close_fds();
+    } catch (...) {}
+    THREAD_SCRATCH_ARENA = nullptr;
+  }
+  allocators::heap_pool_instance().release();
+}
+
+fn start_stage_thread(ExecContext &&ec, EvalContext &cxt) throws
+    -> stage_thread *
+{
+  /* The arguments may live in the evaluator's scratch arena, which the thread
+     must not bump, so the thread gets heap copies of them. */
+  let args = ArrayList<String>{heap_allocator()};
+  args.reserve(ec.args().count());
+  for (let const &arg : ec.args())
+    args.push(String{heap_allocator(), arg.view()});
+  let arg_locations = ArrayList<SourceLocation>{heap_allocator()};
+  arg_locations.reserve(ec.arg_locations().count());
+  for (let const &location : ec.arg_locations())
+    arg_locations.push(location);
+
+  let detached = ExecContext::from_resolved(
+      ec.source_location(), ResolvedCommand::from_builtin(ec.builtin_kind()),
+      steal(args), steal(arg_locations));
+  detached.in_fd = ec.in_fd;
+  detached.out_fd = ec.out_fd;
+  detached.err_fd = ec.err_fd;
+  detached.in_ring = ec.in_ring;
+  detached.out_ring = ec.out_ring;
+  detached.should_leave_shell_fds = true;
+  ec.in_fd.reset();
+  ec.out_fd.reset();
+  ec.err_fd.reset();
+  ec.in_ring = nullptr;
+  ec.out_ring = nullptr;
+
+  let *stage = heap_allocator().alloc_array<stage_thread>(1);
+  new (stage) stage_thread{steal(detached), &cxt};
+
+  LOG(Debug, "starting a thread for the pipeline stage '%s'",
+      stage->ec.program().c_str());
+  let const handle = os::start_thread(run_stage_thread, stage);
+  if (!handle.has_value()) {
+    stage->ec.close_fds();
+    stage->~stage_thread();
+    heap_allocator().free_array(stage, 1);
+    throw Error{"Could not start a thread for a pipeline stage"};
+  }
+  stage->handle = *handle;
+  return stage;
+}
+
+fn join_stage_thread(stage_thread *stage) wontthrow -> i32
+{
+  os::join_thread(stage->handle);
+  let const status = stage->status;
+  stage->~stage_thread();
+  heap_allocator().free_array(stage, 1);
+  return status;
+}
+
+} /* namespace stages */
+
+} /* namespace shit */
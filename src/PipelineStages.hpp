@@ -0,0 +1,57 @@
+#pragma once
+
+/* Pipeline stages that run inside the shell. A shitbox utility that reads and
+   writes only through its ExecContext can run on a thread of this process
+   instead of a forked child, and two such neighbours hand their bytes over
+   through a ring in memory instead of a kernel pipe. A stage next to an
+   external program still talks to it through the real pipe. */
+
+#include "Allocator.hpp"
+#include "Common.hpp"
+#include "String.hpp"
+#include "StringView.hpp"
+
+namespace shit {
+
+class EvalContext;
+class ExecContext;
+
+namespace stages {
+
+/* A single-producer single-consumer byte ring the size of a default pipe
+   buffer. Each end is closed once, by the stage that owns it. */
+struct ring;
+
+fn make_ring() throws -> ring *;
+/* Both ends must be closed and no thread may still use the ring. */
+fn free_ring(ring *r) wontthrow -> void;
+
+/* Block while the ring is full. A ring whose reader is gone throws
+   BrokenPipeExit, what a write to a pipe with no reader turns into. */
+fn write_ring(ring *r, StringView bytes) throws -> void;
+/* Copy out what the ring holds, up to capacity bytes, blocking while it is
+   empty. Zero once the writer closes its end and the ring drains, or when an
+   interrupt ends the wait. */
+fn read_ring(ring *r, char *buffer, usize capacity) throws -> usize;
+/* Read until the writer closes its end. An interrupt ends the read early. */
+fn read_ring_to_string(ring *r, Allocator allocator) throws -> String;
+
+fn close_ring_reader(ring *r) wontthrow -> void;
+fn close_ring_writer(ring *r) wontthrow -> void;
+
+struct stage_thread;
+
+/* Whether the caller runs on a stage thread, where the caches the main thread
+   keeps for diagnostics are off limits. */
+fn is_stage_thread() wontthrow -> bool;
+
+/* Run a builtin stage on a new thread. The context moves to the thread, which
+   closes its descriptors and ring ends when the builtin returns. */
+fn start_stage_thread(ExecContext &&ec, EvalContext &cxt) throws
+    -> stage_thread *;
+/* Wait for the stage to finish and read back its exit status. */
+fn join_stage_thread(stage_thread *stage) wontthrow -> i32;
+
+} /* namespace stages */
+
+} /* namespace shit */
@@ -28,5 +28,74 @@ fn read_fd_to_string(os::descriptor fd, Allocator allocator) throws
   }
 }
 
+/* The in-tree engine compiles the pattern, and the platform's libc engine
+   takes it only when the in-tree one reports it unsupported. */
+static fn compile_regex_with_syntax(StringView pattern, Regex::Syntax syntax,
+                                    case_sensitivity sensitivity,
+                                    compiled_regex &out) throws
+    -> regex_compile_result
+{
+  let const allocator = heap_allocator();
+  Regex *engine = allocator.alloc_array<Regex>(1);
+  new (engine) Regex{allocator};
+  let const result =
+      Regex::compile(pattern, syntax,
+                     sensitivity == case_sensitivity::Insensitive, *engine);
+  if (result == Regex::CompileResult::Ok) {
+    out.engine = engine;
+    return regex_compile_result::Ok;
+  }
+
+  engine->~Regex();
+  allocator.free_array(engine, 1);
+  if (result == Regex::CompileResult::Invalid)
+    return regex_compile_result::Invalid;
+  return compile_libc_regex(pattern, syntax == Regex::Syntax::Extended,
+                            sensitivity, out);
+}
+
+fn compile_regex(StringView pattern, case_sensitivity sensitivity,
+                 compiled_regex &out) throws -> regex_compile_result
+{
+  return compile_regex_with_syntax(pattern, Regex::Syntax::Extended,
+                                   sensitivity, out);
+}
+
+fn execute_regex(compiled_regex &compiled, StringView subject,
+                 ArrayList<regex_span> &spans, String &error_message,
+                 Allocator scratch) throws -> regex_match_result
+{
+  if (compiled.engine == nullptr)
+    return execute_libc_regex(compiled, subject, spans, error_message,
+                              scratch);
+
+  return compiled.engine->find(subject, spans) ? regex_match_result::Matched
+                                               : regex_match_result::NoMatch;
+}
+
+fn free_regex(compiled_regex &compiled) wontthrow -> void
+{
+  if (compiled.engine == nullptr) {
+    free_libc_regex(compiled);
+    return;
+  }
+  compiled.engine->~Regex();
+  heap_allocator().free_array(compiled.engine, 1);
+  compiled.engine = nullptr;
+}
+
+fn compile_search_regex(StringView pattern, case_sensitivity sensitivity,
+                        compiled_regex &out) throws -> regex_compile_result
+{
+  return compile_regex_with_syntax(pattern, Regex::Syntax::Basic, sensitivity,
+                                   out);
+}
+
+fn regex_matches(compiled_regex &compiled, StringView subject) throws -> bool
+{
+  if (compiled.engine == nullptr) return libc_regex_matches(compiled, subject);
+  return compiled.engine->is_match(subject);
+}
+
 } /* namespace os */
 } /* namespace shit */
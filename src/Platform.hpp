@@ -32,8 +32,11 @@
 #undef CEOF
 #endif
 #if defined __linux__
+#include <linux/fs.h>
 #include <linux/perf_event.h>
 #include <sched.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/syscall.h>
 #endif
 #if defined __GLIBC__
@@ -107,6 +110,7 @@ hot alwaysinline fn pack_little_endian_bytes(u64 *words, const char *bytes,
 #include "ArrayList.hpp"
 #include "Maybe.hpp"
 #include "Path.hpp"
+#include "Regex.hpp"
 #include "String.hpp"
 
 namespace shit {
@@ -327,6 +331,27 @@ fn start_thread(void (*entry)(opaque *), opaque *context) wontthrow
 
 fn join_thread(thread t) wontthrow -> void;
 
+/* A lock paired with one condition, what a thread sleeps on while it waits for
+   another to make progress. The static initializers stand in for an init call,
+   and neither platform needs a destroy for an unheld one. */
+struct monitor
+{
+#if SHIT_PLATFORM_IS WIN32
+  SRWLOCK lock = SRWLOCK_INIT;
+  CONDITION_VARIABLE condition = CONDITION_VARIABLE_INIT;
+#elif SHIT_PLATFORM_IS POSIX
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t condition = PTHREAD_COND_INITIALIZER;
+#endif
+};
+
+fn lock_monitor(monitor &m) wontthrow -> void;
+fn unlock_monitor(monitor &m) wontthrow -> void;
+/* Sleep with the lock held until a wake or the timeout, whichever comes first.
+   The lock is held again on return. */
+fn wait_monitor(monitor &m, i64 timeout_nanos) wontthrow -> void;
+fn wake_monitor(monitor &m) wontthrow -> void;
+
 enum class file_open_mode : u8
 {
   Truncate,          /* >  create or truncate for writing */
@@ -341,7 +366,10 @@ fn open_file_descriptor(StringView path, file_open_mode mode) throws
 fn acquire_process_lock(StringView path) throws -> Maybe<descriptor>;
 fn release_process_lock(descriptor lock) wontthrow -> void;
 
-fn write_to_temp_file(StringView content) throws -> Maybe<descriptor>;
+/* A descriptor that reads back the heredoc or here-string body from its
+   start. It is a pre-filled pipe or a sealed memory file where Linux offers
+   them, and an unlinked temp file elsewhere. */
+fn stage_heredoc_body(StringView content) throws -> Maybe<descriptor>;
 
 /* On a platform that leaves no temp file, such as POSIX, it holds nothing. */
 class TempFileSet
@@ -366,11 +394,38 @@ fn make_os_args(const ArrayList<String> &args) throws -> os_args;
 
 fn last_system_error_message() throws -> String;
 fn last_system_error_is_missing_file() wontthrow -> bool;
+fn last_system_error_is_existing_file() wontthrow -> bool;
 
 fn wait_and_monitor_process(process p, bool *was_stopped = nullptr) throws
     -> i32;
 fn wait_for_child_state_change() wontthrow -> void;
 
+/* A GNU make jobserver, the pool of job tokens a make shares with every make
+   its recipes start, so a recursive build keeps to one -j budget. The make
+   that creates the pool passes the two pipe ends down in MAKEFLAGS as
+   --jobserver-auth=R,W, and a make that finds that spelling, or the fifo:PATH
+   one of newer GNU make, joins it. A make runs its first job on the token it
+   was started with and takes one from the pool for every job beyond that. */
+struct jobserver
+{
+  descriptor reader{SHIT_INVALID_FD};
+  descriptor writer{SHIT_INVALID_FD};
+  /* The ends a recipe inherits, held only by the make that made the pool. */
+  descriptor shared_reader{SHIT_INVALID_FD};
+  descriptor shared_writer{SHIT_INVALID_FD};
+};
+
+fn create_jobserver(usize token_count) throws -> Maybe<jobserver>;
+fn join_jobserver(StringView auth) throws -> Maybe<jobserver>;
+fn close_jobserver(jobserver &server) wontthrow -> void;
+/* The --jobserver-auth value for the makes a recipe starts. */
+fn jobserver_auth(const jobserver &server) throws -> String;
+/* None when the pool has no free token. It never blocks. */
+fn take_job_token(jobserver &server) wontthrow -> Maybe<char>;
+fn return_job_token(jobserver &server, char token) wontthrow -> void;
+/* Sleep until a child changes state or a token may have come free. */
+fn wait_for_child_state_change_or_token(jobserver &server) wontthrow -> void;
+
 fn reap_process_quietly(process p) throws -> i32;
 
 /* Unchanged means the poll reported no new transition, so the caller keeps the
@@ -385,6 +440,11 @@ enum class process_state : u8
 
 fn poll_process(process p, i32 &status_out) wontthrow -> process_state;
 
+/* The id of a child whose exit, stop or continue no wait has collected yet,
+   looked at without consuming it, so the caller can reap that one child rather
+   than poll every process it owns. None when no child has a report waiting. */
+fn peek_child_report() wontthrow -> Maybe<i64>;
+
 fn signal_process(process p, i32 signal_number) wontthrow -> bool;
 fn process_group_has_members(process group) wontthrow -> bool;
 fn is_process_signal_supported(i32 signal_number) wontthrow -> bool;
@@ -476,6 +536,31 @@ fn read_fd(os::descriptor fd, opaque *buf, usize size) wontthrow
 fn read_fd_to_string(os::descriptor fd, Allocator allocator) throws
     -> Maybe<String>;
 
+enum class copy_result : u8
+{
+  Ok,
+  ReadFailed,  /* errno holds the reason */
+  WriteFailed, /* errno holds the reason */
+  Interrupted,
+  SameFile,
+};
+
+/* Whether to is the regular file from reads and a copy would read back the
+   bytes it just wrote, so it never reaches the end: to appends, or it writes
+   ahead of where from reads. The check cat makes before "input file is output
+   file". */
+fn copy_reads_own_output(descriptor from, descriptor to) wontthrow -> bool;
+
+/* Copy what is left of from, from its offset to its end, to the offset of to.
+   On Linux the kernel moves the bytes where it can. A whole file going into a
+   new empty file is cloned on a filesystem that shares extents, and the holes
+   of a sparse one stay holes. copy_file_range takes file to file, sendfile
+   takes a file to anything else, and splice takes a pipe on either side. A
+   large buffer does the rest, and takes over from where any kernel path
+   stopped, so a failure is reported from the side it happened on. SameFile,
+   with nothing copied, when copy_reads_own_output holds. */
+fn copy_fd_contents(descriptor from, descriptor to) throws -> copy_result;
+
 fn wait_for_fd_readable(os::descriptor fd, i64 timeout_nanos) wontthrow -> i32;
 
 fn close_fd(os::descriptor fd) wontthrow -> bool;
@@ -555,24 +640,18 @@ fn descriptor_is_shell_fd(os::descriptor fd, i32 shell_fd) wontthrow -> bool;
    platform without one. The sign follows strcmp. */
 fn collate_compare(const String &left, const String &right) wontthrow -> int;
 
-/* One capture group's byte span in the subject. A group that did not
-   participate carries a negative start. */
-struct regex_span
-{
-  i64 start{-1};
-  i64 end{-1};
-};
+using regex_span = shit::regex_span;
 
-/* An opaque compiled extended regex. On POSIX it holds a regex_t, on a platform
-   with no regex engine it holds nothing. Ownership is tracked by CompiledRegex,
-   not here. */
+/* An opaque compiled regex. The in-tree engine holds it, and on POSIX a
+   pattern the engine reports unsupported, one with a backreference, is held
+   by a libc regex_t instead. Ownership is tracked by CompiledRegex, not
+   here. */
 struct compiled_regex
 {
+  Regex *engine{nullptr};
 #if SHIT_PLATFORM_IS POSIX
   regex_t re{};
-#else
-  String pattern{heap_allocator()};
-  bool is_case_insensitive{false};
+  bool is_libc{false};
 #endif
 };
 
@@ -589,10 +668,6 @@ enum class regex_match_result : u8
   Error,
 };
 
-/* False on a platform with no regex engine, so [[ =~ ]] reports it is
-   unsupported rather than matching. */
-constexpr bool HAS_REGEX_ENGINE = ((SHIT_SUPPORT_VECTOR) &POSIX) != 0;
-
 fn compile_regex(StringView pattern, case_sensitivity sensitivity,
                  compiled_regex &out) throws -> regex_compile_result;
 
@@ -602,9 +677,8 @@ fn execute_regex(compiled_regex &compiled, StringView subject,
 
 fn free_regex(compiled_regex &compiled) wontthrow -> void;
 
-/* Compiles a search pattern for a line-at-a-time grep. On POSIX it is a basic
-   regex with no capture, on a platform with no engine it is a literal
-   substring. */
+/* Compiles a search pattern for a line-at-a-time grep, a basic regex with no
+   capture. */
 fn compile_search_regex(StringView pattern, case_sensitivity sensitivity,
                         compiled_regex &out) throws -> regex_compile_result;
 
@@ -645,6 +719,77 @@ cold fn list_directory(StringView dir) throws -> Maybe<ArrayList<String>>;
 cold fn list_directory_typed(StringView dir) throws
     -> Maybe<ArrayList<Path::directory_child>>;
 
+/* Entries named by the open directory that holds them, the way the POSIX *at
+   calls name them, so a walk down a tree neither rebuilds each full path nor
+   has it resolved again from the root. A failed open returns an invalid
+   reference, and every failure leaves the reason for
+   last_system_error_message. Windows has no such calls, so there the name is
+   joined to the path the handle resolves to. */
+fn open_directory(StringView path) throws -> DirectoryReference;
+fn open_directory_at(const DirectoryReference &parent, StringView name) throws
+    -> DirectoryReference;
+fn list_directory_at(const DirectoryReference &dir) throws
+    -> Maybe<ArrayList<Path::directory_child>>;
+/* Like stat_path, a symlink is not followed. */
+fn stat_at(const DirectoryReference &parent, StringView name,
+           file_status &status) throws -> bool;
+fn stat_descriptor(descriptor fd, file_status &status) wontthrow -> bool;
+fn make_directory_at(const DirectoryReference &parent, StringView name,
+                     u32 mode) throws -> bool;
+fn open_file_at(const DirectoryReference &parent, StringView name,
+                file_open_mode mode) throws -> Maybe<descriptor>;
+fn set_descriptor_mode(descriptor fd, u32 mode) wontthrow -> bool;
+fn remove_file_at(const DirectoryReference &parent, StringView name) throws
+    -> bool;
+fn create_symlink_at(StringView target, const DirectoryReference &parent,
+                     StringView name) throws -> bool;
+fn read_symlink_at(const DirectoryReference &parent, StringView name) throws
+    -> Maybe<String>;
+/* The existing file is a path, relative to the current directory. */
+fn create_hard_link_at(StringView existing, const DirectoryReference &parent,
+                       StringView name) throws -> bool;
+
+/* The entries of an open directory one at a time, with no String per name.
+   Linux reads them with getdents64 straight from the reference's descriptor,
+   so the reference must not be read by anything else meanwhile. Other POSIX
+   systems go through readdir on a duplicate, and Windows through
+   FindNextFile. A view lasts until the next call. */
+class DirectoryStream
+{
+public:
+  struct entry
+  {
+    StringView name;
+    Path::entry_kind kind;
+  };
+
+  DirectoryStream() = default;
+  DirectoryStream(const DirectoryStream &) = delete;
+  DirectoryStream &operator=(const DirectoryStream &) = delete;
+  ~DirectoryStream();
+
+  /* False with the reason left for last_system_error_message. */
+  fn open(const DirectoryReference &dir) throws -> bool;
+  /* None at the end, or on a failed read, which has_failed tells apart. */
+  fn next() throws -> Maybe<entry>;
+  mustuse pure fn has_failed() const wontthrow -> bool { return m_has_failed; }
+
+private:
+#if SHIT_PLATFORM_IS WIN32
+  HANDLE m_handle{INVALID_HANDLE_VALUE};
+  WIN32_FIND_DATAA m_data{};
+  bool m_has_pending{false};
+#elif defined __linux__
+  descriptor m_fd{SHIT_INVALID_FD};
+  char *m_buffer{nullptr};
+  usize m_length{0};
+  usize m_position{0};
+#elif SHIT_PLATFORM_IS POSIX
+  DIR *m_handle{nullptr};
+#endif
+  bool m_has_failed{false};
+};
+
 /* The user and system seconds the shell and its children have consumed. Every
    field is zero on a platform with no process accounting. */
 struct cpu_times
@@ -780,6 +925,9 @@ struct processor_counts
 
 fn get_processor_counts() wontthrow -> processor_counts;
 
+/* The one-minute load average, None where the system does not report one. */
+fn load_average() wontthrow -> Maybe<f64>;
+
 fn get_home_directory() throws -> Maybe<Path>;
 
 fn get_home_for_user(StringView username) throws -> Maybe<Path>;
@@ -802,6 +950,11 @@ extern volatile sig_atomic_t INTERRUPT_REQUESTED;
    by the prompt's wake hook so set -b reports a finished job immediately. */
 extern volatile sig_atomic_t CHILD_STATE_CHANGED;
 
+/* Advanced by the SIGCHLD handler on every child state change and never
+   cleared, so the job table can tell whether anything happened since it last
+   looked. */
+extern volatile sig_atomic_t CHILD_STATE_GENERATION;
+
 /* Set to one whenever any trapped signal arrives, so the evaluator's hot poll
    is a single read. The drain at the command boundary clears it as it consumes
    the per-signal flags. */
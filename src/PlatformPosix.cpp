@@ -12,6 +12,7 @@ namespace os {
 
 volatile sig_atomic_t INTERRUPT_REQUESTED = 0;
 volatile sig_atomic_t CHILD_STATE_CHANGED = 0;
+volatile sig_atomic_t CHILD_STATE_GENERATION = 0;
 volatile sig_atomic_t SIGNAL_PENDING = 0;
 
 static constexpr i32 SIGNAL_FLAG_COUNT = 128;
@@ -38,6 +39,12 @@ fn take_pending_signal() wontthrow -> i32
 
 #define SHIT_UMASK(mask) umask(static_cast<mode_t>(mask))
 
+#if defined __GLIBC__
+#if __GLIBC_PREREQ(2, 35)
+#define SHIT_HAS_SPAWN_TCSETPGRP 1
+#endif
+#endif
+
 namespace shit {
 
 namespace os {
@@ -248,10 +255,10 @@ fn get_current_user() throws -> Maybe<String>
 {
   /* getpwuid is avoided so the static build does not pull in the glibc NSS
      modules. */
-  if (const char *name = std::getenv("LOGNAME"); name != nullptr)
-    return String{name};
-  if (const char *name = std::getenv("USER"); name != nullptr)
-    return String{name};
+  if (let name = get_environment_variable("LOGNAME"); name.has_value())
+    return name;
+  if (let name = get_environment_variable("USER"); name.has_value())
+    return name;
 
   return uid_to_username(static_cast<u32>(getuid()));
 }
@@ -279,6 +286,17 @@ fn get_processor_counts() wontthrow -> processor_counts
   return counts;
 }
 
+fn load_average() wontthrow -> Maybe<f64>
+{
+#if SHIT_PLATFORM_IS COSMO
+  return None;
+#else
+  double samples[1] = {};
+  if (getloadavg(samples, 1) != 1) return None;
+  return static_cast<f64>(samples[0]);
+#endif
+}
+
 fn get_home_directory() throws -> Maybe<Path>
 {
   if (let const home = get_environment_variable("HOME"); home.has_value())
@@ -384,23 +402,26 @@ fn collate_compare(const String &left, const String &right) wontthrow -> int
   return strcoll(left.c_str(), right.c_str());
 }
 
-fn compile_regex(StringView pattern, case_sensitivity sensitivity,
-                 compiled_regex &out) throws -> regex_compile_result
+/* libc holds a pattern the in-tree engine reports unsupported, which is one
+   with a backreference. */
+fn compile_libc_regex(StringView pattern, bool is_extended,
+                      case_sensitivity sensitivity, compiled_regex &out) throws
+    -> regex_compile_result
 {
-  let const is_case_insensitive = sensitivity == case_sensitivity::Insensitive;
   let const pattern_text = String{heap_allocator(), pattern};
-  int compile_flags = REG_EXTENDED;
-  if (is_case_insensitive) compile_flags |= REG_ICASE;
+  int compile_flags = is_extended ? REG_EXTENDED : REG_NOSUB;
+  if (sensitivity == case_sensitivity::Insensitive) compile_flags |= REG_ICASE;
 
   if (regcomp(&out.re, pattern_text.c_str(), compile_flags) != 0)
     return regex_compile_result::Invalid;
 
+  out.is_libc = true;
   return regex_compile_result::Ok;
 }
 
-fn execute_regex(compiled_regex &compiled, StringView subject,
-                 ArrayList<regex_span> &spans, String &error_message,
-                 Allocator scratch) throws -> regex_match_result
+fn execute_libc_regex(compiled_regex &compiled, StringView subject,
+                      ArrayList<regex_span> &spans, String &error_message,
+                      Allocator scratch) throws -> regex_match_result
 {
   let const subject_text = String{scratch, subject};
   let const group_count = compiled.re.re_nsub + 1;
@@ -430,26 +451,8 @@ fn execute_regex(compiled_regex &compiled, StringView subject,
   return regex_match_result::Matched;
 }
 
-fn free_regex(compiled_regex &compiled) wontthrow -> void
-{
-  regfree(&compiled.re);
-}
-
-fn compile_search_regex(StringView pattern, case_sensitivity sensitivity,
-                        compiled_regex &out) throws -> regex_compile_result
-{
-  let const is_case_insensitive = sensitivity == case_sensitivity::Insensitive;
-  const String pattern_text{heap_allocator(), pattern};
-  int compile_flags = REG_NOSUB;
-  if (is_case_insensitive) compile_flags |= REG_ICASE;
-
-  if (regcomp(&out.re, pattern_text.c_str(), compile_flags) != 0)
-    return regex_compile_result::Invalid;
-
-  return regex_compile_result::Ok;
-}
-
-fn regex_matches(compiled_regex &compiled, StringView subject) throws -> bool
+fn libc_regex_matches(compiled_regex &compiled, StringView subject) throws
+    -> bool
 {
 #if defined REG_STARTEND
   regmatch_t bounds[1];
@@ -462,6 +465,11 @@ fn regex_matches(compiled_regex &compiled, StringView subject) throws -> bool
 #endif
 }
 
+fn free_libc_regex(compiled_regex &compiled) wontthrow -> void
+{
+  if (compiled.is_libc) regfree(&compiled.re);
+}
+
 pure fn path_is_absolute(StringView path) wontthrow -> bool
 {
   if (path.length == 0) return false;
@@ -487,8 +495,8 @@ pure fn path_root_length(StringView path) wontthrow -> usize
 
 fn temp_directory_path() throws -> String
 {
-  if (const char *from_env = std::getenv("TMPDIR"); from_env != nullptr)
-    return String{from_env};
+  if (let from_env = get_environment_variable("TMPDIR"); from_env.has_value())
+    return from_env.value();
   return String{"/tmp"};
 }
 
@@ -743,13 +751,21 @@ cold fn list_directory(StringView dir) throws -> Maybe<ArrayList<String>>
   return names;
 }
 
-cold fn list_directory_typed(StringView dir) throws
-    -> Maybe<ArrayList<Path::directory_child>>
+static fn entry_kind_of(unsigned char type) wontthrow -> Path::entry_kind
 {
-  const String dir_string{dir};
-  let const handle = ::opendir(dir_string.c_str());
-  if (handle == nullptr) return None;
+  switch (type) {
+  case DT_DIR: return Path::entry_kind::Directory;
+  case DT_REG: return Path::entry_kind::Regular;
+  case DT_LNK: return Path::entry_kind::Symlink;
+  case DT_UNKNOWN: return Path::entry_kind::Unknown;
+  default: return Path::entry_kind::Other;
+  }
+}
 
+/* Takes over the handle and closes it. */
+static fn read_typed_entries(DIR *handle) throws
+    -> Maybe<ArrayList<Path::directory_child>>
+{
   let entries = ArrayList<Path::directory_child>{heap_allocator()};
   loop
   {
@@ -768,22 +784,23 @@ cold fn list_directory_typed(StringView dir) throws
       continue;
     }
 
-    Path::entry_kind kind = Path::entry_kind::Unknown;
-    switch (entry->d_type) {
-    case DT_DIR: kind = Path::entry_kind::Directory; break;
-    case DT_REG: kind = Path::entry_kind::Regular; break;
-    case DT_LNK: kind = Path::entry_kind::Symlink; break;
-    case DT_UNKNOWN: kind = Path::entry_kind::Unknown; break;
-    default: kind = Path::entry_kind::Other; break;
-    }
-
-    entries.push(Path::directory_child{String{name}, kind});
+    entries.push(
+        Path::directory_child{String{name}, entry_kind_of(entry->d_type)});
   }
 
   ::closedir(handle);
   return entries;
 }
 
+cold fn list_directory_typed(StringView dir) throws
+    -> Maybe<ArrayList<Path::directory_child>>
+{
+  const String dir_string{dir};
+  let const handle = ::opendir(dir_string.c_str());
+  if (handle == nullptr) return None;
+  return read_typed_entries(handle);
+}
+
 fn read_process_cpu_times() wontthrow -> cpu_times
 {
   cpu_times result{};
@@ -900,13 +917,123 @@ fn normalize_program_name(String &program_name) throws -> program_name_info
 }
 #endif /* !COSMO */
 
+/* The shell keeps the process environment itself rather than in libc's
+   environ, where every setenv copies and scans the whole array and musl leaks
+   the replaced strings. An assignment only updates this table, and the packed
+   envp a spawn hands the program is rebuilt only when the table changed since
+   the last spawn. The table is read from environ on first use. An unset leaves
+   a hole so the others keep their place, the way setenv appends a new name
+   last, and the holes are squeezed out when the envp is rebuilt. */
+struct environment_entry
+{
+  String name;
+  String value;
+  bool is_set;
+};
+
+struct environment_table
+{
+  ArrayList<environment_entry> entries{heap_allocator()};
+  StringMap<usize> index{heap_allocator()};
+  usize hole_count{0};
+  bool is_loaded{false};
+  u64 generation{0};
+  u64 block_generation{~u64{0}};
+  ArrayList<char> block_bytes{heap_allocator()};
+  ArrayList<char *> block{heap_allocator()};
+};
+
+static environment_table ENVIRONMENT{};
+
+static fn environment() throws -> environment_table &
+{
+  let &table = ENVIRONMENT;
+  if (table.is_loaded) return table;
+
+  table.is_loaded = true;
+  if (environ == nullptr) return table;
+  for (char **entry = environ; *entry != nullptr; entry++) {
+    StringView pair{*entry};
+    let const equals = pair.find_character('=');
+    if (!equals.has_value()) continue;
+    let const name = pair.substring_of_length(0, *equals);
+    if (let const *slot = table.index.find(name); slot != nullptr) {
+      table.entries[*slot].value = String{pair.substring(*equals + 1)};
+      continue;
+    }
+    table.index.set(name, table.entries.count());
+    table.entries.push(
+        environment_entry{String{name}, String{pair.substring(*equals + 1)},
+                          true});
+  }
+  return table;
+}
+
+/* The C library reads the time zone and the locale from environ itself, for
+   localtime and setlocale, so those few names are still written through. */
+static fn is_read_by_libc(StringView name) wontthrow -> bool
+{
+  return name == "TZ" || name == "LANG" || name == "LANGUAGE" ||
+         name.starts_with("LC_");
+}
+
+/* The envp a spawn passes, rebuilt only after the table changed. The strings
+   sit back to back in one buffer, so a rebuild is two allocations. */
+static fn environment_block() throws -> char *const *
+{
+  let &table = environment();
+  if (table.block_generation == table.generation) return table.block.begin();
+
+  if (table.hole_count > 0) {
+    usize kept = 0;
+    for (usize i = 0; i < table.entries.count(); i++) {
+      if (!table.entries[i].is_set) continue;
+      if (kept != i) table.entries[kept] = steal(table.entries[i]);
+      table.index.set(table.entries[kept].name.view(), kept);
+      kept++;
+    }
+    while (table.entries.count() > kept)
+      table.entries.pop_back();
+    table.hole_count = 0;
+  }
+
+  usize byte_count = 0;
+  for (let const &entry : table.entries)
+    byte_count += entry.name.length() + entry.value.length() + 2;
+  table.block_bytes.clear();
+  table.block_bytes.reserve(byte_count);
+  let const append = [&table](StringView text) {
+    for (usize i = 0; i < text.length; i++)
+      table.block_bytes.push(text[i]);
+  };
+  for (let const &entry : table.entries) {
+    append(entry.name.view());
+    table.block_bytes.push('=');
+    append(entry.value.view());
+    table.block_bytes.push('\0');
+  }
+
+  table.block.clear();
+  table.block.reserve(table.entries.count() + 1);
+  usize offset = 0;
+  for (let const &entry : table.entries) {
+    table.block.push(table.block_bytes.begin() + offset);
+    offset += entry.name.length() + entry.value.length() + 2;
+  }
+  table.block.push(nullptr);
+  table.block_generation = table.generation;
+  LOG(Debug, "rebuilt the environment block of %zu entries",
+      table.entries.count());
+  return table.block.begin();
+}
+
 fn get_environment_variable(StringView key) throws -> Maybe<String>
 {
   LOG(All, "reading the environment variable '%.*s'",
       static_cast<int>(key.length), key.data);
-  const String key_string{key};
-  const char *e = std::getenv(key_string.c_str());
-  if (e != nullptr) return String{e};
+  let const &table = environment();
+  if (let const *slot = table.index.find(key); slot != nullptr)
+    return table.entries[*slot].value.clone();
   return shit::None;
 }
 
@@ -914,17 +1041,40 @@ fn set_environment_variable(StringView key, StringView value) throws -> void
 {
   LOG(All, "setting the environment variable '%.*s'",
       static_cast<int>(key.length), key.data);
-  const String key_string{key};
-  const String value_string{value};
-  setenv(key_string.c_str(), value_string.c_str(), 1);
+  let &table = environment();
+  if (let const *slot = table.index.find(key); slot != nullptr) {
+    table.entries[*slot].value = String{value};
+  } else {
+    table.index.set(key, table.entries.count());
+    table.entries.push(environment_entry{String{key}, String{value}, true});
+  }
+  table.generation++;
+
+  if (is_read_by_libc(key)) {
+    const String key_string{key};
+    const String value_string{value};
+    setenv(key_string.c_str(), value_string.c_str(), 1);
+  }
 }
 
 fn unset_environment_variable(StringView key) throws -> void
 {
   LOG(All, "unsetting the environment variable '%.*s'",
       static_cast<int>(key.length), key.data);
-  const String key_string{key};
-  unsetenv(key_string.c_str());
+  let &table = environment();
+  if (let const *slot = table.index.find(key); slot != nullptr) {
+    let &entry = table.entries[*slot];
+    entry.is_set = false;
+    entry.value = String{heap_allocator()};
+    table.index.erase(key);
+    table.hole_count++;
+    table.generation++;
+  }
+
+  if (is_read_by_libc(key)) {
+    const String key_string{key};
+    unsetenv(key_string.c_str());
+  }
 }
 
 fn signal_internal_diagnostic() wontthrow -> void {}
@@ -932,14 +1082,8 @@ fn signal_internal_diagnostic() wontthrow -> void {}
 fn environment_names() throws -> ArrayList<String>
 {
   ArrayList<String> names{heap_allocator()};
-  if (environ == nullptr) return names;
-  for (char **entry = environ; *entry != nullptr; entry++) {
-    StringView pair{*entry};
-    let const equals = pair.find_character('=');
-    let const name =
-        equals.has_value() ? pair.substring_of_length(0, *equals) : pair;
-    names.push(String{name});
-  }
+  for (let const &entry : environment().entries)
+    if (entry.is_set) names.push(entry.name.clone());
   return names;
 }
 
@@ -1014,7 +1158,34 @@ hot fn execute_program(ExecContext &&ec, script_fallback_policy fallback,
     if (!was_fds_handed_to_fallback) ec.close_fds();
   };
 
-  if (should_hand_off_controlling_terminal_before_start) {
+  posix_spawn_file_actions_t file_actions;
+  posix_spawn_file_actions_init(&file_actions);
+  defer { posix_spawn_file_actions_destroy(&file_actions); };
+
+  let should_start_behind_gate =
+      should_hand_off_controlling_terminal_before_start;
+#if defined SHIT_HAS_SPAWN_TCSETPGRP
+  /* The spawned child has joined its new group by the time the file actions
+     run and still holds every signal blocked, so its tcsetpgrp hands it the
+     terminal before the exec with no forked gate and no SIGTTOU. The shell's
+     own stdin names the terminal, so the action comes before any dup2 that
+     replaces it. An action the C library refuses leaves the gate to do it. */
+  if (should_start_behind_gate) {
+    if (shell_has_controlling_terminal()) {
+      ASSERT(new_process_group,
+             "the terminal goes to a group of the child's own");
+      should_start_behind_gate = posix_spawn_file_actions_addtcsetpgrp_np(
+                                     &file_actions, STDIN_FILENO) != 0;
+    } else {
+      should_start_behind_gate = false;
+    }
+  }
+#endif
+
+  /* With no terminal action in the spawn, a forked child waits on a gate until
+     the terminal is its group's, and a second pipe reports whether its exec
+     failed. */
+  if (should_start_behind_gate) {
     let const start_pipe = os::make_pipe();
     let const outcome_pipe = os::make_pipe();
     if (!start_pipe.has_value() || !outcome_pipe.has_value()) {
@@ -1089,10 +1260,6 @@ hot fn execute_program(ExecContext &&ec, script_fallback_policy fallback,
 
   let const child_args = make_os_args(ec.args());
 
-  posix_spawn_file_actions_t file_actions;
-  posix_spawn_file_actions_init(&file_actions);
-  defer { posix_spawn_file_actions_destroy(&file_actions); };
-
   /* A descriptor already on its target slot is left in place, the close would
      shut the live descriptor. */
   if (ec.in_fd && *ec.in_fd != STDIN_FILENO) {
@@ -1152,7 +1319,7 @@ hot fn execute_program(ExecContext &&ec, script_fallback_policy fallback,
                   const_cast<char *const *>(child_args.begin()),
                   ec.should_use_empty_environment
                       ? const_cast<char *const *>(empty_environment)
-                      : environ);
+                      : environment_block());
 
   /* An ENOEXEC file with no shebang runs as a shell script in place, the POSIX
      behavior. The check runs before the fds close so the script keeps them. */
@@ -1292,7 +1459,8 @@ fn capture_program_output(const ArrayList<String> &argv,
   pid_t child_pid = 0;
   const int spawn_result =
       posix_spawn(&child_pid, raw_args[0], &file_actions, &attr,
-                  const_cast<char *const *>(raw_args.begin()), environ);
+                  const_cast<char *const *>(raw_args.begin()),
+                  environment_block());
   posix_spawnattr_destroy(&attr);
   posix_spawn_file_actions_destroy(&file_actions);
   close(write_end);
@@ -1604,7 +1772,7 @@ fn replace_process(ExecContext &&ec) throws -> void
          const_cast<char *const *>(child_args.begin()),
          ec.should_use_empty_environment
              ? const_cast<char *const *>(empty_environment)
-             : environ);
+             : environment_block());
 
   let const exec_error = errno;
   if (exec_error == ENOEXEC) return;
@@ -1677,6 +1845,28 @@ fn start_thread(void (*entry)(opaque *), opaque *context) wontthrow
 
 fn join_thread(thread t) wontthrow -> void { pthread_join(t.handle, nullptr); }
 
+fn lock_monitor(monitor &m) wontthrow -> void { pthread_mutex_lock(&m.lock); }
+
+fn unlock_monitor(monitor &m) wontthrow -> void
+{
+  pthread_mutex_unlock(&m.lock);
+}
+
+fn wait_monitor(monitor &m, i64 timeout_nanos) wontthrow -> void
+{
+  struct timespec deadline{};
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  let const nanos = static_cast<i64>(deadline.tv_nsec) + timeout_nanos;
+  deadline.tv_sec += static_cast<time_t>(nanos / 1'000'000'000);
+  deadline.tv_nsec = static_cast<long>(nanos % 1'000'000'000);
+  pthread_cond_timedwait(&m.condition, &m.lock, &deadline);
+}
+
+fn wake_monitor(monitor &m) wontthrow -> void
+{
+  pthread_cond_broadcast(&m.condition);
+}
+
 fn open_file_descriptor(StringView path, file_open_mode mode) throws
     -> Maybe<descriptor>
 {
@@ -1719,10 +1909,65 @@ fn release_process_lock(descriptor lock) wontthrow -> void
   unused(::close(lock));
 }
 
-fn write_to_temp_file(StringView content) throws -> Maybe<descriptor>
+static fn write_all(int fd, StringView content) wontthrow -> bool
+{
+  usize offset = 0;
+  while (offset < content.count()) {
+    let written = ::write(fd, content.data + offset, content.count() - offset);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) return false;
+    offset += static_cast<usize>(written);
+  }
+  return true;
+}
+
+#if defined __linux__
+/* A body that fits the pipe buffer is written into a pipe whose write end is
+   closed at once, so the reader sees the body and then end of file, and no
+   file is ever made. The write end does not block, so a pipe the kernel gave
+   less room than asked for reports it instead of hanging the shell. Like the
+   temp file, neither end is close-on-exec, since a numbered heredoc that lands
+   on its own descriptor is handed to the program as it is. */
+static fn stage_in_pipe(StringView content) wontthrow -> Maybe<descriptor>
+{
+  int ends[2];
+  if (pipe2(ends, O_NONBLOCK) != 0) return shit::None;
+  let const capacity = fcntl(ends[1], F_GETPIPE_SZ);
+  if (capacity < 0 || content.count() > static_cast<usize>(capacity) ||
+      !write_all(ends[1], content))
+  {
+    close(ends[0]);
+    close(ends[1]);
+    return shit::None;
+  }
+  close(ends[1]);
+  let const flags = fcntl(ends[0], F_GETFL);
+  if (flags != -1) fcntl(ends[0], F_SETFL, flags & ~O_NONBLOCK);
+  return ends[0];
+}
+
+/* A larger body goes into an anonymous memory file, sealed once written so
+   the reader holds a seekable, read-only copy no one can change. */
+static fn stage_in_memory_file(StringView content) wontthrow
+    -> Maybe<descriptor>
 {
-  LOG(Debug, "writing %zu bytes into an anonymous temp file", content.count());
+  const int fd = memfd_create("shit_heredoc", MFD_ALLOW_SEALING);
+  if (fd < 0) return shit::None;
+  if (!write_all(fd, content) || lseek(fd, 0, SEEK_SET) < 0) {
+    close(fd);
+    return shit::None;
+  }
+  unused(fcntl(fd, F_ADD_SEALS,
+               F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL));
+  return fd;
+}
+#endif
 
+/* The temp file every POSIX system has, unlinked as soon as it is open. */
+static fn stage_in_temp_file(StringView content) throws -> Maybe<descriptor>
+{
   let const temp_dir = Path::temp_directory();
 
   let const path_template_path =
@@ -1741,24 +1986,188 @@ fn write_to_temp_file(StringView content) throws -> Maybe<descriptor>
 
   unlink(path_template.begin());
 
-  usize offset = 0;
-  while (offset < content.count()) {
-    let written = ::write(fd, content.data + offset, content.count() - offset);
-    if (written < 0 && errno == EINTR) {
+  if (!write_all(fd, content) || lseek(fd, 0, SEEK_SET) < 0) {
+    close(fd);
+    return shit::None;
+  }
+  return fd;
+}
+
+fn stage_heredoc_body(StringView content) throws -> Maybe<descriptor>
+{
+  LOG(Debug, "staging a heredoc body of %zu bytes", content.count());
+
+#if defined __linux__
+  if (let const piped = stage_in_pipe(content); piped.has_value())
+    return piped;
+  if (let const in_memory = stage_in_memory_file(content);
+      in_memory.has_value())
+    return in_memory;
+  LOG(Debug, "no pipe or memory file took the heredoc, using a temp file");
+#endif
+  return stage_in_temp_file(content);
+}
+
+/* A kernel copy moves at most this much per call, so an interrupt is seen
+   between the pieces of a large file. */
+static constexpr usize KERNEL_COPY_PIECE = 64 * 1024 * 1024;
+static constexpr usize COPY_BUFFER_SIZE = 1024 * 1024;
+
+enum class copy_method : u8
+{
+  Buffer,
+  FileRange,
+  SendFile,
+  Splice,
+};
+
+/* Whatever a kernel path refuses, the buffer carries on from the offsets it
+   left, so a real read or write error turns up there on its own side. */
+static fn copy_span(descriptor from, descriptor to, u64 length,
+                    copy_method method, char *&buffer) throws -> copy_result
+{
+  u64 left = length;
+  while (left > 0) {
+    if (INTERRUPT_REQUESTED) return copy_result::Interrupted;
+    let const piece = left < KERNEL_COPY_PIECE ? static_cast<usize>(left)
+                                               : KERNEL_COPY_PIECE;
+    if (method == copy_method::Buffer) {
+      if (buffer == nullptr)
+        buffer = heap_allocator().alloc_array<char>(COPY_BUFFER_SIZE);
+      let const wanted = piece < COPY_BUFFER_SIZE ? piece : COPY_BUFFER_SIZE;
+      let const read_count = read_fd(from, buffer, wanted);
+      if (!read_count.has_value())
+        return INTERRUPT_REQUESTED ? copy_result::Interrupted
+                                   : copy_result::ReadFailed;
+      if (*read_count == 0) return copy_result::Ok;
+      if (!write_all(to, StringView{buffer, *read_count}))
+        return copy_result::WriteFailed;
+      left -= *read_count;
       continue;
     }
-    if (written < 0) {
-      close(fd);
-      return shit::None;
+
+    ssize_t moved = -1;
+#if defined __linux__
+    switch (method) {
+    case copy_method::FileRange:
+      moved = copy_file_range(from, nullptr, to, nullptr, piece, 0);
+      break;
+    case copy_method::SendFile:
+      moved = sendfile(to, from, nullptr, piece);
+      break;
+    case copy_method::Splice:
+      moved = splice(from, nullptr, to, nullptr, piece,
+                     SPLICE_F_MOVE | SPLICE_F_MORE);
+      break;
+    case copy_method::Buffer: break;
     }
-    offset += static_cast<usize>(written);
-  }
+#endif
+    if (moved == 0) return copy_result::Ok;
+    if (moved < 0) {
+      if (errno != EINTR) method = copy_method::Buffer;
+      continue;
+    }
+    left -= static_cast<u64>(moved);
+  }
+  return copy_result::Ok;
+}
+
+#if defined __linux__
+/* Only the data runs of the source are copied, each to the same offset, and
+   the final length is set at the end so a trailing hole stays a hole. */
+static fn copy_sparse_file(descriptor from, descriptor to, off_t size,
+                           char *&buffer) throws -> copy_result
+{
+  off_t position = 0;
+  while (position < size) {
+    let const data = lseek(from, position, SEEK_DATA);
+    if (data < 0 && errno == ENXIO) break;
+    if (data < 0) {
+      /* A filesystem without SEEK_DATA gets a plain copy of the rest. */
+      if (lseek(from, position, SEEK_SET) < 0) return copy_result::ReadFailed;
+      if (lseek(to, position, SEEK_SET) < 0) return copy_result::WriteFailed;
+      return copy_span(from, to, UINT64_MAX, copy_method::FileRange, buffer);
+    }
+    let hole = lseek(from, data, SEEK_HOLE);
+    if (hole < 0) hole = size;
+    if (lseek(from, data, SEEK_SET) < 0) return copy_result::ReadFailed;
+    if (lseek(to, data, SEEK_SET) < 0) return copy_result::WriteFailed;
+    let const result =
+        copy_span(from, to, static_cast<u64>(hole - data),
+                  copy_method::FileRange, buffer);
+    if (result != copy_result::Ok) return result;
+    position = hole;
+  }
+
+  if (ftruncate(to, size) != 0) return copy_result::WriteFailed;
+  unused(lseek(from, size, SEEK_SET));
+  unused(lseek(to, size, SEEK_SET));
+  return copy_result::Ok;
+}
+#endif
 
-  if (lseek(fd, 0, SEEK_SET) < 0) {
-    close(fd);
-    return shit::None;
+fn copy_reads_own_output(descriptor from, descriptor to) wontthrow -> bool
+{
+  struct stat from_status{};
+  struct stat to_status{};
+  if (fstat(from, &from_status) != 0 || fstat(to, &to_status) != 0)
+    return false;
+  if (!S_ISREG(to_status.st_mode) || from_status.st_dev != to_status.st_dev ||
+      from_status.st_ino != to_status.st_ino)
+    return false;
+
+  let const read_offset = lseek(from, 0, SEEK_CUR);
+  if (read_offset < 0) return false;
+  let const to_flags = fcntl(to, F_GETFL);
+  if (to_flags != -1 && (to_flags & O_APPEND) != 0) return true;
+  let const write_offset = lseek(to, 0, SEEK_CUR);
+  return write_offset >= 0 && read_offset < write_offset;
+}
+
+fn copy_fd_contents(descriptor from, descriptor to) throws -> copy_result
+{
+  if (copy_reads_own_output(from, to)) return copy_result::SameFile;
+
+  char *buffer = nullptr;
+  defer {
+    if (buffer != nullptr)
+      heap_allocator().free_array(buffer, COPY_BUFFER_SIZE);
+  };
+
+  let method = copy_method::Buffer;
+#if defined __linux__
+  struct stat from_status{};
+  struct stat to_status{};
+  if (fstat(from, &from_status) == 0 && fstat(to, &to_status) == 0) {
+    /* A file of length zero may still read back bytes, as the ones in /proc
+       do, and only a read finds them. */
+    let const is_from_file =
+        S_ISREG(from_status.st_mode) && from_status.st_size > 0;
+    if (is_from_file && S_ISREG(to_status.st_mode)) {
+      let const to_flags = fcntl(to, F_GETFL);
+      let const is_whole_into_empty =
+          lseek(from, 0, SEEK_CUR) == 0 && to_status.st_size == 0 &&
+          lseek(to, 0, SEEK_CUR) == 0 && to_flags != -1 &&
+          (to_flags & O_APPEND) == 0;
+      if (is_whole_into_empty) {
+        if (ioctl(to, FICLONE, from) == 0) {
+          LOG(Debug, "cloned the extents of fd %d into fd %d", from, to);
+          unused(lseek(from, from_status.st_size, SEEK_SET));
+          unused(lseek(to, from_status.st_size, SEEK_SET));
+          return copy_result::Ok;
+        }
+        if (from_status.st_blocks * 512 < from_status.st_size)
+          return copy_sparse_file(from, to, from_status.st_size, buffer);
+      }
+      method = copy_method::FileRange;
+    } else if (is_from_file) {
+      method = copy_method::SendFile;
+    } else if (S_ISFIFO(from_status.st_mode) || S_ISFIFO(to_status.st_mode)) {
+      method = copy_method::Splice;
+    }
   }
-  return fd;
+#endif
+  return copy_span(from, to, UINT64_MAX, method, buffer);
 }
 
 fn wait_and_monitor_process(process pid, bool *was_stopped) throws -> i32
@@ -1833,6 +2242,165 @@ fn wait_for_child_state_change() wontthrow -> void
   (void) sigprocmask(SIG_SETMASK, &previous_mask, nullptr);
 }
 
+/* The pool is read through a description of this make's own with O_NONBLOCK
+   set, reopened by path. Setting the flag on the shared end would change it
+   for every make in the pool, and a blocking read could sleep on a token while
+   a finished child of this make holds another one. A pipe reopens through
+   /proc, so without /proc the make stays out of the pool. */
+static fn open_token_reader(StringView path) throws -> Maybe<descriptor>
+{
+  let const path_string = String{path};
+  let const fd = ::open(path_string.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) return None;
+  return fd;
+}
+
+static fn descriptor_path(descriptor fd) throws -> String
+{
+  return "/proc/self/fd/" +
+         String::from(static_cast<i64>(fd), heap_allocator());
+}
+
+fn create_jobserver(usize token_count) throws -> Maybe<jobserver>
+{
+  let const tokens = make_pipe();
+  if (!tokens.has_value()) return None;
+
+  jobserver server{};
+  server.shared_reader = tokens->in;
+  server.shared_writer = tokens->out;
+  server.writer = tokens->out;
+  let const reader = open_token_reader(descriptor_path(tokens->in).view());
+  if (!reader.has_value()) {
+    close(tokens->in);
+    close(tokens->out);
+    return None;
+  }
+  server.reader = *reader;
+
+  make_fd_inheritable(server.shared_reader);
+  make_fd_inheritable(server.shared_writer);
+  for (usize i = 0; i < token_count; i++)
+    if (!write_fd(server.writer, "+", 1).has_value()) {
+      close_jobserver(server);
+      return None;
+    }
+  LOG(Info, "created a jobserver with %zu tokens", token_count);
+  return server;
+}
+
+fn join_jobserver(StringView auth) throws -> Maybe<jobserver>
+{
+  jobserver server{};
+  if (auth.starts_with("fifo:")) {
+    let const path = auth.substring(5);
+    let const reader = open_token_reader(path);
+    if (!reader.has_value()) return None;
+    let const path_string = String{path};
+    server.reader = *reader;
+    server.writer = ::open(path_string.c_str(), O_WRONLY | O_CLOEXEC);
+    if (server.writer < 0) {
+      close(server.reader);
+      return None;
+    }
+    return server;
+  }
+
+  let const comma = auth.find_character(',');
+  if (!comma.has_value()) return None;
+  let const read_end = auth.substring_of_length(0, *comma).to<i64>();
+  let const write_end = auth.substring(*comma + 1).to<i64>();
+  if (read_end.is_error() || write_end.is_error()) return None;
+  let const shared_reader = static_cast<descriptor>(read_end.value());
+  let const shared_writer = static_cast<descriptor>(write_end.value());
+  /* A make that started this one without passing the pipe down leaves the
+     numbers naming nothing, or something else. */
+  if (shared_reader < 0 || shared_writer < 0 ||
+      fcntl(shared_reader, F_GETFD) == -1 ||
+      fcntl(shared_writer, F_GETFD) == -1)
+    return None;
+
+  let const reader = open_token_reader(descriptor_path(shared_reader).view());
+  if (!reader.has_value()) return None;
+  server.reader = *reader;
+  server.writer = fcntl(shared_writer, F_DUPFD_CLOEXEC, 0);
+  if (server.writer < 0) {
+    close(server.reader);
+    return None;
+  }
+  LOG(Info, "joined the jobserver '%.*s'", static_cast<int>(auth.length),
+      auth.data);
+  return server;
+}
+
+fn close_jobserver(jobserver &server) wontthrow -> void
+{
+  /* The creating make writes through its shared end. */
+  if (server.writer != SHIT_INVALID_FD && server.writer != server.shared_writer)
+    close(server.writer);
+  if (server.reader != SHIT_INVALID_FD) close(server.reader);
+  if (server.shared_reader != SHIT_INVALID_FD) close(server.shared_reader);
+  if (server.shared_writer != SHIT_INVALID_FD) close(server.shared_writer);
+  server = jobserver{};
+}
+
+fn jobserver_auth(const jobserver &server) throws -> String
+{
+  return String::from(static_cast<i64>(server.shared_reader),
+                      heap_allocator()) +
+         "," +
+         String::from(static_cast<i64>(server.shared_writer), heap_allocator());
+}
+
+fn take_job_token(jobserver &server) wontthrow -> Maybe<char>
+{
+  char token = 0;
+  ssize_t result;
+  do {
+    result = read(server.reader, &token, 1);
+  } while (result == -1 && errno == EINTR);
+  if (result != 1) return None;
+  return token;
+}
+
+fn return_job_token(jobserver &server, char token) wontthrow -> void
+{
+  ssize_t result;
+  do {
+    result = write(server.writer, &token, 1);
+  } while (result == -1 && errno == EINTR);
+}
+
+fn wait_for_child_state_change_or_token(jobserver &server) wontthrow -> void
+{
+  sigset_t blocked_signals;
+  sigemptyset(&blocked_signals);
+  sigaddset(&blocked_signals, SIGCHLD);
+
+  sigset_t previous_mask;
+  if (sigprocmask(SIG_BLOCK, &blocked_signals, &previous_mask) != 0) return;
+
+  struct pollfd watch = {};
+  watch.fd = server.reader;
+  watch.events = POLLIN;
+  if (CHILD_STATE_CHANGED == 0) {
+#if defined __linux__
+    let wait_mask = previous_mask;
+    sigdelset(&wait_mask, SIGCHLD);
+    (void) ppoll(&watch, 1, nullptr, &wait_mask);
+#else
+    /* Without ppoll a SIGCHLD can land between the check and the poll, so the
+       sleep is cut into slices. */
+    (void) sigprocmask(SIG_SETMASK, &previous_mask, nullptr);
+    (void) poll(&watch, 1, 50);
+    (void) sigprocmask(SIG_BLOCK, &blocked_signals, nullptr);
+#endif
+  }
+
+  CHILD_STATE_CHANGED = 0;
+  (void) sigprocmask(SIG_SETMASK, &previous_mask, nullptr);
+}
+
 fn reap_process_quietly(process pid) throws -> i32
 {
   ASSERT(pid >= 0);
@@ -1886,6 +2454,19 @@ fn poll_process(process p, i32 &status_out) wontthrow -> process_state
   return process_state::Exited;
 }
 
+fn peek_child_report() wontthrow -> Maybe<i64>
+{
+  siginfo_t info = {};
+  i32 result;
+  do {
+    result = waitid(P_ALL, 0, &info,
+                    WEXITED | WSTOPPED | WCONTINUED | WNOHANG | WNOWAIT);
+  } while (result == -1 && errno == EINTR);
+  /* With WNOHANG a zero pid means no child has a report waiting. */
+  if (result != 0 || info.si_pid == 0) return None;
+  return static_cast<i64>(info.si_pid);
+}
+
 fn signal_process(process p, i32 signal_number) wontthrow -> bool
 {
   return kill(p, signal_number) == 0;
@@ -1989,6 +2570,11 @@ fn last_system_error_is_missing_file() wontthrow -> bool
   return errno == ENOENT;
 }
 
+fn last_system_error_is_existing_file() wontthrow -> bool
+{
+  return errno == EEXIST;
+}
+
 static fn make_sigset_impl(int first, ...) wontthrow -> sigset_t
 {
   va_list va;
@@ -2013,6 +2599,7 @@ static fn sigchild_handler(int n, siginfo_t *siginfo, opaque *ctx) wontthrow
   unused(ctx);
   unused(siginfo);
   CHILD_STATE_CHANGED = 1;
+  CHILD_STATE_GENERATION = CHILD_STATE_GENERATION + 1;
 }
 
 static fn install_child_state_handler() throws -> void
@@ -2518,12 +3105,9 @@ fn read_symlink(StringView path) wontthrow -> Maybe<String>
   }
 }
 
-fn stat_path(StringView path, file_status &status) wontthrow -> bool
+static fn fill_file_status(const struct stat &info,
+                             file_status &status) wontthrow -> void
 {
-  const String path_string{path};
-  struct stat info{};
-  /* lstat does not follow the symlink, so ls shows the l type without -L. */
-  if (::lstat(path_string.c_str(), &info) != 0) return false;
   status.device_id = static_cast<u64>(info.st_dev);
   status.file_id = static_cast<u64>(info.st_ino);
   status.has_file_identity = true;
@@ -2537,6 +3121,15 @@ fn stat_path(StringView path, file_status &status) wontthrow -> bool
   status.change_time = static_cast<i64>(info.st_ctime);
   status.change_nanoseconds = static_cast<u32>(info.st_ctim.tv_nsec);
   status.blocks = static_cast<u64>(info.st_blocks);
+}
+
+fn stat_path(StringView path, file_status &status) wontthrow -> bool
+{
+  const String path_string{path};
+  struct stat info{};
+  /* lstat does not follow the symlink, so ls shows the l type without -L. */
+  if (::lstat(path_string.c_str(), &info) != 0) return false;
+  fill_file_status(info, status);
   return true;
 }
 
@@ -2545,22 +3138,272 @@ fn stat_path_following(StringView path, file_status &status) wontthrow -> bool
   const String path_string{path};
   struct stat info{};
   if (::stat(path_string.c_str(), &info) != 0) return false;
-  status.device_id = static_cast<u64>(info.st_dev);
-  status.file_id = static_cast<u64>(info.st_ino);
-  status.has_file_identity = true;
-  status.mode = static_cast<u32>(info.st_mode);
-  status.link_count = static_cast<u64>(info.st_nlink);
-  status.owner_id = static_cast<u32>(info.st_uid);
-  status.group_id = static_cast<u32>(info.st_gid);
-  status.size = static_cast<u64>(info.st_size);
-  status.modification_time = static_cast<i64>(info.st_mtime);
-  status.modification_nanoseconds = static_cast<u32>(info.st_mtim.tv_nsec);
-  status.change_time = static_cast<i64>(info.st_ctime);
-  status.change_nanoseconds = static_cast<u32>(info.st_ctim.tv_nsec);
-  status.blocks = static_cast<u64>(info.st_blocks);
+  fill_file_status(info, status);
   return true;
 }
 
+static constexpr int DIRECTORY_OPEN_FLAGS = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+
+/* A name is rarely longer than this, so the calls below copy it to the stack
+   for its terminator instead of allocating. The long case keeps errno across
+   its free, so a failed call still reports its own reason. */
+static constexpr usize SHORT_NAME_CAPACITY = 256;
+
+class terminated_name
+{
+public:
+  explicit terminated_name(StringView name) throws
+  {
+    m_capacity = name.length < SHORT_NAME_CAPACITY ? 0 : name.length + 1;
+    m_text = m_capacity == 0 ? m_short
+                             : heap_allocator().alloc_array<char>(m_capacity);
+    __builtin_memcpy(m_text, name.data, name.length);
+    m_text[name.length] = '\0';
+  }
+  terminated_name(const terminated_name &) = delete;
+  terminated_name &operator=(const terminated_name &) = delete;
+  ~terminated_name()
+  {
+    if (m_capacity == 0) return;
+    let const saved_errno = errno;
+    heap_allocator().free_array(m_text, m_capacity);
+    errno = saved_errno;
+  }
+
+  mustuse pure fn c_str() const wontthrow -> const char * { return m_text; }
+
+private:
+  char m_short[SHORT_NAME_CAPACITY];
+  char *m_text{nullptr};
+  usize m_capacity{0};
+};
+
+fn open_directory(StringView path) throws -> DirectoryReference
+{
+  const terminated_name path_string{path};
+  let const fd = ::open(path_string.c_str(), DIRECTORY_OPEN_FLAGS);
+  return DirectoryReference{fd < 0 ? SHIT_INVALID_FD : fd};
+}
+
+fn open_directory_at(const DirectoryReference &parent, StringView name) throws
+    -> DirectoryReference
+{
+  const terminated_name name_string{name};
+  let const fd = ::openat(parent.get(), name_string.c_str(),
+                          DIRECTORY_OPEN_FLAGS);
+  return DirectoryReference{fd < 0 ? SHIT_INVALID_FD : fd};
+}
+
+fn list_directory_at(const DirectoryReference &dir) throws
+    -> Maybe<ArrayList<Path::directory_child>>
+{
+  /* fdopendir owns the descriptor it gets and reads from its offset, so it gets
+     a fresh one rewound to the start, and the reference stays usable. */
+  let const fd = ::openat(dir.get(), ".", DIRECTORY_OPEN_FLAGS);
+  if (fd < 0) return None;
+  let const handle = ::fdopendir(fd);
+  if (handle == nullptr) {
+    ::close(fd);
+    return None;
+  }
+  return read_typed_entries(handle);
+}
+
+#if defined __linux__
+/* A linux_dirent64 record is the inode, the offset, the record length, the
+   type, then the terminated name. glibc and musl disagree on a declaration for
+   it, so the fields are read at their offsets. */
+static constexpr usize DIRECTORY_STREAM_BUFFER_SIZE = 32 * 1024;
+static constexpr usize DIRENT_LENGTH_OFFSET = 16;
+static constexpr usize DIRENT_TYPE_OFFSET = 18;
+static constexpr usize DIRENT_NAME_OFFSET = 19;
+
+DirectoryStream::~DirectoryStream()
+{
+  if (m_buffer != nullptr)
+    heap_allocator().free_array(m_buffer, DIRECTORY_STREAM_BUFFER_SIZE);
+}
+
+fn DirectoryStream::open(const DirectoryReference &dir) throws -> bool
+{
+  if (!dir.is_valid()) {
+    errno = EBADF;
+    return false;
+  }
+  m_fd = dir.get();
+  if (m_buffer == nullptr)
+    m_buffer = heap_allocator().alloc_array<char>(DIRECTORY_STREAM_BUFFER_SIZE);
+  m_length = 0;
+  m_position = 0;
+  m_has_failed = false;
+  return true;
+}
+
+hot fn DirectoryStream::next() throws -> Maybe<entry>
+{
+  loop
+  {
+    if (m_position >= m_length) {
+      let const count = ::syscall(SYS_getdents64, m_fd, m_buffer,
+                                  DIRECTORY_STREAM_BUFFER_SIZE);
+      if (count <= 0) {
+        m_has_failed = count < 0;
+        return None;
+      }
+      m_length = static_cast<usize>(count);
+      m_position = 0;
+    }
+
+    let const *record = m_buffer + m_position;
+    u16 record_length;
+    __builtin_memcpy(&record_length, record + DIRENT_LENGTH_OFFSET,
+                     sizeof(record_length));
+    m_position += record_length;
+
+    let const name = StringView{record + DIRENT_NAME_OFFSET};
+    if (name == StringView{"."} || name == StringView{".."}) continue;
+    return entry{name, entry_kind_of(static_cast<unsigned char>(
+                           record[DIRENT_TYPE_OFFSET]))};
+  }
+}
+#else
+DirectoryStream::~DirectoryStream()
+{
+  if (m_handle != nullptr) ::closedir(m_handle);
+}
+
+fn DirectoryStream::open(const DirectoryReference &dir) throws -> bool
+{
+  if (m_handle != nullptr) ::closedir(m_handle);
+  m_handle = nullptr;
+  m_has_failed = false;
+  /* fdopendir owns the descriptor it gets, so it gets a duplicate. */
+  let const fd = ::dup(dir.get());
+  if (fd < 0) return false;
+  m_handle = ::fdopendir(fd);
+  if (m_handle == nullptr) {
+    ::close(fd);
+    return false;
+  }
+  return true;
+}
+
+fn DirectoryStream::next() throws -> Maybe<entry>
+{
+  loop
+  {
+    errno = 0;
+    let const listed = ::readdir(m_handle);
+    if (listed == nullptr) {
+      m_has_failed = errno != 0;
+      return None;
+    }
+    let const name = StringView{listed->d_name};
+    if (name == StringView{"."} || name == StringView{".."}) continue;
+    return entry{name, entry_kind_of(listed->d_type)};
+  }
+}
+#endif
+
+fn stat_at(const DirectoryReference &parent, StringView name,
+           file_status &status) throws -> bool
+{
+  const terminated_name name_string{name};
+  struct stat info{};
+  if (::fstatat(parent.get(), name_string.c_str(), &info,
+                AT_SYMLINK_NOFOLLOW) != 0)
+    return false;
+  fill_file_status(info, status);
+  return true;
+}
+
+fn stat_descriptor(descriptor fd, file_status &status) wontthrow -> bool
+{
+  struct stat info{};
+  if (::fstat(fd, &info) != 0) return false;
+  fill_file_status(info, status);
+  return true;
+}
+
+fn make_directory_at(const DirectoryReference &parent, StringView name,
+                     u32 mode) throws -> bool
+{
+  const terminated_name name_string{name};
+  return ::mkdirat(parent.get(), name_string.c_str(), mode) == 0;
+}
+
+fn open_file_at(const DirectoryReference &parent, StringView name,
+                file_open_mode mode) throws -> Maybe<descriptor>
+{
+  int flags = O_CLOEXEC;
+  switch (mode) {
+  case file_open_mode::Truncate: flags |= O_WRONLY | O_CREAT | O_TRUNC; break;
+  case file_open_mode::TruncateNoClobber:
+    flags |= O_WRONLY | O_CREAT | O_EXCL;
+    break;
+  case file_open_mode::Append: flags |= O_WRONLY | O_CREAT | O_APPEND; break;
+  case file_open_mode::Read: flags |= O_RDONLY; break;
+  case file_open_mode::ReadWrite: flags |= O_RDWR | O_CREAT; break;
+  }
+
+  const terminated_name name_string{name};
+  let const fd = ::openat(parent.get(), name_string.c_str(), flags, 0666);
+  if (fd < 0) return shit::None;
+  return fd;
+}
+
+fn set_descriptor_mode(descriptor fd, u32 mode) wontthrow -> bool
+{
+  return ::fchmod(fd, static_cast<mode_t>(mode)) == 0;
+}
+
+fn remove_file_at(const DirectoryReference &parent, StringView name) throws
+    -> bool
+{
+  const terminated_name name_string{name};
+  return ::unlinkat(parent.get(), name_string.c_str(), 0) == 0;
+}
+
+fn create_symlink_at(StringView target, const DirectoryReference &parent,
+                     StringView name) throws -> bool
+{
+  const terminated_name target_string{target};
+  const terminated_name name_string{name};
+  return ::symlinkat(target_string.c_str(), parent.get(),
+                     name_string.c_str()) == 0;
+}
+
+fn read_symlink_at(const DirectoryReference &parent, StringView name) throws
+    -> Maybe<String>
+{
+  const terminated_name name_string{name};
+  usize capacity = 256;
+  loop
+  {
+    ArrayList<char> buffer{heap_allocator()};
+    buffer.reserve(capacity);
+    let const length = ::readlinkat(parent.get(), name_string.c_str(),
+                                    buffer.begin(), capacity);
+    if (length < 0) return shit::None;
+    if (static_cast<usize>(length) < capacity)
+      return String{
+          StringView{buffer.begin(), static_cast<usize>(length)}
+      };
+
+    if (capacity >= (1U << 20)) return shit::None;
+    capacity *= 2;
+  }
+}
+
+fn create_hard_link_at(StringView existing, const DirectoryReference &parent,
+                       StringView name) throws -> bool
+{
+  const terminated_name existing_string{existing};
+  const terminated_name name_string{name};
+  return ::linkat(AT_FDCWD, existing_string.c_str(), parent.get(),
+                  name_string.c_str(), 0) == 0;
+}
+
 fn file_type_letter(u32 mode) wontthrow -> char
 {
   const mode_t bits = static_cast<mode_t>(mode);
@@ -12,6 +12,7 @@ namespace os {
 
 volatile sig_atomic_t INTERRUPT_REQUESTED = 0;
 volatile sig_atomic_t CHILD_STATE_CHANGED = 0;
+volatile sig_atomic_t CHILD_STATE_GENERATION = 0;
 volatile sig_atomic_t SIGNAL_PENDING = 0;
 
 static constexpr i32 SIGNAL_FLAG_COUNT = 128;
@@ -88,6 +89,54 @@ fn read_fd(os::descriptor fd, opaque *buf, usize size) wontthrow -> Maybe<usize>
   return static_cast<usize>(read_size);
 }
 
+/* A handle does not tell whether it appends, so any read position short of
+   the end of the same file counts as one that would meet the writes. */
+fn copy_reads_own_output(descriptor from, descriptor to) wontthrow -> bool
+{
+  if (GetFileType(to) != FILE_TYPE_DISK) return false;
+  BY_HANDLE_FILE_INFORMATION from_identity{};
+  BY_HANDLE_FILE_INFORMATION to_identity{};
+  if (!GetFileInformationByHandle(from, &from_identity) ||
+      !GetFileInformationByHandle(to, &to_identity))
+    return false;
+  if (from_identity.dwVolumeSerialNumber !=
+          to_identity.dwVolumeSerialNumber ||
+      from_identity.nFileIndexHigh != to_identity.nFileIndexHigh ||
+      from_identity.nFileIndexLow != to_identity.nFileIndexLow)
+    return false;
+
+  LARGE_INTEGER read_offset{};
+  if (!SetFilePointerEx(from, LARGE_INTEGER{}, &read_offset, FILE_CURRENT))
+    return false;
+  let const size = (static_cast<u64>(to_identity.nFileSizeHigh) << 32) |
+                   to_identity.nFileSizeLow;
+  return static_cast<u64>(read_offset.QuadPart) < size;
+}
+
+fn copy_fd_contents(descriptor from, descriptor to) throws -> copy_result
+{
+  if (copy_reads_own_output(from, to)) return copy_result::SameFile;
+
+  static constexpr usize COPY_BUFFER_SIZE = 1024 * 1024;
+  let *buffer = heap_allocator().alloc_array<char>(COPY_BUFFER_SIZE);
+  defer { heap_allocator().free_array(buffer, COPY_BUFFER_SIZE); };
+  loop
+  {
+    if (INTERRUPT_REQUESTED) return copy_result::Interrupted;
+    let const read_count = read_fd(from, buffer, COPY_BUFFER_SIZE);
+    if (!read_count.has_value()) return copy_result::ReadFailed;
+    if (*read_count == 0) return copy_result::Ok;
+    usize written_count = 0;
+    while (written_count < *read_count) {
+      let const written = write_fd(to, buffer + written_count,
+                                   *read_count - written_count);
+      if (!written.has_value() || *written == 0)
+        return copy_result::WriteFailed;
+      written_count += *written;
+    }
+  }
+}
+
 fn wait_for_fd_readable(os::descriptor fd, i64 timeout_nanos) wontthrow -> i32
 {
   let const file_type = GetFileType(fd);
@@ -657,6 +706,8 @@ fn get_hostname() throws -> Maybe<String>
   return shit::None;
 }
 
+fn load_average() wontthrow -> Maybe<f64> { return None; }
+
 fn get_processor_counts() wontthrow -> processor_counts
 {
   processor_counts counts{};
@@ -827,18 +878,22 @@ fn collate_compare(const String &left, const String &right) wontthrow -> int
   return right < left ? 1 : 0;
 }
 
-fn compile_regex(StringView pattern, case_sensitivity sensitivity,
-                 compiled_regex &out) throws -> regex_compile_result
+/* No libc engine backs the in-tree one here, so a pattern it reports
+   unsupported, one with a backreference, does not compile. */
+fn compile_libc_regex(StringView pattern, bool is_extended,
+                      case_sensitivity sensitivity, compiled_regex &out) throws
+    -> regex_compile_result
 {
   unused(pattern);
+  unused(is_extended);
   unused(sensitivity);
   unused(out);
   return regex_compile_result::Invalid;
 }
 
-fn execute_regex(compiled_regex &compiled, StringView subject,
-                 ArrayList<regex_span> &spans, String &error_message,
-                 Allocator scratch) throws -> regex_match_result
+fn execute_libc_regex(compiled_regex &compiled, StringView subject,
+                      ArrayList<regex_span> &spans, String &error_message,
+                      Allocator scratch) throws -> regex_match_result
 {
   unused(compiled);
   unused(subject);
@@ -848,56 +903,17 @@ fn execute_regex(compiled_regex &compiled, StringView subject,
   return regex_match_result::Error;
 }
 
-fn free_regex(compiled_regex &compiled) wontthrow -> void { unused(compiled); }
-
-fn compile_search_regex(StringView pattern, case_sensitivity sensitivity,
-                        compiled_regex &out) throws -> regex_compile_result
+fn libc_regex_matches(compiled_regex &compiled, StringView subject) throws
+    -> bool
 {
-  out.pattern = String{heap_allocator(), pattern};
-  out.is_case_insensitive = sensitivity == case_sensitivity::Insensitive;
-  return regex_compile_result::Ok;
+  unused(compiled);
+  unused(subject);
+  return false;
 }
 
-fn regex_matches(compiled_regex &compiled, StringView subject) throws -> bool
+fn free_libc_regex(compiled_regex &compiled) wontthrow -> void
 {
-  const StringView needle = compiled.pattern.view();
-  if (needle.length == 0) return true;
-  if (needle.length > subject.length) return false;
-
-  if (!compiled.is_case_insensitive) {
-    usize start = 0;
-    while (start + needle.length <= subject.length) {
-      let const found = subject.substring(start).find_character(needle[0]);
-      if (!found.has_value()) return false;
-      start += *found;
-      if (start + needle.length > subject.length) return false;
-
-      bool is_matched = true;
-      for (usize k = 1; k < needle.length; k++)
-        if (subject[start + k] != needle[k]) {
-          is_matched = false;
-          break;
-        }
-      if (is_matched) return true;
-      start++;
-    }
-    return false;
-  }
-
-  for (usize start = 0; start + needle.length <= subject.length; start++) {
-    bool is_matched = true;
-    for (usize k = 0; k < needle.length; k++) {
-      if (utils::ascii_to_lower(subject[start + k]) !=
-          utils::ascii_to_lower(needle[k]))
-      {
-        is_matched = false;
-        break;
-      }
-    }
-    if (is_matched) return true;
-  }
-
-  return false;
+  unused(compiled);
 }
 
 pure fn path_is_absolute(StringView path) wontthrow -> bool
@@ -2037,6 +2053,27 @@ fn join_thread(thread t) wontthrow -> void
   CloseHandle(t.handle);
 }
 
+fn lock_monitor(monitor &m) wontthrow -> void
+{
+  AcquireSRWLockExclusive(&m.lock);
+}
+
+fn unlock_monitor(monitor &m) wontthrow -> void
+{
+  ReleaseSRWLockExclusive(&m.lock);
+}
+
+fn wait_monitor(monitor &m, i64 timeout_nanos) wontthrow -> void
+{
+  SleepConditionVariableSRW(&m.condition, &m.lock,
+                            static_cast<DWORD>(timeout_nanos / 1'000'000), 0);
+}
+
+fn wake_monitor(monitor &m) wontthrow -> void
+{
+  WakeAllConditionVariable(&m.condition);
+}
+
 fn open_file_descriptor(StringView path, file_open_mode mode)
     -> Maybe<descriptor>
 {
@@ -2101,7 +2138,7 @@ fn release_process_lock(descriptor lock) wontthrow -> void
   unused(close_fd(lock));
 }
 
-fn write_to_temp_file(StringView content) -> Maybe<descriptor>
+fn stage_heredoc_body(StringView content) -> Maybe<descriptor>
 {
   char temp_dir[MAX_PATH];
   let const temp_directory_length = GetTempPathA(MAX_PATH, temp_dir);
@@ -2189,6 +2226,45 @@ fn poll_process(process p, i32 &status_out) wontthrow -> process_state
   return process_state::Exited;
 }
 
+fn peek_child_report() wontthrow -> Maybe<i64> { return None; }
+
+fn create_jobserver(usize token_count) throws -> Maybe<jobserver>
+{
+  unused(token_count);
+  return None;
+}
+
+fn join_jobserver(StringView auth) throws -> Maybe<jobserver>
+{
+  unused(auth);
+  return None;
+}
+
+fn close_jobserver(jobserver &server) wontthrow -> void { unused(server); }
+
+fn jobserver_auth(const jobserver &server) throws -> String
+{
+  unused(server);
+  return String{};
+}
+
+fn take_job_token(jobserver &server) wontthrow -> Maybe<char>
+{
+  unused(server);
+  return None;
+}
+
+fn return_job_token(jobserver &server, char token) wontthrow -> void
+{
+  unused(server);
+  unused(token);
+}
+
+fn wait_for_child_state_change_or_token(jobserver &server) wontthrow -> void
+{
+  unused(server);
+}
+
 fn signal_process(process p, i32 signal_number) wontthrow -> bool
 {
   if (signal_number == 0) {
@@ -2437,6 +2513,12 @@ fn last_system_error_is_missing_file() wontthrow -> bool
   return error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND;
 }
 
+fn last_system_error_is_existing_file() wontthrow -> bool
+{
+  let const error = GetLastError();
+  return error == ERROR_FILE_EXISTS || error == ERROR_ALREADY_EXISTS;
+}
+
 static fn handle_interrupt(int s) -> void
 {
   unused(s);
@@ -3014,6 +3096,194 @@ fn stat_path_following(StringView path, file_status &status) wontthrow -> bool
   return stat_path(path, status);
 }
 
+/* The path a directory handle resolves to, with the \\?\ prefix taken off the
+   way restore_current_directory takes it off. */
+static fn path_of_directory(const DirectoryReference &dir) throws
+    -> Maybe<String>
+{
+  if (!dir.is_valid()) {
+    SetLastError(ERROR_INVALID_HANDLE);
+    return None;
+  }
+  char path[32768];
+  let const length = GetFinalPathNameByHandleA(
+      dir.get(), path, static_cast<DWORD>(countof(path)),
+      FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+  if (length == 0 || length >= countof(path)) return None;
+  let const resolved = StringView{path, static_cast<usize>(length)};
+  if (resolved.starts_with(StringView{"\\\\?\\UNC\\"})) {
+    let unc_path = String{"\\\\"};
+    unc_path += resolved.substring(8);
+    return unc_path;
+  }
+  if (resolved.starts_with(StringView{"\\\\?\\"}))
+    return String{resolved.substring(4)};
+  return String{resolved};
+}
+
+static fn path_at(const DirectoryReference &parent, StringView name) throws
+    -> Maybe<String>
+{
+  let path = path_of_directory(parent);
+  if (!path.has_value()) return None;
+  path->push(DIRECTORY_SEPARATOR);
+  path->append(name);
+  return path;
+}
+
+fn open_directory(StringView path) throws -> DirectoryReference
+{
+  const String path_string{path};
+  return DirectoryReference{CreateFileA(
+      path_string.c_str(), 0,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+      OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr)};
+}
+
+fn open_directory_at(const DirectoryReference &parent, StringView name) throws
+    -> DirectoryReference
+{
+  let const path = path_at(parent, name);
+  if (!path.has_value()) return DirectoryReference{};
+  return open_directory(path->view());
+}
+
+fn list_directory_at(const DirectoryReference &dir) throws
+    -> Maybe<ArrayList<Path::directory_child>>
+{
+  let const path = path_of_directory(dir);
+  if (!path.has_value()) return None;
+  return list_directory_typed(path->view());
+}
+
+DirectoryStream::~DirectoryStream()
+{
+  if (m_handle != INVALID_HANDLE_VALUE) FindClose(m_handle);
+}
+
+fn DirectoryStream::open(const DirectoryReference &dir) throws -> bool
+{
+  if (m_handle != INVALID_HANDLE_VALUE) FindClose(m_handle);
+  m_handle = INVALID_HANDLE_VALUE;
+  m_has_pending = false;
+  m_has_failed = false;
+
+  let pattern = path_of_directory(dir);
+  if (!pattern.has_value()) return false;
+  pattern->push(DIRECTORY_SEPARATOR);
+  pattern->push('*');
+  m_handle = FindFirstFileA(pattern->c_str(), &m_data);
+  if (m_handle == INVALID_HANDLE_VALUE) return false;
+  m_has_pending = true;
+  return true;
+}
+
+fn DirectoryStream::next() throws -> Maybe<entry>
+{
+  loop
+  {
+    if (!m_has_pending) {
+      if (FindNextFileA(m_handle, &m_data) == 0) {
+        m_has_failed = GetLastError() != ERROR_NO_MORE_FILES;
+        return None;
+      }
+    }
+    m_has_pending = false;
+
+    let const name = StringView{m_data.cFileName};
+    if (name == StringView{"."} || name == StringView{".."}) continue;
+    Path::entry_kind kind = Path::entry_kind::Regular;
+    if ((m_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+      kind = Path::entry_kind::Symlink;
+    else if ((m_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+      kind = Path::entry_kind::Directory;
+    return entry{name, kind};
+  }
+}
+
+fn stat_at(const DirectoryReference &parent, StringView name,
+           file_status &status) throws -> bool
+{
+  let const path = path_at(parent, name);
+  return path.has_value() && stat_path(path->view(), status);
+}
+
+fn stat_descriptor(descriptor fd, file_status &status) wontthrow -> bool
+{
+  BY_HANDLE_FILE_INFORMATION identity{};
+  if (!GetFileInformationByHandle(fd, &identity)) return false;
+  status = {};
+  status.device_id = identity.dwVolumeSerialNumber;
+  status.file_id = (static_cast<u64>(identity.nFileIndexHigh) << 32) |
+                   identity.nFileIndexLow;
+  status.has_file_identity = true;
+  status.link_count = identity.nNumberOfLinks;
+  status.size = (static_cast<u64>(identity.nFileSizeHigh) << 32) |
+                identity.nFileSizeLow;
+  status.blocks = (status.size + 511) / 512;
+  let const is_directory =
+      (identity.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+  let const is_read_only =
+      (identity.dwFileAttributes & FILE_ATTRIBUTE_READONLY) != 0;
+  status.mode = (is_directory ? 0040000u : 0100000u) |
+                (is_read_only ? 0444u : 0666u) | (is_directory ? 0111u : 0u);
+  return true;
+}
+
+fn make_directory_at(const DirectoryReference &parent, StringView name,
+                     u32 mode) throws -> bool
+{
+  let const path = path_at(parent, name);
+  return path.has_value() && make_directory(path->view(), mode);
+}
+
+fn open_file_at(const DirectoryReference &parent, StringView name,
+                file_open_mode mode) throws -> Maybe<descriptor>
+{
+  let const path = path_at(parent, name);
+  if (!path.has_value()) return None;
+  return open_file_descriptor(path->view(), mode);
+}
+
+/* Windows keeps no permission bits a handle could change. */
+fn set_descriptor_mode(descriptor fd, u32 mode) wontthrow -> bool
+{
+  unused(fd);
+  unused(mode);
+  return true;
+}
+
+fn remove_file_at(const DirectoryReference &parent, StringView name) throws
+    -> bool
+{
+  let const path = path_at(parent, name);
+  return path.has_value() && remove_file(path->view());
+}
+
+fn create_symlink_at(StringView target, const DirectoryReference &parent,
+                     StringView name) throws -> bool
+{
+  let const path = path_at(parent, name);
+  return path.has_value() && create_symlink(target, path->view());
+}
+
+fn read_symlink_at(const DirectoryReference &parent, StringView name) throws
+    -> Maybe<String>
+{
+  let const path = path_at(parent, name);
+  if (!path.has_value()) return None;
+  return read_symlink(path->view());
+}
+
+fn create_hard_link_at(StringView existing, const DirectoryReference &parent,
+                       StringView name) throws -> bool
+{
+  let const path = path_at(parent, name);
+  if (!path.has_value()) return false;
+  const String existing_string{existing};
+  return CreateHardLinkA(path->c_str(), existing_string.c_str(), nullptr) != 0;
+}
+
 fn format_mode_string(u32 mode) throws -> String
 {
   /* Windows stat exposes only the owner bits, mirrored across all three
@@ -0,0 +1,1127 @@
+#include "Regex.hpp"
+
+#include "Debug.hpp"
+
+#include <cstring>
+
+namespace shit {
+
+namespace {
+
+constexpr u32 NO_NODE = static_cast<u32>(-1);
+constexpr i32 UNBOUNDED = -1;
+/* RE_DUP_MAX in glibc, the largest count an interval may name. */
+constexpr i32 MAX_REPEAT_COUNT = 0x7fff;
+/* Past this a counted repeat has been unrolled too far to be worth running as
+   an automaton, and the caller's libc engine takes the pattern. */
+constexpr usize MAX_PROGRAM_LENGTH = 1 << 16;
+constexpr usize MAX_NESTING_DEPTH = 512;
+constexpr usize MAX_DFA_STATES = 4096;
+
+struct regex_node
+{
+  enum class Kind : u8
+  {
+    Empty,
+    Bytes,
+    Concat,
+    Alternate,
+    Repeat,
+    Group,
+    Assert,
+  };
+
+  Kind kind;
+  /* The set index of Bytes, the group number of Group, and the instruction op
+     of Assert. */
+  u32 value{0};
+  i32 min{0};
+  i32 max{0};
+  u32 first_child{NO_NODE};
+  u32 last_child{NO_NODE};
+  u32 next_sibling{NO_NODE};
+};
+
+pure fn is_word_byte(u8 byte) wontthrow -> bool
+{
+  return (byte >= 'a' && byte <= 'z') || (byte >= 'A' && byte <= 'Z') ||
+         (byte >= '0' && byte <= '9') || byte == '_';
+}
+
+fn add_posix_class(regex_byte_set &set, StringView name) wontthrow -> bool
+{
+  for (usize c = 0; c < 256; c++) {
+    let const byte = static_cast<u8>(c);
+    let const is_upper = byte >= 'A' && byte <= 'Z';
+    let const is_lower = byte >= 'a' && byte <= 'z';
+    let const is_digit = byte >= '0' && byte <= '9';
+    let const is_print = byte >= 0x20 && byte < 0x7f;
+    bool is_member = false;
+    if (name == "alpha")
+      is_member = is_upper || is_lower;
+    else if (name == "digit")
+      is_member = is_digit;
+    else if (name == "alnum")
+      is_member = is_upper || is_lower || is_digit;
+    else if (name == "upper")
+      is_member = is_upper;
+    else if (name == "lower")
+      is_member = is_lower;
+    else if (name == "space")
+      is_member = byte == ' ' || (byte >= '\t' && byte <= '\r');
+    else if (name == "blank")
+      is_member = byte == ' ' || byte == '\t';
+    else if (name == "punct")
+      is_member =
+          is_print && byte != ' ' && !is_upper && !is_lower && !is_digit;
+    else if (name == "print")
+      is_member = is_print;
+    else if (name == "graph")
+      is_member = is_print && byte != ' ';
+    else if (name == "cntrl")
+      is_member = byte < 0x20 || byte == 0x7f;
+    else if (name == "xdigit")
+      is_member = is_digit || (byte >= 'a' && byte <= 'f') ||
+                  (byte >= 'A' && byte <= 'F');
+    else
+      return false;
+    if (is_member) set.add(byte);
+  }
+  return true;
+}
+
+fn fold_case(regex_byte_set &set) wontthrow -> void
+{
+  for (u8 c = 'a'; c <= 'z'; c++) {
+    let const upper = static_cast<u8>(c - ('a' - 'A'));
+    if (set.has(c) || set.has(upper)) {
+      set.add(c);
+      set.add(upper);
+    }
+  }
+}
+
+pure fn set_member_count(const regex_byte_set &set) wontthrow -> usize
+{
+  usize members = 0;
+  for (usize w = 0; w < 4; w++)
+    members += static_cast<usize>(__builtin_popcountll(set.bits[w]));
+  return members;
+}
+
+} // namespace
+
+/* Parses a pattern into a node tree, then emits the program into the Regex. It
+   follows the glibc grammar for the syntax: a quantifier with nothing to
+   repeat is invalid in an extended pattern and a literal in a basic one, an
+   unmatched ) is a literal in an extended pattern, and a basic ^ or $ anchors
+   only at the edge of a branch. */
+struct regex_compiler
+{
+  using result = Regex::CompileResult;
+
+  StringView pattern;
+  bool is_extended;
+  bool ignore_case;
+  Regex &out;
+  ArrayList<regex_node> nodes;
+  usize position{0};
+  usize closed_group_count{0};
+  Maybe<result> failure{};
+
+  regex_compiler(StringView pattern_text, bool extended, bool icase,
+                 Regex &target)
+      : pattern(pattern_text), is_extended(extended), ignore_case(icase),
+        out(target), nodes(target.m_allocator)
+  {}
+
+  fn fail(result reason) wontthrow -> u32
+  {
+    if (!failure.has_value()) failure = reason;
+    return NO_NODE;
+  }
+
+  mustuse pure fn at_end() const wontthrow -> bool
+  {
+    return position >= pattern.length;
+  }
+
+  mustuse pure fn peek(usize ahead = 0) const wontthrow -> char
+  {
+    return position + ahead < pattern.length ? pattern[position + ahead]
+                                             : '\0';
+  }
+
+  fn make(regex_node::Kind kind, u32 value = 0) throws -> u32
+  {
+    nodes.push(regex_node{kind, value});
+    return static_cast<u32>(nodes.count() - 1);
+  }
+
+  fn append_child(u32 parent, u32 child) wontthrow -> void
+  {
+    let &node = nodes[parent];
+    if (node.first_child == NO_NODE)
+      node.first_child = child;
+    else
+      nodes[node.last_child].next_sibling = child;
+    node.last_child = child;
+  }
+
+  fn make_set(regex_byte_set set) throws -> u32
+  {
+    if (ignore_case) fold_case(set);
+    out.m_sets.push(set);
+    return make(regex_node::Kind::Bytes,
+                static_cast<u32>(out.m_sets.count() - 1));
+  }
+
+  fn make_byte(u8 byte) throws -> u32
+  {
+    regex_byte_set set{};
+    set.add(byte);
+    return make_set(set);
+  }
+
+  /* Whether the cursor sits on the alternation operator of the syntax. */
+  mustuse pure fn at_alternation() const wontthrow -> bool
+  {
+    if (is_extended) return peek() == '|';
+    return peek() == '\\' && peek(1) == '|';
+  }
+
+  mustuse pure fn at_group_close(usize depth) const wontthrow -> bool
+  {
+    if (depth == 0) return false;
+    if (is_extended) return peek() == ')';
+    return peek() == '\\' && peek(1) == ')';
+  }
+
+  fn parse_alternation(usize depth) throws -> u32
+  {
+    if (depth > MAX_NESTING_DEPTH) return fail(result::Unsupported);
+
+    let const first = parse_branch(depth);
+    if (failure.has_value() || !at_alternation()) return first;
+
+    let const alternate = make(regex_node::Kind::Alternate);
+    append_child(alternate, first);
+    while (!failure.has_value() && at_alternation()) {
+      position += is_extended ? 1 : 2;
+      append_child(alternate, parse_branch(depth));
+    }
+    return alternate;
+  }
+
+  fn parse_branch(usize depth) throws -> u32
+  {
+    let const concat = make(regex_node::Kind::Concat);
+    let const branch_start = position;
+    while (!at_end() && !at_alternation() && !at_group_close(depth) &&
+           !failure.has_value())
+    {
+      let const piece = parse_piece(depth, branch_start);
+      if (piece != NO_NODE) append_child(concat, piece);
+    }
+    return concat;
+  }
+
+  /* Reads {m}, {m,}, {,n}, or {m,n} past the opening brace, and the closing
+     \} of a basic interval. */
+  fn parse_interval(i32 &min, i32 &max) wontthrow -> bool
+  {
+    let const read_count = [&](i32 &count) wontthrow -> bool {
+      if (peek() < '0' || peek() > '9') return false;
+      count = 0;
+      while (peek() >= '0' && peek() <= '9') {
+        count = count * 10 + (peek() - '0');
+        if (count > MAX_REPEAT_COUNT) return false;
+        position++;
+      }
+      return true;
+    };
+
+    let const has_min = read_count(min);
+    if (!has_min) min = 0;
+    if (peek() == ',') {
+      position++;
+      if (!read_count(max)) max = UNBOUNDED;
+    } else {
+      if (!has_min) return false;
+      max = min;
+    }
+
+    if (is_extended) {
+      if (peek() != '}') return false;
+      position++;
+    } else {
+      if (peek() != '\\' || peek(1) != '}') return false;
+      position += 2;
+    }
+    return max == UNBOUNDED || min <= max;
+  }
+
+  /* Reads one quantifier after an atom, or returns false when none follows. */
+  fn parse_quantifier(i32 &min, i32 &max) wontthrow -> bool
+  {
+    let const c = peek();
+    if (is_extended) {
+      if (c == '*' || c == '+' || c == '?') {
+        position++;
+        min = c == '+' ? 1 : 0;
+        max = c == '?' ? 1 : UNBOUNDED;
+        return true;
+      }
+      if (c == '{') {
+        position++;
+        if (!parse_interval(min, max)) unused(fail(result::Invalid));
+        return true;
+      }
+      return false;
+    }
+
+    if (c == '*') {
+      position++;
+      min = 0;
+      max = UNBOUNDED;
+      return true;
+    }
+    if (c == '\\' && (peek(1) == '+' || peek(1) == '?')) {
+      min = peek(1) == '+' ? 1 : 0;
+      max = peek(1) == '?' ? 1 : UNBOUNDED;
+      position += 2;
+      return true;
+    }
+    if (c == '\\' && peek(1) == '{') {
+      position += 2;
+      if (!parse_interval(min, max)) unused(fail(result::Invalid));
+      return true;
+    }
+    return false;
+  }
+
+  fn parse_piece(usize depth, usize branch_start) throws -> u32
+  {
+    u32 atom = parse_atom(depth, branch_start);
+    if (failure.has_value()) return NO_NODE;
+    let const is_assertion =
+        atom != NO_NODE && nodes[atom].kind == regex_node::Kind::Assert;
+
+    i32 min = 0;
+    i32 max = 0;
+    bool is_quantified = false;
+    while (!failure.has_value()) {
+      let const quantifier_start = position;
+      /* A basic * or interval cannot stack on another quantifier, though the
+         \+ and \? extensions can. */
+      let const is_escaped_quantifier =
+          peek() == '\\' && (peek(1) == '+' || peek(1) == '?');
+      if (!parse_quantifier(min, max)) break;
+      if (failure.has_value()) return NO_NODE;
+      if (is_extended && (atom == NO_NODE || is_assertion))
+        return fail(result::Invalid);
+      if (!is_extended && is_quantified && !is_escaped_quantifier)
+        return fail(result::Invalid);
+      if (!is_extended && is_assertion) {
+        /* A basic ^* reads the star as a literal after the anchor. */
+        position = quantifier_start;
+        break;
+      }
+      let const repeat = make(regex_node::Kind::Repeat);
+      nodes[repeat].min = min;
+      nodes[repeat].max = max;
+      append_child(repeat, atom);
+      atom = repeat;
+      is_quantified = true;
+    }
+    return atom;
+  }
+
+  fn parse_escape(usize depth) throws -> u32
+  {
+    unused(depth);
+    position++;
+    if (at_end()) return fail(result::Invalid);
+    let const c = peek();
+    position++;
+
+    if (c >= '1' && c <= '9') {
+      /* A backreference to a group that has closed needs a backtracking
+         engine, and one to any other group is an error as in glibc. */
+      if (static_cast<usize>(c - '0') > closed_group_count)
+        return fail(result::Invalid);
+      return fail(result::Unsupported);
+    }
+
+    regex_byte_set set{};
+    switch (c) {
+    case 'w':
+    case 'W':
+      for (usize b = 0; b < 256; b++) {
+        if (is_word_byte(static_cast<u8>(b)) == (c == 'w'))
+          set.add(static_cast<u8>(b));
+      }
+      return make_set(set);
+    case 's':
+    case 'S':
+      for (usize b = 0; b < 256; b++) {
+        let const byte = static_cast<u8>(b);
+        let const is_space = byte == ' ' || (byte >= '\t' && byte <= '\r');
+        if (is_space == (c == 's')) set.add(byte);
+      }
+      return make_set(set);
+    case 'b':
+      return make_assertion(Regex::instruction::Op::WordBoundary);
+    case 'B':
+      return make_assertion(Regex::instruction::Op::NotWordBoundary);
+    case '<':
+      return make_assertion(Regex::instruction::Op::WordStart);
+    case '>':
+      return make_assertion(Regex::instruction::Op::WordEnd);
+    case '`':
+      return make_assertion(Regex::instruction::Op::TextStart);
+    case '\'':
+      return make_assertion(Regex::instruction::Op::TextEnd);
+    default:
+      return make_byte(static_cast<u8>(c));
+    }
+  }
+
+  fn make_assertion(Regex::instruction::Op op) throws -> u32
+  {
+    if (op != Regex::instruction::Op::TextStart &&
+        op != Regex::instruction::Op::TextEnd)
+      out.m_has_word_assertions = true;
+    return make(regex_node::Kind::Assert, static_cast<u32>(op));
+  }
+
+  fn parse_group(usize depth) throws -> u32
+  {
+    position += is_extended ? 1 : 2;
+    let const group = make(regex_node::Kind::Group,
+                           static_cast<u32>(++out.m_group_count));
+    append_child(group, parse_alternation(depth + 1));
+    if (failure.has_value()) return NO_NODE;
+    if (!at_group_close(depth + 1)) return fail(result::Invalid);
+    position += is_extended ? 1 : 2;
+    closed_group_count++;
+    return group;
+  }
+
+  fn parse_atom(usize depth, usize branch_start) throws -> u32
+  {
+    let const c = peek();
+    let const is_branch_start = position == branch_start;
+
+    if (is_extended) {
+      switch (c) {
+      case '(':
+        return parse_group(depth);
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+        return fail(result::Invalid);
+      case '^':
+        position++;
+        return make_assertion(Regex::instruction::Op::TextStart);
+      case '$':
+        position++;
+        return make_assertion(Regex::instruction::Op::TextEnd);
+      default:
+        break;
+      }
+    } else {
+      if (c == '\\' && peek(1) == '(') return parse_group(depth);
+      if (c == '\\' && peek(1) == ')') return fail(result::Invalid);
+      if (c == '\\' && peek(1) == '{' && is_branch_start)
+        return fail(result::Invalid);
+      if (c == '*' && is_branch_start) {
+        position++;
+        return make_byte('*');
+      }
+      if (c == '^' && is_branch_start) {
+        position++;
+        return make_assertion(Regex::instruction::Op::TextStart);
+      }
+      if (c == '$') {
+        let const saved = position;
+        position++;
+        if (at_end() || at_alternation() || at_group_close(depth))
+          return make_assertion(Regex::instruction::Op::TextEnd);
+        position = saved;
+      }
+    }
+
+    switch (c) {
+    case '.': {
+      position++;
+      regex_byte_set set{};
+      for (usize b = 1; b < 256; b++)
+        set.add(static_cast<u8>(b));
+      return make_set(set);
+    }
+    case '[':
+      return parse_bracket();
+    case '\\':
+      return parse_escape(depth);
+    default:
+      position++;
+      return make_byte(static_cast<u8>(c));
+    }
+  }
+
+  /* Reads one bracket element, a byte, a [.x.] or [=x=] naming one byte, or a
+     [:name:] class added straight into the set. */
+  fn parse_bracket_element(regex_byte_set &set, bool &is_class) wontthrow
+      -> Maybe<u8>
+  {
+    is_class = false;
+    if (peek() == '[' && (peek(1) == ':' || peek(1) == '=' || peek(1) == '.')) {
+      let const delimiter = peek(1);
+      let const body_start = position + 2;
+      usize scan = body_start;
+      while (scan + 1 < pattern.length &&
+             !(pattern[scan] == delimiter && pattern[scan + 1] == ']'))
+        scan++;
+      if (scan + 1 >= pattern.length) {
+        unused(fail(result::Invalid));
+        return None;
+      }
+      let const body =
+          pattern.substring_of_length(body_start, scan - body_start);
+      position = scan + 2;
+      if (delimiter == ':') {
+        is_class = true;
+        if (!add_posix_class(set, body)) unused(fail(result::Invalid));
+        return None;
+      }
+      if (body.length != 1) {
+        unused(fail(result::Invalid));
+        return None;
+      }
+      return static_cast<u8>(body[0]);
+    }
+    return static_cast<u8>(pattern[position++]);
+  }
+
+  fn parse_bracket() throws -> u32
+  {
+    position++;
+    regex_byte_set set{};
+    bool should_negate = false;
+    if (peek() == '^') {
+      should_negate = true;
+      position++;
+    }
+
+    bool is_first = true;
+    loop
+    {
+      if (at_end()) return fail(result::Invalid);
+      if (peek() == ']' && !is_first) break;
+      is_first = false;
+
+      bool is_class = false;
+      let const low = parse_bracket_element(set, is_class);
+      if (failure.has_value()) return NO_NODE;
+
+      let const is_range = peek() == '-' && position + 1 < pattern.length &&
+                           pattern[position + 1] != ']';
+      if (!is_range) {
+        if (low.has_value()) set.add(*low);
+        continue;
+      }
+      if (is_class) return fail(result::Invalid);
+
+      position++;
+      bool is_high_class = false;
+      let const high = parse_bracket_element(set, is_high_class);
+      if (failure.has_value()) return NO_NODE;
+      if (is_high_class || *high < *low) return fail(result::Invalid);
+      for (usize b = *low; b <= *high; b++)
+        set.add(static_cast<u8>(b));
+    }
+    position++;
+
+    if (ignore_case) fold_case(set);
+    if (should_negate) {
+      for (usize w = 0; w < 4; w++)
+        set.bits[w] = ~set.bits[w];
+    }
+    out.m_sets.push(set);
+    return make(regex_node::Kind::Bytes,
+                static_cast<u32>(out.m_sets.count() - 1));
+  }
+
+  fn emit(Regex::instruction::Op op, u32 x = 0, u32 y = 0) throws -> u32
+  {
+    out.m_program.push(Regex::instruction{op, x, y});
+    return static_cast<u32>(out.m_program.count() - 1);
+  }
+
+  mustuse fn here() const wontthrow -> u32
+  {
+    return static_cast<u32>(out.m_program.count());
+  }
+
+  fn emit_node(u32 index) throws -> void
+  {
+    using Op = Regex::instruction::Op;
+    if (out.m_program.count() > MAX_PROGRAM_LENGTH) {
+      unused(fail(result::Unsupported));
+      return;
+    }
+
+    let const node = nodes[index];
+    switch (node.kind) {
+    case regex_node::Kind::Empty:
+      return;
+
+    case regex_node::Kind::Bytes:
+      unused(emit(Op::Bytes, node.value));
+      return;
+
+    case regex_node::Kind::Assert:
+      unused(emit(static_cast<Op>(node.value)));
+      return;
+
+    case regex_node::Kind::Concat:
+      for (u32 child = node.first_child; child != NO_NODE;
+           child = nodes[child].next_sibling)
+        emit_node(child);
+      return;
+
+    case regex_node::Kind::Group:
+      unused(emit(Op::Save, 2 * node.value));
+      emit_node(node.first_child);
+      unused(emit(Op::Save, 2 * node.value + 1));
+      return;
+
+    case regex_node::Kind::Alternate: {
+      let jumps = ArrayList<u32>{out.m_allocator};
+      for (u32 child = node.first_child; child != NO_NODE;
+           child = nodes[child].next_sibling)
+      {
+        if (nodes[child].next_sibling == NO_NODE) {
+          emit_node(child);
+          break;
+        }
+        let const split = emit(Op::Split, here() + 1);
+        emit_node(child);
+        jumps.push(emit(Op::Jump));
+        out.m_program[split].y = here();
+      }
+      for (let const jump : jumps)
+        out.m_program[jump].x = here();
+      return;
+    }
+
+    case regex_node::Kind::Repeat: {
+      /* A starred body that matches the empty string still runs once, so
+         (a*)* before a b leaves group 1 at an empty span the way glibc does.
+         Both forms accept the same strings. */
+      let const min = node.min == 0 && node.max == UNBOUNDED &&
+                              is_nullable(node.first_child)
+                          ? 1
+                          : node.min;
+      for (i32 i = 0; i < min && !failure.has_value(); i++)
+        emit_node(node.first_child);
+
+      if (node.max == UNBOUNDED) {
+        let const split = emit(Op::Split, here() + 1);
+        emit_node(node.first_child);
+        unused(emit(Op::Jump, split));
+        out.m_program[split].y = here();
+        return;
+      }
+
+      /* x{m,n} past its m copies nests n - m optional ones, each skip landing
+         past all of them. */
+      let skips = ArrayList<u32>{out.m_allocator};
+      for (i32 i = node.min; i < node.max; i++) {
+        skips.push(emit(Op::Split, here() + 1));
+        emit_node(node.first_child);
+        if (failure.has_value()) return;
+      }
+      for (let const skip : skips)
+        out.m_program[skip].y = here();
+      return;
+    }
+    }
+  }
+
+  mustuse pure fn is_nullable(u32 index) const wontthrow -> bool
+  {
+    if (index == NO_NODE) return true;
+    let const &node = nodes[index];
+    switch (node.kind) {
+    case regex_node::Kind::Empty:
+    case regex_node::Kind::Assert:
+      return true;
+    case regex_node::Kind::Bytes:
+      return false;
+    case regex_node::Kind::Group:
+      return is_nullable(node.first_child);
+    case regex_node::Kind::Repeat:
+      return node.min == 0 || is_nullable(node.first_child);
+    case regex_node::Kind::Concat:
+      for (u32 child = node.first_child; child != NO_NODE;
+           child = nodes[child].next_sibling)
+      {
+        if (!is_nullable(child)) return false;
+      }
+      return true;
+    case regex_node::Kind::Alternate:
+      for (u32 child = node.first_child; child != NO_NODE;
+           child = nodes[child].next_sibling)
+      {
+        if (is_nullable(child)) return true;
+      }
+      return false;
+    }
+    return false;
+  }
+
+  /* The longest run of single bytes in the top-level concatenation, which
+     every match has to contain. */
+  fn required_literal() const throws -> String
+  {
+    let best = String{out.m_allocator};
+    let run = String{out.m_allocator};
+    if (nodes.is_empty() || nodes[0].kind != regex_node::Kind::Concat)
+      return best;
+
+    for (u32 child = nodes[0].first_child;; child = nodes[child].next_sibling)
+    {
+      let const is_single_byte =
+          child != NO_NODE && nodes[child].kind == regex_node::Kind::Bytes &&
+          set_member_count(out.m_sets[nodes[child].value]) == 1;
+      if (is_single_byte) {
+        let const &set = out.m_sets[nodes[child].value];
+        for (usize b = 0; b < 256; b++) {
+          if (set.has(static_cast<u8>(b))) run.push(static_cast<char>(b));
+        }
+        continue;
+      }
+      if (run.length() > best.length()) best = steal(run);
+      run = String{out.m_allocator};
+      if (child == NO_NODE) break;
+    }
+    return best;
+  }
+};
+
+Regex::Regex(Allocator allocator)
+    : m_allocator(allocator), m_program(allocator), m_sets(allocator),
+      m_required_literal(allocator), m_dfa_states(allocator),
+      m_dfa_pcs(allocator), m_dfa_transitions(allocator),
+      m_dfa_index(allocator), m_floating_pcs(allocator), m_marks(allocator),
+      m_pike_lists{{ArrayList<u32>{allocator}, ArrayList<i64>{allocator}},
+                   {ArrayList<u32>{allocator}, ArrayList<i64>{allocator}}},
+      m_pike_stack(allocator), m_pike_slots(allocator), m_pike_best(allocator)
+{}
+
+fn Regex::compile(StringView pattern, Syntax syntax, bool ignore_case,
+                  Regex &out) throws -> CompileResult
+{
+  using Op = instruction::Op;
+
+  regex_compiler compiler{pattern, syntax == Syntax::Extended, ignore_case,
+                          out};
+  let const root = compiler.parse_alternation(0);
+  if (compiler.failure.has_value()) return *compiler.failure;
+  /* The top level never closes a group, so an extended ) there was read as a
+     literal and the parse always consumes the whole pattern. */
+  ASSERT(compiler.at_end());
+
+  unused(compiler.emit(Op::Save, 0));
+  compiler.emit_node(root);
+  unused(compiler.emit(Op::Save, 1));
+  unused(compiler.emit(Op::Match));
+  if (compiler.failure.has_value()) return *compiler.failure;
+
+  if (root == 0) out.m_required_literal = compiler.required_literal();
+
+  /* Split the bytes into classes, refining by one set at a time. */
+  u16 refined[512];
+  for (let const &set : out.m_sets) {
+    for (usize i = 0; i < 512; i++)
+      refined[i] = 0xffff;
+    usize next_class = 0;
+    for (usize b = 0; b < 256; b++) {
+      let const key =
+          out.m_byte_classes[b] * 2u + (set.has(static_cast<u8>(b)) ? 1u : 0u);
+      if (refined[key] == 0xffff) refined[key] = static_cast<u16>(next_class++);
+      out.m_byte_classes[b] = static_cast<u8>(refined[key]);
+    }
+  }
+  for (usize b = 0; b < 256; b++) {
+    if (out.m_byte_classes[b] + 1u > out.m_class_count)
+      out.m_class_count = out.m_byte_classes[b] + 1u;
+  }
+
+  out.m_marks.reserve(out.m_program.count());
+  for (usize i = 0; i < out.m_program.count(); i++)
+    out.m_marks.push(0);
+
+  let const start_pc = u32{0};
+  out.closure(&start_pc, 1, false, false, out.m_floating_pcs);
+  out.reset_dfa();
+
+  /* A floating start that consumes one byte only, and can not accept yet,
+     lets a scan skip to that byte. */
+  regex_byte_set first{};
+  bool can_skip = true;
+  for (let const pc : out.m_floating_pcs) {
+    let const &instruction = out.m_program[pc];
+    if (instruction.kind != Op::Bytes) {
+      can_skip = false;
+      break;
+    }
+    for (usize w = 0; w < 4; w++)
+      first.bits[w] |= out.m_sets[instruction.x].bits[w];
+  }
+  if (can_skip && set_member_count(first) == 1) {
+    for (usize b = 0; b < 256; b++) {
+      if (first.has(static_cast<u8>(b)))
+        out.m_first_byte = static_cast<char>(b);
+    }
+  }
+  return CompileResult::Ok;
+}
+
+fn Regex::closure(const u32 *seeds, usize seed_count, bool at_start,
+                  bool at_end, ArrayList<u32> &out) throws -> void
+{
+  using Op = instruction::Op;
+
+  out.clear();
+  let const generation = next_mark_generation();
+  let stack = ArrayList<u32>{m_allocator};
+  for (usize i = seed_count; i > 0; i--)
+    stack.push(seeds[i - 1]);
+
+  while (!stack.is_empty()) {
+    u32 pc = stack.back();
+    stack.pop_back();
+    loop
+    {
+      if (m_marks[pc] == generation) break;
+      m_marks[pc] = generation;
+      let const &instruction = m_program[pc];
+      if (instruction.kind == Op::Jump) {
+        pc = instruction.x;
+      } else if (instruction.kind == Op::Split) {
+        stack.push(instruction.y);
+        pc = instruction.x;
+      } else if (instruction.kind == Op::Save) {
+        pc++;
+      } else if (instruction.kind == Op::TextStart) {
+        if (!at_start) break;
+        pc++;
+      } else if (instruction.kind == Op::TextEnd && at_end) {
+        pc++;
+      } else {
+        out.push(pc);
+        break;
+      }
+    }
+  }
+  out.sort();
+}
+
+fn Regex::next_mark_generation() wontthrow -> u32
+{
+  /* A wrapped counter would read stale marks as fresh, so they start over. */
+  if (++m_mark_generation == 0) {
+    for (let &mark : m_marks)
+      mark = 0;
+    m_mark_generation = 1;
+  }
+  return m_mark_generation;
+}
+
+fn Regex::intern_dfa_state(ArrayList<u32> &pcs) throws -> u32
+{
+  let const key = StringView{reinterpret_cast<const char *>(pcs.begin()),
+                             pcs.count() * sizeof(u32)};
+  if (const u32 *found = m_dfa_index.find(key); found != nullptr)
+    return *found;
+
+  bool is_accepting = false;
+  for (let const pc : pcs) {
+    if (m_program[pc].kind == instruction::Op::Match) is_accepting = true;
+  }
+
+  let const index = static_cast<u32>(m_dfa_states.count());
+  m_dfa_states.push(dfa_state{static_cast<u32>(m_dfa_pcs.count()),
+                              static_cast<u32>(pcs.count()), is_accepting});
+  for (let const pc : pcs)
+    m_dfa_pcs.push(pc);
+  for (usize c = 0; c < m_class_count; c++)
+    m_dfa_transitions.push(-1);
+  m_dfa_index.set(key, index);
+  return index;
+}
+
+fn Regex::reset_dfa() throws -> void
+{
+  m_dfa_states.clear();
+  m_dfa_pcs.clear();
+  m_dfa_transitions.clear();
+  m_dfa_index.clear();
+
+  let pcs = ArrayList<u32>{m_allocator};
+  let const start_pc = u32{0};
+  closure(&start_pc, 1, true, false, pcs);
+  m_dfa_start = intern_dfa_state(pcs);
+  pcs = m_floating_pcs.clone();
+  m_dfa_floating = intern_dfa_state(pcs);
+}
+
+fn Regex::dfa_step(u32 state, u8 byte) throws -> u32
+{
+  let const row = static_cast<usize>(state) * m_class_count;
+  let const cached = m_dfa_transitions[row + m_byte_classes[byte]];
+  if (cached >= 0) [[likely]]
+    return static_cast<u32>(cached);
+
+  /* The unanchored search may begin a match at every byte, so the floating
+     start joins every step. */
+  let seeds = ArrayList<u32>{m_allocator};
+  let const &current = m_dfa_states[state];
+  for (usize i = 0; i < current.pc_count; i++) {
+    let const pc = m_dfa_pcs[current.first_pc + i];
+    let const &instruction = m_program[pc];
+    if (instruction.kind == instruction::Op::Bytes &&
+        m_sets[instruction.x].has(byte))
+      seeds.push(pc + 1);
+  }
+  for (let const pc : m_floating_pcs)
+    seeds.push(pc);
+
+  let pcs = ArrayList<u32>{m_allocator};
+  closure(seeds.begin(), seeds.count(), false, false, pcs);
+
+  if (m_dfa_states.count() >= MAX_DFA_STATES) {
+    reset_dfa();
+    return intern_dfa_state(pcs);
+  }
+  let const next = intern_dfa_state(pcs);
+  m_dfa_transitions[row + m_byte_classes[byte]] = static_cast<i32>(next);
+  return next;
+}
+
+fn Regex::dfa_accepts_at_end(u32 state, bool is_subject_empty) throws -> bool
+{
+  let const &current = m_dfa_states[state];
+  if (current.is_accepting) return true;
+
+  let pcs = ArrayList<u32>{m_allocator};
+  closure(m_dfa_pcs.begin() + current.first_pc, current.pc_count,
+          is_subject_empty, true, pcs);
+  for (let const pc : pcs) {
+    if (m_program[pc].kind == instruction::Op::Match) return true;
+  }
+  return false;
+}
+
+fn Regex::is_match(StringView subject) throws -> bool
+{
+  if (!m_required_literal.is_empty()) {
+    let const literal = m_required_literal.view();
+    bool is_found = false;
+    for (usize at = 0; at + literal.length <= subject.length;) {
+      let const *hit = static_cast<const char *>(std::memchr(
+          subject.data + at, literal[0], subject.length - at));
+      if (hit == nullptr) break;
+      at = static_cast<usize>(hit - subject.data);
+      if (at + literal.length > subject.length) break;
+      if (std::memcmp(hit, literal.data, literal.length) == 0) {
+        is_found = true;
+        break;
+      }
+      at++;
+    }
+    if (!is_found) return false;
+  }
+
+  if (m_has_word_assertions) return pike_search(subject, nullptr);
+
+  u32 state = m_dfa_start;
+  for (usize i = 0; i < subject.length; i++) {
+    if (m_dfa_states[state].is_accepting) return true;
+    if (m_dfa_states[state].pc_count == 0) return false;
+
+    if (state == m_dfa_floating && m_first_byte.has_value()) {
+      let const *hit = static_cast<const char *>(std::memchr(
+          subject.data + i, *m_first_byte, subject.length - i));
+      if (hit == nullptr) return false;
+      i = static_cast<usize>(hit - subject.data);
+    }
+    state = dfa_step(state, static_cast<u8>(subject[i]));
+  }
+  return dfa_accepts_at_end(state, subject.length == 0);
+}
+
+fn Regex::find(StringView subject, ArrayList<regex_span> &spans) throws -> bool
+{
+  if (!is_match(subject)) return false;
+  return pike_search(subject, &spans);
+}
+
+fn Regex::pike_search(StringView subject, ArrayList<regex_span> *spans) throws
+    -> bool
+{
+  using Op = instruction::Op;
+
+  let const slot_count = 2 * (m_group_count + 1);
+
+  let *lists = m_pike_lists;
+  let &stack = m_pike_stack;
+  let &slots = m_pike_slots;
+  let &best = m_pike_best;
+  for (let &list : m_pike_lists) {
+    list.pcs.clear();
+    list.slots.clear();
+  }
+  stack.clear();
+  slots.clear();
+  best.clear();
+  for (usize i = 0; i < slot_count; i++)
+    slots.push(-1);
+
+  let const is_word_at = [&](usize at) wontthrow -> bool {
+    return at < subject.length && is_word_byte(static_cast<u8>(subject[at]));
+  };
+  let const assertion_holds = [&](Op kind, usize at) wontthrow -> bool {
+    let const before = at > 0 && is_word_at(at - 1);
+    let const after = is_word_at(at);
+    switch (kind) {
+    case Op::TextStart:
+      return at == 0;
+    case Op::TextEnd:
+      return at == subject.length;
+    case Op::WordBoundary:
+      return before != after;
+    case Op::NotWordBoundary:
+      return before == after;
+    case Op::WordStart:
+      return !before && after;
+    case Op::WordEnd:
+      return before && !after;
+    default:
+      return false;
+    }
+  };
+
+  /* Follows the epsilon edges from pc with the slots of the thread, adding
+     every consuming or accepting instruction it reaches to list. A Save is
+     undone on the way back so a lower-priority branch sees the slots the way
+     the split left them. */
+  let const add_thread = [&](pike_list &list, u32 pc, usize at,
+                             u32 generation) throws -> void {
+    stack.push(pike_frame{pc, static_cast<u32>(slot_count), 0});
+    while (!stack.is_empty()) {
+      let const top = stack.back();
+      stack.pop_back();
+      if (top.restore_slot != slot_count) {
+        slots[top.restore_slot] = top.restore_value;
+        continue;
+      }
+      u32 current = top.pc;
+      loop
+      {
+        if (m_marks[current] == generation) break;
+        m_marks[current] = generation;
+        let const &instruction = m_program[current];
+        if (instruction.kind == Op::Jump) {
+          current = instruction.x;
+        } else if (instruction.kind == Op::Split) {
+          stack.push(
+              pike_frame{instruction.y, static_cast<u32>(slot_count), 0});
+          current = instruction.x;
+        } else if (instruction.kind == Op::Save) {
+          stack.push(pike_frame{0, instruction.x, slots[instruction.x]});
+          slots[instruction.x] = static_cast<i64>(at);
+          current++;
+        } else if (instruction.kind == Op::Bytes ||
+                   instruction.kind == Op::Match)
+        {
+          list.pcs.push(current);
+          for (usize i = 0; i < slot_count; i++)
+            list.slots.push(slots[i]);
+          break;
+        } else {
+          if (!assertion_holds(instruction.kind, at)) break;
+          current++;
+        }
+      }
+    }
+  };
+
+  bool is_matched = false;
+  usize current_list = 0;
+  u32 generation = next_mark_generation();
+
+  for (usize at = 0; at <= subject.length; at++) {
+    let &clist = lists[current_list];
+    /* A new start joins at the lowest priority, and only until a match is
+       found, since a later start can not be leftmost. */
+    if (!is_matched) {
+      for (usize i = 0; i < slot_count; i++)
+        slots[i] = -1;
+      add_thread(clist, 0, at, generation);
+    }
+    if (clist.pcs.is_empty() && is_matched) break;
+
+    let &nlist = lists[1 - current_list];
+    generation = next_mark_generation();
+
+    for (usize t = 0; t < clist.pcs.count(); t++) {
+      let const *thread_slots = clist.slots.begin() + t * slot_count;
+      if (is_matched && thread_slots[0] > best[0]) continue;
+
+      let const &instruction = m_program[clist.pcs[t]];
+      if (instruction.kind == Op::Match) {
+        if (!is_matched || thread_slots[0] < best[0] ||
+            (thread_slots[0] == best[0] && thread_slots[1] > best[1]))
+        {
+          best.clear();
+          for (usize i = 0; i < slot_count; i++)
+            best.push(thread_slots[i]);
+          is_matched = true;
+          if (spans == nullptr) return true;
+        }
+        continue;
+      }
+      if (at < subject.length &&
+          m_sets[instruction.x].has(static_cast<u8>(subject[at])))
+      {
+        for (usize i = 0; i < slot_count; i++)
+          slots[i] = thread_slots[i];
+        add_thread(nlist, clist.pcs[t] + 1, at + 1, generation);
+      }
+    }
+
+    clist.pcs.clear();
+    clist.slots.clear();
+    current_list = 1 - current_list;
+  }
+
+  if (!is_matched || spans == nullptr) return is_matched;
+  spans->clear();
+  spans->reserve(m_group_count + 1);
+  for (usize group = 0; group <= m_group_count; group++) {
+    let const start = best[2 * group];
+    let const end = best[2 * group + 1];
+    if (start < 0 || end < 0)
+      spans->push(regex_span{});
+    else
+      spans->push(regex_span{start, end});
+  }
+  return true;
+}
+
+} // namespace shit
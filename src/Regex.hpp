@@ -0,0 +1,192 @@
+#pragma once
+
+#include "Allocator.hpp"
+#include "ArrayList.hpp"
+#include "Common.hpp"
+#include "Maybe.hpp"
+#include "String.hpp"
+#include "StringMap.hpp"
+#include "StringView.hpp"
+
+namespace shit {
+
+/* One capture group's byte span in the subject. A group that did not
+   participate carries a negative start. */
+struct regex_span
+{
+  i64 start{-1};
+  i64 end{-1};
+};
+
+/* The set of bytes one consuming instruction accepts. */
+struct regex_byte_set
+{
+  u64 bits[4]{};
+
+  fn add(u8 byte) wontthrow -> void
+  {
+    bits[byte / 64] |= u64{1} << (byte % 64);
+  }
+
+  mustuse pure fn has(u8 byte) const wontthrow -> bool
+  {
+    return ((bits[byte / 64] >> (byte % 64)) & 1u) != 0;
+  }
+};
+
+/* A POSIX regular expression, basic or extended, compiled in tree so the
+   matchers do not depend on the speed of the libc engine. Matching bytes the
+   way the libc engine does in the C locale the shell runs it under, the
+   pattern compiles to a Thompson program of byte sets, splits, and capture
+   saves.
+
+   is_match runs the program as a DFA whose states are built lazily, one row of
+   byte classes per state, so a hot grep or a [[ =~ ]] in a loop steps a table
+   per byte once the states it visits exist. A literal every match contains is
+   searched for first, and a scan sitting in the start state skips to the next
+   byte that can begin a match, both through memchr.
+
+   find runs the same program as a Pike VM for the leftmost-longest match and
+   its groups. Among matches of that span, a group takes the span the
+   preferred path gives it: a greedy repeat takes the most, and an earlier
+   alternative wins a tie. That agrees with glibc on the patterns bash scripts
+   write.
+
+   A backreference has no automaton, so such a pattern reports Unsupported and
+   the caller keeps a backtracking engine for it. */
+class Regex
+{
+public:
+  enum class Syntax : u8
+  {
+    Basic,
+    Extended,
+  };
+
+  enum class CompileResult : u8
+  {
+    Ok,
+    Invalid,
+    Unsupported,
+  };
+
+  explicit Regex(Allocator allocator);
+
+  static fn compile(StringView pattern, Syntax syntax, bool ignore_case,
+                    Regex &out) throws -> CompileResult;
+
+  /* The count of parenthesized groups, group 0 not included. */
+  mustuse pure fn group_count() const wontthrow -> usize
+  {
+    return m_group_count;
+  }
+
+  /* Whether any part of subject matches. */
+  hot fn is_match(StringView subject) throws -> bool;
+
+  /* The leftmost-longest match, one span per group with group 0 first. */
+  fn find(StringView subject, ArrayList<regex_span> &spans) throws -> bool;
+
+private:
+  struct instruction
+  {
+    enum class Op : u8
+    {
+      Bytes,
+      Split,
+      Jump,
+      Save,
+      TextStart,
+      TextEnd,
+      WordBoundary,
+      NotWordBoundary,
+      WordStart,
+      WordEnd,
+      Match,
+    };
+
+    Op kind;
+    /* The set index of Bytes, the slot of Save, the target of Jump, and the
+       preferred target of Split. */
+    u32 x{0};
+    /* The other target of Split. */
+    u32 y{0};
+  };
+
+  /* The threads of one position in priority order, each carrying its capture
+     slots. */
+  struct pike_list
+  {
+    ArrayList<u32> pcs;
+    ArrayList<i64> slots;
+  };
+
+  struct pike_frame
+  {
+    u32 pc;
+    /* A slot to restore on the way back, or the slot count for a plain pc. */
+    u32 restore_slot;
+    i64 restore_value;
+  };
+
+  struct dfa_state
+  {
+    u32 first_pc;
+    u32 pc_count;
+    bool is_accepting;
+  };
+
+  friend struct regex_compiler;
+
+  /* The consuming and accepting instructions reachable from the seeds without
+     consuming a byte, sorted, with a TextEnd kept pending unless at_end. */
+  fn closure(const u32 *seeds, usize seed_count, bool at_start, bool at_end,
+             ArrayList<u32> &out) throws -> void;
+  fn next_mark_generation() wontthrow -> u32;
+  fn intern_dfa_state(ArrayList<u32> &pcs) throws -> u32;
+  fn reset_dfa() throws -> void;
+  fn dfa_step(u32 state, u8 byte) throws -> u32;
+  fn dfa_accepts_at_end(u32 state, bool is_subject_empty) throws -> bool;
+  fn pike_search(StringView subject, ArrayList<regex_span> *spans) throws
+      -> bool;
+
+  Allocator m_allocator;
+  ArrayList<instruction> m_program;
+  ArrayList<regex_byte_set> m_sets;
+  usize m_group_count{0};
+  /* A word assertion reads the byte before the position, which a DFA state
+     does not remember, so such a program always runs on the Pike VM. */
+  bool m_has_word_assertions{false};
+  /* Bytes no set tells apart share a class, and a DFA row holds one entry per
+     class rather than per byte. */
+  u8 m_byte_classes[256]{};
+  usize m_class_count{0};
+  /* A run of bytes every match contains, searched for before the DFA runs. */
+  String m_required_literal;
+  /* The only byte that can begin a match, when there is one. */
+  Maybe<char> m_first_byte;
+
+  ArrayList<dfa_state> m_dfa_states;
+  ArrayList<u32> m_dfa_pcs;
+  /* One row of m_class_count entries per state, -1 where the step has not
+     been built yet. */
+  ArrayList<i32> m_dfa_transitions;
+  StringMap<u32> m_dfa_index;
+  /* The state at the first byte, and the one the unanchored search falls back
+     to at every later byte. */
+  u32 m_dfa_start{0};
+  u32 m_dfa_floating{0};
+  ArrayList<u32> m_floating_pcs;
+
+  ArrayList<u32> m_marks;
+  u32 m_mark_generation{0};
+
+  /* The Pike VM's buffers, kept across calls so a hot =~ does not allocate
+     once they have grown to the pattern. */
+  pike_list m_pike_lists[2];
+  ArrayList<pike_frame> m_pike_stack;
+  ArrayList<i64> m_pike_slots;
+  ArrayList<i64> m_pike_best;
+};
+
+} // namespace shit
@@ -4,6 +4,7 @@
 #include "Cli.hpp"
 #include "Errors.hpp"
 #include "Eval.hpp"
+#include "PipelineStages.hpp"
 #include "ResolvedCommand.hpp"
 #include "Trace.hpp"
 #include "Utils.hpp"
@@ -19,6 +20,33 @@ flatten fn find_util(StringView name) throws -> Maybe<Utility::Kind>
   return SHITBOX_UTILS.find(name);
 }
 
+pure fn util_runs_on_stage_thread(Utility::Kind chosen) wontthrow -> bool
+{
+  switch (chosen) {
+  case Utility::Kind::Basename:
+  case Utility::Kind::Cat:
+  case Utility::Kind::Dirname:
+  case Utility::Kind::Grep:
+  case Utility::Kind::Seq:
+  case Utility::Kind::Sort:
+  case Utility::Kind::Tail:
+  case Utility::Kind::Tr:
+  case Utility::Kind::Uniq:
+  case Utility::Kind::Wc: return true;
+  default: return false;
+  }
+}
+
+pure fn util_is_pure(Utility::Kind chosen) wontthrow -> bool
+{
+  switch (chosen) {
+  case Utility::Kind::Basename:
+  case Utility::Kind::Dirname:
+  case Utility::Kind::Seq: return true;
+  default: return false;
+  }
+}
+
 /* Zero-initialized so it is immune to static-init order, filled by each
    utility's registrar. */
 static const ArrayList<Flag *> *SHITBOX_UTIL_FLAG_LISTS[SHITBOX_UTIL_COUNT] =
@@ -218,20 +246,20 @@ fn print_util_help(const ExecContext &ec, StringView name, StringView synopsis,
   ec.print_to_stdout(help_text);
 }
 
-fn read_fd_to_string(os::descriptor fd) throws -> Maybe<String>
-{
-  return os::read_fd_to_string(fd, heap_allocator());
-}
-
 fn read_named_or_stdin(const ExecContext &ec, StringView path) throws
     -> Maybe<String>
 {
-  if (path == "-") return read_fd_to_string(ec.in_fd.value_or(SHIT_STDIN));
+  if (path == "-") {
+    if (ec.in_ring != nullptr)
+      return stages::read_ring_to_string(ec.in_ring, heap_allocator());
+    return os::read_fd_to_string(ec.in_fd.value_or(SHIT_STDIN),
+                                 heap_allocator());
+  }
 
   let const fd = os::open_file_descriptor(path, os::file_open_mode::Read);
   if (!fd.has_value()) return None;
   defer { os::close_fd(*fd); };
-  return read_fd_to_string(*fd);
+  return os::read_fd_to_string(*fd, heap_allocator());
 }
 
 fn split_keep_newlines(StringView text) throws -> ArrayList<StringView>
@@ -254,6 +282,163 @@ fn split_keep_newlines(StringView text) throws -> ArrayList<StringView>
   return lines;
 }
 
+text_reader::~text_reader()
+{
+  close();
+  if (m_buffer != nullptr) heap_allocator().free_array(m_buffer, m_capacity);
+}
+
+fn text_reader::open(const ExecContext &ec, StringView path) throws -> bool
+{
+  close();
+  if (path == "-") {
+    if (ec.in_ring != nullptr)
+      m_ring = ec.in_ring;
+    else
+      m_fd = ec.in_fd.value_or(SHIT_STDIN);
+  } else {
+    let const fd = os::open_file_descriptor(path, os::file_open_mode::Read);
+    if (!fd.has_value()) return false;
+    m_fd = *fd;
+    m_owns_fd = true;
+  }
+  /* The buffer outlives a close, so the next input of the run reuses it. */
+  if (m_buffer == nullptr) {
+    m_buffer = heap_allocator().alloc_array<char>(TEXT_CHUNK_SIZE);
+    m_capacity = TEXT_CHUNK_SIZE;
+  }
+  return true;
+}
+
+fn text_reader::close() wontthrow -> void
+{
+  if (m_owns_fd) os::close_fd(*m_fd);
+  m_ring = nullptr;
+  m_fd.reset();
+  m_owns_fd = false;
+  m_is_at_end = false;
+  m_start = 0;
+  m_end = 0;
+}
+
+/* A read lands after the buffered bytes. A ring that ends its wait on an
+   interrupt reads as the end of the input, and the caller checks the flag. */
+fn text_reader::fill() throws -> Maybe<usize>
+{
+  if (m_is_at_end) return 0;
+  usize read_count = 0;
+  if (m_ring != nullptr) {
+    read_count =
+        stages::read_ring(m_ring, m_buffer + m_end, m_capacity - m_end);
+  } else {
+    let const result = os::read_fd(*m_fd, m_buffer + m_end, m_capacity - m_end);
+    if (!result.has_value()) return None;
+    read_count = *result;
+  }
+  if (read_count == 0) m_is_at_end = true;
+  m_end += read_count;
+  return read_count;
+}
+
+hot fn text_reader::next_chunk() throws -> Maybe<StringView>
+{
+  /* A line read may have left the rest of a chunk behind. */
+  if (m_start < m_end) {
+    let const rest = StringView{m_buffer + m_start, m_end - m_start};
+    m_start = m_end;
+    return rest;
+  }
+  m_start = 0;
+  m_end = 0;
+  let const read_count = fill();
+  if (!read_count.has_value()) return None;
+  m_start = m_end;
+  return StringView{m_buffer, *read_count};
+}
+
+hot fn text_reader::next_line() throws -> Maybe<StringView>
+{
+  usize scanned = m_start;
+  loop
+  {
+    let const *newline = static_cast<const char *>(
+        __builtin_memchr(m_buffer + scanned, '\n', m_end - scanned));
+    if (newline != nullptr) {
+      let const line_end = static_cast<usize>(newline - m_buffer) + 1;
+      let const line = StringView{m_buffer + m_start, line_end - m_start};
+      m_start = line_end;
+      return line;
+    }
+    if (m_is_at_end) {
+      let const last = StringView{m_buffer + m_start, m_end - m_start};
+      m_start = m_end;
+      return last;
+    }
+
+    if (m_start > 0) {
+      __builtin_memmove(m_buffer, m_buffer + m_start, m_end - m_start);
+      m_end -= m_start;
+      m_start = 0;
+    } else if (m_end == m_capacity) {
+      let const grown_capacity = m_capacity * 2;
+      let *grown = heap_allocator().alloc_array<char>(grown_capacity);
+      __builtin_memcpy(grown, m_buffer, m_end);
+      heap_allocator().free_array(m_buffer, m_capacity);
+      m_buffer = grown;
+      m_capacity = grown_capacity;
+    }
+    scanned = m_end;
+    if (!fill().has_value()) return None;
+  }
+}
+
+fn text_reader::descriptor() const wontthrow -> Maybe<os::descriptor>
+{
+  if (m_ring != nullptr || m_start < m_end) return None;
+  return m_fd;
+}
+
+text_writer::text_writer(const ExecContext &ec) throws
+    : m_ec{ec}, m_is_line_buffered{ec.stdout_is_a_tty()}
+{
+  m_buffer.reserve(TEXT_CHUNK_SIZE);
+}
+
+cold fn text_writer::write_slow(StringView bytes) throws -> void
+{
+  if (m_buffer.count() + bytes.length > TEXT_CHUNK_SIZE) {
+    flush();
+    /* A piece at least a buffer long goes out as is instead of being copied. */
+    if (bytes.length >= TEXT_CHUNK_SIZE) return m_ec.print_to_stdout(bytes);
+  }
+  m_buffer.append(bytes);
+  if (m_is_line_buffered && bytes.find_character('\n').has_value()) flush();
+}
+
+fn text_writer::flush() throws -> void
+{
+  if (m_buffer.count() == 0) return;
+  m_ec.print_to_stdout(m_buffer.view());
+  m_buffer.clear();
+}
+
+fn text_writer::copy_from(text_reader &reader) throws
+    -> Maybe<os::copy_result>
+{
+  let const from = reader.descriptor();
+  let const to = m_ec.stdout_descriptor();
+  if (!from.has_value() || !to.has_value()) return None;
+
+  flush();
+  let const result = os::copy_fd_contents(*from, *to);
+  if (result == os::copy_result::WriteFailed) {
+    if (errno == EPIPE) throw BrokenPipeExit{};
+    throw Error{"Unable to write to stdout: " +
+                os::last_system_error_message()};
+  }
+  return result;
+}
+
 fn source_list_from_operands(const ArrayList<String> &operands,
                              Allocator allocator) throws
     -> ArrayList<StringView>
@@ -333,6 +518,50 @@ fn format_human_size(u64 bytes, Allocator allocator) throws -> String
   return out;
 }
 
+fn parse_shitbox_job_count(StringView text, StringView utility_name,
+                           usize limit, Allocator allocator) throws -> usize
+{
+  let const parsed = text.to<u64>();
+  if (parsed.is_error() || parsed.value() == 0)
+    throw ErrorWithDetails{
+        String{allocator, utility_name}
+        + ": invalid job count '" + text + "'",
+        "Pass a positive number to `-j`"
+    };
+  return parsed.value() < limit ? parsed.value() : limit;
+}
+
+struct shitbox_worker_start
+{
+  void (*work)(opaque *);
+  opaque *context;
+};
+
+/* A worker gives its heap pool back as it ends, so what it cached is not lost
+   with the thread. */
+static fn run_shitbox_worker(opaque *raw_start) wontthrow -> void
+{
+  let const *start = static_cast<shitbox_worker_start *>(raw_start);
+  start->work(start->context);
+  allocators::heap_pool_instance().release();
+}
+
+fn run_shitbox_workers(usize job_count, void (*work)(opaque *),
+                       opaque *context) throws -> void
+{
+  shitbox_worker_start start{work, context};
+  let workers = ArrayList<os::thread>{heap_allocator()};
+  workers.reserve(job_count);
+  for (usize i = 1; i < job_count; i++) {
+    let const worker = os::start_thread(run_shitbox_worker, &start);
+    if (!worker.has_value()) break;
+    workers.push(*worker);
+  }
+  work(context);
+  for (let const &worker : workers)
+    os::join_thread(worker);
+}
+
 fn parse_shitbox_duration_seconds(StringView text, StringView utility_name,
                                   Allocator allocator) throws -> f64
 {
@@ -10,11 +10,18 @@
 #include "String.hpp"
 #include "StringView.hpp"
 
+#include <atomic>
+#include <exception>
+
 namespace shit {
 
 class ExecContext;
 class EvalContext;
 
+namespace stages {
+struct ring;
+} /* namespace stages */
+
 namespace shitbox {
 
 class Utility
@@ -150,6 +157,16 @@ fn run_util(Utility::Kind chosen, const ExecContext &ec, EvalContext &cxt,
             const ArrayList<String> &args,
             const ArrayList<SourceLocation> &arg_locations) throws -> i32;
 
+/* Whether the utility reads and writes only through its context and keeps no
+   state outside its own flags, so a pipeline stage can run it on a thread of
+   the shell instead of a forked child. */
+pure fn util_runs_on_stage_thread(Utility::Kind chosen) wontthrow -> bool;
+
+/* Whether the utility prints a function of its operands alone, reading no input
+   and no file, so a command substitution may run it inside the shell and the
+   optimizer may run a constant call once at analyze time. */
+pure fn util_is_pure(Utility::Kind chosen) wontthrow -> bool;
+
 fn preflight_timeout_stage(const ExecContext &ec, EvalContext &cxt,
                            usize name_index, SourceLocation &error_location,
                            String &error_message) throws -> Maybe<i32>;
@@ -271,8 +288,6 @@ UTILITY_STRUCT(Nproc);
 UTILITY_STRUCT(Flock);
 UTILITY_STRUCT(Calc);
 
-fn read_fd_to_string(os::descriptor fd) throws -> Maybe<String>;
-
 /* Returns false on the first failure with the reason in
    os::last_system_error_message. */
 enum class removal_mode : u8
@@ -287,6 +302,191 @@ fn read_named_or_stdin(const ExecContext &ec, StringView path) throws
 
 fn split_keep_newlines(StringView text) throws -> ArrayList<StringView>;
 
+/* The size of the buffers the text utilities read and write through, so what
+   they hold at once stays bounded by it and the longest line, whatever the
+   length of the input. */
+inline constexpr usize TEXT_CHUNK_SIZE = 64 * 1024;
+
+/* One input of a text utility, read a chunk or a line at a time through a
+   buffer that is reused for the whole input. A view it hands out stays valid
+   until the next read. */
+class text_reader
+{
+public:
+  text_reader() = default;
+  text_reader(const text_reader &) = delete;
+  text_reader &operator=(const text_reader &) = delete;
+  ~text_reader();
+
+  /* "-" reads the context's input and anything else names a file. Returns
+     false when the file does not open, with the reason in
+     os::last_system_error_message. */
+  fn open(const ExecContext &ec, StringView path) throws -> bool;
+  fn close() wontthrow -> void;
+
+  /* The next bytes of the input, empty at its end. None when a read fails. */
+  fn next_chunk() throws -> Maybe<StringView>;
+  /* The next line with its newline, the last one without it when the input
+     does not end in one, and empty at the end. A line that crosses chunks is
+     moved to the front of the buffer, which grows only for a line longer than
+     the buffer. None when a read fails. */
+  fn next_line() throws -> Maybe<StringView>;
+  /* The descriptor under the reader while it holds no bytes of its own, for a
+     copy the kernel can make without them passing through the buffer. */
+  fn descriptor() const wontthrow -> Maybe<os::descriptor>;
+
+private:
+  fn fill() throws -> Maybe<usize>;
+
+  stages::ring *m_ring{nullptr};
+  Maybe<os::descriptor> m_fd{};
+  bool m_owns_fd{false};
+  bool m_is_at_end{false};
+  char *m_buffer{nullptr};
+  usize m_capacity{0};
+  usize m_start{0};
+  usize m_end{0};
+};
+
+/* Gathers a text utility's output and hands it to the context a full buffer at
+   a time. On a terminal every completed line goes out at once. The owner
+   calls flush before it returns and before it reports an error, so what was
+   printed so far stays ahead of the message. */
+class text_writer
+{
+public:
+  explicit text_writer(const ExecContext &ec) throws;
+
+  hot fn write(StringView bytes) throws -> void
+  {
+    if (m_is_line_buffered ||
+        m_buffer.count() + bytes.length > TEXT_CHUNK_SIZE) [[unlikely]]
+      return write_slow(bytes);
+    m_buffer.append(bytes);
+  }
+  hot fn write(char c) throws -> void { write(StringView{&c, 1}); }
+  fn flush() throws -> void;
+  /* Copy the rest of the reader's input with os::copy_fd_contents. None when
+     the reader or the output is not a plain descriptor, and the caller then
+     copies by chunks. A failed write throws as print_to_stdout does. */
+  fn copy_from(text_reader &reader) throws -> Maybe<os::copy_result>;
+
+private:
+  cold fn write_slow(StringView bytes) throws -> void;
+
+  const ExecContext &m_ec;
+  String m_buffer{heap_allocator()};
+  bool m_is_line_buffered{false};
+};
+
+/* The most directories cp -r, du and find work through at once. */
+inline constexpr usize MAX_SHITBOX_JOBS = 256;
+
+/* The count a -j operand names, capped at the limit. Zero or anything but a
+   number throws. */
+fn parse_shitbox_job_count(StringView text, StringView utility_name,
+                           usize limit, Allocator allocator) throws -> usize;
+
+/* Run the work on this thread and on job_count - 1 more, and return once all
+   of them are done. Fewer run when a thread cannot start. */
+fn run_shitbox_workers(usize job_count, void (*work)(opaque *),
+                       opaque *context) throws -> void;
+
+/* A stack of directories the calling thread and the workers take jobs from.
+   A worker waits while the stack is empty and a job still runs, since that
+   job may push more, and every worker leaves once none is left. The first
+   exception a job throws stops the rest and is rethrown from run, and an
+   interrupt stops them too, dropping the jobs left behind. */
+template <typename Job> class directory_job_pool
+{
+public:
+  /* Runs one job outside the lock, and may push more. */
+  using job_runner = void (*)(opaque *owner, Job &job);
+
+  directory_job_pool(job_runner run_job, opaque *owner) wontthrow
+      : m_run_job(run_job), m_owner(owner)
+  {}
+  directory_job_pool(const directory_job_pool &) = delete;
+  directory_job_pool &operator=(const directory_job_pool &) = delete;
+
+  fn push(Job job) throws -> void
+  {
+    os::lock_monitor(m_monitor);
+    defer { os::unlock_monitor(m_monitor); };
+    m_jobs.push(steal(job));
+    m_queued_count.fetch_add(1);
+    os::wake_monitor(m_monitor);
+  }
+
+  /* Read without the lock, so a walk can tell whether a directory is worth
+     queueing before it takes the lock to push it. */
+  pure fn queued_count() const wontthrow -> usize
+  {
+    return m_queued_count.load();
+  }
+
+  fn run(usize job_count) throws -> void
+  {
+    run_shitbox_workers(job_count, work_on, this);
+    m_jobs.clear();
+    m_queued_count.store(0);
+    if (m_error) std::rethrow_exception(steal(m_error));
+  }
+
+private:
+  /* A worker that finds the stack empty rechecks on this period, so an
+     interrupt ends the walk even while every worker waits. */
+  static constexpr i64 WAIT_SLICE_NANOS = 50'000'000;
+
+  static fn work_on(opaque *raw_pool) wontthrow -> void
+  {
+    static_cast<directory_job_pool *>(raw_pool)->work();
+  }
+
+  fn work() wontthrow -> void
+  {
+    os::lock_monitor(m_monitor);
+    loop
+    {
+      while (m_jobs.is_empty() && m_active_count != 0 &&
+             !os::INTERRUPT_REQUESTED)
+        os::wait_monitor(m_monitor, WAIT_SLICE_NANOS);
+      if (m_jobs.is_empty() || m_error || os::INTERRUPT_REQUESTED) break;
+
+      std::exception_ptr error{};
+      {
+        let job = steal(m_jobs.back());
+        m_jobs.pop_back();
+        m_queued_count.fetch_sub(1);
+        m_active_count++;
+        os::unlock_monitor(m_monitor);
+
+        try {
+          m_run_job(m_owner, job);
+        } catch (...) {
+          error = std::current_exception();
+        }
+      }
+
+      os::lock_monitor(m_monitor);
+      if (error && !m_error) m_error = error;
+      m_active_count--;
+      if (m_active_count == 0) os::wake_monitor(m_monitor);
+    }
+    /* Whoever leaves first wakes the rest, so they see the same end. */
+    os::wake_monitor(m_monitor);
+    os::unlock_monitor(m_monitor);
+  }
+
+  job_runner m_run_job;
+  opaque *m_owner;
+  os::monitor m_monitor{};
+  ArrayList<Job> m_jobs{heap_allocator()};
+  std::atomic<usize> m_queued_count{0};
+  usize m_active_count{0};
+  std::exception_ptr m_error{};
+};
+
 /* The operand list becomes a source list, a single "-" stdin source when no
    operand is given, otherwise each operand as a view. */
 fn source_list_from_operands(const ArrayList<String> &operands,
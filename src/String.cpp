@@ -100,6 +100,14 @@ fn String::pop_back() wontthrow -> void
   m_data[m_length] = '\0';
 }
 
+fn String::truncate(usize new_length) wontthrow -> void
+{
+  ASSERT(new_length <= m_length, "truncate past the end");
+  if (new_length == m_length) return;
+  m_length = new_length;
+  m_data[m_length] = '\0';
+}
+
 fn String::operator+=(StringView other) throws -> String &
 {
   append(other);
@@ -187,6 +187,8 @@ public:
   }
 
   fn pop_back() wontthrow -> void;
+  /* Drop the bytes past the new length, which must not exceed the old one. */
+  fn truncate(usize new_length) wontthrow -> void;
 
   hot flatten fn append(char c) throws -> void { push(c); }
   fn operator+=(StringView other) throws->String &;
@@ -6,8 +6,142 @@
 #include "String.hpp"
 #include "StringView.hpp"
 
+#if defined __SSE2__
+#include <emmintrin.h>
+#elif defined __aarch64__
+#include <arm_neon.h>
+#endif
+
 namespace shit {
 
+namespace string_map {
+
+/* One control byte per slot. A full slot holds the low seven bits of its key
+   hash, so a full byte is never negative, and the two negative values mark a
+   slot that is free. */
+using control = i8;
+
+constexpr control EMPTY = -128;
+constexpr control DELETED = -2;
+
+constexpr usize GROUP_WIDTH = 16;
+
+/* Sixteen control bytes loaded at once. Each match returns a mask with one set
+   bit per matching byte, walked with lowest() and next(). SSE2 gives a bit per
+   byte; NEON gives a nibble per byte, of which only the top bit is kept. */
+struct group
+{
+#if defined __SSE2__
+  static constexpr u32 INDEX_SHIFT = 0;
+
+  alwaysinline explicit group(const control *bytes) wontthrow
+      : m_bytes(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes)))
+  {}
+
+  alwaysinline fn match(control tag) const wontthrow -> u64
+  {
+    return static_cast<u32>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(m_bytes, _mm_set1_epi8(tag))));
+  }
+
+  alwaysinline fn match_free() const wontthrow -> u64
+  {
+    return static_cast<u32>(_mm_movemask_epi8(m_bytes));
+  }
+
+  alwaysinline static fn leading_clear(u64 mask) wontthrow -> usize
+  {
+    return static_cast<usize>(__builtin_clzll(mask) - 48);
+  }
+
+private:
+  __m128i m_bytes;
+#elif defined __aarch64__
+  static constexpr u32 INDEX_SHIFT = 2;
+
+  alwaysinline explicit group(const control *bytes) wontthrow
+      : m_bytes(vld1q_s8(bytes))
+  {}
+
+  alwaysinline fn match(control tag) const wontthrow -> u64
+  {
+    return narrow(vceqq_s8(m_bytes, vdupq_n_s8(tag)));
+  }
+
+  alwaysinline fn match_free() const wontthrow -> u64
+  {
+    return narrow(vcltzq_s8(m_bytes));
+  }
+
+  alwaysinline static fn leading_clear(u64 mask) wontthrow -> usize
+  {
+    return static_cast<usize>(__builtin_clzll(mask)) >> INDEX_SHIFT;
+  }
+
+private:
+  alwaysinline static fn narrow(uint8x16_t matches) wontthrow -> u64
+  {
+    let const nibbles = vshrn_n_u16(vreinterpretq_u16_u8(matches), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) &
+           0x8888888888888888ull;
+  }
+
+  int8x16_t m_bytes;
+#else
+  static constexpr u32 INDEX_SHIFT = 0;
+
+  alwaysinline explicit group(const control *bytes) wontthrow
+  {
+    __builtin_memcpy(m_bytes, bytes, GROUP_WIDTH);
+  }
+
+  fn match(control tag) const wontthrow -> u64
+  {
+    u64 mask = 0;
+    for (usize i = 0; i < GROUP_WIDTH; i++)
+      mask |= static_cast<u64>(m_bytes[i] == tag) << i;
+    return mask;
+  }
+
+  fn match_free() const wontthrow -> u64
+  {
+    u64 mask = 0;
+    for (usize i = 0; i < GROUP_WIDTH; i++)
+      mask |= static_cast<u64>(m_bytes[i] < 0) << i;
+    return mask;
+  }
+
+  alwaysinline static fn leading_clear(u64 mask) wontthrow -> usize
+  {
+    return static_cast<usize>(__builtin_clzll(mask) - 48);
+  }
+
+private:
+  control m_bytes[GROUP_WIDTH];
+#endif
+
+public:
+  alwaysinline fn match_empty() const wontthrow -> u64 { return match(EMPTY); }
+
+  alwaysinline static fn lowest(u64 mask) wontthrow -> usize
+  {
+    return static_cast<usize>(__builtin_ctzll(mask)) >> INDEX_SHIFT;
+  }
+
+  alwaysinline static fn next(u64 mask) wontthrow -> u64
+  {
+    return mask & (mask - 1);
+  }
+};
+
+} /* namespace string_map */
+
+/* An open-addressing table of byte-string keys laid out as a Swiss table. Next
+   to the slots sits one control byte per slot, and a lookup compares the tag of
+   its key against sixteen of them with one vector compare, looking at a key
+   only where the tag matched. A miss therefore seldom touches a slot at all.
+   The first group of control bytes is mirrored past the end, so a group read
+   near the end wraps without a branch. */
 template <class Value = String>
 class StringMap
 {
@@ -19,7 +153,7 @@ public:
     if (other.m_count == 0) return;
     rehash(other.m_capacity);
     for (usize i = 0; i < other.m_capacity; i++) {
-      if (other.m_slots[i].state == slot::Occupied)
+      if (other.m_controls[i] >= 0)
         set_value_with_hash(other.m_slots[i].key.view(),
                             Value{other.m_slots[i].value},
                             other.m_slots[i].hash);
@@ -29,28 +163,31 @@ public:
   mustuse cold fn clone() const throws -> StringMap { return StringMap{*this}; }
 
   StringMap(StringMap &&other) noexcept
-      : m_allocator(other.m_allocator), m_slots(other.m_slots),
-        m_capacity(other.m_capacity), m_count(other.m_count),
-        m_tombstones(other.m_tombstones)
+      : m_allocator(other.m_allocator), m_controls(other.m_controls),
+        m_slots(other.m_slots), m_capacity(other.m_capacity),
+        m_count(other.m_count), m_growth_left(other.m_growth_left)
   {
+    other.m_controls = nullptr;
     other.m_slots = nullptr;
     other.m_capacity = 0;
     other.m_count = 0;
-    other.m_tombstones = 0;
+    other.m_growth_left = 0;
   }
   fn operator=(StringMap &&other) wontthrow->StringMap &
   {
     if (this != &other) {
       destroy_all();
       m_allocator = other.m_allocator;
+      m_controls = other.m_controls;
       m_slots = other.m_slots;
       m_capacity = other.m_capacity;
       m_count = other.m_count;
-      m_tombstones = other.m_tombstones;
+      m_growth_left = other.m_growth_left;
+      other.m_controls = nullptr;
       other.m_slots = nullptr;
       other.m_capacity = 0;
       other.m_count = 0;
-      other.m_tombstones = 0;
+      other.m_growth_left = 0;
     }
     return *this;
   }
@@ -69,9 +206,8 @@ public:
 
   cold fn reserve(usize expected_count) throws -> void
   {
-    let const needed = (expected_count * 4 / 3) + 1;
-    usize new_capacity = m_capacity == 0 ? 16 : m_capacity;
-    while (new_capacity < needed)
+    usize new_capacity = m_capacity == 0 ? MINIMUM_CAPACITY : m_capacity;
+    while (growth_limit(new_capacity) < expected_count)
       new_capacity *= 2;
 
     if (new_capacity > m_capacity) rehash(new_capacity);
@@ -79,9 +215,7 @@ public:
 
   hot mustuse pure fn find(StringView key) const wontthrow -> const Value *
   {
-    if (m_capacity == 0) return nullptr;
-    let const found = probe(key, hash_bytes(key)).found;
-    return found == NO_INDEX ? nullptr : &m_slots[found].value;
+    return find_hashed(key, hash_bytes(key));
   }
 
   hot flatten mustuse fn find(StringView key) wontthrow -> Value *
@@ -89,6 +223,23 @@ public:
     return const_cast<Value *>(static_cast<const StringMap *>(this)->find(key));
   }
 
+  /* The _hashed forms take the hash_bytes of the key from the caller, so a
+     wrapper that routes on the hash does not hash the key a second time. */
+  hot mustuse pure fn find_hashed(StringView key, u64 hash) const wontthrow
+      -> const Value *
+  {
+    if (m_capacity == 0) return nullptr;
+    let const found = probe(key, hash);
+    return found == NO_INDEX ? nullptr : &m_slots[found].value;
+  }
+
+  hot flatten mustuse fn find_hashed(StringView key, u64 hash) wontthrow
+      -> Value *
+  {
+    return const_cast<Value *>(
+        static_cast<const StringMap *>(this)->find_hashed(key, hash));
+  }
+
   pure fn allocator() const wontthrow -> Allocator { return m_allocator; }
 
   hot fn set(StringView key, Value value) throws -> void
@@ -96,9 +247,19 @@ public:
     set_value(key, steal(value));
   }
 
+  hot fn set_hashed(StringView key, u64 hash, Value value) throws -> void
+  {
+    set_value_with_hash(key, steal(value), hash);
+  }
+
   hot fn get_or_create(StringView key, Value default_value) throws -> Value &
   {
-    let const hash = hash_bytes(key);
+    return get_or_create_hashed(key, hash_bytes(key), steal(default_value));
+  }
+
+  hot fn get_or_create_hashed(StringView key, u64 hash,
+                              Value default_value) throws -> Value &
+  {
     let const result = prepare_insertion(key, hash);
     if (result.found != NO_INDEX) return m_slots[result.found].value;
     return *place(result.insertion, key, hash, steal(default_value));
@@ -110,7 +271,11 @@ public:
      read bytes the clear already truncated. */
   hot fn set(StringView key, StringView value) throws -> void
   {
-    let const hash = hash_bytes(key);
+    set_hashed(key, hash_bytes(key), value);
+  }
+
+  hot fn set_hashed(StringView key, u64 hash, StringView value) throws -> void
+  {
     let const result = prepare_insertion(key, hash);
     if (result.found != NO_INDEX) {
       Value *existing = &m_slots[result.found].value;
@@ -131,24 +296,42 @@ public:
   }
 
   hot fn erase(StringView key) throws -> void
+  {
+    erase_hashed(key, hash_bytes(key));
+  }
+
+  /* A probe stops at the first group with an empty byte, so the erased slot
+     can go back to empty when no probe could have passed over it full: when
+     the run of non-empty bytes through it is shorter than a group. Otherwise it
+     is marked deleted, and only a rehash reclaims it. */
+  hot fn erase_hashed(StringView key, u64 hash) throws -> void
   {
     if (m_capacity == 0) return;
-    let const found = probe(key, hash_bytes(key)).found;
+    let const found = probe(key, hash);
     if (found == NO_INDEX) return;
-    let &slot = m_slots[found];
-    slot.key = String{m_allocator};
-    slot.value = Value{};
-    slot.state = slot::Tombstone;
+
+    using string_map::group;
+    let const mask = m_capacity - 1;
+    let const before = (found - string_map::GROUP_WIDTH) & mask;
+    let const empty_after = group{m_controls + found}.match_empty();
+    let const empty_before = group{m_controls + before}.match_empty();
+    let const was_never_full =
+        empty_after != 0 && empty_before != 0 &&
+        group::lowest(empty_after) + group::leading_clear(empty_before) <
+            string_map::GROUP_WIDTH;
+
+    m_slots[found].~slot();
+    set_control(found,
+                was_never_full ? string_map::EMPTY : string_map::DELETED);
+    if (was_never_full) m_growth_left++;
     m_count--;
-    m_tombstones++;
   }
 
   template <class Fn>
   fn for_each(Fn callback) const throws -> void
   {
     for (usize i = 0; i < m_capacity; i++) {
-      if (m_slots[i].state == slot::Occupied)
-        callback(m_slots[i].key.view(), m_slots[i].value);
+      if (m_controls[i] >= 0) callback(m_slots[i].key.view(), m_slots[i].value);
     }
   }
 
@@ -156,8 +339,7 @@ public:
   fn for_each(Fn callback) throws -> void
   {
     for (usize i = 0; i < m_capacity; i++) {
-      if (m_slots[i].state == slot::Occupied)
-        callback(m_slots[i].key.view(), m_slots[i].value);
+      if (m_controls[i] >= 0) callback(m_slots[i].key.view(), m_slots[i].value);
     }
   }
 
@@ -166,19 +348,13 @@ public:
 private:
   struct slot
   {
-    enum State : u8
-    {
-      Empty,
-      Occupied,
-      Tombstone,
-    };
-    State state{Empty};
-    u64 hash{0};
-    String key{};
-    Value value{};
+    u64 hash;
+    String key;
+    Value value;
   };
 
   static constexpr usize NO_INDEX = static_cast<usize>(-1);
+  static constexpr usize MINIMUM_CAPACITY = string_map::GROUP_WIDTH;
 
   struct probe_result
   {
@@ -186,55 +362,80 @@ private:
     usize insertion{NO_INDEX};
   };
 
-  hot mustuse fn probe(StringView key, u64 hash) const wontthrow -> probe_result
+  /* Seven eighths of the slots may fill, so every probe meets an empty byte. */
+  pure static fn growth_limit(usize capacity) wontthrow -> usize
+  {
+    return capacity - capacity / 8;
+  }
+
+  pure static fn tag_of(u64 hash) wontthrow -> string_map::control
+  {
+    return static_cast<string_map::control>(hash & 0x7f);
+  }
+
+  /* Probing moves by whole groups in growing strides, one group, then two,
+     then three, which visits every group of a power-of-two table once. */
+  hot mustuse fn probe(StringView key, u64 hash) const wontthrow -> usize
   {
     ASSERT(m_capacity != 0);
+    using string_map::group;
     let const mask = m_capacity - 1;
-    let index = static_cast<usize>(hash) & mask;
-    let first_tombstone = NO_INDEX;
-
-    for (usize probe_count = 0; probe_count < m_capacity; probe_count++) {
-      let const &candidate = m_slots[index];
-      if (candidate.state == slot::Empty) {
-        return {NO_INDEX,
-                first_tombstone != NO_INDEX ? first_tombstone : index};
-      }
-      if (candidate.state == slot::Occupied && candidate.hash == hash &&
-          candidate.key.view() == key) [[likely]]
+    let const tag = tag_of(hash);
+    let position = static_cast<usize>(hash >> 7) & mask;
+    usize stride = 0;
+
+    loop
+    {
+      let const bytes = group{m_controls + position};
+      for (let matches = bytes.match(tag); matches != 0;
+           matches = group::next(matches))
       {
-        return {index, index};
+        let const index = (position + group::lowest(matches)) & mask;
+        let const &candidate = m_slots[index];
+        if (candidate.hash == hash && candidate.key.view() == key) [[likely]]
+          return index;
       }
-      if (candidate.state == slot::Tombstone && first_tombstone == NO_INDEX)
-        first_tombstone = index;
-      index = (index + 1) & mask;
+      if (bytes.match_empty() != 0) [[likely]]
+        return NO_INDEX;
+      stride += string_map::GROUP_WIDTH;
+      position = (position + stride) & mask;
     }
-
-    return {NO_INDEX, first_tombstone};
   }
 
-  hot fn prepare_insertion(StringView key, u64 hash) throws -> probe_result
+  hot mustuse fn find_free(u64 hash) const wontthrow -> usize
   {
-    if (m_capacity == 0) {
-      rehash(16);
-    }
+    using string_map::group;
+    let const mask = m_capacity - 1;
+    let position = static_cast<usize>(hash >> 7) & mask;
+    usize stride = 0;
 
-    let result = probe(key, hash);
-    ASSERT(result.insertion != NO_INDEX);
-    if (result.found != NO_INDEX ||
-        m_slots[result.insertion].state == slot::Tombstone)
+    loop
     {
-      return result;
+      let const free = group{m_controls + position}.match_free();
+      if (free != 0) [[likely]]
+        return (position + group::lowest(free)) & mask;
+      stride += string_map::GROUP_WIDTH;
+      position = (position + stride) & mask;
     }
+  }
 
-    let const maximum_occupied = (m_capacity >> 1) + (m_capacity >> 2);
-    if (m_count + m_tombstones + 1 <= maximum_occupied) return result;
-
-    if (m_count + 1 > maximum_occupied)
-      rehash(m_capacity * 2);
-    else
-      rehash(m_capacity);
-    result = probe(key, hash);
-    return result;
+  hot fn prepare_insertion(StringView key, u64 hash) throws -> probe_result
+  {
+    if (m_capacity == 0) rehash(MINIMUM_CAPACITY);
+
+    let const found = probe(key, hash);
+    if (found != NO_INDEX) return {found, found};
+
+    let insertion = find_free(hash);
+    if (m_growth_left == 0 && m_controls[insertion] == string_map::EMPTY) {
+      /* A table crowded mostly by deleted bytes is rebuilt at its size. */
+      if (m_count * 32 <= m_capacity * 25)
+        rehash(m_capacity);
+      else
+        rehash(m_capacity * 2);
+      insertion = find_free(hash);
+    }
+    return {NO_INDEX, insertion};
   }
 
   hot fn set_value(StringView key, Value value) throws -> Value *
@@ -256,65 +457,75 @@ private:
 
   fn place(usize index, StringView key, u64 hash, Value value) throws -> Value *
   {
-    let &slot = m_slots[index];
-    let const was_tombstone = slot.state == slot::Tombstone;
-    slot.key = String{m_allocator, key};
-    slot.hash = hash;
-    slot.value = steal(value);
-    if (was_tombstone) m_tombstones--;
-    slot.state = slot::Occupied;
+    let *destination =
+        new (&m_slots[index]) slot{hash, String{m_allocator, key}, steal(value)};
+    if (m_controls[index] == string_map::EMPTY) m_growth_left--;
+    set_control(index, tag_of(hash));
     m_count++;
-    return &slot.value;
+    return &destination->value;
+  }
+
+  /* Store a control byte, and its mirror when it is in the first group. */
+  alwaysinline fn set_control(usize index, string_map::control value) wontthrow
+      -> void
+  {
+    m_controls[index] = value;
+    if (index < string_map::GROUP_WIDTH) m_controls[m_capacity + index] = value;
   }
 
   cold fn rehash(usize new_capacity) throws -> void
   {
-    let old_slots = m_slots;
+    let *old_controls = m_controls;
+    let *old_slots = m_slots;
     let const old_capacity = m_capacity;
 
-    m_slots = m_allocator.alloc_array<slot>(new_capacity);
-#pragma clang loop unroll_count(4)
-    for (usize i = 0; i < new_capacity; i++)
-      new (&m_slots[i]) slot{};
+    let *new_slots = m_allocator.alloc_array<slot>(new_capacity);
+    m_controls = m_allocator.alloc_array<string_map::control>(
+        new_capacity + string_map::GROUP_WIDTH);
+    m_slots = new_slots;
+    __builtin_memset(m_controls, string_map::EMPTY,
+                     new_capacity + string_map::GROUP_WIDTH);
     m_capacity = new_capacity;
-    m_count = 0;
-    m_tombstones = 0;
-    let const mask = m_capacity - 1;
+    m_growth_left = growth_limit(new_capacity) - m_count;
 
-#pragma clang loop unroll_count(4)
     for (usize i = 0; i < old_capacity; i++) {
-      if (old_slots[i].state == slot::Occupied) {
-        let index = static_cast<usize>(old_slots[i].hash) & mask;
-        while (m_slots[index].state == slot::Occupied)
-          index = (index + 1) & mask;
-        let &destination = m_slots[index];
-        destination.hash = old_slots[i].hash;
-        destination.key = steal(old_slots[i].key);
-        destination.value = steal(old_slots[i].value);
-        destination.state = slot::Occupied;
-        m_count++;
-      }
-      old_slots[i].~slot();
+      if (old_controls[i] < 0) continue;
+      let &source = old_slots[i];
+      let const index = find_free(source.hash);
+      new (&m_slots[index]) slot{steal(source)};
+      set_control(index, old_controls[i]);
+      source.~slot();
+    }
+    if (old_slots != nullptr) {
+      m_allocator.free_array(old_slots, old_capacity);
+      m_allocator.free_array(old_controls,
+                             old_capacity + string_map::GROUP_WIDTH);
     }
-    if (old_slots != nullptr) m_allocator.free_array(old_slots, old_capacity);
   }
 
   cold fn destroy_all() wontthrow -> void
   {
-    for (usize i = 0; i < m_capacity; i++)
-      m_slots[i].~slot();
-    if (m_slots != nullptr) m_allocator.free_array(m_slots, m_capacity);
+    for (usize i = 0; i < m_capacity; i++) {
+      if (m_controls[i] >= 0) m_slots[i].~slot();
+    }
+    if (m_slots != nullptr) {
+      m_allocator.free_array(m_slots, m_capacity);
+      m_allocator.free_array(m_controls,
+                             m_capacity + string_map::GROUP_WIDTH);
+    }
+    m_controls = nullptr;
     m_slots = nullptr;
     m_capacity = 0;
     m_count = 0;
-    m_tombstones = 0;
+    m_growth_left = 0;
   }
 
   Allocator m_allocator;
+  string_map::control *m_controls{nullptr};
   slot *m_slots{nullptr};
   usize m_capacity{0};
   usize m_count{0};
-  usize m_tombstones{0};
+  usize m_growth_left{0};
 };
 
 } // namespace shit
@@ -11,20 +11,6 @@ class Expression;
 
 struct word_assignment_split;
 
-struct arith_token
-{
-  enum class kind : u8
-  {
-    number,
-    name,
-    op,
-    subscript,
-  };
-  kind k;
-  i64 value{0};
-  StringView text{};
-};
-
 class WordSegment
 {
 public:
@@ -68,9 +54,23 @@ public:
   mutable const Expression *cached_substitution_ast{nullptr};
   mutable usize cached_substitution_generation{0};
 
-  mutable ArrayList<arith_token> cached_arith_tokens{heap_allocator()};
-  mutable bool arith_tokenized{false};
-  mutable bool arith_simple{false};
+  /* The output of a pure shitbox call the optimizer ran at analyze time. It
+     lives in the arena of the cached tree and is read only while that tree is
+     current. */
+  mutable const String *folded_substitution_output{nullptr};
+
+  /* The shell variable a plain name reference read last, kept while the
+     variable table keeps its layout so a hot loop skips the hash and probe. */
+  mutable persistent_map_slot<String> bound_variable{};
+
+  /* A ${...} body taken apart on its first expansion. */
+  mutable parameter_expansion_plan expansion_plan{};
+
+  /* The operand subwords of that body, taken apart on the same run. */
+  mutable parameter_operand_cache operand_cache{};
+
+  /* A $((...)) body compiled on its first expansion. */
+  mutable arith_program compiled_arithmetic{};
 
   pure fn is_split_eligible() const wontthrow -> bool;
   pure fn has_live_glob_chars() const wontthrow -> bool;
@@ -88,6 +88,7 @@ public:
       copy.set_source_span(source_position, source_length);
     copy.cached_substitution_ast = cached_substitution_ast;
     copy.cached_substitution_generation = cached_substitution_generation;
+    copy.folded_substitution_output = folded_substitution_output;
     return copy;
   }
 
@@ -121,7 +122,7 @@ public:
   pure fn has_glob_metacharacter() const wontthrow -> bool;
 };
 
-static_assert(sizeof(usize) != 8 || sizeof(WordSegment) == 160);
+static_assert(sizeof(usize) != 8 || sizeof(WordSegment) == 176);
 
 class Word
 {
@@ -7,6 +7,7 @@
 #include "Errors.hpp"
 #include "Eval.hpp"
 #include "Lexer.hpp"
+#include "PipelineStages.hpp"
 #include "Platform.hpp"
 #include "Shitbox.hpp"
 #include "Toiletline.hpp"
@@ -813,6 +814,50 @@ fn terminate_and_reap_processes(const ArrayList<os::process> &processes,
   }
 }
 
+pure static fn stage_runs_in_process(const ExecContext &ec) wontthrow -> bool
+{
+  return !ec.is_unresolved() && ec.is_builtin();
+}
+
+/* A foreground pipeline runs its builtin stages on threads when every one of
+   them is a shitbox utility that reads and writes only through its context.
+   The utilities keep their flags in process-wide statics, so no utility may
+   appear twice, and a stage that routes its stderr would need fd 2, which the
+   threads share. A builtin forked while threads run would carry their locks
+   into the child mid-flight, so one stage that cannot run on a thread keeps
+   the whole pipeline on the fork path. A first stage reading a terminal stays
+   there too, since only a child dies to the Ctrl-C that ends its read. */
+static fn pipeline_runs_stage_threads(const ArrayList<ExecContext> &ecs) throws
+    -> bool
+{
+  u64 seen_utilities = 0;
+  usize thread_stage_count = 0;
+  for (usize stage_index = 0; stage_index < ecs.count(); stage_index++) {
+    let const &ec = ecs[stage_index];
+    if (!stage_runs_in_process(ec)) continue;
+    if (ec.builtin_kind() != Builtin::Kind::Shitbox) return false;
+    if (ec.err_fd.has_value() || ec.dup_err_to_out || ec.dup_out_to_err)
+      return false;
+    if (stage_index == 0 && !ec.in_fd.has_value() &&
+        os::is_fd_a_tty(SHIT_STDIN))
+      return false;
+
+    const usize utility_index = ec.program() == "shitbox" ? 1 : 0;
+    if (utility_index >= ec.args().count()) return false;
+    let const utility_kind =
+        shitbox::find_util(ec.args()[utility_index].view());
+    if (!utility_kind.has_value() ||
+        !shitbox::util_runs_on_stage_thread(*utility_kind))
+      return false;
+    let const utility_bit = u64{1} << static_cast<u32>(*utility_kind);
+    if ((seen_utilities & utility_bit) != 0) return false;
+    seen_utilities |= utility_bit;
+
+    if (stage_index + 1 < ecs.count()) thread_stage_count++;
+  }
+  return thread_stage_count > 0;
+}
+
 fn execute_contexts_with_pipes(ArrayList<ExecContext> &&ecs, EvalContext &cxt,
                                execution_mode mode) throws -> i32
 {
@@ -830,16 +875,42 @@ fn execute_contexts_with_pipes(ArrayList<ExecContext> &&ecs, EvalContext &cxt,
   let children = ArrayList<os::process>{heap_allocator()};
   os::process last_child = SHIT_INVALID_PROCESS;
   os::descriptor last_stdin = SHIT_INVALID_FD;
+  stages::ring *last_ring = nullptr;
   i64 process_group_id = 0;
   bool should_reap_children_on_unwind = true;
+
+  /* Every stage but the last runs on a thread of its own and the last one runs
+     here, and two neighbours in the shell hand their bytes over through a ring
+     rather than a pipe. */
+  let const should_run_stage_threads =
+      !is_async && pipeline_runs_stage_threads(ecs);
+  let stage_threads = ArrayList<stages::stage_thread *>{heap_allocator()};
+  let thread_stage = ArrayList<usize>{heap_allocator()};
+  let rings = ArrayList<stages::ring *>{heap_allocator()};
+  if (should_run_stage_threads) {
+    LOG(Debug, "running the shitbox stages of the pipeline on threads");
+    unused(cxt.materialize_shit_identity());
+  }
+
+  /* A thread blocked on a ring wakes once both of its ends are closed, and one
+     blocked on a pipe once the children are gone, so the threads are joined
+     after both. */
   defer
   {
     if (should_reap_children_on_unwind) {
       for (ExecContext &pending_context : ecs)
         pending_context.close_fds();
       if (last_stdin != SHIT_INVALID_FD) os::close_fd(last_stdin);
+      for (let *r : rings) {
+        stages::close_ring_reader(r);
+        stages::close_ring_writer(r);
+      }
       terminate_and_reap_processes(children);
     }
+    for (let *stage : stage_threads)
+      unused(stages::join_stage_thread(stage));
+    for (let *r : rings)
+      stages::free_ring(r);
   };
 
   /* Each stage's status is recorded against its position, so pipefail can
@@ -859,10 +930,18 @@ fn execute_contexts_with_pipes(ArrayList<ExecContext> &&ecs, EvalContext &cxt,
 
   for (ExecContext &ec : ecs) {
     Maybe<os::Pipe> pipe;
+    stages::ring *ring = nullptr;
 
     let const is_last = (&ec == &ecs.back());
 
-    if (!is_last) {
+    if (!is_last && should_run_stage_threads && stage_runs_in_process(ec) &&
+        stage_runs_in_process(ecs[stage_index + 1]) && !ec.out_fd &&
+        !ecs[stage_index + 1].in_fd)
+    {
+      rings.push(stages::make_ring());
+      ring = rings.back();
+      ec.out_ring = ring;
+    } else if (!is_last) {
       pipe = os::make_pipe();
       if (!pipe) {
         throw ErrorWithLocation{ec.source_location(), "Could not open a pipe"};
@@ -876,13 +955,16 @@ fn execute_contexts_with_pipes(ArrayList<ExecContext> &&ecs, EvalContext &cxt,
     }
 
     if (!is_first) {
-      if (!ec.in_fd)
+      if (last_ring != nullptr)
+        ec.in_ring = last_ring;
+      else if (!ec.in_fd)
         ec.in_fd = last_stdin;
       else
         os::close_fd(last_stdin);
     }
     if (!is_last) {
-      last_stdin = pipe->in;
+      last_stdin = pipe.has_value() ? pipe->in : SHIT_INVALID_FD;
+      last_ring = ring;
     }
 
     if (ec.is_unresolved()) {
@@ -903,6 +985,9 @@ fn execute_contexts_with_pipes(ArrayList<ExecContext> &&ecs, EvalContext &cxt,
       children.push(child);
       child_stage.push(stage_index);
       last_child = child;
+    } else if (should_run_stage_threads && !is_last) {
+      stage_threads.push(stages::start_stage_thread(steal(ec), cxt));
+      thread_stage.push(stage_index);
     } else if (!is_last || is_async) {
       let const source = cxt.current_source();
       let const process_group =
@@ -1078,6 +1163,7 @@ fn execute_contexts_with_pipes(ArrayList<ExecContext> &&ecs, EvalContext &cxt,
          The flag makes exec spawn a child rather than replace the shell. */
       cxt.set_in_pipeline_stage(true);
       defer { cxt.set_in_pipeline_stage(false); };
+      ec.should_leave_shell_fds = should_run_stage_threads;
       ret = execute_builtin(steal(ec), cxt);
       stage_status[stage_index] = ret;
     }
@@ -1102,6 +1188,12 @@ fn execute_contexts_with_pipes(ArrayList<ExecContext> &&ecs, EvalContext &cxt,
     return ret;
   }
 
+  for (usize thread_index = 0; thread_index < stage_threads.count();
+       thread_index++)
+    stage_status[thread_stage[thread_index]] =
+        stages::join_stage_thread(stage_threads[thread_index]);
+  stage_threads.clear();
+
   usize waited_child_count = 0;
   try {
     for (; waited_child_count < children.count(); waited_child_count++)
@@ -1422,6 +1514,13 @@ static LineNumberCache LINE_NUMBER_CACHE{};
 fn source_line_position_at(StringView source, usize position) throws
     -> source_line_position
 {
+  /* A pipeline stage thread builds a table of its own rather than race the
+     main thread on the shared one. */
+  if (stages::is_stage_thread()) [[unlikely]] {
+    let cache = LineNumberCache{};
+    cache.ensure_built_for(source);
+    return cache.locate(position);
+  }
   LINE_NUMBER_CACHE.ensure_built_for(source);
   return LINE_NUMBER_CACHE.locate(position);
 }
@@ -2170,6 +2269,70 @@ pure fn smart_case_prefix_matches(StringView candidate,
   return true;
 }
 
+/* A [:name:] unit inside a bracket is a POSIX character class. The index past
+   its closing ":]" comes back when one starts here, so the scans treat the unit
+   atomically and its inner ] never closes the bracket. */
+static fn glob_class_end_past(StringView glob, const Bitset &glob_active,
+                              usize mask_offset, usize index) wontthrow
+    -> Maybe<usize>
+{
+  if (index + 1 >= glob.count() || glob[index] != '[' ||
+      glob[index + 1] != ':' ||
+      !is_glob_char_active(glob_active, mask_offset + index))
+    return None;
+  for (usize scan = index + 2; scan + 1 < glob.count(); scan++) {
+    if (glob[scan] == ':' && glob[scan + 1] == ']') return scan + 2;
+    /* A ] before any ":]" means the [ was a plain member after all, the way
+       [[:a] is a bracket holding [, :, and a. */
+    if (glob[scan] == ']' &&
+        is_glob_char_active(glob_active, mask_offset + scan))
+      return None;
+  }
+  return None;
+}
+
+fn glob_bracket_close(StringView glob, const Bitset &glob_active,
+                      usize mask_offset, usize open) wontthrow -> Maybe<usize>
+{
+  let const is_close_at = [&](usize index) wontthrow -> bool {
+    return glob[index] == ']' &&
+           is_glob_char_active(glob_active, mask_offset + index);
+  };
+
+  /* A ] right after [ or [^ is a member, so the scan starts past it. */
+  usize close_scan = open + 1;
+  if (close_scan < glob.count() &&
+      (glob[close_scan] == '!' || glob[close_scan] == '^') &&
+      is_glob_char_active(glob_active, mask_offset + close_scan))
+  {
+    close_scan++;
+  }
+  if (close_scan < glob.count() && is_close_at(close_scan)) close_scan++;
+  while (close_scan < glob.count()) {
+    if (Maybe<usize> past_class =
+            glob_class_end_past(glob, glob_active, mask_offset, close_scan);
+        past_class.has_value())
+    {
+      close_scan = *past_class;
+      continue;
+    }
+    if (is_close_at(close_scan)) return close_scan;
+    close_scan++;
+  }
+  return None;
+}
+
+fn glob_has_extglob_group(StringView glob) wontthrow -> bool
+{
+  for (usize i = 0; i + 1 < glob.count(); i++) {
+    const char c = glob[i];
+    if ((c == '?' || c == '*' || c == '+' || c == '@' || c == '!') &&
+        glob[i + 1] == '(')
+      return true;
+  }
+  return false;
+}
+
 fn glob_matches(StringView glob, StringView str, const Bitset &glob_active,
                 usize mask_offset, bool extglob) throws -> bool
 {
@@ -2177,16 +2340,8 @@ fn glob_matches(StringView glob, StringView str, const Bitset &glob_active,
      repetition, so it runs in a separate recursive matcher. It is taken only
      when extglob is on and the pattern actually holds a group, so a plain glob
      keeps the iterative matcher below, unchanged, and pays nothing. */
-  if (extglob) {
-    for (usize i = 0; i + 1 < glob.count(); i++) {
-      const char c = glob[i];
-      if ((c == '?' || c == '*' || c == '+' || c == '@' || c == '!') &&
-          glob[i + 1] == '(')
-      {
-        return extglob_full_match(glob, str, glob_active, mask_offset);
-      }
-    }
-  }
+  if (extglob && glob_has_extglob_group(glob))
+    return extglob_full_match(glob, str, glob_active, mask_offset);
 
   usize s = 0;
   usize g = 0;
@@ -2253,51 +2408,13 @@ fn glob_matches(StringView glob, StringView str, const Bitset &glob_active,
         return static_cast<u8>(view[index]);
       };
 
-      /* A [:name:] unit inside the bracket is a POSIX character class. The
-         index past its closing ":]" comes back when one starts here, so both
-         scans treat the unit atomically and its inner ] never closes the
-         bracket. */
       let const class_end_past = [&](usize index) wontthrow -> Maybe<usize> {
-        if (index + 1 >= glob.count() || glob[index] != '[' ||
-            glob[index + 1] != ':' || !is_active(index))
-          return None;
-        for (usize scan = index + 2; scan + 1 < glob.count(); scan++) {
-          if (glob[scan] == ':' && glob[scan + 1] == ']') return scan + 2;
-          /* A ] before any ":]" means the [ was a plain member after all, the
-             way [[:a] is a bracket holding [, :, and a. */
-          if (glob[scan] == ']' && is_active(scan)) return None;
-        }
-        return None;
+        return glob_class_end_past(glob, glob_active, mask_offset, index);
       };
 
       /* A bracket with no closing ] is not a character class, so the [ is a
-         literal character, as POSIX specifies. A ] right after [ or [^ is a
-         member, so the scan for the closing ] starts past it. */
-      usize close_scan = g + 1;
-      if (close_scan < glob.count() &&
-          (glob[close_scan] == '!' || glob[close_scan] == '^') &&
-          is_active(close_scan))
-      {
-        close_scan++;
-      }
-      if (close_scan < glob.count() && is_close_at(close_scan)) {
-        close_scan++;
-      }
-      bool has_closing_bracket = false;
-      while (close_scan < glob.count()) {
-        if (Maybe<usize> past_class = class_end_past(close_scan);
-            past_class.has_value())
-        {
-          close_scan = *past_class;
-          continue;
-        }
-        if (is_close_at(close_scan)) {
-          has_closing_bracket = true;
-          break;
-        }
-        close_scan++;
-      }
-      if (!has_closing_bracket) {
+         literal character, as POSIX specifies. */
+      if (!glob_bracket_close(glob, glob_active, mask_offset, g).has_value()) {
         if (byte_at(glob, g) != byte_at(str, s)) goto retry_star;
         g++;
         s++;
@@ -2400,7 +2517,8 @@ fn set_quit_context(const EvalContext *context) wontthrow -> void
 /* The granular memory report, the live bump bytes and the reserved capacity of
    each arena, then the malloc heap in use. The arena capacity counts the blocks
    the bump allocator holds, while the heap figure counts the String buffers and
-   other long-lived allocations the arenas do not own. */
+   other long-lived allocations the arenas do not own. The snapshot line shows
+   what the subshell snapshots shared and what their writes had to copy. */
 cold fn print_memory_report() wontthrow -> void
 {
   if (AST_ARENA != nullptr)
@@ -2417,6 +2535,13 @@ cold fn print_memory_report() wontthrow -> void
                  "Malloc heap: in use %zu, total arena %zu, mmapped %zu\n",
                  heap_stats.bytes_in_use, heap_stats.arena_bytes,
                  heap_stats.mapped_bytes);
+  let const &snapshot_stats = persistent_map_stats();
+  if (snapshot_stats.snapshots_taken != 0)
+    std::fprintf(stderr,
+                 "State snapshots: taken %zu, entries shared %zu, shards "
+                 "cloned %zu, entries cloned %zu\n",
+                 snapshot_stats.snapshots_taken, snapshot_stats.entries_shared,
+                 snapshot_stats.shards_cloned, snapshot_stats.entries_cloned);
 }
 
 [[noreturn]] fn quit(i32 code, farewell_policy farewell) throws -> void
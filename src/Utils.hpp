@@ -239,6 +239,14 @@ fn file_content_identity(const Path &path, Allocator allocator) throws
 fn glob_matches(StringView glob, StringView str, const Bitset &glob_active,
                 usize mask_offset, bool extglob = false) throws -> bool;
 
+/* The index of the ] that closes the bracket opened at glob[open], or None when
+   the [ is a literal byte. */
+fn glob_bracket_close(StringView glob, const Bitset &glob_active,
+                      usize mask_offset, usize open) wontthrow -> Maybe<usize>;
+
+/* Whether the glob holds one of the extended-glob groups, read by text. */
+fn glob_has_extglob_group(StringView glob) wontthrow -> bool;
+
 fn set_quit_context(const EvalContext *context) wontthrow -> void;
 
 enum class farewell_policy : u8
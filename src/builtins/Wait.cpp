@@ -7,9 +7,11 @@
 
 FLAG_LIST_DECL();
 
-HELP_SYNOPSIS_DECL("[%job|pid ...]");
+HELP_SYNOPSIS_DECL("[-n] [%job|pid ...]");
 
-HELP_DESCRIPTION_DECL("The wait builtin blocks until the named jobs finish.");
+HELP_DESCRIPTION_DECL(
+    "The wait builtin blocks until the named jobs finish. With -n it returns "
+    "as soon as one of them finishes, with that job's status.");
 
 FLAG(HELP, Bool, '\0', "help", "Display help.");
 
@@ -17,6 +19,42 @@ REGISTER_BUILTIN_FLAGS(Wait);
 
 namespace shit {
 
+/* Block until one of the candidate jobs finishes, any job when there are none,
+   and drop the job it reports, so the next wait -n reports another. */
+static fn wait_for_next_job(EvalContext &cxt, const ArrayList<i32> &candidates)
+    throws -> i32
+{
+  loop
+  {
+    cxt.update_jobs();
+    if (let const id = cxt.take_finished_job(candidates); id.has_value()) {
+      let const status = cxt.find_job(*id)->last_status;
+      LOG(Debug, "wait -n reports job %d with status %d", *id, status);
+      unused(cxt.remove_job(*id));
+      return status;
+    }
+
+    job *running = nullptr;
+    for (job &job : cxt.jobs()) {
+      if (job.state != job::State::Running) continue;
+      let is_candidate = candidates.is_empty();
+      for (let const candidate : candidates)
+        if (candidate == job.id) is_candidate = true;
+      if (is_candidate) {
+        running = &job;
+        break;
+      }
+    }
+    if (running == nullptr) return 127;
+
+    if constexpr (os::HAS_CHILD_STATE_CHANGE_WAIT) {
+      os::wait_for_child_state_change();
+    } else {
+      unused(cxt.wait_for_job_processes(*running));
+    }
+  }
+}
+
 Wait::Wait() = default;
 
 pure fn Wait::kind() const wontthrow -> Builtin::Kind { return Kind::Wait; }
@@ -30,6 +68,10 @@ fn Wait::execute(ExecContext &ec, EvalContext &cxt) const throws -> i32
 
   i32 status = 0;
 
+  let const should_wait_for_next = args.count() > 1 && args[1] == "-n";
+  let const first_target = should_wait_for_next ? 2 : 1;
+  let next_candidates = ArrayList<i32>{heap_allocator()};
+
   if (args.count() == 1) {
     LOG(Debug, "wait blocking on every job of %zu", cxt.jobs().count());
     for (job &job : cxt.jobs())
@@ -38,7 +80,10 @@ fn Wait::execute(ExecContext &ec, EvalContext &cxt) const throws -> i32
     return 0;
   }
 
-  for (usize i = 1; i < args.count(); i++) {
+  if (should_wait_for_next && args.count() == 2)
+    return wait_for_next_job(cxt, next_candidates);
+
+  for (usize i = first_target; i < args.count(); i++) {
     let const &target = args[i];
 
     LOG(Debug, "wait blocking on target '%s'", target.c_str());
@@ -47,7 +92,10 @@ fn Wait::execute(ExecContext &ec, EvalContext &cxt) const throws -> i32
       job *const matched = cxt.find_job_by_spec(target);
 
       if (matched != nullptr) {
-        status = cxt.wait_for_job_processes(*matched);
+        if (should_wait_for_next)
+          next_candidates.push(matched->id);
+        else
+          status = cxt.wait_for_job_processes(*matched);
       } else {
         report_soft_builtin_error(ec, cxt, ec.arg_location_at(i),
                                   target + ": no such job",
@@ -75,12 +123,21 @@ fn Wait::execute(ExecContext &ec, EvalContext &cxt) const throws -> i32
             break;
           }
         }
-        status =
-            matched != nullptr ? cxt.wait_for_job_processes(*matched) : 127;
+        if (matched != nullptr && should_wait_for_next)
+          next_candidates.push(matched->id);
+        else
+          status =
+              matched != nullptr ? cxt.wait_for_job_processes(*matched) : 127;
       }
     }
   }
 
+  if (should_wait_for_next) {
+    /* Every target was unknown, so there is nothing to wait for. */
+    if (next_candidates.is_empty()) return 127;
+    return wait_for_next_job(cxt, next_candidates);
+  }
+
   cxt.forget_done_jobs();
   return status;
 }
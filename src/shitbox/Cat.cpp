@@ -35,17 +35,16 @@ static fn number_prefix(i64 line_number, Allocator allocator) throws -> String
   return prefix;
 }
 
-static fn append_cat_source(String &output, StringView source,
-                            bool should_number, bool should_highlight,
-                            i64 &line_number, bool &is_at_output_line_start,
-                            EvalContext &context) throws -> void
+/* Highlighting needs the whole source to tell shell from other text and to
+   carry the lexer state across lines, so only that path reads the input at
+   once. */
+static fn write_highlighted_cat_source(text_writer &writer, StringView source,
+                                       bool should_number, i64 &line_number,
+                                       bool &is_at_output_line_start,
+                                       EvalContext &context) throws -> void
 {
-  if (!should_number && !should_highlight) {
-    output += source;
-    return;
-  }
-
   let highlight_cache = completion::shell_highlight_cache{};
+  let output = String{context.scratch_allocator()};
   usize line_start = 0;
   while (line_start < source.length) {
     let line_end = line_start;
@@ -53,6 +52,7 @@ static fn append_cat_source(String &output, StringView source,
       line_end++;
     if (line_end < source.length) line_end++;
 
+    output.clear();
     if (should_number && is_at_output_line_start) {
       output += number_prefix(line_number, context.scratch_allocator());
       line_number++;
@@ -60,20 +60,43 @@ static fn append_cat_source(String &output, StringView source,
 
     let const line =
         source.substring_of_length(line_start, line_end - line_start);
-    if (should_highlight) {
-      let const *spans =
-          highlight_cache.spans_for(source, line_start, line_end, context);
-      completion::append_highlighted_range(
-          output, line, *spans, 0, line.length,
-          colors::PRINTED_SOURCE_HIGHLIGHT_THEME);
-    } else {
-      output += line;
-    }
+    let const *spans =
+        highlight_cache.spans_for(source, line_start, line_end, context);
+    completion::append_highlighted_range(
+        output, line, *spans, 0, line.length,
+        colors::PRINTED_SOURCE_HIGHLIGHT_THEME);
+    writer.write(output.view());
     is_at_output_line_start = !line.is_empty() && line[line.length - 1] == '\n';
     line_start = line_end;
   }
 }
 
+/* The text may be any piece of the input, since the line state carries from
+   one piece to the next. */
+static fn write_cat_text(text_writer &writer, StringView text,
+                         bool should_number, i64 &line_number,
+                         bool &is_at_output_line_start,
+                         EvalContext &context) throws -> void
+{
+  if (!should_number) return writer.write(text);
+
+  usize line_start = 0;
+  while (line_start < text.length) {
+    let line_end = line_start;
+    while (line_end < text.length && text[line_end] != '\n')
+      line_end++;
+    if (line_end < text.length) line_end++;
+
+    if (is_at_output_line_start) {
+      writer.write(number_prefix(line_number, context.scratch_allocator()));
+      line_number++;
+    }
+    writer.write(text.substring_of_length(line_start, line_end - line_start));
+    is_at_output_line_start = text[line_end - 1] == '\n';
+    line_start = line_end;
+  }
+}
+
 Cat::Cat() = default;
 
 pure fn Cat::kind() const wontthrow -> Utility::Kind { return Kind::Cat; }
@@ -91,33 +114,77 @@ fn Cat::execute(const ExecContext &ec, EvalContext &cxt,
   let const sources =
       source_list_from_operands(operands, cxt.scratch_allocator());
 
-  let output = String{cxt.scratch_allocator()};
+  let writer = text_writer{ec};
+  let reader = text_reader{};
+  let const should_number = FLAG_CAT_NUMBER.is_enabled();
   let const should_highlight_output =
-      FLAG_CAT_SYNTAX_HIGHLIGHTING.is_enabled() && colors::stdout_wants_color();
+      FLAG_CAT_SYNTAX_HIGHLIGHTING.is_enabled() &&
+      colors::terminal_wants_color(ec.stdout_is_a_tty());
   i64 line_number = 1;
   let is_at_output_line_start = true;
   i32 status = 0;
   for (let const &source : sources) {
-    let const content = read_named_or_stdin(ec, source);
+    let is_read = false;
+    if (should_highlight_output) {
+      let const content = read_named_or_stdin(ec, source);
+      if (content.has_value()) {
+        is_read = true;
+        let const should_highlight_source =
+            !content->view().find_character('\0').has_value() &&
+            Path{source}.is_shell_source(content->view());
+        if (should_highlight_source)
+          write_highlighted_cat_source(writer, content->view(), should_number,
+                                       line_number, is_at_output_line_start,
+                                       cxt);
+        else
+          write_cat_text(writer, content->view(), should_number, line_number,
+                         is_at_output_line_start, cxt);
+      }
+    } else if (reader.open(ec, source)) {
+      /* Reading the file the output appends to would never reach its end,
+         so the operand is refused as GNU cat refuses it. */
+      writer.flush();
+      let const from = reader.descriptor();
+      let const to = ec.stdout_descriptor();
+      if (from.has_value() && to.has_value() &&
+          os::copy_reads_own_output(*from, *to))
+      {
+        reader.close();
+        report_soft_shitbox_error(ec, cxt,
+                                  "cat: " +
+                                      String{cxt.scratch_allocator(), source} +
+                                      ": input file is output file");
+        status = 1;
+        continue;
+      }
+      /* Unnumbered text between two plain descriptors is the kernel's to
+         copy. A stage ring or a capture on either side takes the buffers. */
+      let const copied = should_number ? Maybe<os::copy_result>{}
+                                       : writer.copy_from(reader);
+      if (copied.has_value()) is_read = *copied != os::copy_result::ReadFailed;
+      while (!copied.has_value()) {
+        let const chunk = reader.next_chunk();
+        if (!chunk.has_value() || chunk->is_empty()) {
+          is_read = chunk.has_value();
+          break;
+        }
+        write_cat_text(writer, *chunk, should_number, line_number,
+                       is_at_output_line_start, cxt);
+      }
+      reader.close();
+    }
     if (os::INTERRUPT_REQUESTED) return 130;
-    if (!content.has_value()) {
+    if (!is_read) {
+      writer.flush();
       report_soft_shitbox_error(
           ec, cxt,
           "cat: " + String{cxt.scratch_allocator(), source} + ": " +
               os::last_system_error_message());
       status = 1;
-      continue;
     }
-    let const should_highlight_source =
-        should_highlight_output &&
-        !content->view().find_character('\0').has_value() &&
-        Path{source}.is_shell_source(content->view());
-    append_cat_source(output, content->view(), FLAG_CAT_NUMBER.is_enabled(),
-                      should_highlight_source, line_number,
-                      is_at_output_line_start, cxt);
   }
 
-  ec.print_to_stdout(output);
+  writer.flush();
   return status;
 }
 
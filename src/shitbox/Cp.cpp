@@ -3,16 +3,22 @@
 #include "../Eval.hpp"
 #include "../Path.hpp"
 #include "../Shitbox.hpp"
+#include "../StringMap.hpp"
+
+#include <atomic>
 
 FLAG_LIST_DECL();
 
-HELP_SYNOPSIS_DECL("[-rRv] source ... destination");
+HELP_SYNOPSIS_DECL("[-rRv] [-j jobs] source ... destination");
 
 HELP_DESCRIPTION_DECL("The cp utility copies each source to the destination.");
 
 FLAG(CP_RECURSIVE_R, Bool, 'r', "", "Copy directories and their contents.");
 FLAG(CP_RECURSIVE_UPPER, Bool, 'R', "", "Copy directories and their contents.");
 FLAG(CP_VERBOSE, Bool, 'v', "", "Print the name of each copy as it happens.");
+FLAG(CP_JOBS, String, 'j', "jobs",
+     "Copy this many entries of a directory at once, one per processor by "
+     "default.");
 FLAG(HELP, Bool, '\0', "help", "Display help.");
 
 REGISTER_SHITBOX_UTIL_FLAGS(Cp);
@@ -34,6 +40,14 @@ static fn copy_file(const ExecContext &ec, StringView source,
     };
   defer { os::close_fd(*in_fd); };
 
+  /* The truncating open would empty the source before a byte is read. */
+  if (Path{source}.is_same_file_as(Path{destination}))
+    throw Error{
+        "cp: '" + String{allocator, source}
+          + "' and '" + String{allocator, destination}
+          + "' are the same file"
+    };
+
   let const out_fd =
       os::open_file_descriptor(destination, os::file_open_mode::Truncate);
   if (!out_fd.has_value())
@@ -44,33 +58,24 @@ static fn copy_file(const ExecContext &ec, StringView source,
     };
   defer { os::close_fd(*out_fd); };
 
-  char buffer[4096];
-  loop
-  {
-    let const read_count = os::read_fd(*in_fd, buffer, sizeof(buffer));
-    if (!read_count.has_value())
-      throw Error{
-          "cp: a read of '" + String{allocator, source}
-            +
-          "' failed: " + os::last_system_error_message()
-      };
-    if (*read_count == 0) break;
-    /* write_fd returns a single write's count that can fall short, so the
-       remaining bytes are written in the loop. */
-    usize written_count = 0;
-    while (written_count < *read_count) {
-      let const chunk = os::write_fd(*out_fd, buffer + written_count,
-                                     *read_count - written_count);
-      if (!chunk.has_value() || *chunk == 0) {
-        throw Error{
-            "cp: a write to '" + String{allocator, destination}
-              +
-            "' failed: " + os::last_system_error_message()
-        };
-      }
-
-      written_count += *chunk;
-    }
+  switch (os::copy_fd_contents(*in_fd, *out_fd)) {
+  case os::copy_result::Ok: break;
+  case os::copy_result::ReadFailed:
+    throw Error{
+        "cp: a read of '" + String{allocator, source}
+          +
+        "' failed: " + os::last_system_error_message()
+    };
+  case os::copy_result::WriteFailed:
+    throw Error{
+        "cp: a write to '" + String{allocator, destination}
+          +
+        "' failed: " + os::last_system_error_message()
+    };
+  /* A truncated destination reads back nothing of its own. */
+  case os::copy_result::SameFile: unreachable("the destination was truncated");
+  case os::copy_result::Interrupted:
+    throw InterruptErrorWithLocation{ec.source_location()};
   }
 
   if (is_verbose)
@@ -95,9 +100,427 @@ static fn source_permission_bits(const Path &source_path,
   return status.mode & 0777;
 }
 
+/* A directory copy runs on a pool of workers that share one stack of entries.
+   Each directory is opened once on either side and its entries are named
+   through those descriptors, so no worker rebuilds a full path or has the
+   kernel walk one again. A directory keeps its descriptors until the last of
+   its entries is done, then takes its mode and closes them. The stack is last
+   in, first out, so the walk goes deep before it goes wide and few directories
+   hold descriptors at once.
+
+   Nothing is printed while the workers run. Each entry records how it went,
+   and once the whole tree is done the verbose lines and the first failure come
+   out in the order the directories list their entries, the order a copy one
+   entry at a time would report them in, however the workers interleaved. */
+enum class copy_failure : u8
+{
+  None,
+  Open,
+  Create,
+  Read,
+  Write,
+  ReadDirectory,
+  Symlink,
+  SameFile,
+};
+
+struct tree_node;
+
+struct tree_entry
+{
+  String name;
+  Path::entry_kind kind;
+  tree_node *directory{nullptr};
+  copy_failure failure{copy_failure::None};
+  String reason{heap_allocator()};
+  bool is_copied{false};
+};
+
+struct tree_node
+{
+  /* The node whose entry this directory is, and that entry's index. */
+  tree_node *parent{nullptr};
+  usize index{0};
+  os::DirectoryReference source{};
+  os::DirectoryReference destination{};
+  bool did_create_destination{false};
+  u32 mode{0};
+  ArrayList<tree_entry> entries{heap_allocator()};
+  std::atomic<usize> pending{0};
+};
+
+struct copy_job
+{
+  tree_node *node;
+  usize index;
+};
+
+class tree_copier
+{
+public:
+  tree_copier(StringView source, StringView destination) throws
+      : m_source_root(heap_allocator(), source),
+        m_destination_root(heap_allocator(), destination),
+        m_creation_mask(os::get_file_creation_mask())
+  {
+    m_top.entries.push(
+        tree_entry{String{heap_allocator()}, Path::entry_kind::Directory});
+    m_top.pending.store(1);
+  }
+  tree_copier(const tree_copier &) = delete;
+  tree_copier &operator=(const tree_copier &) = delete;
+  ~tree_copier() { destroy_children(m_top); }
+
+  fn run(usize job_count) throws -> void
+  {
+    m_pool.push(copy_job{&m_top, 0});
+    m_pool.run(job_count);
+  }
+
+  /* Print the verbose lines up to the first failure, and throw that failure. */
+  fn report(const ExecContext &ec, bool is_verbose, Allocator allocator) const
+      throws -> void
+  {
+    report_entry(ec, m_top.entries[0], m_source_root.view(),
+                 m_destination_root.view(), is_verbose, allocator);
+  }
+
+private:
+  static fn run_job(opaque *raw_copier, copy_job &job) throws -> void
+  {
+    static_cast<tree_copier *>(raw_copier)->copy_entry(*job.node, job.index);
+  }
+
+  fn push_jobs(tree_node &node) throws -> void
+  {
+    /* Pushed last to first, so the first entry is the next one taken. */
+    for (usize i = node.entries.count(); i > 0; i--)
+      m_pool.push(copy_job{&node, i - 1});
+  }
+
+  fn copy_entry(tree_node &node, usize index) throws -> void
+  {
+    defer { release(node); };
+    switch (node.entries[index].kind) {
+    case Path::entry_kind::Directory: copy_directory(node, index); break;
+    case Path::entry_kind::Symlink: copy_symlink(node, index); break;
+    default: copy_file(node, index); break;
+    }
+  }
+
+  /* The entry is done with its directory's descriptors. */
+  fn release(tree_node &node) wontthrow -> void
+  {
+    if (node.pending.fetch_sub(1) != 1) return;
+    if (node.did_create_destination && node.destination.is_valid())
+      os::set_descriptor_mode(node.destination.get(),
+                              node.mode & ~m_creation_mask);
+    node.source = os::DirectoryReference{};
+    node.destination = os::DirectoryReference{};
+  }
+
+  fn fail(tree_entry &entry, copy_failure failure) throws -> void
+  {
+    entry.failure = failure;
+    entry.reason = os::last_system_error_message();
+  }
+
+  fn copy_directory(tree_node &node, usize index) throws -> void
+  {
+    let &entry = node.entries[index];
+    let const is_root = &node == &m_top;
+
+    let source =
+        is_root ? os::open_directory(m_source_root.view())
+                : os::open_directory_at(node.source, entry.name.view());
+    if (!source.is_valid()) return fail(entry, copy_failure::ReadDirectory);
+    os::file_status status{};
+    let const has_status = os::stat_descriptor(source.get(), status);
+
+    /* Created owner only and given its mode once its entries are in, so a
+       read-only directory can still be filled. */
+    let const did_create =
+        is_root ? os::make_directory(m_destination_root.view(), 0700)
+                : os::make_directory_at(node.destination, entry.name.view(),
+                                        0700);
+    let destination =
+        is_root ? os::open_directory(m_destination_root.view())
+                : os::open_directory_at(node.destination, entry.name.view());
+    if (!destination.is_valid()) return fail(entry, copy_failure::Create);
+
+    let children = os::list_directory_at(source);
+    if (!children.has_value()) return fail(entry, copy_failure::ReadDirectory);
+
+    let *child = heap_allocator().alloc_array<tree_node>(1);
+    new (child) tree_node{};
+    entry.directory = child;
+    child->parent = &node;
+    child->index = index;
+    child->did_create_destination = did_create && has_status;
+    child->mode = status.mode & 0777;
+    child->entries.reserve(children->count());
+    for (let &listed : *children) {
+      let kind = listed.kind;
+      if (kind == Path::entry_kind::Unknown)
+        kind = entry_kind_at(source, listed.name.view());
+      child->entries.push(tree_entry{steal(listed.name), kind});
+    }
+
+    child->source = steal(source);
+    child->destination = steal(destination);
+    child->pending.store(child->entries.count() + 1);
+    push_jobs(*child);
+    release(*child);
+  }
+
+  static fn entry_kind_at(const os::DirectoryReference &dir, StringView name)
+      throws -> Path::entry_kind
+  {
+    os::file_status status{};
+    if (!os::stat_at(dir, name, status)) return Path::entry_kind::Regular;
+    switch (status.mode & 0170000) {
+    case 0040000: return Path::entry_kind::Directory;
+    case 0120000: return Path::entry_kind::Symlink;
+    default: return Path::entry_kind::Regular;
+    }
+  }
+
+  fn copy_symlink(tree_node &node, usize index) throws -> void
+  {
+    let &entry = node.entries[index];
+    let const target = os::read_symlink_at(node.source, entry.name.view());
+    if (!target.has_value()) return fail(entry, copy_failure::Open);
+
+    /* Symlink creation fails when the path is already present, so an existing
+       destination is removed first. */
+    os::remove_file_at(node.destination, entry.name.view());
+    if (!os::create_symlink_at(target->view(), node.destination,
+                               entry.name.view()))
+      return fail(entry, copy_failure::Symlink);
+    entry.is_copied = true;
+  }
+
+  /* A new file is created exclusively, which tells it apart from one that was
+     there already and keeps its mode. A symlink in the way is removed so the
+     copy does not follow it and truncate its target. A file that is the
+     source under another name is left alone and the entry fails. */
+  fn create_file(tree_node &node, usize index,
+                 const os::file_status *source_status, bool &did_create) throws
+      -> Maybe<os::descriptor>
+  {
+    let &entry = node.entries[index];
+    let const name = entry.name.view();
+    let fd = os::open_file_at(node.destination, name,
+                              os::file_open_mode::TruncateNoClobber);
+    if (fd.has_value() || !os::last_system_error_is_existing_file()) {
+      did_create = fd.has_value();
+      if (!fd.has_value()) fail(entry, copy_failure::Create);
+      return fd;
+    }
+
+    os::file_status status{};
+    let const has_status = os::stat_at(node.destination, name, status);
+    if (has_status && source_status != nullptr &&
+        source_status->has_file_identity && status.has_file_identity &&
+        source_status->device_id == status.device_id &&
+        source_status->file_id == status.file_id)
+    {
+      fail(entry, copy_failure::SameFile);
+      return None;
+    }
+    if (has_status && (status.mode & 0170000) == 0120000) {
+      os::remove_file_at(node.destination, name);
+      fd = os::open_file_at(node.destination, name,
+                            os::file_open_mode::TruncateNoClobber);
+      did_create = fd.has_value();
+      if (!fd.has_value()) fail(entry, copy_failure::Create);
+      return fd;
+    }
+
+    did_create = false;
+    fd = os::open_file_at(node.destination, name, os::file_open_mode::Truncate);
+    if (!fd.has_value()) fail(entry, copy_failure::Create);
+    return fd;
+  }
+
+  fn copy_file(tree_node &node, usize index) throws -> void
+  {
+    let &entry = node.entries[index];
+    let const name = entry.name.view();
+
+    let const in_fd =
+        os::open_file_at(node.source, name, os::file_open_mode::Read);
+    if (!in_fd.has_value()) return fail(entry, copy_failure::Open);
+    defer { os::close_fd(*in_fd); };
+
+    os::file_status status{};
+    let const has_status = os::stat_descriptor(*in_fd, status);
+    let const *const source_status = has_status ? &status : nullptr;
+
+    /* A file with other names may already have a copy from one of them, and
+       then this name becomes another link to that copy. The first name creates
+       its copy under the lock, so a later name never links to nothing. */
+    bool did_create = false;
+    Maybe<os::descriptor> out_fd;
+    if (has_status && status.has_file_identity && status.link_count > 1) {
+      let const key = inode_key(status);
+      os::lock_monitor(m_link_monitor);
+      let const *existing = m_links.find(key.view());
+      if (existing != nullptr) {
+        let const linked_path = existing->clone();
+        os::unlock_monitor(m_link_monitor);
+        os::remove_file_at(node.destination, name);
+        if (os::create_hard_link_at(linked_path.view(), node.destination,
+                                    name))
+        {
+          entry.is_copied = true;
+          return;
+        }
+      } else {
+        defer { os::unlock_monitor(m_link_monitor); };
+        out_fd = create_file(node, index, source_status, did_create);
+        if (out_fd.has_value())
+          m_links.set(key.view(), destination_path(node, index));
+      }
+    }
+
+    if (!out_fd.has_value() && entry.failure == copy_failure::None)
+      out_fd = create_file(node, index, source_status, did_create);
+    if (!out_fd.has_value()) return;
+    defer { os::close_fd(*out_fd); };
+
+    switch (os::copy_fd_contents(*in_fd, *out_fd)) {
+    case os::copy_result::Ok: break;
+    case os::copy_result::ReadFailed: return fail(entry, copy_failure::Read);
+    case os::copy_result::WriteFailed: return fail(entry, copy_failure::Write);
+    /* A truncated destination reads back nothing of its own. */
+    case os::copy_result::SameFile:
+      unreachable("the destination was truncated");
+    /* The interrupt flag stays up and the caller throws for it. */
+    case os::copy_result::Interrupted: return;
+    }
+
+    if (has_status && did_create)
+      os::set_descriptor_mode(*out_fd, status.mode & 0777 & ~m_creation_mask);
+    entry.is_copied = true;
+  }
+
+  static fn inode_key(const os::file_status &status) throws -> String
+  {
+    let key = String{heap_allocator()};
+    key.append(StringView{reinterpret_cast<const char *>(&status.device_id),
+                          sizeof(status.device_id)});
+    key.append(StringView{reinterpret_cast<const char *>(&status.file_id),
+                          sizeof(status.file_id)});
+    return key;
+  }
+
+  fn directory_path(const tree_node &node) const throws -> String
+  {
+    if (node.parent == &m_top) return m_destination_root.clone();
+    let const parent_path = directory_path(*node.parent);
+    return PathBuilder{parent_path.view()}
+        .append(node.parent->entries[node.index].name.view())
+        .build()
+        .text()
+        .clone();
+  }
+
+  fn destination_path(const tree_node &node, usize index) const throws
+      -> String
+  {
+    let const parent_path = directory_path(node);
+    return PathBuilder{parent_path.view()}
+        .append(node.entries[index].name.view())
+        .build()
+        .text()
+        .clone();
+  }
+
+  static fn report_entry(const ExecContext &ec, const tree_entry &entry,
+                         StringView source, StringView destination,
+                         bool is_verbose, Allocator allocator) throws -> void
+  {
+    switch (entry.failure) {
+    case copy_failure::None: break;
+    case copy_failure::Open:
+      throw Error{
+          "cp: unable to open '" + String{allocator, source}
+            + "': " + entry.reason
+      };
+    case copy_failure::Create:
+      throw Error{
+          "cp: unable to create '" + String{allocator, destination}
+            + "': " + entry.reason
+      };
+    case copy_failure::Read:
+      throw Error{
+          "cp: a read of '" + String{allocator, source}
+            + "' failed: " + entry.reason
+      };
+    case copy_failure::Write:
+      throw Error{
+          "cp: a write to '" + String{allocator, destination}
+            + "' failed: " + entry.reason
+      };
+    case copy_failure::ReadDirectory:
+      throw Error{
+          "cp: unable to read the directory '" + String{allocator, source}
+            + "': " + entry.reason
+      };
+    case copy_failure::Symlink:
+      throw Error{
+          "cp: unable to create the symlink '" +
+          String{allocator, destination}
+            + "': " + entry.reason
+      };
+    case copy_failure::SameFile:
+      throw Error{
+          "cp: '" + String{allocator, source}
+            + "' and '" + String{allocator, destination}
+            + "' are the same file"
+      };
+    }
+
+    if (entry.is_copied && is_verbose)
+      ec.print_to_stdout("'" + String{allocator, source} + "' -> '" +
+                         String{allocator, destination} + "'\n");
+
+    if (entry.directory == nullptr) return;
+    for (let const &child : entry.directory->entries) {
+      let const child_source =
+          PathBuilder{source}.append(child.name.view()).build();
+      let const child_destination =
+          PathBuilder{destination}.append(child.name.view()).build();
+      report_entry(ec, child, child_source.text().view(),
+                   child_destination.text().view(), is_verbose, allocator);
+    }
+  }
+
+  static fn destroy_children(tree_node &node) wontthrow -> void
+  {
+    for (let &entry : node.entries) {
+      if (entry.directory == nullptr) continue;
+      destroy_children(*entry.directory);
+      entry.directory->~tree_node();
+      heap_allocator().free_array(entry.directory, 1);
+    }
+  }
+
+  String m_source_root;
+  String m_destination_root;
+  u32 m_creation_mask;
+  tree_node m_top{};
+
+  directory_job_pool<copy_job> m_pool{run_job, this};
+
+  os::monitor m_link_monitor{};
+  StringMap<String> m_links{heap_allocator()};
+};
+
 static fn copy_path(const ExecContext &ec, StringView source,
                     StringView destination, bool is_recursive, bool is_verbose,
-                    Allocator allocator) throws -> void
+                    usize job_count, Allocator allocator) throws -> void
 {
   let const source_path = Path{source};
   let const source_mode = source_permission_bits(source_path, source);
@@ -149,29 +572,11 @@ static fn copy_path(const ExecContext &ec, StringView source,
       };
     }
 
-    let const destination_existed = Path{destination}.is_directory();
-    os::make_directory(destination, 0700);
-    Maybe<ArrayList<String>> names = Path::read_directory(source_path);
-    if (!names.has_value())
-      throw Error{
-          "cp: unable to read the directory '" + String{allocator, source}
-            +
-          "': " + os::last_system_error_message()
-      };
-
-    for (let const &name : *names) {
-      let const child_source = PathBuilder{source}.append(name.view()).build();
-      let const child_destination =
-          PathBuilder{destination}.append(name.view()).build();
-      copy_path(ec, child_source.text().view(), child_destination.text().view(),
-                is_recursive, is_verbose, allocator);
-    }
-
-    if (source_mode.has_value() && !destination_existed) {
-      os::set_file_mode(destination,
-                        *source_mode & ~os::get_file_creation_mask());
-    }
-
+    let copier = tree_copier{source, destination};
+    copier.run(job_count);
+    if (os::INTERRUPT_REQUESTED)
+      throw InterruptErrorWithLocation{ec.source_location()};
+    copier.report(ec, is_verbose, allocator);
     return;
   }
 
@@ -208,6 +613,14 @@ fn Cp::execute(const ExecContext &ec, EvalContext &cxt,
       FLAG_CP_RECURSIVE_R.is_enabled() || FLAG_CP_RECURSIVE_UPPER.is_enabled();
   let const is_verbose = FLAG_CP_VERBOSE.is_enabled();
   let const destination = operands[operands.count() - 1].view();
+
+  usize job_count = os::get_processor_counts().online_count;
+  if (FLAG_CP_JOBS.is_set())
+    job_count = parse_shitbox_job_count(FLAG_CP_JOBS.value(), "cp",
+                                        MAX_SHITBOX_JOBS,
+                                        cxt.scratch_allocator());
+  if (job_count > MAX_SHITBOX_JOBS) job_count = MAX_SHITBOX_JOBS;
+
   let const destination_is_directory = Path{destination}.is_directory();
 
   if (operands.count() > 2 && !destination_is_directory) {
@@ -227,10 +640,10 @@ fn Cp::execute(const ExecContext &ec, EvalContext &cxt,
       let const leaf = source_path.filename();
       let const target = PathBuilder{destination}.append(leaf).build();
       copy_path(ec, source, target.text().view(), is_recursive, is_verbose,
-                cxt.scratch_allocator());
+                job_count, cxt.scratch_allocator());
     } else {
       copy_path(ec, source, destination, is_recursive, is_verbose,
-                cxt.scratch_allocator());
+                job_count, cxt.scratch_allocator());
     }
   }
 
@@ -3,19 +3,28 @@
 #include "../Eval.hpp"
 #include "../Path.hpp"
 #include "../Shitbox.hpp"
+#include "../StringMap.hpp"
 #include "../Utils.hpp"
 
+#include <atomic>
+
 FLAG_LIST_DECL();
 
-HELP_SYNOPSIS_DECL("[-sh] [path ...]");
+HELP_SYNOPSIS_DECL("[-shx] [--apparent-size] [-j jobs] [path ...]");
 
 HELP_DESCRIPTION_DECL(
-    "The du utility prints the total byte size of each path.");
+    "The du utility prints the total byte size each path takes on disk.");
 
 FLAG(DU_SUMMARY, Bool, 's', "",
      "Print only the total for each path, the default.");
 FLAG(DU_HUMAN, Bool, 'h', "",
      "Print the size in a human-readable form such as 4.0K or 1.5M.");
+FLAG(DU_APPARENT_SIZE, Bool, '\0', "apparent-size",
+     "Count the length of each file instead of the blocks it takes.");
+FLAG(DU_ONE_FILE_SYSTEM, Bool, 'x', "one-file-system",
+     "Skip the entries on a filesystem other than the path's own.");
+FLAG(DU_JOBS, String, 'j', "jobs",
+     "Scan this many directories at once, one by default.");
 FLAG(HELP, Bool, '\0', "help", "Display help.");
 
 REGISTER_SHITBOX_UTIL_FLAGS(Du);
@@ -24,25 +33,137 @@ namespace shit {
 
 namespace shitbox {
 
-/* A symlink is counted as its own size and not followed, so a cycle cannot
-   run forever. */
-static fn total_size(const Path &path) throws -> u64
+/* A walk that names every entry through the open directory holding it and
+   stats it there once without following it, so a symlink counts as itself
+   and a cycle cannot run forever. The stat is the only one an entry gets, and
+   it is needed anyway for the blocks, so the type the listing reports goes
+   unused. A file with several names counts once, by its device and inode,
+   across every path of one run.
+
+   With more than one job, a directory found while the queue is short goes to
+   the queue for any worker to take. Otherwise it is scanned where it was
+   found, so a wide tree does not hold a descriptor for every directory it has
+   seen. The total is a sum, so the order the workers finish in does not
+   change it. */
+struct scan_job
+{
+  os::DirectoryReference dir;
+  u64 device_id;
+};
+
+class usage_scanner
 {
-  if (path.is_directory() && !path.is_symbolic_link()) {
+public:
+  usage_scanner(bool is_apparent, bool is_one_file_system) wontthrow
+      : m_is_apparent(is_apparent), m_is_one_file_system(is_one_file_system)
+  {}
+  usage_scanner(const usage_scanner &) = delete;
+  usage_scanner &operator=(const usage_scanner &) = delete;
+
+  /* None when the path cannot be stated. */
+  fn scan(StringView path, usize job_count) throws -> Maybe<u64>
+  {
+    os::file_status status{};
+    if (!os::stat_path(path, status)) return None;
+    m_total.store(0);
+    if (!is_counted(status)) return 0;
+    m_total.store(size_of(status));
+    if ((status.mode & 0170000) != 0040000) return m_total.load();
+
+    let dir = os::open_directory(path);
+    if (!dir.is_valid()) return m_total.load();
+
+    m_job_count = job_count;
+    if (job_count <= 1) {
+      m_total.fetch_add(scan_directory(dir, status.device_id));
+      return m_total.load();
+    }
+
+    m_pool.push(scan_job{steal(dir), status.device_id});
+    m_pool.run(job_count);
+    return m_total.load();
+  }
+
+private:
+  static fn run_job(opaque *raw_scanner, scan_job &job) throws -> void
+  {
+    let *scanner = static_cast<usage_scanner *>(raw_scanner);
+    scanner->m_total.fetch_add(scanner->scan_directory(job.dir, job.device_id));
+  }
+
+  /* Hand the directory to the queue when there are workers to take it and the
+     queue is not already ahead of them. */
+  fn try_queue(os::DirectoryReference &dir, u64 device_id) throws -> bool
+  {
+    if (m_job_count <= 1 || m_pool.queued_count() >= m_job_count) return false;
+    m_pool.push(scan_job{steal(dir), device_id});
+    return true;
+  }
+
+  /* The bytes under the directory, not counting the directory itself. An
+     unreadable directory or entry counts as nothing, as before. */
+  fn scan_directory(const os::DirectoryReference &dir, u64 device_id) throws
+      -> u64
+  {
+    os::DirectoryStream stream{};
+    if (!stream.open(dir)) return 0;
+
     u64 total_bytes = 0;
-    Maybe<ArrayList<String>> names = Path::read_directory(path);
-    if (names.has_value())
-      for (let const &name : *names) {
-        if (os::INTERRUPT_REQUESTED) return total_bytes;
-
-        let const child =
-            PathBuilder{path.text().view()}.append(name.view()).build();
-        total_bytes += total_size(child);
-      }
+    loop
+    {
+      let const listed = stream.next();
+      if (!listed.has_value() || os::INTERRUPT_REQUESTED) break;
+
+      os::file_status status{};
+      if (!os::stat_at(dir, listed->name, status)) continue;
+      if (m_is_one_file_system && status.device_id != device_id) continue;
+      if (!is_counted(status)) continue;
+      total_bytes += size_of(status);
+
+      if ((status.mode & 0170000) != 0040000) continue;
+      let child = os::open_directory_at(dir, listed->name);
+      if (!child.is_valid()) continue;
+      if (try_queue(child, device_id)) continue;
+      total_bytes += scan_directory(child, device_id);
+    }
     return total_bytes;
   }
-  return path.file_size().value_or(0);
-}
+
+  pure fn size_of(const os::file_status &status) const wontthrow -> u64
+  {
+    return m_is_apparent ? status.size : status.blocks * 512;
+  }
+
+  /* A directory always has several links, so only the other kinds are checked
+     for a name seen before. */
+  fn is_counted(const os::file_status &status) throws -> bool
+  {
+    if (status.link_count <= 1 || !status.has_file_identity ||
+        (status.mode & 0170000) == 0040000)
+      return true;
+
+    let key = String{heap_allocator()};
+    key.append(StringView{reinterpret_cast<const char *>(&status.device_id),
+                          sizeof(status.device_id)});
+    key.append(StringView{reinterpret_cast<const char *>(&status.file_id),
+                          sizeof(status.file_id)});
+    os::lock_monitor(m_seen_monitor);
+    defer { os::unlock_monitor(m_seen_monitor); };
+    if (m_seen.find(key.view()) != nullptr) return false;
+    m_seen.set(key.view(), true);
+    return true;
+  }
+
+  bool m_is_apparent;
+  bool m_is_one_file_system;
+  usize m_job_count{1};
+  std::atomic<u64> m_total{0};
+
+  directory_job_pool<scan_job> m_pool{run_job, this};
+
+  os::monitor m_seen_monitor{};
+  StringMap<bool> m_seen{heap_allocator()};
+};
 
 Du::Du() = default;
 
@@ -58,6 +179,12 @@ fn Du::execute(const ExecContext &ec, EvalContext &cxt,
 
   SHITBOX_SHOW_HELP_AND_RETURN(ec, args);
 
+  usize job_count = 1;
+  if (FLAG_DU_JOBS.is_set())
+    job_count = parse_shitbox_job_count(FLAG_DU_JOBS.value(), "du",
+                                        MAX_SHITBOX_JOBS,
+                                        cxt.scratch_allocator());
+
   ArrayList<StringView> targets{cxt.scratch_allocator()};
   if (operands.is_empty())
     targets.push(StringView{"."});
@@ -65,11 +192,14 @@ fn Du::execute(const ExecContext &ec, EvalContext &cxt,
     for (let const &operand : operands)
       targets.push(operand.view());
 
+  let scanner = usage_scanner{FLAG_DU_APPARENT_SIZE.is_enabled(),
+                              FLAG_DU_ONE_FILE_SYSTEM.is_enabled()};
   let output = String{cxt.scratch_allocator()};
   i32 status = 0;
   for (let const &target : targets) {
-    let const path = Path{target};
-    if (!path.exists()) {
+    let const total = scanner.scan(target, job_count);
+    if (os::INTERRUPT_REQUESTED) return 130;
+    if (!total.has_value()) {
       report_soft_shitbox_error(ec, cxt,
                                 "du: cannot access '" +
                                     String{cxt.scratch_allocator(), target} +
@@ -77,10 +207,9 @@ fn Du::execute(const ExecContext &ec, EvalContext &cxt,
       status = 1;
       continue;
     }
-    let const total = total_size(path);
     output += FLAG_DU_HUMAN.is_enabled()
-                  ? format_human_size(total, cxt.scratch_allocator())
-                  : String::from(total, cxt.scratch_allocator());
+                  ? format_human_size(*total, cxt.scratch_allocator())
+                  : String::from(*total, cxt.scratch_allocator());
     output += '\t';
     output += target;
     output += '\n';
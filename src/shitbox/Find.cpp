@@ -1,6 +1,7 @@
 #include "../Cli.hpp"
 #include "../Errors.hpp"
 #include "../Eval.hpp"
+#include "../Glob.hpp"
 #include "../Path.hpp"
 #include "../Shitbox.hpp"
 #include "../Trace.hpp"
@@ -8,11 +9,14 @@
 
 FLAG_LIST_DECL();
 
-HELP_SYNOPSIS_DECL(
-    "[path ...] [-name glob] [-type fdl] [-maxdepth n] [-mindepth n]");
+HELP_SYNOPSIS_DECL("[path ...] [-j n] [-unordered] [-maxdepth n] [-mindepth n] "
+                   "[expression]");
 
 HELP_DESCRIPTION_DECL(
-    "The find utility walks each path and prints every entry under it.");
+    "The find utility walks each path and prints every entry under it that "
+    "the expression holds for. The tests are -name, -iname, -type, -size, "
+    "-newer and -mtime, the actions -print, -print0 and -prune, joined with "
+    "( ), !, -a and -o.");
 
 FLAG(HELP, Bool, '\0', "help", "Display help.");
 
@@ -22,120 +26,723 @@ namespace shit {
 
 namespace shitbox {
 
-struct find_options
+/* A -name or -iname glob, compiled once into a GlobProgram. A pattern the
+   program cannot hold falls back to utils::glob_matches. -iname lowers the
+   glob for the program, as nocaseglob does, and the fallback lowers each name
+   too. */
+class name_pattern
 {
-  const ArrayList<StringView> *name_patterns{nullptr};
-  const Bitset *glob_active{nullptr};
-  char type_filter{0};
+public:
+  static fn compile(StringView glob, bool is_case_folded) throws
+      -> name_pattern
+  {
+    let pattern = name_pattern{is_case_folded};
+    for (usize i = 0; i < glob.length; i++) {
+      pattern.m_glob.push(is_case_folded ? utils::ascii_to_lower(glob[i])
+                                         : glob[i]);
+      pattern.m_glob_active.push(true);
+    }
+    pattern.m_program =
+        GlobProgram::compile(pattern.m_glob.view(), pattern.m_glob_active, 0,
+                             false, is_case_folded, heap_allocator());
+    return pattern;
+  }
+
+  hot fn matches(StringView name) const throws -> bool
+  {
+    if (m_program.is_compiled()) [[likely]]
+      return m_program.matches(name);
+    if (!m_is_case_folded)
+      return utils::glob_matches(m_glob.view(), name, m_glob_active, 0);
+    let lowered = String{heap_allocator()};
+    for (usize i = 0; i < name.length; i++)
+      lowered.push(utils::ascii_to_lower(name[i]));
+    return utils::glob_matches(m_glob.view(), lowered.view(), m_glob_active,
+                               0);
+  }
+
+private:
+  explicit name_pattern(bool is_case_folded) wontthrow
+      : m_is_case_folded(is_case_folded)
+  {}
+
+  bool m_is_case_folded;
+  String m_glob{heap_allocator()};
+  Bitset m_glob_active{heap_allocator()};
+  GlobProgram m_program{};
+};
+
+enum class predicate_kind : u8
+{
+  True,
+  And,
+  Or,
+  Not,
+  Name,
+  Type,
+  Size,
+  Newer,
+  ModifiedDays,
+  Prune,
+  Print,
+  Print0,
+};
+
+/* -type letters as bits, so a comma list tests in one step. */
+enum type_bit : u8
+{
+  TYPE_FILE = 1 << 0,
+  TYPE_DIRECTORY = 1 << 1,
+  TYPE_SYMLINK = 1 << 2,
+  TYPE_BLOCK = 1 << 3,
+  TYPE_CHARACTER = 1 << 4,
+  TYPE_FIFO = 1 << 5,
+  TYPE_SOCKET = 1 << 6,
+};
+
+/* One node of the expression, kept in a flat list and linked by index. A
+   comparison is -1 for a -N operand, 1 for +N and 0 for an exact N. */
+struct find_predicate
+{
+  predicate_kind kind;
+  u32 left{0};
+  u32 right{0};
+  u8 type_mask{0};
+  i8 comparison{0};
+  i64 number{0};
+  u64 unit{1};
+  i64 seconds{0};
+  u32 nanoseconds{0};
+};
+
+struct find_program
+{
+  ArrayList<find_predicate> predicates{heap_allocator()};
+  ArrayList<name_pattern> patterns{heap_allocator()};
+  u32 root{0};
   i64 max_depth{-1};
   i64 min_depth{0};
+  usize job_count{1};
+  bool is_ordered{true};
 };
 
-static fn find_entry_matches(char type_letter, StringView filename, usize depth,
-                             const find_options &options) throws -> bool
+/* A recursive descent over the POSIX grammar, where -o binds loosest, then
+   -a, which may be left out, then !, then a parenthesized group or a single
+   test. The global options may sit anywhere and read as true. */
+class find_parser
 {
-  if (static_cast<i64>(depth) < options.min_depth) return false;
-  if (options.max_depth >= 0 && static_cast<i64>(depth) > options.max_depth) {
-    return false;
+public:
+  find_parser(const ArrayList<String> &args, usize index, find_program &program,
+              Allocator allocator) wontthrow
+      : m_args(args), m_index(index), m_program(program),
+        m_allocator(allocator)
+  {}
+
+  fn parse() throws -> void
+  {
+    Maybe<u32> root;
+    if (m_index < m_args.count()) root = parse_or();
+    if (m_index < m_args.count()) {
+      if (peek() == ")")
+        throw Error{"find: ')' without a matching '('"};
+      throw Error{
+          "find: unknown predicate '" + String{m_allocator, peek()} + "'"
+      };
+    }
+
+    let const expression = root.value_or(add(predicate_kind::True));
+    m_program.root =
+        m_has_action ? expression
+                     : add(predicate_kind::And, expression,
+                           add(predicate_kind::Print));
+  }
+
+private:
+  mustuse fn peek() const wontthrow -> StringView
+  {
+    return m_args[m_index].view();
   }
 
-  switch (options.type_filter) {
-  case 'f':
-    if (type_letter != '-') return false;
-    break;
-  case 'd':
-    if (type_letter != 'd') return false;
-    break;
-  case 'l':
-    if (type_letter != 'l') return false;
-    break;
-  default: break;
+  fn add(predicate_kind kind, u32 left = 0, u32 right = 0) throws -> u32
+  {
+    m_program.predicates.push(find_predicate{kind, left, right});
+    return static_cast<u32>(m_program.predicates.count() - 1);
   }
 
-  if (options.name_patterns != nullptr) {
-    for (let const &pattern : *options.name_patterns) {
-      if (!utils::glob_matches(pattern, filename, *options.glob_active, 0))
-        return false;
+  fn parse_or() throws -> u32
+  {
+    let left = parse_and();
+    while (m_index < m_args.count() && (peek() == "-o" || peek() == "-or")) {
+      let const op = peek();
+      m_index++;
+      expect_operand(op);
+      left = add(predicate_kind::Or, left, parse_and());
     }
+    return left;
   }
 
-  return true;
-}
+  fn parse_and() throws -> u32
+  {
+    let left = parse_not();
+    while (m_index < m_args.count()) {
+      let const next = peek();
+      if (next == "-o" || next == "-or" || next == ")") break;
+      if (next == "-a" || next == "-and") {
+        m_index++;
+        expect_operand(next);
+      }
+      left = add(predicate_kind::And, left, parse_not());
+    }
+    return left;
+  }
+
+  fn parse_not() throws -> u32
+  {
+    if (peek() == "!" || peek() == "-not") {
+      let const op = peek();
+      m_index++;
+      expect_operand(op);
+      return add(predicate_kind::Not, parse_not());
+    }
+    return parse_primary();
+  }
+
+  fn expect_operand(StringView op) throws -> void
+  {
+    if (m_index < m_args.count() && peek() != ")" && peek() != "-o" &&
+        peek() != "-a")
+      return;
+    throw Error{
+        "find: expected an expression after '" + String{m_allocator, op} + "'"
+    };
+  }
+
+  fn operand_of(StringView predicate) throws -> StringView
+  {
+    if (m_index >= m_args.count())
+      throw Error{
+          "find: " + String{m_allocator, predicate}
+            + " expects an argument"
+      };
+    return m_args[m_index++].view();
+  }
+
+  fn parse_primary() throws -> u32
+  {
+    let const predicate = m_args[m_index++].view();
+
+    if (predicate == ")") throw Error{"find: ')' without a matching '('"};
+    if (predicate == "(") {
+      if (m_index >= m_args.count() || peek() == ")")
+        throw Error{"find: expected an expression after '('"};
+      let const inner = parse_or();
+      if (m_index >= m_args.count() || peek() != ")")
+        throw Error{"find: '(' without a matching ')'"};
+      m_index++;
+      return inner;
+    }
+
+    if (predicate == "-print" || predicate == "-print0") {
+      m_has_action = true;
+      return add(predicate == "-print" ? predicate_kind::Print
+                                       : predicate_kind::Print0);
+    }
+    if (predicate == "-prune") return add(predicate_kind::Prune);
+
+    if (predicate == "-name" || predicate == "-iname") {
+      if (m_index >= m_args.count())
+        throw ErrorWithDetails{
+            "find: " + String{m_allocator, predicate}
+              + " expects a pattern",
+            "Pass a glob after `" + String{m_allocator, predicate} +
+                "`, e.g. `" + String{m_allocator, predicate} + " '*.c'`"
+        };
+      let const glob = m_args[m_index++].view();
+      m_program.patterns.push(
+          name_pattern::compile(glob, predicate == "-iname"));
+      let const index = add(predicate_kind::Name);
+      m_program.predicates[index].number =
+          static_cast<i64>(m_program.patterns.count() - 1);
+      return index;
+    }
+
+    if (predicate == "-type") return parse_type();
+    if (predicate == "-size") return parse_size();
+    if (predicate == "-mtime") {
+      let const index = add(predicate_kind::ModifiedDays);
+      let const operand = operand_of(predicate);
+      parse_count(predicate, operand, operand, m_program.predicates[index]);
+      return index;
+    }
+    if (predicate == "-newer") {
+      let const reference = operand_of(predicate);
+      os::file_status status{};
+      if (!os::stat_path(reference, status))
+        throw Error{
+            "find: cannot stat '" + String{m_allocator, reference}
+              + "': " + os::last_system_error_message()
+        };
+      let const index = add(predicate_kind::Newer);
+      m_program.predicates[index].seconds = status.modification_time;
+      m_program.predicates[index].nanoseconds = status.modification_nanoseconds;
+      return index;
+    }
+
+    if (predicate == "-maxdepth") {
+      m_program.max_depth = parse_depth(predicate);
+      return add(predicate_kind::True);
+    }
+    if (predicate == "-mindepth") {
+      m_program.min_depth = parse_depth(predicate);
+      return add(predicate_kind::True);
+    }
+    if (predicate == "-unordered") {
+      m_program.is_ordered = false;
+      return add(predicate_kind::True);
+    }
+    if (predicate == "-j" || (predicate.starts_with("-j") &&
+                              predicate.substring(2).is_all_decimal_digits()))
+    {
+      let const count =
+          predicate == "-j" ? operand_of(predicate) : predicate.substring(2);
+      m_program.job_count = parse_shitbox_job_count(
+          count, "find", MAX_SHITBOX_JOBS, m_allocator);
+      return add(predicate_kind::True);
+    }
+
+    throw Error{
+        "find: unknown predicate '" + String{m_allocator, predicate} + "'"
+    };
+  }
+
+  fn parse_type() throws -> u32
+  {
+    let const type_error = ErrorWithDetails{
+        "find: -type expects one of f, d, l, b, c, p, or s",
+        "Pass `f`, `d`, `l`, `b`, `c`, `p`, or `s` after `-type`, or several "
+        "joined with commas"
+    };
+    if (m_index >= m_args.count()) throw type_error;
+    let const letters = m_args[m_index++].view();
+
+    u8 mask = 0;
+    for (usize i = 0; i < letters.length; i++) {
+      if (i % 2 == 1) {
+        if (letters[i] != ',') throw type_error;
+        continue;
+      }
+      switch (letters[i]) {
+      case 'f': mask |= TYPE_FILE; break;
+      case 'd': mask |= TYPE_DIRECTORY; break;
+      case 'l': mask |= TYPE_SYMLINK; break;
+      case 'b': mask |= TYPE_BLOCK; break;
+      case 'c': mask |= TYPE_CHARACTER; break;
+      case 'p': mask |= TYPE_FIFO; break;
+      case 's': mask |= TYPE_SOCKET; break;
+      default: throw type_error;
+      }
+    }
+    if (mask == 0 || letters.length % 2 == 0) throw type_error;
+
+    let const index = add(predicate_kind::Type);
+    m_program.predicates[index].type_mask = mask;
+    return index;
+  }
+
+  /* The size rounds up to whole units, 512-byte blocks unless a suffix
+     names another unit, as POSIX find counts it. */
+  fn parse_size() throws -> u32
+  {
+    let const written = operand_of("-size");
+    let operand = written;
+    u64 unit = 512;
+    if (!operand.is_empty()) {
+      switch (operand[operand.length - 1]) {
+      case 'b': unit = 512; break;
+      case 'c': unit = 1; break;
+      case 'w': unit = 2; break;
+      case 'k': unit = 1024; break;
+      case 'M': unit = 1024 * 1024; break;
+      case 'G': unit = 1024 * 1024 * 1024; break;
+      default: unit = 0; break;
+      }
+      if (unit != 0)
+        operand = operand.substring_of_length(0, operand.length - 1);
+      else
+        unit = 512;
+    }
+    let const index = add(predicate_kind::Size);
+    m_program.predicates[index].unit = unit;
+    parse_count("-size", operand, written, m_program.predicates[index]);
+    return index;
+  }
+
+  /* A count with an optional sign. written is the operand as given, for the
+     error, before a unit suffix was taken off. */
+  fn parse_count(StringView predicate, StringView operand, StringView written,
+                 find_predicate &target) throws -> void
+  {
+    let digits = operand;
+    if (!digits.is_empty() && (digits[0] == '+' || digits[0] == '-')) {
+      target.comparison = digits[0] == '+' ? 1 : -1;
+      digits = digits.substring(1);
+    }
+    let const parsed = digits.to<i64>();
+    if (digits.is_empty() || !digits.is_all_decimal_digits() ||
+        parsed.is_error())
+      throw Error{
+          "find: " + String{m_allocator, predicate}
+            + " expects a number, got '" + String{m_allocator, written} + "'"
+      };
+    target.number = parsed.value();
+  }
+
+  fn parse_depth(StringView predicate) throws -> i64
+  {
+    if (m_index >= m_args.count())
+      throw Error{
+          "find: " + String{m_allocator, predicate}
+            + " expects a number"
+      };
+
+    /* A negative value is rejected rather than parsed, since max_depth carries
+       -1 as its no-limit sentinel, so a negative -maxdepth would otherwise read
+       as an unbounded walk rather than the error find gives. */
+    let const parsed_value = m_args[m_index].view().to<i64>();
+    if (parsed_value.is_error() || parsed_value.value() < 0) {
+      throw Error{
+          "find: " + String{m_allocator, predicate}
+            +
+          " expects a non-negative number, got '" + m_args[m_index] + "'"
+      };
+    }
+    m_index++;
+    return parsed_value.value();
+  }
+
+  const ArrayList<String> &m_args;
+  usize m_index;
+  find_program &m_program;
+  Allocator m_allocator;
+  bool m_has_action{false};
+};
 
-static fn find_walk(const ExecContext &ec, EvalContext &cxt, const Path &path,
-                    StringView display, usize depth,
-                    const find_options &options, String &output,
-                    i32 &exit_status, Allocator allocator) throws -> void
+/* An entry under test. The status is read the first time a test needs it, so
+   a walk that only looks at names and at the types the listing gives never
+   stats anything. */
+struct find_entry
 {
-  /* The stat reads the symlink, not its target, and a failed stat yields the
-     marker '\0' that matches no -type filter and is not descended. */
+  /* Null for a path named on the command line, which is stated by path. */
+  const os::DirectoryReference *parent;
+  StringView name;
+  StringView display;
+  Path::entry_kind kind;
+  bool is_pruned{false};
+  bool has_status{false};
+  bool has_failed_status{false};
   os::file_status status{};
-  const char type_letter = os::stat_path(path.text().view(), status)
-                               ? os::file_type_letter(status.mode)
-                               : '\0';
 
-  if (find_entry_matches(type_letter, path.filename(), depth, options)) {
-    output += display;
-    output += '\n';
+  fn ensure_status() throws -> bool
+  {
+    if (has_status || has_failed_status) return has_status;
+    has_status = parent != nullptr ? os::stat_at(*parent, name, status)
+                                   : os::stat_path(display, status);
+    has_failed_status = !has_status;
+    return has_status;
   }
 
-  const bool should_descend =
-      options.max_depth < 0 || static_cast<i64>(depth) < options.max_depth;
-  if (!should_descend || type_letter != 'd') {
-    return;
+  fn type_bits() throws -> u8
+  {
+    switch (kind) {
+    case Path::entry_kind::Directory: return TYPE_DIRECTORY;
+    case Path::entry_kind::Regular: return TYPE_FILE;
+    case Path::entry_kind::Symlink: return TYPE_SYMLINK;
+    default: break;
+    }
+    if (!ensure_status()) return 0;
+    switch (os::file_type_letter(status.mode)) {
+    case '-': return TYPE_FILE;
+    case 'd': return TYPE_DIRECTORY;
+    case 'l': return TYPE_SYMLINK;
+    case 'b': return TYPE_BLOCK;
+    case 'c': return TYPE_CHARACTER;
+    case 'p': return TYPE_FIFO;
+    case 's': return TYPE_SOCKET;
+    default: return 0;
+    }
   }
+};
 
-  Maybe<ArrayList<String>> names = Path::read_directory(path);
-  if (!names.has_value()) {
-    if (!path.is_readable()) {
-      report_soft_shitbox_error(ec, cxt,
-                                "find: '" + String{allocator, display} +
-                                    "': Permission denied");
-      exit_status = 1;
+struct find_node;
+
+/* Where a directory's output is spliced into its parent's: the output of a
+   directory a worker scanned, or an error to report in that place. */
+struct find_mark
+{
+  usize offset;
+  find_node *child;
+  String error;
+};
+
+struct find_node
+{
+  os::DirectoryReference dir{};
+  String display{heap_allocator()};
+  usize depth{0};
+  String output{heap_allocator()};
+  ArrayList<find_mark> marks{heap_allocator()};
+};
+
+struct listed_name
+{
+  u32 offset;
+  u32 length;
+  Path::entry_kind kind;
+};
+
+/* The walk names each entry through its directory's descriptor. Each
+   directory's entries are read and, unless -unordered, sorted, then visited
+   in that order. A directory found while the queue is short of the job count
+   becomes a node of its own for any worker to take, and a mark keeps its
+   place in its parent's output. Otherwise it is walked where it was found,
+   straight into the same output. Splicing the nodes back together once every
+   worker is done gives the output a walk of one directory at a time would,
+   and the errors in the same order. -unordered only skips the sort. */
+class tree_finder
+{
+public:
+  tree_finder(const find_program &program) wontthrow
+      : m_program(program),
+        m_now_seconds(
+            static_cast<i64>(os::realtime_microseconds() / 1000000ULL))
+  {}
+  tree_finder(const tree_finder &) = delete;
+  tree_finder &operator=(const tree_finder &) = delete;
+
+  /* The root must exist. */
+  fn walk(StringView root, find_node &top) throws -> void
+  {
+    let const root_path = Path{root};
+    top.display = String{heap_allocator(), root};
+    find_entry entry{nullptr, root_path.filename(), top.display.view(),
+                     Path::entry_kind::Unknown};
+    if (entry.ensure_status() && entry.type_bits() == TYPE_DIRECTORY)
+      entry.kind = Path::entry_kind::Directory;
+    visit(top, entry, top.display, 0);
+    if (m_pool.queued_count() == 0) return;
+    m_pool.run(m_program.job_count);
+  }
+
+  /* Splice the outputs together and report the errors, both in walk order. */
+  static fn emit(const ExecContext &ec, EvalContext &cxt, const find_node &node,
+                 String &output, i32 &status) throws -> void
+  {
+    usize cursor = 0;
+    for (let const &mark : node.marks) {
+      output += node.output.view().substring_of_length(cursor,
+                                                       mark.offset - cursor);
+      cursor = mark.offset;
+      if (mark.child != nullptr) {
+        emit(ec, cxt, *mark.child, output, status);
+      } else {
+        report_soft_shitbox_error(ec, cxt, mark.error.view());
+        status = 1;
+      }
     }
+    output += node.output.view().substring(cursor);
+  }
 
-    return;
+  static fn destroy(find_node &node) wontthrow -> void
+  {
+    for (let &mark : node.marks) {
+      if (mark.child == nullptr) continue;
+      destroy(*mark.child);
+      mark.child->~find_node();
+      heap_allocator().free_array(mark.child, 1);
+    }
+    node.marks.clear();
   }
-  sort_string_list(*names);
 
-  for (let const &child_name : *names) {
-    if (os::INTERRUPT_REQUESTED) return;
+private:
+  static fn run_job(opaque *raw_finder, find_node *&node) throws -> void
+  {
+    let display = node->display.clone();
+    static_cast<tree_finder *>(raw_finder)->scan(*node, node->dir, display,
+                                                 node->depth);
+    node->dir = os::DirectoryReference{};
+  }
 
-    String child_display{allocator, display};
-    if (!child_display.is_empty() && child_display.back() != '/') {
-      child_display += '/';
+  fn evaluate(u32 index, find_entry &entry, String &output) throws -> bool
+  {
+    let const &predicate = m_program.predicates[index];
+    switch (predicate.kind) {
+    case predicate_kind::True: return true;
+    case predicate_kind::And:
+      return evaluate(predicate.left, entry, output) &&
+             evaluate(predicate.right, entry, output);
+    case predicate_kind::Or:
+      return evaluate(predicate.left, entry, output) ||
+             evaluate(predicate.right, entry, output);
+    case predicate_kind::Not: return !evaluate(predicate.left, entry, output);
+    case predicate_kind::Name:
+      return m_program.patterns[static_cast<usize>(predicate.number)].matches(
+          entry.name);
+    case predicate_kind::Type:
+      return (entry.type_bits() & predicate.type_mask) != 0;
+    case predicate_kind::Size: {
+      if (!entry.ensure_status()) return false;
+      let const units = (entry.status.size + predicate.unit - 1) /
+                        predicate.unit;
+      return compare(static_cast<i64>(units), predicate);
+    }
+    case predicate_kind::ModifiedDays: {
+      if (!entry.ensure_status()) return false;
+      let const age = m_now_seconds - entry.status.modification_time;
+      let const days = age >= 0 ? age / 86400 : -((-age + 86399) / 86400);
+      return compare(days, predicate);
     }
-    child_display += child_name.view();
-    let const child_path = Path{child_display.view()};
-    find_walk(ec, cxt, child_path, child_display.view(), depth + 1, options,
-              output, exit_status, allocator);
+    case predicate_kind::Newer:
+      if (!entry.ensure_status()) return false;
+      return entry.status.modification_time > predicate.seconds ||
+             (entry.status.modification_time == predicate.seconds &&
+              entry.status.modification_nanoseconds > predicate.nanoseconds);
+    case predicate_kind::Prune: entry.is_pruned = true; return true;
+    case predicate_kind::Print:
+      output += entry.display;
+      output += '\n';
+      return true;
+    case predicate_kind::Print0:
+      output += entry.display;
+      output += '\0';
+      return true;
+    }
+    return false;
   }
-}
 
-static fn parse_depth_argument(const ArrayList<String> &args, usize index,
-                               StringView predicate, Allocator allocator) throws
-    -> i64
-{
-  if (index >= args.count())
-    throw Error{
-        "find: " + String{allocator, predicate}
-          + " expects a number"
-    };
+  static fn compare(i64 value, const find_predicate &predicate) wontthrow
+      -> bool
+  {
+    if (predicate.comparison > 0) return value > predicate.number;
+    if (predicate.comparison < 0) return value < predicate.number;
+    return value == predicate.number;
+  }
 
-  /* A negative value is rejected rather than parsed, since max_depth carries -1
-     as its no-limit sentinel, so a negative -maxdepth would otherwise read as
-     an unbounded walk rather than the error find gives. */
-  let const parsed_value = args[index].view().to<i64>();
-  if (parsed_value.is_error() || parsed_value.value() < 0) {
-    throw Error{
-        "find: " + String{allocator, predicate}
-          +
-        " expects a non-negative number, got '" + args[index] + "'"
+  /* Test the entry, then walk into it when it is a directory the depth limit,
+     a -prune and the listing all allow. display is the entry's path. */
+  fn visit(find_node &node, find_entry &entry, String &display, usize depth)
+      throws -> void
+  {
+    if (static_cast<i64>(depth) >= m_program.min_depth)
+      evaluate(m_program.root, entry, node.output);
+
+    if (m_program.max_depth >= 0 &&
+        static_cast<i64>(depth) >= m_program.max_depth)
+      return;
+    if (entry.is_pruned) return;
+    if (entry.kind == Path::entry_kind::Unknown)
+      if (entry.type_bits() == TYPE_DIRECTORY)
+        entry.kind = Path::entry_kind::Directory;
+    if (entry.kind != Path::entry_kind::Directory) return;
+
+    let child = entry.parent != nullptr
+                    ? os::open_directory_at(*entry.parent, entry.name)
+                    : os::open_directory(display.view());
+    if (!child.is_valid()) return record_error(node, display.view());
+
+    if (m_program.job_count > 1 &&
+        m_pool.queued_count() < m_program.job_count)
+    {
+      let *queued = heap_allocator().alloc_array<find_node>(1);
+      new (queued) find_node{};
+      queued->dir = steal(child);
+      queued->display = display.clone();
+      queued->depth = depth + 1;
+      node.marks.push(find_mark{node.output.length(), queued,
+                                String{heap_allocator()}});
+      m_pool.push(queued);
+      return;
+    }
+    scan(node, child, display, depth + 1);
+  }
+
+  fn record_error(find_node &node, StringView display) throws -> void
+  {
+    let error = String{heap_allocator(), "find: '"};
+    error += display;
+    error += "': ";
+    error += os::last_system_error_message();
+    node.marks.push(find_mark{node.output.length(), nullptr, steal(error)});
+  }
+
+  /* Visit every entry of the directory whose path is display. */
+  fn scan(find_node &node, const os::DirectoryReference &dir, String &display,
+          usize depth) throws -> void
+  {
+    let const base_length = display.length();
+    let const needs_separator = !display.is_empty() && display.back() != '/';
+
+    os::DirectoryStream stream{};
+    if (!stream.open(dir)) return record_error(node, display.view());
+
+    if (!m_program.is_ordered) {
+      loop
+      {
+        let const listed = stream.next();
+        if (!listed.has_value() || os::INTERRUPT_REQUESTED) break;
+        visit_child(node, dir, display, base_length, needs_separator,
+                    listed->name, listed->kind, depth);
+      }
+      if (stream.has_failed()) record_error(node, display.view());
+      return;
+    }
+
+    /* The names share one buffer, so a directory costs two allocations and
+       not one per entry. */
+    let names = String{heap_allocator()};
+    let listing = ArrayList<listed_name>{heap_allocator()};
+    loop
+    {
+      let const listed = stream.next();
+      if (!listed.has_value()) break;
+      listing.push(listed_name{static_cast<u32>(names.length()),
+                               static_cast<u32>(listed->name.length),
+                               listed->kind});
+      names.append(listed->name);
+    }
+    if (stream.has_failed()) return record_error(node, display.view());
+
+    let const name_of = [&](const listed_name &l) wontthrow -> StringView {
+      return names.view().substring_of_length(l.offset, l.length);
     };
+    listing.sort([&](const listed_name &a, const listed_name &b) {
+      return name_of(a) < name_of(b);
+    });
+
+    for (let const &l : listing) {
+      if (os::INTERRUPT_REQUESTED) return;
+      visit_child(node, dir, display, base_length, needs_separator, name_of(l),
+                  l.kind, depth);
+    }
   }
 
-  return parsed_value.value();
-}
+  fn visit_child(find_node &node, const os::DirectoryReference &dir,
+                 String &display, usize base_length, bool needs_separator,
+                 StringView name, Path::entry_kind kind, usize depth) throws
+      -> void
+  {
+    display.truncate(base_length);
+    if (needs_separator) display += '/';
+    display += name;
+    find_entry entry{&dir, name, display.view(), kind};
+    visit(node, entry, display, depth);
+    display.truncate(base_length);
+  }
+
+  const find_program &m_program;
+  i64 m_now_seconds;
+
+  directory_job_pool<find_node *> m_pool{run_job, this};
+};
 
 Find::Find() = default;
 
@@ -146,93 +753,45 @@ fn Find::execute(const ExecContext &ec, EvalContext &cxt,
                  const ArrayList<SourceLocation> &arg_locations) const throws
     -> i32
 {
-  unused(cxt);
   unused(arg_locations);
 
-  ArrayList<StringView> roots{cxt.scratch_allocator()};
-  ArrayList<StringView> name_patterns{cxt.scratch_allocator()};
-  find_options options{};
-  Bitset name_glob_active{cxt.scratch_allocator()};
+  for (usize i = 1; i < args.count(); i++) {
+    if (args[i] == "--help") {
+      print_util_help(ec, args[0].view(), HELP_SYNOPSIS[0], HELP_DESCRIPTION,
+                      FLAG_LIST);
+      return 0;
+    }
+  }
 
   /* The flag parser is bypassed, a predicate such as -name is not a
      single-letter flag bundle. An empty argument is a start path, not a
      predicate, so it is collected as a root. */
+  ArrayList<StringView> roots{cxt.scratch_allocator()};
   usize index = 1;
   while (index < args.count()) {
     let const start_argument = args[index].view();
-    if (!start_argument.is_empty() && start_argument[0] == '-') break;
+    if (!start_argument.is_empty() &&
+        (start_argument[0] == '-' || start_argument == "(" ||
+         start_argument == ")" || start_argument == "!"))
+      break;
 
     roots.push(start_argument);
     index++;
   }
 
-  for (; index < args.count(); index++) {
-    let const predicate = args[index].view();
-    if (predicate == "--help") {
-      print_util_help(ec, args[0].view(), HELP_SYNOPSIS[0], HELP_DESCRIPTION,
-                      FLAG_LIST);
-      return 0;
-    } else if (predicate == "-print") {
-      /* The walk prints every matched entry already, so -print is the default
-         and needs no action. */
-    } else if (predicate == "-name") {
-      if (index + 1 >= args.count())
-        throw ErrorWithDetails{"find: -name expects a pattern",
-                               "Pass a glob after `-name`, e.g. `-name '*.c'`"};
-      name_patterns.push(args[index + 1].view());
-      index++;
-    } else if (predicate == "-type") {
-      if (index + 1 >= args.count())
-        throw ErrorWithDetails{"find: -type expects one of f, d, or l",
-                               "Pass `f`, `d`, or `l` after `-type`"};
-      let const type = args[index + 1].view();
-      if (type.length != 1 ||
-          (type[0] != 'f' && type[0] != 'd' && type[0] != 'l'))
-      {
-        throw ErrorWithDetails{"find: -type expects one of f, d, or l",
-                               "Pass `f`, `d`, or `l` after `-type`"};
-      }
-      options.type_filter = type[0];
-      index++;
-    } else if (predicate == "-maxdepth") {
-      options.max_depth = parse_depth_argument(args, index + 1, predicate,
-                                               cxt.scratch_allocator());
-      index++;
-    } else if (predicate == "-mindepth") {
-      options.min_depth = parse_depth_argument(args, index + 1, predicate,
-                                               cxt.scratch_allocator());
-      index++;
-    } else {
-      throw Error{
-          "find: unknown predicate '" +
-          String{cxt.scratch_allocator(), predicate}
-          + "'"
-      };
-    }
-  }
-
-  if (!name_patterns.is_empty()) {
-    usize longest_pattern_length = 0;
-    for (let const &pattern : name_patterns) {
-      if (pattern.length > longest_pattern_length)
-        longest_pattern_length = pattern.length;
-    }
-
-    name_glob_active.reserve(longest_pattern_length);
-    for (usize i = 0; i < longest_pattern_length; i++)
-      name_glob_active.push(true);
-
-    options.name_patterns = &name_patterns;
-    options.glob_active = &name_glob_active;
-  }
+  find_program program{};
+  program.job_count = os::get_processor_counts().online_count;
+  find_parser{args, index, program, cxt.scratch_allocator()}.parse();
+  if (program.job_count > MAX_SHITBOX_JOBS)
+    program.job_count = MAX_SHITBOX_JOBS;
 
   if (roots.is_empty()) roots.push(StringView{"."});
 
   let output = String{cxt.scratch_allocator()};
   i32 status = 0;
+  let finder = tree_finder{program};
   for (let const &root : roots) {
-    let const root_path = Path{root};
-    if (!root_path.exists()) {
+    if (!Path{root}.exists()) {
       report_soft_shitbox_error(ec, cxt,
                                 "find: '" +
                                     String{cxt.scratch_allocator(), root} +
@@ -240,8 +799,12 @@ fn Find::execute(const ExecContext &ec, EvalContext &cxt,
       status = 1;
       continue;
     }
-    find_walk(ec, cxt, root_path, root, 0, options, output, status,
-              cxt.scratch_allocator());
+
+    find_node top{};
+    defer { tree_finder::destroy(top); };
+    finder.walk(root, top);
+    if (os::INTERRUPT_REQUESTED) return 130;
+    tree_finder::emit(ec, cxt, top, output, status);
   }
 
   ec.print_to_stdout(output);
@@ -62,39 +62,48 @@ fn Grep::execute(const ExecContext &ec, EvalContext &cxt,
       sources.push(operands[i].view());
 
   let const should_print_names = sources.count() > 1;
-  let output = String{cxt.scratch_allocator()};
+  let writer = text_writer{ec};
+  let reader = text_reader{};
   bool has_any_match = false;
   i32 status = 0;
   for (let const &source : sources) {
-    let const content = read_named_or_stdin(ec, source);
-    if (os::INTERRUPT_REQUESTED) return 130;
-    if (!content.has_value()) {
-      report_soft_shitbox_error(
-          ec, cxt,
-          "grep: " + String{cxt.scratch_allocator(), source} + ": " +
-              os::last_system_error_message());
-      status = 2;
-      continue;
-    }
+    let is_read = reader.open(ec, source);
     let const display_name =
         source == "-" ? StringView{"(standard input)"} : source;
-    for (let const &line : split_keep_newlines(content->view())) {
-      let const body = line.without_trailing_newline();
-      let const has_newline = body.length != line.length;
+    while (is_read) {
+      let const line = reader.next_line();
+      if (!line.has_value()) {
+        is_read = false;
+        break;
+      }
+      if (line->is_empty()) break;
+
+      let const body = line->without_trailing_newline();
+      let const has_newline = body.length != line->length;
       let const is_match = os::regex_matches(compiled, body);
       if (is_match == should_invert) continue;
 
       has_any_match = true;
       if (should_print_names) {
-        output += display_name;
-        output += ':';
+        writer.write(display_name);
+        writer.write(':');
       }
-      output += line;
-      if (!has_newline) output += '\n';
+      writer.write(*line);
+      if (!has_newline) writer.write('\n');
+    }
+    reader.close();
+    if (os::INTERRUPT_REQUESTED) return 130;
+    if (!is_read) {
+      writer.flush();
+      report_soft_shitbox_error(
+          ec, cxt,
+          "grep: " + String{cxt.scratch_allocator(), source} + ": " +
+              os::last_system_error_message());
+      status = 2;
     }
   }
 
-  ec.print_to_stdout(output);
+  writer.flush();
   if (status == 2) return 2;
 
   return has_any_match ? 0 : 1;
@@ -21,92 +21,102 @@ namespace shit {
 
 namespace shitbox {
 
-/* Stopping at max_lines keeps an endless producer such as yes from running
-   forever, since reading to the end would never return. */
-static fn read_up_to_lines(os::descriptor fd, i64 max_lines,
-                           Allocator allocator) throws -> Maybe<String>
+/* Each helper returns false when a read fails. Stopping at max_lines keeps an
+   endless producer such as yes from running forever, since reading to the end
+   would never return. */
+static fn write_first_lines(text_writer &writer, text_reader &reader,
+                            i64 max_lines) throws -> bool
 {
-  String out{allocator};
   i64 line_count = 0;
-  char buffer[4096];
   while (line_count < max_lines) {
-    if (os::INTERRUPT_REQUESTED) break;
-    let const read_count = os::read_fd(fd, buffer, sizeof(buffer));
-    if (!read_count.has_value()) return None;
-    if (*read_count == 0) break;
+    let const chunk = reader.next_chunk();
+    if (!chunk.has_value()) return false;
+    if (chunk->is_empty()) break;
     usize span_length = 0;
-    while (span_length < *read_count && line_count < max_lines) {
-      if (buffer[span_length] == '\n') line_count++;
-      span_length++;
+    while (span_length < chunk->length && line_count < max_lines) {
+      let const *newline = static_cast<const char *>(__builtin_memchr(
+          chunk->data + span_length, '\n', chunk->length - span_length));
+      if (newline == nullptr) {
+        span_length = chunk->length;
+        break;
+      }
+      span_length = static_cast<usize>(newline - chunk->data) + 1;
+      line_count++;
     }
-    out.append(StringView{buffer, span_length});
+    writer.write(chunk->substring_of_length(0, span_length));
   }
 
-  return out;
+  return true;
 }
 
-static fn read_up_to_bytes(os::descriptor fd, i64 max_bytes,
-                           Allocator allocator) throws -> Maybe<String>
+static fn write_first_bytes(text_writer &writer, text_reader &reader,
+                            i64 max_bytes) throws -> bool
 {
-  String out{allocator};
   i64 byte_count = 0;
-  char buffer[4096];
   while (byte_count < max_bytes) {
-    if (os::INTERRUPT_REQUESTED) break;
-    let const read_count = os::read_fd(fd, buffer, sizeof(buffer));
-    if (!read_count.has_value()) return None;
-    if (*read_count == 0) break;
+    let const chunk = reader.next_chunk();
+    if (!chunk.has_value()) return false;
+    if (chunk->is_empty()) break;
     let const remaining_count = static_cast<usize>(max_bytes - byte_count);
     let const take_count =
-        *read_count < remaining_count ? *read_count : remaining_count;
-    out.append(StringView{buffer, take_count});
+        chunk->length < remaining_count ? chunk->length : remaining_count;
+    writer.write(chunk->substring_of_length(0, take_count));
     byte_count += static_cast<i64>(take_count);
   }
 
-  return out;
-}
-
-static fn read_all(os::descriptor fd, Allocator allocator) throws
-    -> Maybe<String>
-{
-  if (os::INTERRUPT_REQUESTED) return String{allocator};
-  return os::read_fd_to_string(fd, allocator);
+  return true;
 }
 
-static fn line_prefix_length_dropping_last(StringView text,
-                                           i64 drop_count) wontthrow -> usize
+/* The last drop_count lines wait in a ring of their own copies, and a line
+   goes out once as many lines have come after it. */
+static fn write_all_but_last_lines(text_writer &writer, text_reader &reader,
+                                   i64 drop_count) throws -> bool
 {
-  i64 total_line_count = 0;
-  for (usize i = 0; i < text.length; i++) {
-    if (text[i] == '\n') total_line_count++;
-  }
-
-  if (text.length > 0 && text[text.length - 1] != '\n') {
-    total_line_count++;
-  }
-
-  let const keep_count = total_line_count - drop_count;
-  if (keep_count <= 0) return 0;
-
-  i64 lines_seen = 0;
-  for (usize i = 0; i < text.length; i++) {
-    if (text[i] == '\n') {
-      lines_seen++;
-      if (lines_seen == keep_count) return i + 1;
+  if (drop_count <= 0) return write_first_bytes(writer, reader, INT64_MAX);
+
+  let held = ArrayList<String>{heap_allocator()};
+  usize oldest = 0;
+  loop
+  {
+    let const line = reader.next_line();
+    if (!line.has_value()) return false;
+    if (line->is_empty()) return true;
+    if (static_cast<i64>(held.count()) < drop_count) {
+      held.push(String{heap_allocator(), *line});
+      continue;
     }
+    writer.write(held[oldest].view());
+    held[oldest].clear();
+    held[oldest].append(*line);
+    oldest = (oldest + 1) % held.count();
   }
-
-  return text.length;
 }
 
-static fn byte_prefix_length_dropping_last(StringView text,
-                                           i64 drop_count) wontthrow -> usize
+/* The held bytes are cut back to the last drop_count only once they reach
+   twice that, so each byte is moved a bounded number of times. */
+static fn write_all_but_last_bytes(text_writer &writer, text_reader &reader,
+                                   i64 drop_count) throws -> bool
 {
-  let const total_length = static_cast<i64>(text.length);
-  let const keep_length = total_length - drop_count;
-  if (keep_length <= 0) return 0;
+  if (drop_count <= 0) return write_first_bytes(writer, reader, INT64_MAX);
+
+  let const kept_count = static_cast<usize>(drop_count);
+  let held = String{heap_allocator()};
+  loop
+  {
+    let const chunk = reader.next_chunk();
+    if (!chunk.has_value()) return false;
+    if (chunk->is_empty()) break;
+    held.append(*chunk);
+    if (held.count() < 2 * kept_count + TEXT_CHUNK_SIZE) continue;
+
+    let const released_count = held.count() - kept_count;
+    writer.write(held.view().substring_of_length(0, released_count));
+    held = String{heap_allocator(), held.view().substring(released_count)};
+  }
 
-  return static_cast<usize>(keep_length);
+  writer.write(
+      held.view().substring_of_length(0, sub_sat(held.count(), kept_count)));
+  return true;
 }
 
 Head::Head() = default;
@@ -163,69 +173,49 @@ fn Head::execute(const ExecContext &ec, EvalContext &cxt,
       source_list_from_operands(operands, cxt.scratch_allocator());
 
   let const should_print_headers = sources.count() > 1;
+  let writer = text_writer{ec};
+  let reader = text_reader{};
   i32 status = 0;
   for (usize source_index = 0; source_index < sources.count(); source_index++) {
-    os::descriptor fd;
-    bool was_opened = false;
-    if (sources[source_index] == "-") {
-      fd = ec.in_fd.value_or(SHIT_STDIN);
-    } else {
-      let const opened_fd = os::open_file_descriptor(sources[source_index],
-                                                     os::file_open_mode::Read);
-      if (!opened_fd.has_value()) {
-        report_soft_shitbox_error(
-            ec, cxt,
-            "head: cannot open '" +
-                String{cxt.scratch_allocator(), sources[source_index]} +
-                "': " + os::last_system_error_message());
-        status = 1;
-        continue;
-      }
-      fd = *opened_fd;
-      was_opened = true;
+    if (!reader.open(ec, sources[source_index])) {
+      writer.flush();
+      report_soft_shitbox_error(
+          ec, cxt,
+          "head: cannot open '" +
+              String{cxt.scratch_allocator(), sources[source_index]} +
+              "': " + os::last_system_error_message());
+      status = 1;
+      continue;
     }
 
-    let text = Maybe<String>{};
-    if (is_all_but_last) {
-      let const whole = read_all(fd, cxt.scratch_allocator());
-      if (whole.has_value()) {
-        let const keep_length =
-            is_byte_mode
-                ? byte_prefix_length_dropping_last(whole->view(), count)
-                : line_prefix_length_dropping_last(whole->view(), count);
-        text = String{cxt.scratch_allocator(),
-                      whole->view().substring_of_length(0, keep_length)};
-      }
-    } else {
-      text = is_byte_mode
-                 ? read_up_to_bytes(fd, count, cxt.scratch_allocator())
-                 : read_up_to_lines(fd, count, cxt.scratch_allocator());
+    if (should_print_headers) {
+      if (source_index > 0) writer.write('\n');
+      writer.write("==> ");
+      writer.write(sources[source_index]);
+      writer.write(" <==\n");
     }
 
-    if (was_opened) os::close_fd(fd);
+    let const is_read =
+        is_all_but_last
+            ? (is_byte_mode ? write_all_but_last_bytes(writer, reader, count)
+                            : write_all_but_last_lines(writer, reader, count))
+            : (is_byte_mode ? write_first_bytes(writer, reader, count)
+                            : write_first_lines(writer, reader, count));
+    reader.close();
     /* A Ctrl-C during the read returns 130 rather than freezing the utility. */
     if (os::INTERRUPT_REQUESTED) return 130;
-    if (!text.has_value()) {
+    if (!is_read) {
+      writer.flush();
       report_soft_shitbox_error(
           ec, cxt,
           "head: cannot read '" +
               String{cxt.scratch_allocator(), sources[source_index]} +
               "': " + os::last_system_error_message());
       status = 1;
-      continue;
-    }
-
-    let output = String{cxt.scratch_allocator()};
-    if (should_print_headers) {
-      if (source_index > 0) output += '\n';
-      output += "==> ";
-      output += sources[source_index];
-      output += " <==\n";
     }
-    output += text->view();
-    ec.print_to_stdout(output);
   }
 
+  writer.flush();
   return status;
 }
 
@@ -4,11 +4,13 @@
 #include "../Path.hpp"
 #include "../Platform.hpp"
 #include "../Shitbox.hpp"
+#include "../Trace.hpp"
 #include "../Utils.hpp"
 
 FLAG_LIST_DECL();
 
-HELP_SYNOPSIS_DECL("[-f file] [target ...]");
+HELP_SYNOPSIS_DECL(
+    "[-j [jobs]] [-l load] [-k] [--debug=time] [-f file] [target ...]");
 
 HELP_DESCRIPTION_DECL(
     "The make utility runs the recipe of each requested target.");
@@ -20,7 +22,15 @@ FLAG(MAKE_DIR, String, 'C', "directory",
 FLAG(MAKE_ALWAYS_MAKE, Bool, 'B', "always-make",
      "Rebuild every target unconditionally.");
 FLAG(MAKE_KEEP_GOING, Bool, 'k', "keep-going",
-     "Keep going after a target fails.");
+     "Keep building the targets that do not depend on a failed one.");
+/* -j takes an optional count, which the flag parser cannot express, so execute
+   reads it before parsing and this entry only documents it. */
+FLAG(MAKE_JOBS, String, 'j', "jobs",
+     "Run this many recipes at once, one per processor without a count.");
+FLAG(MAKE_LOAD_AVERAGE, String, 'l', "load-average",
+     "Start no new job while the load average is at least this.");
+FLAG(MAKE_DEBUG, String, '\0', "debug",
+     "Report what the build did, time for how long each phase took.");
 FLAG(HELP, Bool, '\0', "help", "Display help.");
 
 REGISTER_SHITBOX_UTIL_FLAGS(Make);
@@ -67,11 +77,22 @@ struct make_rule
   ArrayList<String> variable_assignments;
 };
 
+/* The pattern rules whose text after the % is the same, in file order. */
+struct make_pattern_bucket
+{
+  explicit make_pattern_bucket(Allocator allocator)
+      : suffix(allocator), rule_indexes(allocator)
+  {}
+  String suffix;
+  ArrayList<usize> rule_indexes;
+};
+
 struct makefile
 {
   explicit makefile(Allocator allocator)
       : variables(allocator), rules(allocator), pattern_rules(allocator),
-        default_goal(allocator), variable_index(allocator)
+        default_goal(allocator), variable_index(allocator),
+        rule_index(allocator), pattern_buckets(allocator)
   {}
   ArrayList<make_variable> variables;
   ArrayList<make_rule> rules;
@@ -81,6 +102,11 @@ struct makefile
    */
   String default_goal;
   StringMap<usize> variable_index;
+  /* The first rule of each target, the one a lookup finds. */
+  StringMap<usize> rule_index;
+  /* A goal only has to try the patterns whose suffix it ends with, and a
+     makefile has few distinct suffixes, so the buckets are scanned whole. */
+  ArrayList<make_pattern_bucket> pattern_buckets;
 
   fn find_variable(StringView name) const throws -> const String *
   {
@@ -91,17 +117,61 @@ struct makefile
 
   fn find_rule(StringView target) const throws -> const make_rule *
   {
-    for (const make_rule &rule : rules)
-      if (rule.target == target) return &rule;
+    if (let const *index = rule_index.find(target)) return &rules[*index];
     return nullptr;
   }
 
   fn find_mutable_rule(StringView target) throws -> make_rule *
   {
-    for (make_rule &rule : rules)
-      if (rule.target == target) return &rule;
+    if (let const *index = rule_index.find(target)) return &rules[*index];
     return nullptr;
   }
+
+  fn add_rule(make_rule &&rule) throws -> make_rule *
+  {
+    if (rule_index.find(rule.target.view()) == nullptr)
+      rule_index.set(rule.target.view(), rules.count());
+    rules.push(steal(rule));
+    return &rules[rules.count() - 1];
+  }
+
+  fn add_pattern_rule(make_rule &&rule) throws -> make_rule *
+  {
+    let const target = rule.target.view();
+    let const suffix = target.substring(*target.find_character('%') + 1);
+    make_pattern_bucket *bucket = nullptr;
+    for (make_pattern_bucket &candidate : pattern_buckets)
+      if (candidate.suffix == suffix) {
+        bucket = &candidate;
+        break;
+      }
+    if (bucket == nullptr) {
+      make_pattern_bucket fresh{pattern_buckets.allocator()};
+      fresh.suffix = String{pattern_buckets.allocator(), suffix};
+      pattern_buckets.push(steal(fresh));
+      bucket = &pattern_buckets[pattern_buckets.count() - 1];
+    }
+    bucket->rule_indexes.push(pattern_rules.count());
+    pattern_rules.push(steal(rule));
+    return &pattern_rules[pattern_rules.count() - 1];
+  }
+
+  /* The pattern rules that can match the goal, in file order. */
+  fn candidate_pattern_rules(StringView goal, ArrayList<usize> &out) const
+      throws -> void
+  {
+    usize matched_buckets = 0;
+    for (const make_pattern_bucket &bucket : pattern_buckets) {
+      if (goal.length < bucket.suffix.length() ||
+          goal.substring(goal.length - bucket.suffix.length()) !=
+              bucket.suffix.view())
+        continue;
+      for (let const index : bucket.rule_indexes)
+        out.push(index);
+      matched_buckets++;
+    }
+    if (matched_buckets > 1) out.sort();
+  }
 };
 
 static fn match_pattern(StringView pattern, StringView goal,
@@ -404,6 +474,20 @@ static fn is_target_variable_assignment(StringView after_colon) wontthrow
   return true;
 }
 
+static fn store_variable(EvalContext &cxt, makefile &mk, StringView name,
+                         StringView value) throws -> void
+{
+  if (let const *index = mk.variable_index.find(name); index != nullptr) {
+    mk.variables[*index].value = String{cxt.scratch_allocator(), value};
+    return;
+  }
+  mk.variable_index.set(name, mk.variables.count());
+  mk.variables.push(make_variable{
+      String{cxt.scratch_allocator(), name },
+      String{cxt.scratch_allocator(), value}
+  });
+}
+
 static fn apply_assignment(EvalContext &cxt, makefile &mk, StringView name_part,
                            StringView operator_and_value) throws -> void
 {
@@ -439,16 +523,10 @@ static fn apply_assignment(EvalContext &cxt, makefile &mk, StringView name_part,
     if (operator_character == '+') {
       variable.value += " ";
       variable.value += value_to_store.view();
-    } else {
-      variable.value = String{cxt.scratch_allocator(), value_to_store.view()};
+      return;
     }
-    return;
   }
-  mk.variable_index.set(name, mk.variables.count());
-  mk.variables.push(make_variable{
-      String{cxt.scratch_allocator(), name                 },
-      String{cxt.scratch_allocator(), value_to_store.view()}
-  });
+  store_variable(cxt, mk, name, value_to_store.view());
 }
 
 /* An odd run of trailing backslashes continues the line, a doubled \\ is a
@@ -692,8 +770,7 @@ static fn parse_makefile(EvalContext &cxt, StringView source) throws -> makefile
           if (rule == nullptr) {
             make_rule fresh{cxt.scratch_allocator()};
             fresh.target = target.clone();
-            mk.rules.push(steal(fresh));
-            rule = &mk.rules[mk.rules.count() - 1];
+            rule = mk.add_rule(steal(fresh));
           }
           rule->variable_assignments.push(
               String{cxt.scratch_allocator(), trim(after_colon)});
@@ -732,13 +809,10 @@ static fn parse_makefile(EvalContext &cxt, StringView source) throws -> makefile
         make_rule rule{cxt.scratch_allocator()};
         rule.target = target.clone();
         rule.prerequisites = steal(new_prerequisites);
-        if (target.view().find_character('%').has_value()) {
-          mk.pattern_rules.push(steal(rule));
-          current = &mk.pattern_rules[mk.pattern_rules.count() - 1];
-        } else {
-          mk.rules.push(steal(rule));
-          current = &mk.rules[mk.rules.count() - 1];
-        }
+        if (target.view().find_character('%').has_value())
+          current = mk.add_pattern_rule(steal(rule));
+        else
+          current = mk.add_rule(steal(rule));
       }
       continue;
     }
@@ -759,18 +833,166 @@ struct saved_make_variable
   String old_value;
 };
 
-static fn build_target(const ExecContext &ec, EvalContext &cxt, makefile &mk,
-                       StringView goal, ArrayList<String> &visiting,
-                       ArrayList<String> &built) throws -> void
+/* The saved values restore in reverse so a repeated += unwinds cleanly. */
+static fn restore_variables(EvalContext &cxt, makefile &mk,
+                            const ArrayList<saved_make_variable> &saved) throws
+    -> void
+{
+  for (usize i = saved.count(); i-- > 0;) {
+    const saved_make_variable &snapshot = saved[i];
+    if (snapshot.was_present) {
+      if (let const *index = mk.variable_index.find(snapshot.name.view());
+          index != nullptr)
+        mk.variables[*index].value =
+            String{cxt.scratch_allocator(), snapshot.old_value.view()};
+    } else {
+      /* A variable the assignment created is unset again, not left empty, so
+         a later ?= still applies its default. */
+      mk.variable_index.erase(snapshot.name.view());
+    }
+  }
+}
+
+static fn save_variable(EvalContext &cxt, const makefile &mk, StringView name,
+                        ArrayList<saved_make_variable> &saved) throws -> void
+{
+  saved_make_variable snapshot{
+      String{cxt.scratch_allocator(), name},
+      false,
+      String{cxt.scratch_allocator()}
+  };
+  if (const String *current_value = mk.find_variable(name);
+      current_value != nullptr)
+  {
+    snapshot.was_present = true;
+    snapshot.old_value = String{cxt.scratch_allocator(), current_value->view()};
+  }
+  saved.push(steal(snapshot));
+}
+
+enum class make_node_state : u8
+{
+  Waiting,
+  Running,
+  Built,
+  Failed,
+};
+
+/* A target of the build plan. The walk lays the nodes out in the order the
+   serial build runs them, every node after its prerequisites. */
+struct make_node
+{
+  explicit make_node(Allocator allocator)
+      : goal(allocator), first_prerequisite(allocator),
+        all_prerequisites(allocator), stem(allocator), variables(allocator),
+        dependents(allocator), failure(allocator)
+  {}
+  String goal;
+  /* Null for a target with no rule, which only has to exist as a file once the
+     build reaches it. */
+  const ArrayList<String> *recipe_lines{nullptr};
+  String first_prerequisite;
+  String all_prerequisites;
+  String stem;
+  /* The values the target-specific assignments gave where the walk first
+     reached the target, its own and the ones it inherits, set again around the
+     recipe so a later expansion sees them without rerunning a := value. */
+  ArrayList<make_variable> variables;
+  ArrayList<usize> dependents;
+  /* The error the walk met at the target, raised once the build reaches it. */
+  String failure;
+  usize pending_count{0};
+  make_node_state state{make_node_state::Waiting};
+  bool has_failed_prerequisite{false};
+  os::process child{SHIT_INVALID_PROCESS};
+  /* The read end of the pipe the job hands its failure back through. */
+  os::descriptor failure_reader{SHIT_INVALID_FD};
+  Maybe<char> token{};
+};
+
+struct make_file_status
+{
+  /* None when the file does not exist. */
+  Maybe<i64> modification_time;
+  /* The recipe count when the file was looked at. */
+  usize recipe_generation;
+};
+
+/* The files the build looked at, so a name the walk and the build ask about
+   again is stat'ed once. A recipe can only be trusted to write its own target,
+   which is dropped when the recipe ends, but it may create any other file
+   too, so a missing file is looked at again once another recipe has run. */
+struct make_file_cache
+{
+  explicit make_file_cache(Allocator allocator) : files(allocator) {}
+  StringMap<make_file_status> files;
+  usize recipe_generation{0};
+
+  fn exists(StringView path) throws -> bool
+  {
+    if (let const *status = files.find(path);
+        status != nullptr && (status->modification_time.has_value() ||
+                              status->recipe_generation == recipe_generation))
+      return status->modification_time.has_value();
+    let const modification_time = Path{path}.modification_time();
+    files.set(path, make_file_status{modification_time, recipe_generation});
+    return modification_time.has_value();
+  }
+
+  fn forget_target(StringView target) throws -> void
+  {
+    files.erase(target);
+    recipe_generation++;
+  }
+};
+
+struct make_plan
+{
+  explicit make_plan(Allocator allocator)
+      : nodes(allocator), node_index(allocator), visiting(allocator),
+        assignment_scopes(allocator), file_cache(allocator)
+  {}
+  ArrayList<make_node> nodes;
+  StringMap<usize> node_index;
+  ArrayList<String> visiting;
+  /* The target-specific assignments in force at this point of the walk,
+     outermost first. */
+  ArrayList<const ArrayList<String> *> assignment_scopes;
+  make_file_cache file_cache;
+};
+
+static fn add_node(make_plan &plan, make_node &&node,
+                   const ArrayList<usize> &dependencies, bool is_indexed) throws
+    -> usize
+{
+  let const position = plan.nodes.count();
+  for (let const dependency : dependencies) {
+    plan.nodes[dependency].dependents.push(position);
+    node.pending_count++;
+  }
+  if (is_indexed) plan.node_index.set(node.goal.view(), position);
+  plan.nodes.push(steal(node));
+  return position;
+}
+
+/* Walk the prerequisites the way the serial build always has, expanding each
+   rule's prerequisites with the target-specific assignments of the targets
+   above it in force, but record the targets instead of running them. */
+static fn plan_target(EvalContext &cxt, makefile &mk, make_plan &plan,
+                      StringView goal) throws -> usize
 {
-  if (built.find(goal).has_value()) return;
+  if (let const *index = plan.node_index.find(goal); index != nullptr)
+    return *index;
 
-  if (visiting.find(goal).has_value())
-    throw Error{
-        "The target '" + String{cxt.scratch_allocator(), goal}
-          +
-        "' is part of a dependency cycle"
-    };
+  make_node node{cxt.scratch_allocator()};
+  node.goal = String{cxt.scratch_allocator(), goal};
+  let const no_dependencies = ArrayList<usize>{cxt.scratch_allocator()};
+
+  if (plan.visiting.find(goal).has_value()) {
+    node.failure = "The target '" + String{cxt.scratch_allocator(), goal} +
+                   "' is part of a dependency cycle";
+    return add_node(plan, steal(node), no_dependencies, false);
+  }
 
   const ArrayList<String> *recipe_lines = nullptr;
   ArrayList<String> prerequisites{cxt.scratch_allocator()};
@@ -787,7 +1009,10 @@ static fn build_target(const ExecContext &ec, EvalContext &cxt, makefile &mk,
     recipe_lines = &rule->recipe_lines;
     target_assignments = &rule->variable_assignments;
   } else {
-    for (const make_rule &pattern : mk.pattern_rules) {
+    let candidates = ArrayList<usize>{cxt.scratch_allocator()};
+    mk.candidate_pattern_rules(goal, candidates);
+    for (let const pattern_index : candidates) {
+      const make_rule &pattern = mk.pattern_rules[pattern_index];
       let const stem =
           match_pattern(pattern.target.view(), goal, cxt.scratch_allocator());
       if (!stem.has_value()) continue;
@@ -804,8 +1029,9 @@ static fn build_target(const ExecContext &ec, EvalContext &cxt, makefile &mk,
       /* make chooses a pattern rule only when its prerequisite can be supplied,
          so the first prerequisite must already be a file or be a target with
          its own rule. */
-      if (!candidate.is_empty() && !Path{candidate[0].view()}.exists() &&
-          mk.find_rule(candidate[0].view()) == nullptr)
+      if (!candidate.is_empty() &&
+          mk.find_rule(candidate[0].view()) == nullptr &&
+          !plan.file_cache.exists(candidate[0].view()))
         continue;
 
       prerequisites = steal(candidate);
@@ -814,56 +1040,43 @@ static fn build_target(const ExecContext &ec, EvalContext &cxt, makefile &mk,
       break;
     }
 
-    if (recipe_lines == nullptr) {
-      if (Path{goal}.exists()) return;
-      throw Error{
-          "There is no rule to make the target '" +
-          String{cxt.scratch_allocator(), goal}
-          + "'"
-      };
-    }
+    /* An earlier recipe may still create the file, so whether it exists is
+       asked only when the build reaches it. */
+    if (recipe_lines == nullptr)
+      return add_node(plan, steal(node), no_dependencies, true);
   }
 
-  /* The saved values restore in reverse so a repeated += unwinds cleanly. */
   let saved_variables = ArrayList<saved_make_variable>{cxt.scratch_allocator()};
-  if (target_assignments != nullptr)
+  let const has_own_assignments =
+      target_assignments != nullptr && !target_assignments->is_empty();
+  if (has_own_assignments) {
     for (const String &assignment : *target_assignments) {
-      let const name = assignment_variable_name(assignment.view());
-      saved_make_variable snapshot{
-          String{cxt.scratch_allocator(), name},
-          false,
-          String{cxt.scratch_allocator()}
-      };
-      if (const String *current_value = mk.find_variable(name);
-          current_value != nullptr)
-      {
-        snapshot.was_present = true;
-        snapshot.old_value =
-            String{cxt.scratch_allocator(), current_value->view()};
-      }
-      saved_variables.push(steal(snapshot));
+      save_variable(cxt, mk, assignment_variable_name(assignment.view()),
+                    saved_variables);
       let const equals = assignment.view().find_character('=');
       apply_assignment(cxt, mk,
                        assignment.view().substring_of_length(0, *equals),
                        assignment.view().substring(*equals));
     }
+    plan.assignment_scopes.push(target_assignments);
+  }
   defer
   {
-    for (usize i = saved_variables.count(); i-- > 0;) {
-      const saved_make_variable &snapshot = saved_variables[i];
-      if (snapshot.was_present) {
-        if (let const *index = mk.variable_index.find(snapshot.name.view());
-            index != nullptr)
-          mk.variables[*index].value =
-              String{cxt.scratch_allocator(), snapshot.old_value.view()};
-      } else {
-        /* A variable the assignment created is unset again, not left empty, so
-           a later ?= still applies its default. */
-        mk.variable_index.erase(snapshot.name.view());
-      }
-    }
+    if (has_own_assignments) plan.assignment_scopes.pop_back();
+    restore_variables(cxt, mk, saved_variables);
   };
 
+  for (let const *scope : plan.assignment_scopes)
+    for (const String &assignment : *scope) {
+      let const name = assignment_variable_name(assignment.view());
+      const String *value = mk.find_variable(name);
+      node.variables.push(make_variable{
+          String{cxt.scratch_allocator(), name},
+          String{cxt.scratch_allocator(),
+                 value != nullptr ? value->view() : StringView{}}
+      });
+    }
+
   ArrayList<String> normal_prerequisites{cxt.scratch_allocator()};
   ArrayList<String> order_only_prerequisites{cxt.scratch_allocator()};
   bool is_order_only_section = false;
@@ -879,28 +1092,112 @@ static fn build_target(const ExecContext &ec, EvalContext &cxt, makefile &mk,
       normal_prerequisites.push(prerequisite.clone());
   }
 
-  visiting.push(String{cxt.scratch_allocator(), goal});
+  let dependencies = ArrayList<usize>{cxt.scratch_allocator()};
+  plan.visiting.push(String{cxt.scratch_allocator(), goal});
   for (const String &prerequisite : normal_prerequisites)
-    build_target(ec, cxt, mk, prerequisite.view(), visiting, built);
+    dependencies.push(plan_target(cxt, mk, plan, prerequisite.view()));
   for (const String &prerequisite : order_only_prerequisites)
-    build_target(ec, cxt, mk, prerequisite.view(), visiting, built);
-  visiting.pop_back();
-
-  let const first_prereq = normal_prerequisites.is_empty()
-                               ? StringView{}
-                               : normal_prerequisites[0].view();
-  ArrayList<String> seen_prerequisites{cxt.scratch_allocator()};
-  String all_prereqs{cxt.scratch_allocator()};
+    dependencies.push(plan_target(cxt, mk, plan, prerequisite.view()));
+  plan.visiting.pop_back();
+
+  if (!normal_prerequisites.is_empty())
+    node.first_prerequisite = normal_prerequisites[0].clone();
+  StringMap<bool> seen_prerequisites{cxt.scratch_allocator()};
   for (const String &prerequisite : normal_prerequisites) {
-    if (seen_prerequisites.find(prerequisite.view()).has_value()) continue;
+    if (seen_prerequisites.find(prerequisite.view()) != nullptr) continue;
 
-    seen_prerequisites.push(prerequisite.clone());
-    if (!all_prereqs.is_empty()) all_prereqs += ' ';
-    all_prereqs += prerequisite.view();
+    seen_prerequisites.set(prerequisite.view(), true);
+    if (!node.all_prerequisites.is_empty()) node.all_prerequisites += ' ';
+    node.all_prerequisites += prerequisite.view();
   }
+  node.recipe_lines = recipe_lines;
+  node.stem = steal(target_stem);
+  return add_node(plan, steal(node), dependencies, true);
+}
 
-  for (const String &recipe : *recipe_lines) {
-    StringView body = recipe.view();
+/* Whether a word of the line is the ulimit builtin. A limit set in process
+   would outlive the line, and a lowered hard limit cannot be raised back, so
+   such a line still gets a forked subshell. */
+static fn mentions_ulimit(StringView command) wontthrow -> bool
+{
+  let const is_name_character = [](char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || c == '-';
+  };
+  let const keyword = StringView{"ulimit"};
+  for (usize i = 0; i + keyword.length <= command.length; i++) {
+    if (command.substring_of_length(i, keyword.length) != keyword) continue;
+    let const is_word_start = i == 0 || !is_name_character(command[i - 1]);
+    let const end = i + keyword.length;
+    let const is_word_end =
+        end == command.length || !is_name_character(command[end]);
+    if (is_word_start && is_word_end) return true;
+  }
+  return false;
+}
+
+/* Run one recipe command the way GNU make runs it in a shell of its own. The
+   command runs in a subshell, so a cd, an assignment, a trap or an exit stays
+   inside it. The subshell is a snapshot of this shell rather than a fork, so a
+   line of builtins starts no process at all and an external program is the
+   only process the line spawns. */
+static fn run_recipe_command(const ExecContext &ec, EvalContext &cxt,
+                             StringView command) throws -> i32
+{
+  /* A recipe runs with the strict toggles off so an unmatched glob or an unset
+     variable does not abort the build. */
+  let const saved_runtime = RuntimeState::capture(cxt);
+  RuntimeState recipe_runtime = saved_runtime;
+  recipe_runtime.set_option(shell_option_id::Failglob, false);
+  recipe_runtime.set_option(shell_option_id::Nounset, false);
+  recipe_runtime.warning_level = 0;
+  recipe_runtime.restore(cxt);
+  defer { saved_runtime.restore(cxt); };
+
+  /* The parentheses are the subshell. Even a forked one keeps the tail-command
+     exec optimization from replacing the make process when the recipe is a
+     single external command, which would otherwise abandon the remaining
+     recipe lines and targets. The newlines guard the closing paren against a
+     trailing comment in the line. */
+  let subshell_command = String{cxt.scratch_allocator(), "(\n"};
+  subshell_command += command;
+  subshell_command += "\n)";
+  if (!mentions_ulimit(command)) cxt.request_in_process_subshell();
+  defer { static_cast<void>(cxt.take_in_process_subshell_request()); };
+  return cxt.run_source(subshell_command.view(), "make",
+                        return_handling::Consume, ec.source_location(),
+                        StringView{"make"});
+}
+
+static fn run_recipe(const ExecContext &ec, EvalContext &cxt, makefile &mk,
+                     const make_node &node) throws -> void
+{
+  let saved_variables = ArrayList<saved_make_variable>{cxt.scratch_allocator()};
+  for (const make_variable &variable : node.variables) {
+    save_variable(cxt, mk, variable.name.view(), saved_variables);
+    store_variable(cxt, mk, variable.name.view(), variable.value.view());
+  }
+  defer { restore_variables(cxt, mk, saved_variables); };
+
+  /* Under .ONESHELL the whole recipe is one script, and only the prefixes of
+     its first line count, the way GNU make reads it. */
+  let const is_one_shell = mk.find_rule(".ONESHELL") != nullptr;
+  let script = String{cxt.scratch_allocator()};
+  bool is_script_silent = false;
+  bool should_script_ignore_errors = false;
+
+  let const check_status = [&](i32 status, bool should_ignore_errors) {
+    if (status != 0 && !should_ignore_errors) {
+      throw Error{
+          "The recipe for the target '" + node.goal +
+          "' failed with status " +
+          String::from(status, cxt.scratch_allocator())
+      };
+    }
+  };
+
+  for (usize line = 0; line < node.recipe_lines->count(); line++) {
+    StringView body = (*node.recipe_lines)[line].view();
     bool is_silent = false;
     bool should_ignore_errors = false;
     /* A leading @ or - applies in either order. */
@@ -909,50 +1206,364 @@ static fn build_target(const ExecContext &ec, EvalContext &cxt, makefile &mk,
       if (body[0] == '-') should_ignore_errors = true;
       body = body.substring(1);
     }
+    if (is_one_shell && line == 0) {
+      is_script_silent = is_silent;
+      should_script_ignore_errors = should_ignore_errors;
+    }
 
     /* The automatic variables are filled on the raw recipe first, then the
        $(NAME) expansion runs, so a $$ stays an escape and a $@ that the
        expansion would not touch is resolved here. */
-    let const with_autos =
-        substitute_automatic(body, goal, first_prereq, all_prereqs.view(),
-                             target_stem.view(), cxt.scratch_allocator());
+    let const with_autos = substitute_automatic(
+        body, node.goal.view(), node.first_prerequisite.view(),
+        node.all_prerequisites.view(), node.stem.view(),
+        cxt.scratch_allocator());
     let const command = expand(cxt, mk, with_autos.view(), 0);
     if (command.is_empty()) continue;
+
+    if (is_one_shell) {
+      if (!is_script_silent) ec.print_to_stdout(command + "\n");
+      script += command.view();
+      script += '\n';
+      continue;
+    }
+
     if (!is_silent) ec.print_to_stdout(command + "\n");
+    check_status(run_recipe_command(ec, cxt, command.view()),
+                 should_ignore_errors);
+  }
 
-    /* A recipe runs with the strict toggles off so an unmatched glob or an
-       unset variable does not abort the build. */
-    let const saved_runtime = RuntimeState::capture(cxt);
-    RuntimeState recipe_runtime = saved_runtime;
-    recipe_runtime.set_option(shell_option_id::Failglob, false);
-    recipe_runtime.set_option(shell_option_id::Nounset, false);
-    recipe_runtime.warning_level = 0;
-    recipe_runtime.restore(cxt);
-    defer { saved_runtime.restore(cxt); };
-
-    /* Each recipe line runs in its own subshell, the way GNU make spawns a
-       shell per line. The parentheses also keep the tail-command exec
-       optimization from replacing the make process when the recipe is a single
-       external command, which would otherwise abandon the remaining recipe
-       lines and targets. The newlines guard the closing paren against a
-       trailing comment in the line. */
-    let subshell_command = String{cxt.scratch_allocator(), "(\n"};
-    subshell_command += command.view();
-    subshell_command += "\n)";
-    let const status = cxt.run_source(subshell_command.view(), "make",
-                                      return_handling::Consume,
-                                      ec.source_location(), StringView{"make"});
-    if (status != 0 && !should_ignore_errors) {
-      throw Error{
-          "The recipe for the target '" +
-          String{cxt.scratch_allocator(), goal}
-          + "' failed with status " +
-          String::from(status, cxt.scratch_allocator())
-      };
+  if (is_one_shell && !script.is_empty())
+    check_status(run_recipe_command(ec, cxt, script.view()),
+                 should_script_ignore_errors);
+}
+
+static fn build_node(const ExecContext &ec, EvalContext &cxt, makefile &mk,
+                     make_plan &plan, const make_node &node) throws -> void
+{
+  if (!node.failure.is_empty()) throw Error{node.failure};
+  if (node.recipe_lines == nullptr) {
+    if (plan.file_cache.exists(node.goal.view())) return;
+    throw Error{"There is no rule to make the target '" + node.goal + "'"};
+  }
+  defer { plan.file_cache.forget_target(node.goal.view()); };
+  run_recipe(ec, cxt, mk, node);
+}
+
+/* Record the outcome and release the targets that waited on it. A target
+   below a failed one never runs, it fails in turn once -k lets the build reach
+   it. The targets left with nothing to wait for join the ready list. */
+static fn finish_node(make_plan &plan, usize index, bool is_built,
+                      ArrayList<usize> &ready) throws -> void
+{
+  make_node &node = plan.nodes[index];
+  node.state = is_built ? make_node_state::Built : make_node_state::Failed;
+  for (let const dependent_index : node.dependents) {
+    make_node &dependent = plan.nodes[dependent_index];
+    if (!is_built) dependent.has_failed_prerequisite = true;
+    ASSERT(dependent.pending_count > 0);
+    if (--dependent.pending_count == 0) ready.push(dependent_index);
+  }
+}
+
+/* The serial build runs the plan in its order inside the shell, so it prints
+   and fails exactly where the recursive walk always did. */
+static fn run_plan_serially(const ExecContext &ec, EvalContext &cxt,
+                            makefile &mk, make_plan &plan,
+                            bool should_keep_going) throws -> bool
+{
+  let unused_ready = ArrayList<usize>{cxt.scratch_allocator()};
+  bool is_complete = true;
+  for (usize index = 0; index < plan.nodes.count(); index++) {
+    if (plan.nodes[index].has_failed_prerequisite) {
+      finish_node(plan, index, false, unused_ready);
+      continue;
+    }
+    try {
+      build_node(ec, cxt, mk, plan, plan.nodes[index]);
+      finish_node(plan, index, true, unused_ready);
+    } catch (const Error &error) {
+      if (!should_keep_going) throw;
+      report_soft_shitbox_error(ec, cxt, error.message());
+      is_complete = false;
+      finish_node(plan, index, false, unused_ready);
+    }
+  }
+  return is_complete;
+}
+
+/* The ceiling on -j, and the limit a make that shares a jobserver runs under,
+   where the tokens decide how many jobs start. */
+static constexpr usize MAX_MAKE_JOBS = 4096;
+
+struct make_job_settings
+{
+  usize job_limit{1};
+  Maybe<f64> max_load{};
+  bool should_keep_going{false};
+};
+
+/* The forked child runs the recipe, since only it knows which line failed and
+   why. A failure that has a location it shows itself; the message of any
+   other it writes to the pipe and exits with 2, so the parent raises or
+   reports it the way the serial build would. The message ends in a null byte,
+   and the parent reads only after the child exited, so a grandchild that
+   kept the pipe open never holds the read up. */
+static fn start_node_job(const ExecContext &ec, EvalContext &cxt, makefile &mk,
+                         make_node &node) throws -> void
+{
+  let const pipe = os::make_pipe();
+  if (!pipe.has_value())
+    throw Error{"Unable to start a job for the target '" + node.goal + "'"};
+
+  flush();
+  let const child = os::try_fork_compound_stage(None, None, None);
+  if (!child.has_value()) {
+    os::close_fd(pipe->in);
+    os::close_fd(pipe->out);
+    throw Error{"Unable to start a job for the target '" + node.goal + "'"};
+  }
+
+  if (os::process_id_of(*child) == 0) {
+    os::close_fd(pipe->in);
+    let failure = String{cxt.scratch_allocator()};
+    i32 status = 0;
+    try {
+      run_recipe(ec, cxt, mk, node);
+    } catch (const InterruptErrorWithLocation &) {
+      status = 130;
+    } catch (const ErrorWithLocation &error) {
+      try {
+        const String *source = cxt.current_source();
+        show_message(error.to_string(
+            source != nullptr ? source->view() : StringView{}, &cxt));
+      } catch (...) {}
+      status = 2;
+    } catch (const Error &error) {
+      try {
+        failure = error.message().clone();
+      } catch (...) {}
+      status = 2;
+    } catch (...) {
+      status = 2;
+    }
+    try {
+      flush();
+    } catch (...) {}
+    if (status == 2)
+      (void) os::write_fd(pipe->out, failure.c_str(), failure.length() + 1);
+    os::exit_process_immediately(status);
+  }
+
+  os::close_fd(pipe->out);
+  LOG(Debug, "started a job for the target '%s'", node.goal.c_str());
+  node.child = *child;
+  node.failure_reader = pipe->in;
+  node.state = make_node_state::Running;
+}
+
+/* The message a job that exited with 2 wrote before it exited, empty when it
+   showed its failure itself. */
+static fn read_job_failure(os::descriptor reader, Allocator allocator) throws
+    -> String
+{
+  let message = String{allocator};
+  char buffer[256];
+  loop
+  {
+    let const count = os::read_fd(reader, buffer, sizeof(buffer));
+    if (!count.has_value() || *count == 0) break;
+    let const chunk = StringView{buffer, *count};
+    for (usize i = 0; i < chunk.length; i++) {
+      if (chunk[i] == '\0') {
+        message += StringView{buffer, i};
+        return message;
+      }
+    }
+    message += chunk;
+  }
+  return message;
+}
+
+/* The parallel build starts every target whose prerequisites are built, as
+   many at a time as the job limit, the load limit, and the jobserver allow,
+   and reaps the forked jobs as SIGCHLD reports them. A failure stops new
+   starts unless -k asks to keep going, and the jobs already running always
+   finish before the build returns. Without -k the first failure is then
+   raised, the error the serial build stops with. */
+static fn run_plan_in_parallel(const ExecContext &ec, EvalContext &cxt,
+                               makefile &mk, make_plan &plan,
+                               const make_job_settings &settings,
+                               Maybe<os::jobserver> &server) throws -> bool
+{
+  let ready = ArrayList<usize>{cxt.scratch_allocator()};
+  usize ready_head = 0;
+  for (usize index = 0; index < plan.nodes.count(); index++)
+    if (plan.nodes[index].pending_count == 0) ready.push(index);
+
+  let running = ArrayList<usize>{cxt.scratch_allocator()};
+  bool is_complete = true;
+  bool should_stop = false;
+  Maybe<String> first_failure{};
+
+  /* Under -k a failure is reported as it happens, and otherwise the first one
+     is kept for the error the build stops with. */
+  let const fail = [&](String message) {
+    is_complete = false;
+    if (settings.should_keep_going) {
+      report_soft_shitbox_error(ec, cxt, message.view());
+      return;
+    }
+    should_stop = true;
+    if (!first_failure.has_value()) first_failure = steal(message);
+  };
+
+  /* A throw out of the loop still waits for the jobs it started and hands
+     their tokens back, so no child outlives the make or keeps a token. */
+  defer
+  {
+    for (let const index : running) {
+      make_node &node = plan.nodes[index];
+      i32 status = 0;
+      while (os::poll_process(node.child, status) != os::process_state::Exited)
+        os::wait_for_child_state_change();
+      os::close_fd(node.failure_reader);
+      if (node.token.has_value() && server.has_value())
+        os::return_job_token(*server, *node.token);
+    }
+  };
+
+  loop
+  {
+    if (os::INTERRUPT_REQUESTED) should_stop = true;
+
+    bool is_waiting_for_token = false;
+    while (!should_stop && ready_head < ready.count()) {
+      let const index = ready[ready_head];
+      make_node &node = plan.nodes[index];
+
+      /* A target with nothing to run settles here without a job. */
+      if (node.has_failed_prerequisite || !node.failure.is_empty() ||
+          node.recipe_lines == nullptr || node.recipe_lines->is_empty())
+      {
+        ready_head++;
+        if (node.has_failed_prerequisite) {
+          finish_node(plan, index, false, ready);
+          continue;
+        }
+        try {
+          build_node(ec, cxt, mk, plan, node);
+          finish_node(plan, index, true, ready);
+        } catch (const Error &error) {
+          fail(error.message().clone());
+          finish_node(plan, index, false, ready);
+        }
+        continue;
+      }
+
+      /* The first job runs on the token this make was started with. */
+      if (!running.is_empty()) {
+        if (running.count() >= settings.job_limit) break;
+        if (settings.max_load.has_value()) {
+          let const load = os::load_average();
+          if (load.has_value() && *load >= *settings.max_load) break;
+        }
+        if (server.has_value()) {
+          node.token = os::take_job_token(*server);
+          if (!node.token.has_value()) {
+            is_waiting_for_token = true;
+            break;
+          }
+        }
+      }
+
+      ready_head++;
+      try {
+        start_node_job(ec, cxt, mk, node);
+      } catch (...) {
+        if (node.token.has_value() && server.has_value())
+          os::return_job_token(*server, *node.token);
+        throw;
+      }
+      running.push(index);
     }
+
+    if (running.is_empty()) break;
+
+    bool has_reaped = false;
+    for (usize position = running.count(); position > 0; position--) {
+      let const index = running[position - 1];
+      make_node &node = plan.nodes[index];
+      i32 status = 0;
+      if (os::poll_process(node.child, status) != os::process_state::Exited)
+        continue;
+
+      running.remove(position - 1);
+      has_reaped = true;
+      let failure = status == 2 ? read_job_failure(node.failure_reader,
+                                                   cxt.scratch_allocator())
+                                : String{cxt.scratch_allocator()};
+      os::close_fd(node.failure_reader);
+      node.failure_reader = SHIT_INVALID_FD;
+      plan.file_cache.forget_target(node.goal.view());
+      if (node.token.has_value() && server.has_value())
+        os::return_job_token(*server, *node.token);
+      node.token = None;
+      LOG(Debug, "the job for the target '%s' exited with status %d",
+          node.goal.c_str(), status);
+      if (status != 0 && failure.is_empty()) {
+        /* The job showed its own failure, so there is nothing more to say
+           under -k. */
+        if (settings.should_keep_going)
+          is_complete = false;
+        else
+          failure = "The recipe for the target '" + node.goal +
+                    "' failed with status " +
+                    String::from(status, cxt.scratch_allocator());
+      }
+      if (!failure.is_empty()) fail(steal(failure));
+      finish_node(plan, index, status == 0, ready);
+    }
+    if (has_reaped) continue;
+
+    if (is_waiting_for_token)
+      os::wait_for_child_state_change_or_token(*server);
+    else
+      os::wait_for_child_state_change();
   }
 
-  built.push(String{cxt.scratch_allocator(), goal});
+  if (os::INTERRUPT_REQUESTED)
+    throw InterruptErrorWithLocation{ec.source_location()};
+  if (first_failure.has_value()) throw Error{*first_failure};
+  return is_complete;
+}
+
+/* The jobserver named in an inherited MAKEFLAGS, the last spelling winning the
+   way GNU make reads it. */
+static fn inherited_jobserver_auth(StringView flags, Allocator allocator) throws
+    -> Maybe<String>
+{
+  let auth = Maybe<String>{None};
+  for (const String &word : split_words(flags, allocator))
+    for (let const prefix :
+         {StringView{"--jobserver-auth="}, StringView{"--jobserver-fds="}})
+      if (word.view().starts_with(prefix))
+        auth = String{allocator, word.view().substring(prefix.length)};
+  return auth;
+}
+
+/* A phase's time in milliseconds with three decimals, the --debug=time
+   report's one unit. */
+static fn format_phase_time(u64 nanos, Allocator allocator) throws -> String
+{
+  let text = String::from(nanos / 1'000'000, allocator);
+  text += '.';
+  let const micros = nanos / 1'000 % 1'000;
+  if (micros < 100) text += '0';
+  if (micros < 10) text += '0';
+  text += String::from(micros, allocator);
+  text += "ms";
+  return text;
 }
 
 } /* namespace */
@@ -967,21 +1578,35 @@ fn Make::execute(const ExecContext &ec, EvalContext &cxt,
     -> i32
 {
   unused(arg_locations);
-  /* The -j flag accepts an optional job count, with no value meaning
-     unlimited, so it is dropped here before the flag parser demands a value. */
+  /* The -j flag accepts an optional job count, with no value meaning one job
+     per processor, so it is read here before the flag parser demands a
+     value. */
   ArrayList<String> filtered{cxt.scratch_allocator()};
-  for (const String &arg : args) {
-    let const text = arg.view();
-    bool is_jobs_flag = text == "-j";
-    if (!is_jobs_flag && text.length > 2 && text[0] == '-' && text[1] == 'j') {
-      is_jobs_flag = true;
-      for (usize k = 2; k < text.length; k++)
-        if (text[k] < '0' || text[k] > '9') {
-          is_jobs_flag = false;
-          break;
-        }
+  Maybe<usize> requested_jobs{};
+  for (usize i = 0; i < args.count(); i++) {
+    let const text = args[i].view();
+    /* Only a bare -j or --jobs goes without a count, and a count attached to
+       the flag, -jx or an empty --jobs=, is checked like a separate one. */
+    Maybe<StringView> count{};
+    if (text == "-j" || text == "--jobs") {
+      if (i + 1 < args.count() && args[i + 1].view().is_all_decimal_digits()) {
+        count = args[++i].view();
+      } else {
+        requested_jobs = os::get_processor_counts().online_count;
+        continue;
+      }
+    } else if (text.length > 2 && text[0] == '-' && text[1] == 'j') {
+      count = text.substring(2);
+    } else if (text.starts_with("--jobs=")) {
+      count = text.substring(7);
+    }
+    if (!count.has_value()) {
+      filtered.push(args[i].clone());
+      continue;
     }
-    if (!is_jobs_flag) filtered.push(arg.clone());
+
+    requested_jobs = parse_shitbox_job_count(*count, "make", MAX_MAKE_JOBS,
+                                             cxt.scratch_allocator());
   }
 
   /* A recipe's $(MAKE) re-enters this util while the outer call is still on the
@@ -994,6 +1619,39 @@ fn Make::execute(const ExecContext &ec, EvalContext &cxt,
 
   SHITBOX_SHOW_HELP_AND_RETURN(ec, args);
 
+  let const should_keep_going = FLAG_MAKE_KEEP_GOING.is_enabled();
+  bool should_report_time = false;
+  if (FLAG_MAKE_DEBUG.is_set()) {
+    let categories = FLAG_MAKE_DEBUG.value();
+    loop
+    {
+      let const comma = categories.find_character(',');
+      let const category =
+          comma.has_value() ? categories.substring_of_length(0, *comma)
+                            : categories;
+      if (category != "time")
+        throw ErrorWithDetails{
+            "Unknown debug category '" +
+                String{cxt.scratch_allocator(), category} + "'",
+            "The only category is `--debug=time`"};
+      should_report_time = true;
+      if (!comma.has_value()) break;
+      categories = categories.substring(*comma + 1);
+    }
+  }
+  Maybe<f64> max_load{};
+  if (FLAG_MAKE_LOAD_AVERAGE.is_set()) {
+    let const parsed =
+        utils::parse_decimal_f64(FLAG_MAKE_LOAD_AVERAGE.value());
+    if (parsed.is_error() || parsed.value() < 0)
+      throw ErrorWithDetails{
+          "Invalid load average '" +
+              String{cxt.scratch_allocator(), FLAG_MAKE_LOAD_AVERAGE.value()} +
+              "'",
+          "Pass a non-negative number to `-l`"};
+    max_load = parsed.value();
+  }
+
   Maybe<Path> saved_directory;
   if (FLAG_MAKE_DIR.is_set()) {
     saved_directory = Path::current_directory();
@@ -1024,6 +1682,7 @@ fn Make::execute(const ExecContext &ec, EvalContext &cxt,
                            "Create a `Makefile` or pass `-f <file>`"};
   }
 
+  let const parse_start = os::monotonic_nanos();
   Maybe<String> source = Path{makefile_path.view()}.read_entire_file();
   if (!source.has_value())
     throw ErrorWithDetails{"Unable to read the makefile '" + makefile_path +
@@ -1031,6 +1690,7 @@ fn Make::execute(const ExecContext &ec, EvalContext &cxt,
                            "Check the path passed to `-f`"};
 
   let mk = parse_makefile(cxt, source->view());
+  let const parse_nanos = os::monotonic_nanos() - parse_start;
 
   ArrayList<String> goals{cxt.scratch_allocator()};
   if (operands.is_empty()) {
@@ -1044,11 +1704,88 @@ fn Make::execute(const ExecContext &ec, EvalContext &cxt,
       goals.push(operand.clone());
   }
 
-  ArrayList<String> visiting{cxt.scratch_allocator()};
-  ArrayList<String> built{cxt.scratch_allocator()};
+  let settings = make_job_settings{};
+  settings.should_keep_going = should_keep_going;
+  settings.max_load = max_load;
+  if (requested_jobs.has_value())
+    settings.job_limit = *requested_jobs;
+
+  /* A make started by a parallel make without its own -j shares the parent's
+     job slots through the jobserver the parent advertised in MAKEFLAGS. A make
+     with more than one job advertises its own to the recipes it runs. */
+  Maybe<os::jobserver> server{};
+  let const inherited_flags = os::get_environment_variable("MAKEFLAGS");
+  if (!requested_jobs.has_value() && inherited_flags.has_value()) {
+    if (let const auth = inherited_jobserver_auth(inherited_flags->view(),
+                                                  cxt.scratch_allocator());
+        auth.has_value())
+    {
+      server = os::join_jobserver(auth->view());
+      if (server.has_value())
+        settings.job_limit = MAX_MAKE_JOBS;
+      else
+        LOG(Debug, "the inherited jobserver '%s' is not usable", auth->c_str());
+    }
+  } else if (settings.job_limit > 1 && os::can_fork_evaluator()) {
+    server = os::create_jobserver(settings.job_limit - 1);
+  }
+  defer
+  {
+    if (server.has_value()) os::close_jobserver(*server);
+  };
+
+  let const is_server = requested_jobs.has_value() && server.has_value();
+  if (is_server) {
+    let flags = String{cxt.scratch_allocator(), "-j"};
+    flags += String::from(settings.job_limit, cxt.scratch_allocator());
+    flags += " --jobserver-auth=";
+    flags += os::jobserver_auth(*server);
+    os::set_environment_variable("MAKEFLAGS", flags.view());
+  }
+  defer
+  {
+    if (!is_server) return;
+    if (inherited_flags.has_value())
+      os::set_environment_variable("MAKEFLAGS", inherited_flags->view());
+    else
+      os::unset_environment_variable("MAKEFLAGS");
+  };
+
+  u64 plan_nanos = 0;
+  Maybe<u64> execute_start{};
+  /* The report is written however the build ends, so a failing build still
+     shows where its time went. */
+  defer
+  {
+    if (!should_report_time) return;
+    let report = String{cxt.scratch_allocator(), "make: parse "};
+    report += format_phase_time(parse_nanos, cxt.scratch_allocator());
+    report += ", plan ";
+    report += format_phase_time(plan_nanos, cxt.scratch_allocator());
+    report += ", execute ";
+    report += format_phase_time(
+        execute_start.has_value() ? os::monotonic_nanos() - *execute_start : 0,
+        cxt.scratch_allocator());
+    report += '\n';
+    ec.print_to_stderr(report.view());
+  };
+
+  bool is_complete = true;
   try {
+    let const plan_start = os::monotonic_nanos();
+    let plan = make_plan{cxt.scratch_allocator()};
     for (const String &goal : goals)
-      build_target(ec, cxt, mk, goal.view(), visiting, built);
+      plan_target(cxt, mk, plan, goal.view());
+    plan_nanos = os::monotonic_nanos() - plan_start;
+    LOG(Debug, "the make plan has %zu targets", plan.nodes.count());
+
+    execute_start = os::monotonic_nanos();
+    if (settings.job_limit > 1 && os::can_fork_evaluator())
+      is_complete =
+          run_plan_in_parallel(ec, cxt, mk, plan, settings, server);
+    else
+      is_complete =
+          run_plan_serially(ec, cxt, mk, plan, settings.should_keep_going);
   } catch (const InterruptErrorWithLocation &) {
     throw;
   } catch (Error &error) {
@@ -1056,7 +1793,7 @@ fn Make::execute(const ExecContext &ec, EvalContext &cxt,
     throw;
   }
 
-  return 0;
+  return is_complete ? 0 : 2;
 }
 
 fn collect_makefile_targets(EvalContext &cxt, const Path &makefile) throws
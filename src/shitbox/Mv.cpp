@@ -42,32 +42,26 @@ static fn copy_file_contents(StringView source, StringView destination,
     };
   defer { os::close_fd(*out_fd); };
 
-  char buffer[4096];
-  loop
-  {
-    let const read_count = os::read_fd(*in_fd, buffer, sizeof(buffer));
-    if (!read_count.has_value())
-      throw Error{
-          "mv: a read of '" + String{allocator, source}
-            +
-          "' failed: " + os::last_system_error_message()
-      };
-    if (*read_count == 0) break;
-
-    usize written_count = 0;
-    while (written_count < *read_count) {
-      let const chunk = os::write_fd(*out_fd, buffer + written_count,
-                                     *read_count - written_count);
-      if (!chunk.has_value() || *chunk == 0) {
-        throw Error{
-            "mv: a write to '" + String{allocator, destination}
-              +
-            "' failed: " + os::last_system_error_message()
-        };
-      }
-
-      written_count += *chunk;
-    }
+  switch (os::copy_fd_contents(*in_fd, *out_fd)) {
+  case os::copy_result::Ok: break;
+  case os::copy_result::ReadFailed:
+    throw Error{
+        "mv: a read of '" + String{allocator, source}
+          +
+        "' failed: " + os::last_system_error_message()
+    };
+  case os::copy_result::WriteFailed:
+    throw Error{
+        "mv: a write to '" + String{allocator, destination}
+          +
+        "' failed: " + os::last_system_error_message()
+    };
+  /* Mv::execute refuses a source and target that are one file, and a copy
+     only runs across devices anyway. */
+  case os::copy_result::SameFile: unreachable("the destination was truncated");
+  case os::copy_result::Interrupted:
+    throw Error{"mv: the copy of '" + String{allocator, source} +
+                "' was interrupted, so it is left in place"};
   }
 }
 
@@ -62,19 +62,21 @@ fn Sort::execute(const ExecContext &ec, EvalContext &cxt,
 
   sort_stringview_list(lines);
 
-  let output = String{cxt.scratch_allocator()};
+  /* Sorting needs every line at hand, but the output goes out a buffer at a
+     time instead of as a second copy of the input. */
+  let writer = text_writer{ec};
   if (FLAG_SORT_REVERSE.is_enabled())
     for (usize i = lines.count(); i > 0; i--) {
-      output += lines[i - 1];
-      output += '\n';
+      writer.write(lines[i - 1]);
+      writer.write('\n');
     }
   else
     for (const StringView &line : lines) {
-      output += line;
-      output += '\n';
+      writer.write(line);
+      writer.write('\n');
     }
 
-  ec.print_to_stdout(output);
+  writer.flush();
 
   return status;
 }
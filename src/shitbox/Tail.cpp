@@ -45,6 +45,96 @@ static fn parse_tail_count(StringView spec, count_origin &origin_out,
   return true;
 }
 
+/* Each helper returns false when a read fails. */
+static fn write_from_line(text_writer &writer, text_reader &reader,
+                          i64 skip_count) throws -> bool
+{
+  i64 skipped_count = 0;
+  loop
+  {
+    let chunk = reader.next_chunk();
+    if (!chunk.has_value()) return false;
+    if (chunk->is_empty()) return true;
+    while (skipped_count < skip_count && !chunk->is_empty()) {
+      let const *newline = static_cast<const char *>(
+          __builtin_memchr(chunk->data, '\n', chunk->length));
+      if (newline == nullptr) {
+        *chunk = StringView{};
+        break;
+      }
+      *chunk = chunk->substring(static_cast<usize>(newline - chunk->data) + 1);
+      skipped_count++;
+    }
+    writer.write(*chunk);
+  }
+}
+
+static fn write_from_byte(text_writer &writer, text_reader &reader,
+                          i64 skip_count) throws -> bool
+{
+  let skipped_count = static_cast<usize>(skip_count);
+  loop
+  {
+    let const chunk = reader.next_chunk();
+    if (!chunk.has_value()) return false;
+    if (chunk->is_empty()) return true;
+    if (skipped_count >= chunk->length) {
+      skipped_count -= chunk->length;
+      continue;
+    }
+    writer.write(chunk->substring(skipped_count));
+    skipped_count = 0;
+  }
+}
+
+/* The last wanted_count lines live in a ring of their own copies, so the
+   memory held is theirs and not the whole input's. */
+static fn write_last_lines(text_writer &writer, text_reader &reader,
+                           usize wanted_count) throws -> bool
+{
+  let held = ArrayList<String>{heap_allocator()};
+  usize oldest = 0;
+  loop
+  {
+    let const line = reader.next_line();
+    if (!line.has_value()) return false;
+    if (line->is_empty()) break;
+    if (wanted_count == 0) continue;
+    if (held.count() < wanted_count) {
+      held.push(String{heap_allocator(), *line});
+      continue;
+    }
+    held[oldest].clear();
+    held[oldest].append(*line);
+    oldest = (oldest + 1) % held.count();
+  }
+
+  for (usize i = 0; i < held.count(); i++)
+    writer.write(held[(oldest + i) % held.count()].view());
+  return true;
+}
+
+/* The held bytes are cut back to the last wanted_count only once they reach
+   twice that, so each byte is moved a bounded number of times. */
+static fn write_last_bytes(text_writer &writer, text_reader &reader,
+                           usize wanted_count) throws -> bool
+{
+  let held = String{heap_allocator()};
+  loop
+  {
+    let const chunk = reader.next_chunk();
+    if (!chunk.has_value()) return false;
+    if (chunk->is_empty()) break;
+    held.append(*chunk);
+    if (held.count() >= 2 * wanted_count + TEXT_CHUNK_SIZE)
+      held = String{heap_allocator(),
+                    held.view().substring(held.count() - wanted_count)};
+  }
+
+  writer.write(held.view().substring(sub_sat(held.count(), wanted_count)));
+  return true;
+}
+
 Tail::Tail() = default;
 
 pure fn Tail::kind() const wontthrow -> Utility::Kind { return Kind::Tail; }
@@ -87,12 +177,12 @@ fn Tail::execute(const ExecContext &ec, EvalContext &cxt,
       source_list_from_operands(operands, cxt.scratch_allocator());
 
   let const should_print_headers = sources.count() > 1;
-  let output = String{cxt.scratch_allocator()};
+  let writer = text_writer{ec};
+  let reader = text_reader{};
   i32 status = 0;
   for (usize source_index = 0; source_index < sources.count(); source_index++) {
-    let const content = read_named_or_stdin(ec, sources[source_index]);
-    if (os::INTERRUPT_REQUESTED) return 130;
-    if (!content.has_value()) {
+    if (!reader.open(ec, sources[source_index])) {
+      writer.flush();
       report_soft_shitbox_error(
           ec, cxt,
           "tail: cannot open '" +
@@ -103,35 +193,35 @@ fn Tail::execute(const ExecContext &ec, EvalContext &cxt,
     }
 
     if (should_print_headers) {
-      if (source_index > 0) output += '\n';
-      output += "==> ";
-      output += sources[source_index] == "-" ? StringView{"standard input"}
-                                             : sources[source_index];
-      output += " <==\n";
-    }
-
-    if (is_byte_mode) {
-      let const wanted_count = static_cast<usize>(count);
-      let const text = content->view();
-      let start = origin == count_origin::FromStart
-                      ? (count > 0 ? static_cast<usize>(count - 1) : 0)
-                      : sub_sat(text.length, wanted_count);
-      if (start > text.length) start = text.length;
-
-      output += text.substring(start);
-      continue;
+      if (source_index > 0) writer.write('\n');
+      writer.write("==> ");
+      writer.write(sources[source_index] == "-" ? StringView{"standard input"}
+                                                : sources[source_index]);
+      writer.write(" <==\n");
     }
 
-    let const lines = split_keep_newlines(content->view());
+    let const skip_count = count > 0 ? count - 1 : 0;
     let const wanted_count = static_cast<usize>(count);
-    let const start = origin == count_origin::FromStart
-                          ? (count > 0 ? static_cast<usize>(count - 1) : 0)
-                          : sub_sat(lines.count(), wanted_count);
-    for (usize i = start; i < lines.count(); i++)
-      output += lines[i];
+    let const is_read =
+        origin == count_origin::FromStart
+            ? (is_byte_mode ? write_from_byte(writer, reader, skip_count)
+                            : write_from_line(writer, reader, skip_count))
+            : (is_byte_mode ? write_last_bytes(writer, reader, wanted_count)
+                            : write_last_lines(writer, reader, wanted_count));
+    reader.close();
+    if (os::INTERRUPT_REQUESTED) return 130;
+    if (!is_read) {
+      writer.flush();
+      report_soft_shitbox_error(
+          ec, cxt,
+          "tail: cannot read '" +
+              String{cxt.scratch_allocator(), sources[source_index]} +
+              "': " + os::last_system_error_message());
+      status = 1;
+    }
   }
 
-  ec.print_to_stdout(output);
+  writer.flush();
   return status;
 }
 
@@ -35,19 +35,13 @@ fn Tee::execute(const ExecContext &ec, EvalContext &cxt,
 
   SHITBOX_SHOW_HELP_AND_RETURN(ec, args);
 
-  let const input = read_fd_to_string(ec.in_fd.value_or(SHIT_STDIN));
-  if (os::INTERRUPT_REQUESTED) return 130;
-  if (!input.has_value()) {
-    report_soft_shitbox_error(
-        ec, cxt, "tee: read failed: " + os::last_system_error_message());
-    return 1;
-  }
-
-  ec.print_to_stdout(input->view());
-
   let const mode = FLAG_TEE_APPEND.is_enabled() ? os::file_open_mode::Append
                                                 : os::file_open_mode::Truncate;
   i32 status = 0;
+  /* Every file is opened before the first chunk, and a file whose write fails
+     is reported once and left out of the chunks after it. */
+  ArrayList<os::descriptor> fds{cxt.scratch_allocator()};
+  ArrayList<const String *> names{cxt.scratch_allocator()};
   for (const String &operand : operands) {
     let const fd = os::open_file_descriptor(operand.view(), mode);
     if (!fd.has_value()) {
@@ -56,27 +50,66 @@ fn Tee::execute(const ExecContext &ec, EvalContext &cxt,
       status = 1;
       continue;
     }
-    /* write_fd returns one write's count, which can fall short, so the loop
-       writes the rest until the whole input lands or a write fails. */
-    usize written_count = 0;
-    bool did_write_fail = false;
-    while (written_count < input->count()) {
-      let const chunk = os::write_fd(*fd, input->view().data + written_count,
-                                     input->count() - written_count);
-      if (!chunk.has_value() || *chunk == 0) {
-        did_write_fail = true;
-        break;
-      }
-
-      written_count += *chunk;
+    fds.push(*fd);
+    names.push(&operand);
+  }
+  defer {
+    for (let const fd : fds)
+      if (fd != SHIT_INVALID_FD) os::close_fd(fd);
+  };
+
+  let reader = text_reader{};
+  reader.open(ec, "-");
+  /* With no file left to feed, the copy to standard output is the kernel's to
+     make. Otherwise one read feeds every destination. */
+  if (fds.is_empty()) {
+    let writer = text_writer{ec};
+    let const copied = writer.copy_from(reader);
+    if (os::INTERRUPT_REQUESTED) return 130;
+    if (copied == os::copy_result::ReadFailed) {
+      report_soft_shitbox_error(
+          ec, cxt, "tee: read failed: " + os::last_system_error_message());
+      return 1;
     }
+    if (copied == os::copy_result::SameFile) {
+      report_soft_shitbox_error(ec, cxt, "tee: input file is output file");
+      return 1;
+    }
+    if (copied.has_value()) return status;
+  }
 
-    if (did_write_fail) {
+  loop
+  {
+    let const chunk = reader.next_chunk();
+    if (os::INTERRUPT_REQUESTED) return 130;
+    if (!chunk.has_value()) {
       report_soft_shitbox_error(
-          ec, cxt, "tee: " + operand + ": " + os::last_system_error_message());
-      status = 1;
+          ec, cxt, "tee: read failed: " + os::last_system_error_message());
+      return 1;
+    }
+    if (chunk->is_empty()) break;
+
+    ec.print_to_stdout(*chunk);
+    for (usize i = 0; i < fds.count(); i++) {
+      if (fds[i] == SHIT_INVALID_FD) continue;
+      /* write_fd returns one write's count, which can fall short, so the loop
+         writes the rest until the whole chunk lands or a write fails. */
+      usize written_count = 0;
+      while (written_count < chunk->length) {
+        let const written = os::write_fd(fds[i], chunk->data + written_count,
+                                         chunk->length - written_count);
+        if (!written.has_value() || *written == 0) break;
+        written_count += *written;
+      }
+      if (written_count < chunk->length) {
+        report_soft_shitbox_error(ec, cxt,
+                                  "tee: " + *names[i] + ": " +
+                                      os::last_system_error_message());
+        status = 1;
+        os::close_fd(fds[i]);
+        fds[i] = SHIT_INVALID_FD;
+      }
     }
-    os::close_fd(*fd);
   }
 
   return status;
@@ -186,27 +186,39 @@ fn Tr::execute(const ExecContext &ec, EvalContext &cxt,
     }
   }
 
-  let const input = read_fd_to_string(ec.in_fd.value_or(SHIT_STDIN));
-  if (os::INTERRUPT_REQUESTED) return 130;
-  if (!input.has_value()) {
-    report_soft_shitbox_error(
-        ec, cxt, "tr: read failed: " + os::last_system_error_message());
-    return 1;
-  }
-  let output = String{cxt.scratch_allocator()};
-  output.reserve(input->count());
-  let const input_view = input->view();
-  for (usize i = 0; i < input_view.length; i++) {
-    let const c = static_cast<unsigned char>(input_view[i]);
-    if (!is_in_set1[c]) {
-      output.push(static_cast<char>(c));
-      continue;
+  let reader = text_reader{};
+  reader.open(ec, "-");
+  let writer = text_writer{ec};
+  /* Each chunk is translated into a buffer of its own size, which the writer
+     then takes whole. */
+  let output = String{heap_allocator()};
+  output.reserve(TEXT_CHUNK_SIZE);
+  loop
+  {
+    let const chunk = reader.next_chunk();
+    if (os::INTERRUPT_REQUESTED) return 130;
+    if (!chunk.has_value()) {
+      writer.flush();
+      report_soft_shitbox_error(
+          ec, cxt, "tr: read failed: " + os::last_system_error_message());
+      return 1;
+    }
+    if (chunk->is_empty()) break;
+
+    output.clear();
+    for (usize i = 0; i < chunk->length; i++) {
+      let const c = static_cast<unsigned char>((*chunk)[i]);
+      if (!is_in_set1[c]) {
+        output.push(static_cast<char>(c));
+        continue;
+      }
+      if (is_deleting) continue;
+      output.push(static_cast<char>(translation[c]));
     }
-    if (is_deleting) continue;
-    output.push(static_cast<char>(translation[c]));
+    writer.write(output.view());
   }
 
-  ec.print_to_stdout(output);
+  writer.flush();
   return 0;
 }
 
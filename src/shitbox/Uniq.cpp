@@ -47,9 +47,8 @@ fn Uniq::execute(const ExecContext &ec, EvalContext &cxt,
   SHITBOX_SHOW_HELP_AND_RETURN(ec, args);
 
   let const source = operands.is_empty() ? StringView{"-"} : operands[0].view();
-  let const content = read_named_or_stdin(ec, source);
-  if (os::INTERRUPT_REQUESTED) return 130;
-  if (!content.has_value())
+  let reader = text_reader{};
+  if (!reader.open(ec, source))
     throw Error{
         "uniq: cannot read '" + String{cxt.scratch_allocator(), source}
           +
@@ -57,35 +56,51 @@ fn Uniq::execute(const ExecContext &ec, EvalContext &cxt,
     };
 
   let const should_show_count = FLAG_UNIQ_COUNT.is_enabled();
-  let output = String{cxt.scratch_allocator()};
+  let writer = text_writer{ec};
   bool has_previous = false;
-  StringView previous{};
+  /* The reader reuses its buffer, so the line a run is compared against is
+     kept as a copy. */
+  let previous = String{heap_allocator()};
   u64 run_length = 0;
 
   let const do_flush = [&]() throws -> void {
     if (!has_previous) return;
     if (should_show_count)
-      output += count_prefix(run_length, cxt.scratch_allocator());
-    output += previous;
-    output += '\n';
+      writer.write(count_prefix(run_length, cxt.scratch_allocator()));
+    writer.write(previous.view());
+    writer.write('\n');
   };
 
-  for (const StringView &line : split_keep_newlines(content->view())) {
-    let const body = line.without_trailing_newline();
-    if (has_previous && body == previous) {
+  loop
+  {
+    let const line = reader.next_line();
+    if (os::INTERRUPT_REQUESTED) return 130;
+    if (!line.has_value()) {
+      writer.flush();
+      throw Error{
+          "uniq: cannot read '" + String{cxt.scratch_allocator(), source}
+            +
+          "': " + os::last_system_error_message()
+      };
+    }
+    if (line->is_empty()) break;
+
+    let const body = line->without_trailing_newline();
+    if (has_previous && body == previous.view()) {
       run_length++;
       continue;
     }
 
     do_flush();
-    previous = body;
+    previous.clear();
+    previous.append(body);
     run_length = 1;
     has_previous = true;
   }
 
   do_flush();
 
-  ec.print_to_stdout(output);
+  writer.flush();
   return 0;
 }
 
@@ -112,10 +112,36 @@ fn Wc::execute(const ExecContext &ec, EvalContext &cxt,
   u64 total_words = 0;
   u64 total_bytes = 0;
   i32 status = 0;
+  let reader = text_reader{};
   for (const StringView &source : sources) {
-    let const content = read_named_or_stdin(ec, source);
+    u64 lines = 0;
+    u64 words = 0;
+    u64 bytes = 0;
+    /* A word may run across a chunk boundary, so the state carries over. */
+    bool is_in_word = false;
+    let is_read = reader.open(ec, source);
+    while (is_read) {
+      let const chunk = reader.next_chunk();
+      if (!chunk.has_value()) {
+        is_read = false;
+        break;
+      }
+      if (chunk->is_empty()) break;
+      bytes += chunk->length;
+      for (usize i = 0; i < chunk->length; i++) {
+        let const c = (*chunk)[i];
+        if (c == '\n') lines++;
+        if (is_blank(c)) {
+          is_in_word = false;
+        } else if (!is_in_word) {
+          is_in_word = true;
+          words++;
+        }
+      }
+    }
+    reader.close();
     if (os::INTERRUPT_REQUESTED) return 130;
-    if (!content.has_value()) {
+    if (!is_read) {
       report_soft_shitbox_error(
           ec, cxt,
           "wc: " + String{cxt.scratch_allocator(), source} + ": " +
@@ -123,21 +149,6 @@ fn Wc::execute(const ExecContext &ec, EvalContext &cxt,
       status = 1;
       continue;
     }
-    u64 lines = 0;
-    u64 words = 0;
-    u64 bytes = content->count();
-    bool is_in_word = false;
-    let const bytes_view = content->view();
-    for (usize i = 0; i < bytes_view.length; i++) {
-      let const c = bytes_view[i];
-      if (c == '\n') lines++;
-      if (is_blank(c)) {
-        is_in_word = false;
-      } else if (!is_in_word) {
-        is_in_word = true;
-        words++;
-      }
-    }
 
     total_lines += lines;
     total_words += words;
@@ -0,0 +1,20 @@
+#!/usr/bin/env bash
+# Appending: build one long string with var+= and one long array with arr+=()
+# out of short pieces. Each append should cost the piece, not the value built
+# so far, so doubling COUNT should roughly double the time.
+# Usage: appends [COUNT]
+
+count=${1:-1000000}
+
+out=
+list=()
+declare -A by_key=()
+i=0
+while [ "$i" -lt "$count" ]; do
+    out+="line $i;"
+    list+=("$i")
+    by_key[k]+=x
+    i=$((i + 1))
+done
+
+echo "$i ${#out} ${#list[@]} ${#by_key[k]} ${list[$((count - 1))]}"
@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+# Regex matching: test generated log lines against [[ =~ ]] patterns and read
+# the groups out of BASH_REMATCH. The patterns repeat across the loop, so they
+# compile once and each test should cost the line, not the pattern.
+# Usage: regex [LINES]
+
+count=${1:-100000}
+
+levels=(INFO WARN ERROR DEBUG)
+errors=0
+warnings=0
+slow=0
+total=0
+i=0
+while [ "$i" -lt "$count" ]; do
+    line="2024-01-$((i % 18 + 10)) 12:$((i % 60)):07 ${levels[i % 4]}"
+    line+=" host$((i % 97)).example.org took $((i * 7 % 1000))ms"
+    line+=" path=/api/v$((i % 3))/items/$i"
+    if [[ $line =~ ^([0-9-]+)\ [0-9:]+\ (ERROR|WARN)\ ([a-z0-9]+)\.example\.org\ took\ ([0-9]+)ms ]]; then
+        if [ "${BASH_REMATCH[2]}" = ERROR ]; then
+            errors=$((errors + 1))
+        else
+            warnings=$((warnings + 1))
+        fi
+        total=$((total + BASH_REMATCH[4]))
+    fi
+    [[ $line =~ took\ (9[0-9][0-9])ms.*items/[0-9]*7$ ]] && slow=$((slow + 1))
+    i=$((i + 1))
+done
+
+echo "$i $errors $warnings $slow $total"
@@ -0,0 +1,20 @@
+#!/usr/bin/env bash
+# Spawn latency against the shell's resident size: grows the heap by MEGABYTES
+# through one padded variable, then runs COUNT external commands. A fork copies
+# the page tables of the whole heap and a vfork-style spawn does not, so the
+# time should stay flat as the heap grows.
+# It measures plain spawns only. The script runs without a terminal or job
+# control, so no command takes the terminal before it starts, and the handoff
+# spawn that shitbox timeout makes in an interactive shell is not timed here.
+# Usage: spawn [MEGABYTES] [COUNT]
+
+megabytes=${1:-1}
+count=${2:-500}
+
+printf -v pad '%*s' $((megabytes * 1048576)) ''
+
+for (( i = 0; i < count; i++ )); do
+    /bin/true
+done
+
+echo "${#pad} $count"
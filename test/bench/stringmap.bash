@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+# Hash table churn: inserts KEYS distinct keys into an associative array, looks
+# each one up, then erases and reinserts every other key twice over, so deleted
+# slots pile up between the live ones. Associative arrays sit on StringMap, and
+# the lookups dominate the loop once the table outgrows the caches. Run it at a
+# few sizes to see how probing holds up as the table grows.
+# Usage: stringmap [KEYS]
+
+keys=${1:-1000}
+declare -A table
+
+for (( i = 0; i < keys; i++ )); do
+    table[key$i]=$i
+done
+
+found=0
+for (( i = 0; i < keys; i++ )); do
+    (( found += ${table[key$i]} ))
+done
+
+for (( round = 0; round < 2; round++ )); do
+    for (( i = round; i < keys; i += 2 )); do
+        unset "table[key$i]"
+    done
+    for (( i = round; i < keys; i += 2 )); do
+        table[key$i]=$round
+    done
+done
+
+missing=0
+for (( i = 0; i < keys; i++ )); do
+    [[ -v table[key$i] ]] || (( missing++ ))
+    [[ -v table[other$i] ]] && (( missing++ ))
+done
+
+echo "${#table[@]} $found $missing"
@@ -0,0 +1,27 @@
+#!/usr/bin/env bash
+# Variable lookup: a hot loop that reads and assigns a handful of plain scalars
+# while a few hundred unrelated names sit in the table, so every lookup that
+# hashes and probes pays for it. Run it against two builds to compare.
+# Usage: variables [ITERATIONS]
+
+iterations=${1:-100000}
+
+for (( n = 0; n < 400; n++ )); do
+    eval "filler_$n=$n"
+done
+
+first=alpha
+second=beta
+third=gamma
+readonly fixed=delta
+declare -i counter=0
+joined=
+
+i=0
+while [ "$i" -lt "$iterations" ]; do
+    joined=$first$second$third$fixed
+    counter=counter+1
+    i=$((i + 1))
+done
+
+echo "$i $counter ${#joined} $filler_399"
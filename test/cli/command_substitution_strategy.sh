@@ -36,3 +36,5 @@ printf 'in-process=%s\n' \
     "$(grep -c 'running the captured substitution in process' "$d/log")"
 printf 'child-process=%s\n' \
     "$(grep -c 'running the captured substitution in a child process' "$d/log")"
+printf 'in-memory=%s\n' \
+    "$(grep -c 'running the captured substitution in process into memory' "$d/log")"
@@ -0,0 +1,33 @@
+# The shell keeps the exported variables in a table of its own and packs the
+# environment a program receives only when it spawns one. Every change made
+# between two spawns has to reach the second, an unset has to drop the name,
+# and an export scoped to a function, a subshell, or a prefix assignment has
+# to be gone once the scope ends.
+unset SHIT_FLAGS
+BIN=$(CDPATH= cd -- "$(dirname -- "$BIN")" && pwd)/$(basename -- "$BIN")
+
+show() { "$BIN" -c "$1" 2>&1; }
+
+echo "--- an inherited name, changed, unset, and set again ---"
+INHERITED=from-parent show '
+sh -c "echo \$INHERITED"
+export INHERITED=changed; sh -c "echo \$INHERITED"
+unset INHERITED; sh -c "echo [\${INHERITED-unset}]"
+export INHERITED=back; sh -c "echo \$INHERITED"'
+
+echo "--- set -a exports every assignment ---"
+show 'set -a; A=1; A=2; B=3; sh -c "echo \$A \$B"'
+
+echo "--- scoped exports end with their scope ---"
+show 'export S=outer
+f() { local S=local; export S; sh -c "echo in function \$S"; }
+f; sh -c "echo after function \$S"
+(export S=subshell; sh -c "echo in subshell \$S"); sh -c "echo after subshell \$S"
+S=prefix sh -c "echo prefix \$S"; sh -c "echo after prefix \$S"'
+
+echo "--- env lists the table in order ---"
+show 'export ORDER_ONE=1 ORDER_TWO=2 ORDER_THREE=3; unset ORDER_TWO
+export ORDER_TWO=again; env | grep "^ORDER_"'
+
+echo "--- exec -c still starts with nothing ---"
+show 'export KEPT=1; exec -c /usr/bin/env' | wc -l | tr -d ' '
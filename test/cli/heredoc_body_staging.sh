@@ -0,0 +1,43 @@
+# A heredoc or here-string body that fits a pipe buffer is handed over in a
+# pre-filled pipe, and a larger one in a sealed memory file, with a temp file
+# left as the fallback. Whichever holds it, the reader sees the whole body and
+# then end of file, on fd 0 or on the numbered descriptor it names.
+unset SHIT_FLAGS
+
+"$BIN" -c '
+echo "--- a small heredoc and a here-string ---"
+shitbox wc -c <<EOF
+small body
+EOF
+shitbox wc -c <<< "here-string"
+
+echo "--- a body larger than a pipe buffer ---"
+big=$(shitbox seq 1 50000)
+shitbox wc -l <<EOF
+$big
+EOF
+shitbox wc -c <<< "$big"
+
+echo "--- a numbered heredoc ---"
+awk "END { print NR }" /proc/self/fd/3 3<<EOF
+$big
+EOF
+awk "{ print }" /proc/self/fd/4 4<<EOF
+four
+EOF
+
+echo "--- a large body can be read twice from its start ---"
+{ head -n 1 /proc/self/fd/0; head -n 1 /proc/self/fd/0; } <<EOF
+$big
+EOF
+
+echo "--- a heredoc in a loop ---"
+i=0
+while [ "$i" -lt 3 ]; do
+  read -r line <<EOF
+pass $i
+EOF
+  echo "$line"
+  let i=i+1
+done
+' 2>&1
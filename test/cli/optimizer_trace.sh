@@ -28,3 +28,9 @@ printf '' | "$BIN" --show-optimizer-state -c 'read n; echo $((n + 1))' 2>&1 | ./
 
 echo "=== undecidable condition does not fold ==="
 "$BIN" --show-optimizer-state -c 'if [ -f /nonexistent_optimizer_probe ]; then echo a; fi; echo done'
+
+echo "=== pure shitbox substitution folds ==="
+"$BIN" --show-optimizer-state -c 'p=/usr/lib/libz.so; echo "$(shitbox basename "$p" .so)" "$(shitbox dirname "$p")" "$(shitbox seq 2 4)"'
+
+echo "=== failing, runtime, and shadowed substitutions do not fold ==="
+printf '3\n' | "$BIN" --show-optimizer-state -c 'x=$(shitbox seq 5000); echo ${#x}; read -r n; echo $(shitbox seq "$n"); shitbox() { echo shadowed; }; echo "$(shitbox basename /a/b)"'
@@ -0,0 +1,19 @@
+unset SHIT_FLAGS
+# Shitbox stages of a foreground pipeline run on threads of the shell joined by
+# in-memory rings, and the statuses read the same as when every stage forks: a
+# failing stage shows in PIPESTATUS and pipefail, a producer whose reader left
+# exits as if by SIGPIPE, and a stage next to an external program keeps the
+# real pipe.
+echo "== rings between shitbox stages carry every byte:"
+"$BIN" -c 'shitbox seq 1 200000 | shitbox tr 7 x | shitbox grep x | shitbox wc -l; echo "${PIPESTATUS[@]}"' 2>&1
+echo "== a failing stage shows in the status and PIPESTATUS:"
+"$BIN" -c 'shitbox cat /nonexistent/file | shitbox wc -l; echo "$? ${PIPESTATUS[@]}"' 2>/dev/null
+echo "== pipefail reports the failing stage:"
+"$BIN" -c 'set -o pipefail; shitbox cat /nonexistent/file | shitbox sort | shitbox wc -l; echo "$? ${PIPESTATUS[@]}"' 2>/dev/null
+echo "== a producer whose reader left exits 141:"
+"$BIN" -c 'shitbox seq 1 300000 | shitbox basename x; echo "${PIPESTATUS[@]}"' 2>&1
+"$BIN" -c 'shitbox seq 1 300000 | shitbox cat | head -n 1; echo "${PIPESTATUS[@]}"' 2>&1
+echo "== an external stage between threads keeps its pipes:"
+"$BIN" -c 'printf "b\na\nb\n" | shitbox sort | cat | shitbox uniq -c; echo "${PIPESTATUS[@]}"' 2>&1
+echo "== a redirected stage leaves its neighbour an empty input:"
+"$BIN" -c 'shitbox seq 1 3 > /dev/null | shitbox wc -l; echo "${PIPESTATUS[@]}"' 2>&1
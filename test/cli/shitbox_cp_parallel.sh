@@ -0,0 +1,61 @@
+# cp -r copies a tree on a pool of workers that name each entry through the
+# open directory holding it. Whatever the job count, the copy matches the
+# source, files that share an inode come out sharing one, a new directory
+# takes its mode once it is full, and the verbose lines and the first failure
+# come out in the order a copy of one entry at a time would print them.
+unset SHIT_FLAGS
+BIN=$(CDPATH= cd -- "$(dirname -- "$BIN")" && pwd)/$(basename -- "$BIN")
+d=$(mktemp -d) || exit 1
+cd "$d" || exit 1
+
+for p in 1 2 3 4 5 6 7 8; do
+  mkdir -p "src/pkg$p/lib/deep/er"
+  for f in 1 2 3 4 5 6 7 8 9 10; do
+    echo "$p $f" > "src/pkg$p/lib/f$f"
+  done
+  echo "$p" > "src/pkg$p/lib/deep/er/leaf"
+done
+ln src/pkg1/lib/f1 src/pkg8/lib/linked
+ln src/pkg1/lib/f1 src/pkg4/linked_too
+ln -s ../pkg1 src/pkg2/up
+mkdir src/empty
+chmod 500 src/pkg5/lib/deep
+
+inode() { ls -i "$1" | awk '{ print $1 }'; }
+
+echo "--- every job count copies the same tree ---"
+for j in 1 2 8; do
+  "$BIN" -c "shitbox cp -r -j$j src out$j"
+  diff -r src "out$j" > /dev/null && echo "-j$j same"
+  [ "$(inode "out$j/pkg1/lib/f1")" = "$(inode "out$j/pkg8/lib/linked")" ] &&
+    [ "$(inode "out$j/pkg1/lib/f1")" = "$(inode "out$j/pkg4/linked_too")" ] &&
+    echo "-j$j hard links kept"
+  readlink "out$j/pkg2/up"
+  stat -c %a "out$j/pkg5/lib/deep"
+done
+"$BIN" -c 'shitbox cp -r --jobs=3 src/pkg3 long_form' && ls long_form/lib | wc -l
+
+echo "--- verbose lines come out in walk order ---"
+"$BIN" -c 'shitbox cp -rv -j1 src v1' | sed 's/v1/OUT/' > one_at_a_time
+for j in 4 8 8; do
+  "$BIN" -c "shitbox cp -rv -j$j src v$j-$RANDOM" | sed 's/v[0-9]*-[0-9]*/OUT/' |
+    cmp -s - one_at_a_time && echo "-j$j matches -j1"
+done
+wc -l < one_at_a_time
+
+echo "--- the first failure in walk order is the one reported ---"
+mkdir -p blocked/pkg2/lib/f3 blocked/pkg7/lib/f9
+"$BIN" -c 'shitbox cp -r -j1 src/. blocked' 2>&1 | grep -o "unable to create '[^']*'" > first
+for j in 2 8 8; do
+  "$BIN" -c "shitbox cp -r -j$j src/. blocked" 2>&1 |
+    grep -o "unable to create '[^']*'" | cmp -s - first && echo "-j$j same failure"
+done
+wc -l < first
+[ -f blocked/pkg7/lib/f8 ] && echo "the rest of the tree still copied"
+
+echo "--- a bad job count ---"
+"$BIN" -c 'shitbox cp -r -j0 src bad' 2>&1 | grep -o "invalid job count '0'"
+"$BIN" -c 'shitbox cp -r -j x src bad' 2>&1 | grep -o "invalid job count 'x'"
+
+chmod -R u+w .
+cd / && rm -rf "$d"
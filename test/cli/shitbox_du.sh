@@ -0,0 +1,50 @@
+# du counts the blocks each entry takes by default and the file lengths with
+# --apparent-size, both the same as the system du in bytes. A file with
+# several names counts once, a symlink counts as itself, and the total is the
+# same whatever the job count.
+unset SHIT_FLAGS
+BIN=$(CDPATH= cd -- "$(dirname -- "$BIN")" && pwd)/$(basename -- "$BIN")
+d=$(mktemp -d) || exit 1
+cd "$d" || exit 1
+
+mkdir -p tree/a/b/c tree/empty
+seq 1 100000 > tree/a/numbers
+ln tree/a/numbers tree/a/b/second_name
+ln -s numbers tree/a/link
+ln -s .. tree/a/b/c/up
+truncate -s 10M tree/a/b/c/sparse
+for i in 1 2 3 4 5 6 7 8; do
+  mkdir -p "tree/wide/$i"
+  echo "$i" > "tree/wide/$i/file"
+done
+
+same() { [ "$1" = "$2" ] && echo "$3 same" || echo "$3 DIFFERS: $1 $2"; }
+total() { awk '{ print $1 }'; }
+
+echo "--- blocks and lengths match the system du ---"
+same "$("$BIN" -c 'shitbox du tree' | total)" "$(du -s -B1 tree | total)" blocks
+same "$("$BIN" -c 'shitbox du --apparent-size tree' | total)" \
+  "$(du -s -B1 --apparent-size tree | total)" lengths
+"$BIN" -c 'shitbox du --apparent-size tree/a/b/c/sparse'
+[ "$("$BIN" -c 'shitbox du tree/a/b/c/sparse' | total)" -lt 10485760 ] &&
+  echo "a sparse file takes less than its length"
+
+echo "--- every job count gives the same total ---"
+one=$("$BIN" -c 'shitbox du tree' | total)
+for j in 2 8; do
+  same "$("$BIN" -c "shitbox du -j$j tree" | total)" "$one" "-j$j"
+done
+same "$("$BIN" -c 'shitbox du --jobs=3 --apparent-size tree' | total)" \
+  "$("$BIN" -c 'shitbox du --apparent-size tree' | total)" "--jobs=3"
+
+echo "--- a second name is not counted again ---"
+"$BIN" -c 'shitbox du --apparent-size tree/a/numbers tree/a/b/second_name'
+"$BIN" -c 'shitbox du -x --apparent-size tree/a/link'
+
+echo "--- errors ---"
+"$BIN" -c 'shitbox du tree/missing' 2>&1 | grep -o "cannot access '[^']*'"
+"$BIN" -c 'shitbox du tree/missing' 2>/dev/null
+echo "rc=$?"
+"$BIN" -c 'shitbox du -j0 tree' 2>&1 | grep -o "invalid job count '0'"
+
+cd / && rm -rf "$d"
@@ -25,8 +25,8 @@ echo "--- ls -l sym (mode nlink size name) ---"
 "$BIN" -c 'shitbox ls -l sym' | sed 's/^l[rwxsStT-]\{9\}/lrwxrwxrwx/' | awk '{print $1, $2, $5, $NF}'
 echo "--- ls after operations ---"
 "$BIN" -c 'shitbox ls'
-echo "--- du -s nums.txt ---"
-"$BIN" -c 'shitbox du -s nums.txt'
+echo "--- du -s --apparent-size nums.txt ---"
+"$BIN" -c 'shitbox du -s --apparent-size nums.txt'
 echo "--- basename ---"
 "$BIN" -c 'shitbox basename /usr/local/libfoo.so .so'
 echo "--- dirname ---"
@@ -0,0 +1,58 @@
+# find compiles its expression once and walks the tree on several jobs, and
+# the output keeps the sorted walk order whatever the job count. -unordered
+# drops that order, so its output is sorted here before it is compared.
+unset SHIT_FLAGS
+BIN=$(CDPATH= cd -- "$(dirname -- "$BIN")" && pwd)/$(basename -- "$BIN")
+d=$(mktemp -d) || exit 1
+cd "$d" || exit 1
+
+mkdir -p t/src/lib t/src/.git/objects t/docs
+printf 'x' > t/src/main.c
+head -c 3000 /dev/zero > t/src/lib/big.C
+printf 'ab' > t/src/lib/util.h
+printf '' > t/src/.git/objects/pack
+printf 'hello' > t/docs/README
+ln -s README t/docs/link
+touch -d '2001-01-01' t/docs/README t/src/main.c
+touch -d '2001-01-02' t/src/stamp
+for i in 1 2 3 4 5 6; do
+  mkdir -p "t/wide/$i"
+  printf '%s' "$i" > "t/wide/$i/f$i.txt"
+done
+
+echo "--- -iname ---"
+"$BIN" -c "shitbox find t -iname '*.c'"
+echo "--- bracket and class ---"
+"$BIN" -c "shitbox find t -name '[[:upper:]]*'"
+"$BIN" -c "shitbox find t -name 'f[!1-4].txt'"
+echo "--- -o and ! ---"
+"$BIN" -c "shitbox find t -name '*.h' -o -type l"
+"$BIN" -c "shitbox find t/src ! -type d"
+echo "--- parentheses ---"
+"$BIN" -c "shitbox find t/src '(' -name '*.c' -o -name '*.h' ')' -print"
+echo "--- -prune ---"
+"$BIN" -c "shitbox find t -name .git -prune -o -type f -print"
+echo "--- -size ---"
+"$BIN" -c "shitbox find t/src -type f -size +5"
+"$BIN" -c "shitbox find t/src -type f -size -2c"
+"$BIN" -c "shitbox find t/src -type f -size 2c"
+echo "--- -newer and -mtime ---"
+"$BIN" -c "shitbox find t/src -type f -newer t/src/stamp"
+"$BIN" -c "shitbox find t -type f -mtime +1000"
+echo "--- -type list ---"
+"$BIN" -c "shitbox find t/docs -type l,f"
+echo "--- -print0 ---"
+"$BIN" -c "shitbox find t/docs -type f -print0" | tr '\0' '|'
+echo
+echo "--- -j keeps the order ---"
+"$BIN" -c 'shitbox find t -j 1' > one
+"$BIN" -c 'shitbox find t -j 4' > four
+cmp one four && echo same
+"$BIN" -c 'shitbox find t -unordered -j 3' | LC_ALL=C sort > unordered
+LC_ALL=C sort one | cmp - unordered && echo same
+echo "--- errors ---"
+"$BIN" -c "shitbox find t '(' -name x" 2>&1 | head -n 1
+"$BIN" -c "shitbox find t -size lots" 2>&1 | head -n 1
+"$BIN" -c "shitbox find t -j 0" 2>&1 | head -n 1
+
+cd / && rm -rf "$d"
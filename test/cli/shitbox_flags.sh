@@ -10,10 +10,10 @@ d=$(mktemp -d) || exit 1
 cd "$d" || exit 1
 "$BIN" -c 'shitbox seq 1 500 > big.txt'
 
-echo "--- du -s prints bytes ---"
-"$BIN" -c 'shitbox du -s big.txt'
+echo "--- du -s --apparent-size prints bytes ---"
+"$BIN" -c 'shitbox du -s --apparent-size big.txt'
 echo "--- du -sh is human-readable ---"
-"$BIN" -c 'shitbox du -sh big.txt'
+"$BIN" -c 'shitbox du -sh --apparent-size big.txt'
 # The owner, the group, and the time vary by machine, so the golden keeps only
 # the mode, the link count, the size, and the name of the long row.
 echo "--- ls -l prints bytes ---"
@@ -0,0 +1,92 @@
+# cat, cp and tee hand the copy to the kernel where both ends are descriptors:
+# a clone or copy_file_range between files, sendfile from a file, and splice
+# from a pipe. What arrives must match the source byte for byte whichever path
+# took it, holes of a sparse file stay holes, and the files that read back
+# more than their length claims, as the ones in /proc do, still read whole.
+unset SHIT_FLAGS
+BIN=$(CDPATH= cd -- "$(dirname -- "$BIN")" && pwd)/$(basename -- "$BIN")
+d=$(mktemp -d) || exit 1
+cd "$d" || exit 1
+
+awk 'BEGIN { for (i = 0; i < 300000; i++) print i, "some text to copy" }' > source
+
+same() { cmp -s "$1" "$2" && echo "$3 same" || echo "$3 DIFFERS"; }
+
+echo "--- file to file ---"
+"$BIN" -c 'shitbox cp source copied; shitbox cat source > catted'
+same source copied cp
+same source catted cat
+"$BIN" -c 'shitbox cat source source > twice'
+cat source source > expected_twice
+same expected_twice twice "cat of two files"
+"$BIN" -c 'echo head > appended; shitbox cat source >> appended'
+{ echo head; cat source; } > expected_appended
+same expected_appended appended "cat onto an appended file"
+
+echo "--- pipes on either side ---"
+"$BIN" -c 'shitbox cat source | cat > from_file_to_pipe'
+same source from_file_to_pipe "file into a pipe"
+"$BIN" -c 'awk 1 source | shitbox cat > from_pipe_to_file'
+same source from_pipe_to_file "pipe into a file"
+"$BIN" -c 'awk 1 source | shitbox tee | cat > through_tee'
+same source through_tee "tee with no file"
+"$BIN" -c 'awk 1 source | shitbox tee teed > tee_out'
+same source teed "tee file"
+same source tee_out "tee output"
+"$BIN" -c 'shitbox cat source | head -n 1; echo "${PIPESTATUS[@]}"'
+
+echo "--- a file whose length reads as zero ---"
+"$BIN" -c 'shitbox cat /proc/self/stat' | awk '{ print (NF > 20) }'
+"$BIN" -c 'shitbox cp /proc/self/stat stat; shitbox wc -l < stat'
+
+echo "--- a sparse file keeps its holes ---"
+printf start > sparse
+printf end | dd of=sparse bs=1 seek=50000000 conv=notrunc 2>/dev/null
+truncate -s 80000000 sparse
+"$BIN" -c 'shitbox cp sparse sparse_copy'
+same sparse sparse_copy "sparse copy"
+wc -c < sparse_copy
+[ "$(stat -c %b sparse_copy)" -le "$(stat -c %b sparse)" ] && echo "no more blocks than the source"
+
+echo "--- the output file as an input ---"
+# Appending a file to itself would read back every byte it writes, so it is
+# refused the way GNU cat refuses it, and the other operands still go out.
+printf 'hello\n' > self
+printf 'x\n' > other
+timeout 10 "$BIN" -c 'shitbox cat self >> self' 2>&1 |
+  grep -o 'cat: self: input file is output file'
+timeout 10 "$BIN" -c 'shitbox cat self >> self' 2>/dev/null
+echo "rc=$?"
+timeout 10 "$BIN" -c 'shitbox cat -n self >> self' 2>&1 |
+  grep -o 'cat: self: input file is output file'
+timeout 10 "$BIN" -c 'shitbox cat other self other >> self' 2>/dev/null
+cat self
+timeout 10 "$BIN" -c 'shitbox tee < self >> self' 2>&1 |
+  grep -o 'tee: input file is output file'
+wc -c < self
+printf 'in place\n' > overwritten
+"$BIN" -c 'shitbox cat overwritten 1<> overwritten; echo "rc=$?"'
+cat overwritten
+
+echo "--- a destination that is the source ---"
+# The destination is truncated when it opens, so one that is the source under
+# another name is refused before that and keeps its bytes.
+printf 'data\n' > linked
+ln linked hardlink
+"$BIN" -c 'shitbox cp linked hardlink' 2>&1 | grep -o 'are the same file'
+"$BIN" -c 'shitbox cp linked hardlink' 2>/dev/null
+echo "rc=$?"
+cat linked hardlink
+"$BIN" -c 'shitbox cp linked linked' 2>&1 | grep -o 'are the same file'
+cat linked
+mkdir tree_from tree_to
+printf 'tree\n' > tree_from/x
+ln tree_from/x tree_to/x
+"$BIN" -c 'shitbox cp -r tree_from/. tree_to' 2>&1 | grep -o 'are the same file'
+cat tree_from/x tree_to/x
+
+echo "--- errors keep their side ---"
+"$BIN" -c 'shitbox cp source /nonexistent/dir/file' 2>&1 | grep -o "unable to create '[^']*'"
+"$BIN" -c 'shitbox cat /nonexistent/file; echo "rc=$?"' 2>/dev/null
+
+cd / && rm -rf "$d"
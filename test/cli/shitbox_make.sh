@@ -62,7 +62,7 @@ EOF
 echo "--- advanced features ---"
 "$BIN" -c 'shitbox make' 2>&1
 
-echo "--- ignored flags -B and -k ---"
+echo "--- ignored flag -B, -k with nothing failing ---"
 cat > Makefile <<'EOF'
 all:
 	@echo built
@@ -78,3 +78,11 @@ broken:
 EOF
 "$BIN" -c 'shitbox make broken' 2>&1
 echo "rc=$?"
+
+echo "--- --debug=time reports each phase ---"
+cat > Makefile <<'EOF'
+all:
+	@echo timed
+EOF
+"$BIN" -c 'shitbox make --debug=time' 2>&1 | sed 's/[0-9][0-9]*\.[0-9]*ms/Nms/g'
+"$BIN" -c 'shitbox make --debug=jobs' 2>&1 | head -n 1
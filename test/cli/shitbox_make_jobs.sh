@@ -0,0 +1,81 @@
+# With -j the make runs the recipes of independent targets at once, each in a
+# forked job, while a target still waits for its prerequisites. -k keeps the
+# targets that do not depend on a failed one building, and a recipe's $(MAKE)
+# finds the jobserver in MAKEFLAGS and shares the parent's job slots.
+unset SHIT_FLAGS MAKEFLAGS
+BIN=$(CDPATH= cd -- "$(dirname -- "$BIN")" && pwd)/$(basename -- "$BIN")
+d=$(mktemp -d) || exit 1
+cd "$d" || exit 1
+
+cat > Makefile <<'EOF'
+all: link
+	@echo all
+link: one two three
+	@cat one two three
+one:
+	@sleep 0.2; echo one > one
+two:
+	@echo two > two
+three: two
+	@cat two > three; echo three >> three
+EOF
+
+echo "--- prerequisites finish before their target ---"
+"$BIN" -c 'shitbox make -j4'
+echo "rc=$?"
+rm -f one two three
+
+echo "--- a spaced count and the long form ---"
+"$BIN" -c 'shitbox make -j 3 one && shitbox make --jobs=2 two' 2>&1
+echo "rc=$?"
+rm -f one two three
+
+echo "--- a bare -j ---"
+"$BIN" -c 'shitbox make -j link' | sort
+rm -f one two three
+
+echo "--- an invalid count ---"
+"$BIN" -c 'shitbox make -j0' 2>&1 | head -n 1
+"$BIN" -c 'shitbox make -jx' 2>&1 | head -n 1
+"$BIN" -c 'shitbox make --jobs=' 2>&1 | head -n 1
+"$BIN" -c 'shitbox make -l high' 2>&1 | head -n 1
+
+cat > Makefile <<'EOF'
+all: good bad after_bad
+good:
+	@sleep 0.1; echo good
+bad:
+	@exit 3
+after_bad: bad
+	@echo after_bad must not run
+EOF
+
+echo "--- a failure stops the build with status 2 ---"
+# Without -k the failure is raised once the running jobs finish, as the serial
+# build raises it, so the script stops there too.
+for jobs in -j2 -j1; do
+  "$BIN" -c "shitbox make $jobs; echo rc=\$?" > out 2>&1
+  echo "shell rc=$?"
+  grep -v '^ ' out
+done
+
+echo "--- -k builds what does not depend on the failure ---"
+"$BIN" -c 'shitbox make -k -j2; echo rc=$?' 2>&1 | grep -v '^ ' | sort
+"$BIN" -c 'shitbox make -k; echo rc=$?' 2>&1 | grep -v '^ ' | sort
+
+cat > Makefile <<'EOF'
+top: sub
+sub:
+	@case "$$MAKEFLAGS" in *--jobserver-auth=*) echo outer shares;; esac
+	@$(MAKE) inner
+inner:
+	@case "$$MAKEFLAGS" in *--jobserver-auth=*) echo inner sees it;; esac
+EOF
+
+echo "--- a recipe's make joins the jobserver ---"
+"$BIN" -c 'shitbox make -j2'
+echo "rc=$?"
+echo "--- MAKEFLAGS is restored after the build ---"
+"$BIN" -c 'shitbox make -j2 >/dev/null; echo "[${MAKEFLAGS-unset}]"'
+
+cd / && rm -rf "$d"
@@ -31,3 +31,25 @@ EOF
 : > b
 : > c
 "$BIN" -c 'shitbox make'
+
+echo "--- the first pattern in the file wins across suffixes ---"
+cat > Makefile <<'EOF'
+%.gz: %
+	@echo gz rule for $@
+%.tar.gz: %.tar
+	@echo tar rule for $@
+%.z: %
+	@echo never
+EOF
+: > pkg.tar
+"$BIN" -c 'shitbox make pkg.tar.gz'
+"$BIN" -c 'shitbox make missing.z' 2>&1 | head -n 1
+
+echo "--- a file a recipe creates satisfies a later prerequisite ---"
+cat > Makefile <<'EOF'
+all: gen generated.h
+	@echo saw generated.h
+gen:
+	@: > generated.h
+EOF
+"$BIN" -c 'shitbox make'
@@ -0,0 +1,42 @@
+# Each recipe line runs in a subshell of its own, by snapshot rather than a
+# fork, so a cd, an assignment, a trap, an exit, or a ulimit in one line never
+# reaches the next line or the shell that ran make. Under .ONESHELL the lines
+# of a recipe share one subshell.
+unset SHIT_FLAGS
+BIN=$(CDPATH= cd -- "$(dirname -- "$BIN")" && pwd)/$(basename -- "$BIN")
+d=$(mktemp -d) || exit 1
+mkdir "$d/top" "$d/top/sub" && cd "$d/top" || exit 1
+
+cat > Makefile <<'EOF'
+isolated:
+	@cd sub; X=1; echo "line one in $$(basename $$PWD) with X=$$X"
+	@echo "line two in $$(basename $$PWD) with X=[$$X]"
+	@trap 'echo exit trap of line three' EXIT; echo line three
+	@echo line four
+	@exit 0; echo never
+	@echo after an exit
+	@ulimit -n 32; echo "limit inside $$(ulimit -n)"
+	@exec echo exec ends only its line
+	@echo after the exec
+	-@set -e; false; echo never
+	-@exit 5
+	@echo after an ignored failure
+EOF
+
+echo "--- every line is its own subshell ---"
+"$BIN" -c 'before=$(ulimit -n); shitbox make; echo "rc=$?";
+           echo "make ran in $(basename "$PWD") with X=[${X-}]";
+           [ "$(ulimit -n)" = "$before" ] && echo "limit unchanged"'
+
+cat > Makefile <<'EOF'
+.ONESHELL:
+shared:
+	@cd sub
+	X=2
+	echo "one shell in $$(basename $$PWD) with X=$$X"
+EOF
+
+echo "--- .ONESHELL runs the recipe as one script ---"
+"$BIN" -c 'shitbox make shared; echo "rc=$?"; basename "$PWD"'
+
+cd / && rm -rf "$d"
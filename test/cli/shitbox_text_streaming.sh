@@ -0,0 +1,51 @@
+# The text utilities read and write through fixed buffers instead of whole
+# inputs, so a line longer than a buffer or split across two reads comes out
+# intact, the counts from the end still see the whole input, and a reader that
+# never sees the end of its input still passes lines on.
+unset SHIT_FLAGS
+BIN=$(CDPATH= cd -- "$(dirname -- "$BIN")" && pwd)/$(basename -- "$BIN")
+d=$(mktemp -d) || exit 1
+cd "$d" || exit 1
+
+# 150000 numbered lines and one 200000-byte line, so line ends fall at every
+# offset of a chunk and one line spans several chunks.
+seq 1 150000 > numbers
+awk 'BEGIN { s = ""; for (i = 0; i < 200000; i++) s = s "z"; print "head"; print s; printf "tail" }' > long
+
+sum() { cksum | awk '{ print $1, $2 }'; }
+
+echo "--- cat, cat -n and tee match the system tools ---"
+"$BIN" -c 'shitbox cat numbers long' | sum
+cat numbers long | sum
+"$BIN" -c 'shitbox cat -n numbers long' | sum
+cat -n numbers long | sum
+"$BIN" -c 'shitbox cat long | shitbox tee copy' | sum
+sum < copy
+
+echo "--- grep, uniq, tr and wc across chunk boundaries ---"
+"$BIN" -c 'shitbox grep 7 numbers' | sum
+grep 7 numbers | sum
+"$BIN" -c 'shitbox grep z long | shitbox wc -c'
+"$BIN" -c 'shitbox grep -v z long'
+"$BIN" -c 'shitbox tr 0-9 a-j < numbers | shitbox uniq -c | shitbox tail -n 1'
+"$BIN" -c 'shitbox wc numbers long'
+
+echo "--- head and tail counts over a long input ---"
+"$BIN" -c 'shitbox head -n 2 numbers; shitbox head -c 7 long; echo'
+"$BIN" -c 'shitbox head -n -149998 numbers'
+"$BIN" -c 'shitbox head -c -200005 long'
+"$BIN" -c 'shitbox tail -n 2 numbers; shitbox tail -c 6 long; echo'
+"$BIN" -c 'shitbox tail -n +149999 numbers'
+"$BIN" -c 'shitbox tail -c +200007 long; echo'
+"$BIN" -c 'shitbox tail -n 1 long | shitbox wc -c'
+"$BIN" -c 'shitbox head -n -1 long | shitbox wc -c'
+
+echo "--- an endless input still reaches the reader ---"
+timeout 10 "$BIN" -c 'shitbox yes | shitbox head -n 2'
+timeout 10 "$BIN" -c 'shitbox yes | shitbox grep y | shitbox head -n 1
+echo "${PIPESTATUS[@]}"'
+timeout 10 "$BIN" -c 'shitbox yes | shitbox tr y n | shitbox head -n 1
+echo "${PIPESTATUS[@]}"'
+echo "rc=$?"
+
+cd / && rm -rf "$d"
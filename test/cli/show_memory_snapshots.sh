@@ -0,0 +1,8 @@
+unset SHIT_FLAGS
+# A subshell or an in-process substitution shares the evaluator tables rather
+# than copying them, and --show-memory counts the snapshots taken. A write
+# inside the child clones only the shard it touches and never reaches the
+# parent.
+"$BIN" --show-memory -c 'a=1; b=2; x=$(a=3; echo $a); (b=4; echo $b); echo "$a $b $x"' 2>&1 |
+    sed -e 's/^\(State snapshots: taken [0-9]*\),.*/\1/' -e '/^State/!{/^[0-9]/!d}'
+"$BIN" --show-memory -c 'echo none' 2>&1 | grep -c '^State snapshots'
@@ -34,6 +34,14 @@ printf 'nested substitution traces=%s errors=%s parents=%s sites=%s\n' \
         grep -Fc 'echo ${UNSET_TRACE_POLICY:-$(no_such_nested_substitution_xyz)}')" \
     "$(printf '%s\n' "$out" | grep -c 'shit: 1:28: trace:')"
 
+# A second failing substitution still traces the script's own frame.
+printf 'a=$(shitbox basename --bogus)\nb=$(shitbox basename --bogus)\n' \
+    > "$d/twice"
+out=$("$BIN" --no-diagnostics "$d/twice" 2>&1)
+printf 'repeated substitution traces=%s errors=%s\n' \
+    "$(printf '%s\n' "$out" | grep -Ec 'trace:')" \
+    "$(printf '%s\n' "$out" | grep -c 'error:')"
+
 check_expansion_trace()
 {
     label=$1
@@ -0,0 +1,23 @@
+# Each child blocks on a read from its own fifo, and the script releases them
+# in a fixed order, so which job wait -n reports next never depends on timing.
+unset SHIT_FLAGS
+BIN=$(CDPATH= cd -- "$(dirname -- "$BIN")" && pwd)/$(basename -- "$BIN")
+d=$(mktemp -d) || exit 1
+cd "$d" || exit 1
+mkfifo a b c long last
+
+"$BIN" -c 'sh -c "read x < a; exit 3" & sh -c "read x < b; exit 4" &
+sh -c "read x < c; exit 0" &
+echo > a; wait -n; echo "first $?"
+echo > b; wait -n; echo "second $?"
+echo > c; wait -n; echo "third $?"
+wait -n; echo "none $?"' 2>&1
+"$BIN" -c 'sh -c "exit 5" & p=$!; wait -n "$p"; echo "pid $?"' 2>&1
+"$BIN" -c 'sh -c "read x < long" & s=$!; sh -c "exit 7" & q=$!
+wait -n "$q"; echo "listed $?"; echo > long; wait "$s"' 2>&1
+"$BIN" -c 'let i=0; while [ "$i" -lt 200 ]; do sh -c "exit 0" & let i=i+1; done
+sh -c "read x < last; exit 9" & let n=0
+while wait -n; do let n=n+1; if [ "$n" -eq 200 ]; then echo > last; fi; done
+wait -n; echo "drained $n then $?"' 2>&1
+
+cd / && rm -rf "$d"
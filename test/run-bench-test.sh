@@ -2,9 +2,17 @@
 # Benchmark configure.sh, configure.bash, and configure.shit across the reference
 # shells and shit, reporting wall-clock seconds at the given scale and checking
 # that shit output matches the reference shell. The Makefile passes SCALE, BIN,
-# DASH, BASHP, ZSH, ASH, YASH, BENCH, BENCH_BASH, and BENCH_SHIT. Run from the
-# test directory. The bash time keyword formats the wall clock through
-# TIMEFORMAT.
+# DASH, BASHP, ZSH, ASH, YASH, BENCH, BENCH_BASH, BENCH_SHIT, PRIMES, PRIMES_PY,
+# PRIMES_LIMIT, VARIABLES, VARIABLES_ITERATIONS, APPENDS, APPENDS_COUNT, REGEX,
+# REGEX_LINES, GREP_LINES, STRINGMAP, STRINGMAP_KEYS, SPAWN, SPAWN_COUNT, and
+# SPAWN_MEGABYTES. Run from the test directory. The bash time keyword formats
+# the wall clock through TIMEFORMAT.
+# The appends run is repeated at half the count, so the two times show whether
+# an append costs the piece or the whole value. The grep run searches a generated log of GREP_LINES
+# lines with the system grep and with shitbox grep. The stringmap run repeats at
+# each table size in STRINGMAP_KEYS. The spawn run repeats at each heap size in
+# SPAWN_MEGABYTES, once with no spawns so the heap setup can be told apart. It
+# times plain spawns, none of which hands the terminal over.
 
 export TIMEFORMAT="  %R"
 
@@ -23,6 +31,19 @@ ZS=$WORK/zs
 PP=$WORK/pp
 PB=$WORK/pb
 PS=$WORK/ps
+VB=$WORK/vb
+VS=$WORK/vs
+AB=$WORK/ab
+AS=$WORK/as
+RB=$WORK/rb
+RS=$WORK/rs
+LOG=$WORK/log
+GB=$WORK/gb
+GS=$WORK/gs
+MB=$WORK/mb
+MS=$WORK/ms
+PNB=$WORK/pnb
+PNS=$WORK/pns
 
 run_ref() {
     if ! command -v "$1" >/dev/null; then return 0; fi
@@ -66,3 +87,46 @@ compare "$PB" "$PS" "bash"
 printf "  %-16s" "$(basename "$BIN")+analysis"; ( time $BIN --mood bash -W $PRIMES $PRIMES_LIMIT >"$PS" 2>/dev/null ) 2>&1
 compare "$PB" "$PS" "bash with analysis"
 compare "$PB" "$PP" "python"
+
+echo "variables.bash, wall-clock seconds for $VARIABLES_ITERATIONS iterations, lower is better:"
+printf "  %-16s" "$(basename "$BASHP")"; ( time $BASHP $VARIABLES $VARIABLES_ITERATIONS >"$VB" 2>&1 ) 2>&1
+printf "  %-16s" "$(basename "$BIN")";  ( time $BIN --mood bash $VARIABLES $VARIABLES_ITERATIONS >"$VS" 2>&1 ) 2>&1
+compare "$VB" "$VS" "bash"
+
+echo "appends.bash, wall-clock seconds for $APPENDS_COUNT appends, lower is better:"
+printf "  %-16s" "$(basename "$BASHP")"; ( time $BASHP $APPENDS $APPENDS_COUNT >"$AB" 2>&1 ) 2>&1
+printf "  %-16s" "$(basename "$BIN")";  ( time $BIN --mood bash $APPENDS $APPENDS_COUNT >"$AS" 2>&1 ) 2>&1
+compare "$AB" "$AS" "bash"
+printf "  %-16s" "$(basename "$BIN") at half"; ( time $BIN --mood bash $APPENDS $((APPENDS_COUNT / 2)) >/dev/null 2>&1 ) 2>&1
+
+echo "regex.bash, wall-clock seconds for $REGEX_LINES lines, lower is better:"
+printf "  %-16s" "$(basename "$BASHP")"; ( time $BASHP $REGEX $REGEX_LINES >"$RB" 2>&1 ) 2>&1
+printf "  %-16s" "$(basename "$BIN")";  ( time $BIN --mood bash $REGEX $REGEX_LINES >"$RS" 2>&1 ) 2>&1
+compare "$RB" "$RS" "bash"
+
+awk -v n="$GREP_LINES" 'BEGIN {
+    split("INFO WARN ERROR DEBUG", levels, " ")
+    for (i = 0; i < n; i++)
+        printf "2024-01-%d 12:%02d:07 %s host%d.example.org took %dms path=/api/v%d/items/%d\n",
+            i % 18 + 10, i % 60, levels[i % 4 + 1], i % 97, i * 7 % 1000, i % 3, i
+}' >"$LOG"
+echo "grep over $GREP_LINES log lines, wall-clock seconds, lower is better:"
+GREP_PATTERN='ERROR host[0-9]*\.example\.org took 9[0-9]*ms'
+printf "  %-16s" "grep"; ( time grep "$GREP_PATTERN" "$LOG" >"$GB" 2>&1 ) 2>&1
+printf "  %-16s" "shitbox grep"; ( time $BIN -c 'shitbox grep "$1" "$2"' grep "$GREP_PATTERN" "$LOG" >"$GS" 2>&1 ) 2>&1
+compare "$GB" "$GS" "grep"
+
+for keys in $STRINGMAP_KEYS; do
+    echo "stringmap.bash, wall-clock seconds for $keys keys, lower is better:"
+    printf "  %-16s" "$(basename "$BASHP")"; ( time $BASHP $STRINGMAP $keys >"$MB" 2>&1 ) 2>&1
+    printf "  %-16s" "$(basename "$BIN")";  ( time $BIN --mood bash $STRINGMAP $keys >"$MS" 2>&1 ) 2>&1
+    compare "$MB" "$MS" "bash"
+done
+
+for megabytes in $SPAWN_MEGABYTES; do
+    echo "spawn.bash, wall-clock seconds for $SPAWN_COUNT spawns at $megabytes MB, lower is better:"
+    printf "  %-16s" "$(basename "$BASHP")"; ( time $BASHP $SPAWN $megabytes $SPAWN_COUNT >"$PNB" 2>&1 ) 2>&1
+    printf "  %-16s" "$(basename "$BIN")";  ( time $BIN --mood bash $SPAWN $megabytes $SPAWN_COUNT >"$PNS" 2>&1 ) 2>&1
+    compare "$PNB" "$PNS" "bash"
+    printf "  %-16s" "$(basename "$BIN") setup"; ( time $BIN --mood bash $SPAWN $megabytes 0 >/dev/null 2>&1 ) 2>&1
+done